@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <unistd.h>
+
+namespace rusync::bench {
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief fixed seed, so every run works on the same data
+ *
+ */
+constexpr uint64_t SEED = 20220401;
+
+/**
+ * @brief deterministic pseudo-random content
+ *
+ * @param size
+ * @param seed
+ * @return std::string
+ */
+inline std::string random_content(size_t size, uint64_t seed = SEED) {
+    std::mt19937_64 random {seed};
+    std::string result(size, '\0');
+    for (size_t i = 0; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        const uint64_t value = random();
+        memcpy(result.data() + i, &value, sizeof(value));
+    }
+    return result;
+}
+
+/**
+ * @brief file within temp dir, removed on destruction.<br>
+ * File is written once before measurement, so benchmarks measure hashing of page-cached data, not disk speed
+ *
+ */
+struct TempFile {
+    TempFile(const std::string& name, const std::string& content) :
+        path {fs::temp_directory_path() / ("rusync_bench_" + std::to_string(getpid()) + "_" + name)} {
+        std::ofstream stream {path, std::ios::binary};
+        stream.write(content.data(), content.size());
+    }
+    ~TempFile() {
+        fs::remove(path);
+    }
+    fs::path path;
+};
+}
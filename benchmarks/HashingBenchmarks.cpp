@@ -0,0 +1,153 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include "BenchmarkData.hpp"
+#include "ChunkDiff.hpp"
+#include "DirEntry.hpp"
+#include "FileChunk.hpp"
+#include "Hash.hpp"
+#include "ReadEngine.hpp"
+
+namespace {
+
+using namespace rusync::bench;
+
+/**
+ * @brief hashing of data in memory, without file IO. range(1) is HashAlgorithm id
+ *
+ */
+void BM_HashBytes(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto algorithm = static_cast<rusync::HashAlgorithm>(state.range(1));
+    const std::string content = random_content(size);
+    for (auto _: state) {
+        benchmark::DoNotOptimize(rusync::hash_bytes(algorithm, content.data(), content.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    state.SetLabel(algorithm == rusync::HashAlgorithm::XXHASH3 ? rusync::hash_implementation() : "");
+}
+
+/**
+ * @brief whole-file hash computed by client and server for every entry of description. range(1) is HashAlgorithm id
+ *
+ */
+void BM_DirEntryFromPath(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto algorithm = static_cast<rusync::HashAlgorithm>(state.range(1));
+    TempFile file {"from_path", random_content(size)};
+    for (auto _: state) {
+        benchmark::DoNotOptimize(rusync::DirEntry::from_path(file.path, file.path.parent_path(), algorithm));
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    state.SetItemsProcessed(state.iterations());
+}
+
+/**
+ * @brief chunk hashes computed by server for meta request. range(1) is HashAlgorithm id
+ *
+ */
+void BM_ComputeChunksForFile(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const auto algorithm = static_cast<rusync::HashAlgorithm>(state.range(1));
+    TempFile file {"chunks", random_content(size)};
+    for (auto _: state) {
+        benchmark::DoNotOptimize(rusync::compute_chunks_for_file(file.path, algorithm));
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    state.counters["chunks"] = rusync::compute_chunks_for_file(file.path).size();
+}
+
+/**
+ * @brief hashing of many files as done by scan. range(1) is 0 for one blocking read of whole file at a time,
+ * 1 for ReadEngine with io_uring and 2 for ReadEngine with reader threads. Files are in page cache after first iteration,
+ * so it measures submission overhead rather than device queue depth
+ *
+ */
+void BM_HashFiles(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const int mode = state.range(1);
+    constexpr size_t FILES = 256;
+    const std::string content = random_content(size);
+    std::vector<std::unique_ptr<TempFile>> files;
+    std::vector<fs::path> paths;
+    for (size_t i = 0; i < FILES; i++) {
+        files.push_back(std::make_unique<TempFile>("hash_files_" + std::to_string(i), content));
+        paths.push_back(files.back()->path);
+    }
+    rusync::ReadEngine engine {mode == 1};
+    std::vector<char> buffer;
+    for (auto _: state) {
+        if (mode == 0) {
+            for (const auto& path: paths) {
+                std::ifstream stream {path, std::ios::binary};
+                buffer.resize(size);
+                stream.read(buffer.data(), buffer.size());
+                benchmark::DoNotOptimize(rusync::hash_bytes(rusync::HashAlgorithm::XXHASH3, buffer.data(), buffer.size()));
+            }
+            continue;
+        }
+        std::vector<rusync::Hasher> hashers;
+        for (size_t i = 0; i < FILES; i++) {
+            hashers.emplace_back(rusync::HashAlgorithm::XXHASH3);
+        }
+        engine.read_files(paths, rusync::ReadEngine::BUFFER_SIZE, [&hashers](size_t file, uint64_t, const char* data, size_t size) {
+            hashers[file].update(data, size);
+        }, [&hashers](size_t file, bool) {
+            benchmark::DoNotOptimize(hashers[file].digest());
+        });
+    }
+    state.SetBytesProcessed(state.iterations() * size * FILES);
+    state.SetItemsProcessed(state.iterations() * FILES);
+    state.SetLabel(mode == 0 ? "sequential" : engine.backend());
+}
+
+/**
+ * @brief client side of patch upload: local file is compared with remote chunks.<br>
+ * range(1) is per mille of chunks which differ, patch data is dropped instead of being sent. range(2) is 1 if file is diffed within mapped window
+ *
+ */
+void BM_DiffChunks(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const size_t changed_per_mille = state.range(1);
+    std::string content = random_content(size);
+    TempFile remote {"diff_remote", content};
+    const auto remote_chunks = rusync::compute_chunks_for_file(remote.path);
+    const size_t step = changed_per_mille == 0 ? remote_chunks.size() + 1 : 1000 / changed_per_mille;
+    uint64_t offset = 0;
+    for (size_t i = 0; i < remote_chunks.size(); i++) {
+        if (i % step == 0 && changed_per_mille != 0) {
+            content[offset] ^= 0xff;
+        }
+        offset += remote_chunks[i].size;
+    }
+    TempFile local {"diff_local", content};
+    uint64_t patched_bytes = 0;
+    const auto emit = [&patched_bytes](uint64_t, std::string data, bool) {
+        patched_bytes += data.size();
+    };
+    for (auto _: state) {
+        if (state.range(2) == 1) {
+            auto file = rusync::MappedFile::open(local.path);
+            rusync::diff_chunks(*file, remote_chunks, emit);
+            continue;
+        }
+        FILE* stream = fopen(local.path.c_str(), "rb");
+        rusync::diff_chunks(stream, size, remote_chunks, emit);
+        fclose(stream);
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+    state.counters["patched_bytes"] = benchmark::Counter(patched_bytes, benchmark::Counter::kAvgIterations);
+}
+
+}
+
+// arguments are data size (chunk sizes of calculate_chunk_size and whole files) and HashAlgorithm id
+BENCHMARK(BM_HashBytes)->ArgsProduct({{1000, 31622, 100000, 1 << 20}, {0, 1}});
+BENCHMARK(BM_DirEntryFromPath)->ArgsProduct({{64 << 10, 1 << 20, 64 << 20}, {0, 1}})->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ComputeChunksForFile)->ArgsProduct({{64 << 10, 1 << 20, 64 << 20}, {0, 1}})->Unit(benchmark::kMicrosecond);
+// arguments are size of each file and read mode
+BENCHMARK(BM_HashFiles)->ArgsProduct({{4 << 10, 64 << 10, 1 << 20}, {0, 1, 2}})->Unit(benchmark::kMicrosecond);
+// arguments are file size, per mille of changed chunks and whether file is mapped
+BENCHMARK(BM_DiffChunks)->ArgsProduct({{1 << 20, 64 << 20}, {0, 10}, {0, 1}})->Unit(benchmark::kMicrosecond);
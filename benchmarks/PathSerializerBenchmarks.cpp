@@ -0,0 +1,94 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include "PathSerializer.hpp"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr size_t WRITES = 2000;
+constexpr size_t WRITE_SIZE = 4096;
+
+/**
+ * @brief set of files which are patched by benchmark, removed on destruction
+ *
+ */
+struct Files {
+    explicit Files(size_t count) : dir {fs::temp_directory_path() / "rusync_serializer_bench"} {
+        fs::create_directories(dir);
+        for (size_t i = 0; i < count; i++) {
+            fds.push_back(open((dir / std::to_string(i)).c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644));
+        }
+    }
+    ~Files() {
+        for (int fd: fds) {
+            close(fd);
+        }
+        fs::remove_all(dir);
+    }
+    fs::path dir;
+    std::vector<int> fds;
+};
+
+/**
+ * @brief applies WRITES small patches spread over range(0) files, post is responsible for ordering of writes to the same file
+ *
+ */
+template <typename Post>
+void run_patches(benchmark::State& state, Post&& post) {
+    const size_t files_count = state.range(0);
+    Files files {files_count};
+    const std::string data(WRITE_SIZE, 'x');
+    for (auto _: state) {
+        std::atomic<size_t> remaining = WRITES;
+        std::promise<void> done;
+        for (size_t i = 0; i < WRITES; i++) {
+            const size_t file = i % files_count;
+            post(std::to_string(file), [&, file, i]() {
+                benchmark::DoNotOptimize(pwrite(files.fds[file], data.data(), data.size(), (i / files_count) * WRITE_SIZE));
+                if (--remaining == 0) {
+                    done.set_value();
+                }
+            });
+        }
+        done.get_future().wait();
+    }
+    state.SetItemsProcessed(state.iterations() * WRITES);
+    state.SetBytesProcessed(state.iterations() * WRITES * WRITE_SIZE);
+}
+
+/**
+ * @brief baseline: writes are ordered by single table-wide lock
+ *
+ */
+void BM_GlobalLock(benchmark::State& state) {
+    rusync::IOExecutor executor {8};
+    std::mutex global;
+    run_patches(state, [&](const std::string&, std::function<void()> fn) {
+        executor.post(rusync::IOExecutor::FAST, [&global, fn = std::move(fn)]() {
+            std::lock_guard lock {global};
+            fn();
+        });
+    });
+    executor.stop();
+}
+
+void BM_PathSerializer(benchmark::State& state) {
+    rusync::IOExecutor executor {8};
+    rusync::PathSerializer serializer {executor};
+    run_patches(state, [&](const std::string& path, std::function<void()> fn) {
+        serializer.post(path, rusync::IOExecutor::FAST, std::move(fn));
+    });
+    executor.stop();
+}
+
+}
+
+// argument is number of distinct files patched concurrently
+BENCHMARK(BM_GlobalLock)->Arg(1)->Arg(16)->Arg(256)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_PathSerializer)->Arg(1)->Arg(16)->Arg(256)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,185 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "BenchmarkData.hpp"
+#include "BinaryWriter.hpp"
+#include "BufferPool.hpp"
+#include "DescriptionJson.hpp"
+#include "EntryTable.hpp"
+#include "FileMeta.hpp"
+#include "Utils.hpp"
+
+namespace {
+
+using namespace rusync::bench;
+
+/**
+ * @brief meta response for file of range(0) chunks, same layout as written by server
+ *
+ */
+void BM_ParseMeta(benchmark::State& state) {
+    const size_t chunks = state.range(0);
+    std::string buffer;
+    buffer.resize(1 + chunks * (sizeof(uint32_t) + sizeof(uint64_t)));
+    rusync::BinaryWriter writer {reinterpret_cast<unsigned char*>(buffer.data()), buffer.size()};
+    writer.write(uint8_t{1});
+    std::mt19937_64 random {SEED};
+    for (size_t i = 0; i < chunks; i++) {
+        writer.write(uint32_t{31622});
+        writer.write(uint64_t{random()});
+    }
+    for (auto _: state) {
+        benchmark::DoNotOptimize(rusync::parse_meta(reinterpret_cast<const unsigned char*>(buffer.data()), buffer.size()));
+    }
+    state.SetBytesProcessed(state.iterations() * buffer.size());
+    state.SetItemsProcessed(state.iterations() * chunks);
+}
+
+/**
+ * @brief query of typical patch request
+ *
+ */
+const std::string QUERY = "key=abcdef0123456789&path=some/nested/dir/file name.txt&offset=123456789&session=9876543210123456789&end=1";
+
+/**
+ * @brief what server does per request: decodes raw query and looks up params of patch handler
+ *
+ */
+void BM_ParseParams(benchmark::State& state) {
+    const std::string raw = rusync::url_encode(QUERY);
+    for (auto _: state) {
+        const auto params = rusync::QueryParams::decode(raw);
+        benchmark::DoNotOptimize(params.at("key"));
+        benchmark::DoNotOptimize(params.at("path"));
+        benchmark::DoNotOptimize(params.number("offset"));
+        benchmark::DoNotOptimize(params.get("session"));
+        benchmark::DoNotOptimize(params.contains("end"));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * raw.size());
+}
+
+void BM_UrlEncode(benchmark::State& state) {
+    for (auto _: state) {
+        benchmark::DoNotOptimize(rusync::url_encode(QUERY));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * QUERY.size());
+}
+
+/**
+ * @brief what client does per request: builds uri of patch request
+ *
+ */
+void BM_MakeUri(benchmark::State& state) {
+    const std::string path = "some/nested/dir/file name.txt";
+    const std::string session = "9876543210123456789";
+    for (auto _: state) {
+        rusync::QueryBuilder query;
+        query.add("path", path).add("offset", uint64_t{123456789}).add("end", "1").add("session", session);
+        benchmark::DoNotOptimize(rusync::make_uri("127.0.0.1", "8080", "/files", "abcdef0123456789", query));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+std::vector<rusync::DirEntry> make_entries(size_t count) {
+    std::vector<rusync::DirEntry> entries;
+    std::mt19937_64 random {SEED};
+    for (size_t i = 0; i < count; i++) {
+        const bool dir = i % 10 == 0;
+        entries.emplace_back("dir" + std::to_string(i / 100) + "/entry_" + std::to_string(i) + (dir ? "" : ".dat"),
+                             dir ? rusync::DirEntry::DIR : rusync::DirEntry::FILE, dir ? 0 : random(), dir ? 0 : random() % (1 << 30));
+    }
+    return entries;
+}
+
+/**
+ * @brief what server does with body of each PATCH/POST: accumulates range(0) bytes received by 16KB frames and releases buffer once request is done.
+ * range(1) is 0 for buffer grown by resize per frame (as on_full_data does), 1 for pooled buffer reserved from content-length
+ *
+ */
+void BM_RequestBody(benchmark::State& state) {
+    const size_t size = state.range(0);
+    const bool pooled = state.range(1);
+    const std::string frame(16 << 10, 'x');
+    for (auto _: state) {
+        if (pooled) {
+            auto buffer = rusync::BufferPool::local().acquire(size);
+            for (size_t received = 0; received < size; received += frame.size()) {
+                buffer->insert(buffer->end(), frame.data(), frame.data() + std::min(frame.size(), size - received));
+            }
+            benchmark::DoNotOptimize(buffer->data());
+        } else {
+            auto buffer = std::make_shared<std::vector<char>>();
+            for (size_t received = 0; received < size; received += frame.size()) {
+                const size_t len = std::min(frame.size(), size - received);
+                buffer->resize(buffer->size() + len);
+                memcpy(buffer->data() + buffer->size() - len, frame.data(), len);
+            }
+            benchmark::DoNotOptimize(buffer->data());
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * size);
+}
+
+/**
+ * @brief /files_description response building for range(0) entries
+ *
+ */
+void BM_SerializeDescription(benchmark::State& state) {
+    const auto entries = make_entries(state.range(0));
+    size_t bytes = 0;
+    for (auto _: state) {
+        auto json = rusync::serialize_description(entries);
+        bytes = json.size();
+        benchmark::DoNotOptimize(json);
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+    state.SetBytesProcessed(state.iterations() * bytes);
+}
+
+void BM_ParseDescription(benchmark::State& state) {
+    const auto json = rusync::serialize_description(make_entries(state.range(0)));
+    for (auto _: state) {
+        benchmark::DoNotOptimize(rusync::parse_description(json.data(), json.size()));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.SetBytesProcessed(state.iterations() * json.size());
+}
+
+/**
+ * @brief initial sync diff of range(0) local entries against description where every 100th file was changed and every 50th is missing
+ *
+ */
+void BM_DiffEntries(benchmark::State& state) {
+    const auto entries = make_entries(state.range(0));
+    rusync::EntryTable local;
+    rusync::EntryTable remote;
+    for (size_t i = 0; i < entries.size(); i++) {
+        const auto& entry = entries[i];
+        local.push_back(entry);
+        if (i % 50 != 1) {
+            remote.add(entry.path, entry.type, i % 100 == 3 ? entry.hash + 1 : entry.hash, entry.size);
+        }
+    }
+    local.sort();
+    remote.sort();
+    for (auto _: state) {
+        benchmark::DoNotOptimize(rusync::diff_entries(local, remote));
+    }
+    state.SetItemsProcessed(state.iterations() * entries.size());
+}
+
+}
+
+// argument is number of chunks
+BENCHMARK(BM_ParseMeta)->Arg(1000)->Arg(32000);
+BENCHMARK(BM_ParseParams);
+BENCHMARK(BM_UrlEncode);
+BENCHMARK(BM_MakeUri);
+// argument is number of entries
+BENCHMARK(BM_RequestBody)->ArgsProduct({{4 << 10, 256 << 10}, {0, 1}})->ThreadRange(1, 8);
+BENCHMARK(BM_SerializeDescription)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_ParseDescription)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_DiffEntries)->Arg(10000)->Arg(1000000)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,195 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <future>
+#include <random>
+#include <boost/asio.hpp>
+#include "StrandScheduler.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t EXECUTORS = 4;
+constexpr size_t KEYS = 256;
+constexpr size_t TASKS = 4000;
+/**
+ * @brief tasks arrive at steady rate which is about half of pool capacity, so latency shows queueing caused by imbalance only
+ *
+ */
+constexpr std::chrono::microseconds ARRIVAL_INTERVAL {20};
+
+/**
+ * @brief single-threaded event loops, same as Worker's io_service
+ *
+ */
+struct Executors {
+    explicit Executors(size_t size) : contexts(size) {
+        for (auto& context: contexts) {
+            guards.push_back(boost::asio::make_work_guard(context));
+            threads.emplace_back([&context]() { context.run(); });
+        }
+    }
+    void join() {
+        for (auto& guard: guards) {
+            guard.reset();
+        }
+        for (auto& thread: threads) {
+            thread.join();
+        }
+    }
+    std::deque<boost::asio::io_context> contexts;
+    std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> guards;
+    std::vector<std::thread> threads;
+};
+
+struct Task {
+    size_t key;
+    std::chrono::microseconds cost;
+};
+
+/**
+ * @brief generates tasks with zipf-distributed keys. Small share of tasks are heavy (e.g. huge file hashing)
+ *
+ * @param skew zipf exponent, 0 - uniform
+ * @return std::vector<Task>
+ */
+std::vector<Task> make_workload(double skew) {
+    std::vector<double> weights(KEYS);
+    for (size_t i = 0; i < KEYS; i++) {
+        weights[i] = 1.0 / std::pow(i + 1, skew);
+    }
+    std::mt19937 gen {42};
+    std::discrete_distribution<size_t> key_dist {weights.begin(), weights.end()};
+    std::bernoulli_distribution heavy {0.01};
+    std::vector<Task> tasks;
+    for (size_t i = 0; i < TASKS; i++) {
+        tasks.push_back({key_dist(gen), heavy(gen) ? std::chrono::microseconds{2000} : std::chrono::microseconds{20}});
+    }
+    return tasks;
+}
+
+void spin(std::chrono::microseconds cost) {
+    const auto until = Clock::now() + cost;
+    while (Clock::now() < until);
+}
+
+void report(benchmark::State& state, std::vector<double>& latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&](double p) {
+        return latencies[std::min(latencies.size() - 1, static_cast<size_t>(p * latencies.size()))];
+    };
+    state.counters["p50_us"] = percentile(0.5);
+    state.counters["p99_us"] = percentile(0.99);
+    state.counters["max_us"] = latencies.back();
+    state.SetItemsProcessed(state.iterations() * TASKS);
+}
+
+template <typename Post>
+void run_workload(const std::vector<Task>& tasks, std::vector<double>& latencies, Post&& post) {
+    std::vector<double> local(tasks.size());
+    std::atomic<size_t> remaining = tasks.size();
+    std::promise<void> done;
+    auto next_arrival = Clock::now();
+    for (size_t i = 0; i < tasks.size(); i++) {
+        next_arrival += ARRIVAL_INTERVAL;
+        while (Clock::now() < next_arrival);
+        const auto posted = Clock::now();
+        post(tasks[i].key, [&, i, posted]() {
+            spin(tasks[i].cost);
+            local[i] = std::chrono::duration<double, std::micro>(Clock::now() - posted).count();
+            if (--remaining == 0) {
+                done.set_value();
+            }
+        });
+    }
+    done.get_future().wait();
+    latencies.insert(latencies.end(), local.begin(), local.end());
+}
+
+/**
+ * @brief previous WorkerPool behaviour: key is pinned to executors[hash(key) % N]
+ *
+ */
+void BM_StaticHashSharding(benchmark::State& state) {
+    const auto tasks = make_workload(state.range(0) / 10.0);
+    std::vector<double> latencies;
+    for (auto _: state) {
+        Executors executors {EXECUTORS};
+        run_workload(tasks, latencies, [&](size_t key, std::function<void()> fn) {
+            boost::asio::post(executors.contexts[std::hash<size_t>{}(key) % EXECUTORS], std::move(fn));
+        });
+        executors.join();
+    }
+    report(state, latencies);
+}
+
+void BM_WorkStealing(benchmark::State& state) {
+    const auto tasks = make_workload(state.range(0) / 10.0);
+    std::vector<double> latencies;
+    for (auto _: state) {
+        Executors executors {EXECUTORS};
+        {
+            rusync::StrandScheduler scheduler {EXECUTORS, [&](size_t index, rusync::StrandScheduler::Handler handler) {
+                boost::asio::post(executors.contexts[index], std::move(handler));
+            }};
+            run_workload(tasks, latencies, [&](size_t key, std::function<void()> fn) {
+                scheduler.post(std::to_string(key), [fn = std::move(fn)](size_t) { fn(); });
+            });
+            executors.join();
+        }
+    }
+    report(state, latencies);
+}
+
+/**
+ * @brief latency of interactive tasks (e.g. saved file) posted while executors work through backlog of bulk tasks (e.g. initial sync).
+ * Argument is 0 if bulk tasks are posted with interactive priority (single class), 1 if with bulk priority
+ *
+ */
+void BM_InteractiveUnderBulk(benchmark::State& state) {
+    constexpr size_t BULK_TASKS = 2000;
+    constexpr size_t INTERACTIVE_TASKS = 100;
+    const auto bulk_priority = state.range(0) ? rusync::Priority::BULK : rusync::Priority::INTERACTIVE;
+    std::vector<double> latencies;
+    for (auto _: state) {
+        Executors executors {EXECUTORS};
+        {
+            rusync::StrandScheduler scheduler {EXECUTORS, [&](size_t index, rusync::StrandScheduler::Handler handler) {
+                boost::asio::post(executors.contexts[index], std::move(handler));
+            }};
+            for (size_t i = 0; i < BULK_TASKS; i++) {
+                scheduler.post("bulk" + std::to_string(i), [](size_t) { spin(std::chrono::microseconds{200}); }, bulk_priority);
+            }
+            std::vector<double> local(INTERACTIVE_TASKS);
+            std::atomic<size_t> remaining = INTERACTIVE_TASKS;
+            std::promise<void> done;
+            for (size_t i = 0; i < INTERACTIVE_TASKS; i++) {
+                spin(std::chrono::microseconds{500});
+                scheduler.post("edit" + std::to_string(i), [&, i, posted = Clock::now()](size_t) {
+                    spin(std::chrono::microseconds{20});
+                    local[i] = std::chrono::duration<double, std::micro>(Clock::now() - posted).count();
+                    if (--remaining == 0) {
+                        done.set_value();
+                    }
+                });
+            }
+            done.get_future().wait();
+            latencies.insert(latencies.end(), local.begin(), local.end());
+            executors.join();
+        }
+    }
+    report(state, latencies);
+    state.SetItemsProcessed(state.iterations() * INTERACTIVE_TASKS);
+}
+
+}
+
+// argument is zipf exponent * 10
+BENCHMARK(BM_StaticHashSharding)->Arg(0)->Arg(10)->Arg(15)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(BM_WorkStealing)->Arg(0)->Arg(10)->Arg(15)->Unit(benchmark::kMillisecond)->UseRealTime();
+// argument is 1 if bulk tasks are posted with bulk priority
+BENCHMARK(BM_InteractiveUnderBulk)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,418 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+#include "Priority.hpp"
+
+namespace rusync {
+
+/**
+ * @brief limits of client in bytes per second, 0 means unlimited
+ *
+ */
+struct RateLimits {
+    uint64_t upload = 0;
+    uint64_t download = 0;
+
+    bool operator==(const RateLimits&) const = default;
+};
+
+/**
+ * @brief parses rate like "0", "300000", "512K", "2M" or "1G" (binary multiples)
+ *
+ * @param text
+ * @return std::optional<uint64_t> bytes per second, nullopt if text is malformed
+ */
+inline std::optional<uint64_t> parse_rate(std::string_view text) {
+    uint64_t value = 0;
+    const auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc() || end == text.data()) {
+        return std::nullopt;
+    }
+    const std::string_view suffix {end, static_cast<size_t>(text.data() + text.size() - end)};
+    if (suffix.empty()) {
+        return value;
+    }
+    if (suffix.size() != 1) {
+        return std::nullopt;
+    }
+    switch (suffix[0]) {
+    case 'K':
+    case 'k':
+        return value << 10;
+    case 'M':
+    case 'm':
+        return value << 20;
+    case 'G':
+    case 'g':
+        return value << 30;
+    default:
+        return std::nullopt;
+    }
+}
+
+/**
+ * @brief Limits of client by time of day, e.g. "08:00-18:00=512K/4M;18:00-08:00=0/0".<br>
+ * Each window is [from, to) in local time with upload/download rates, window with from > to wraps over midnight.
+ * First matching window wins, base limits apply outside of windows
+ */
+class BandwidthSchedule {
+public:
+    struct Window {
+        unsigned from;
+        unsigned to;
+        RateLimits limits;
+    };
+
+    static constexpr unsigned MINUTES_PER_DAY = 24 * 60;
+
+    BandwidthSchedule() = default;
+
+    explicit BandwidthSchedule(RateLimits base) : m_base {base} {
+
+    }
+
+    /**
+     * @brief
+     *
+     * @param text windows separated by ';'
+     * @param base limits outside of windows
+     * @return std::optional<BandwidthSchedule> nullopt if text is malformed
+     */
+    static std::optional<BandwidthSchedule> parse(std::string_view text, RateLimits base) {
+        BandwidthSchedule schedule {base};
+        while (!text.empty()) {
+            const auto window_end = std::min(text.find(';'), text.size());
+            const auto window = parse_window(text.substr(0, window_end));
+            if (!window) {
+                return std::nullopt;
+            }
+            schedule.m_windows.push_back(*window);
+            text.remove_prefix(std::min(window_end + 1, text.size()));
+        }
+        return schedule;
+    }
+
+    /**
+     * @brief
+     *
+     * @param minute minute of day, 0..MINUTES_PER_DAY-1
+     * @return RateLimits
+     */
+    RateLimits at(unsigned minute) const {
+        for (const auto& window: m_windows) {
+            const bool inside = window.from <= window.to ? minute >= window.from && minute < window.to : minute >= window.from || minute < window.to;
+            if (inside) {
+                return window.limits;
+            }
+        }
+        return m_base;
+    }
+
+    const std::vector<Window>& windows() const {
+        return m_windows;
+    }
+
+private:
+    static std::optional<unsigned> parse_time(std::string_view text) {
+        unsigned hours = 0;
+        unsigned minutes = 0;
+        if (text.size() != 5 || text[2] != ':'
+            || std::from_chars(text.data(), text.data() + 2, hours).ptr != text.data() + 2
+            || std::from_chars(text.data() + 3, text.data() + 5, minutes).ptr != text.data() + 5
+            || hours > 24 || minutes > 59 || (hours == 24 && minutes != 0)) {
+            return std::nullopt;
+        }
+        return hours * 60 + minutes;
+    }
+
+    static std::optional<Window> parse_window(std::string_view text) {
+        const auto dash = text.find('-');
+        const auto equals = text.find('=');
+        const auto slash = text.find('/');
+        if (dash == std::string_view::npos || equals == std::string_view::npos || slash == std::string_view::npos || !(dash < equals && equals < slash)) {
+            return std::nullopt;
+        }
+        const auto from = parse_time(text.substr(0, dash));
+        const auto to = parse_time(text.substr(dash + 1, equals - dash - 1));
+        const auto upload = parse_rate(text.substr(equals + 1, slash - equals - 1));
+        const auto download = parse_rate(text.substr(slash + 1));
+        if (!from || !to || !upload || !download) {
+            return std::nullopt;
+        }
+        return Window{*from % MINUTES_PER_DAY, *to % MINUTES_PER_DAY, {*upload, *download}};
+    }
+
+    RateLimits m_base;
+    std::vector<Window> m_windows;
+};
+
+/**
+ * @brief Token bucket of one direction shared by all transfers of client (all workers), thread safe.<br>
+ * Bucket holds up to BURST of rate, so short idle periods are not lost but bursts stay short. Transfers take at most QUANTUM
+ * (one HTTP/2 DATA frame) at once. Once bucket runs dry, transfers queue up and get their quantum in turn, so capacity is shared evenly
+ * between active transfers and capacity which one transfer doesn't use goes to the others. Interactive transfers have queue of their own,
+ * which is served before queue of bulk ones, so edit isn't slowed down by full sync. Transfer which doesn't claim its turn within
+ * CLAIM_TIMEOUT (e.g. its stream is blocked by flow control) is moved to the back of its queue (of bulk queue if it's the only interactive one)
+ * instead of holding up others
+ */
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t QUANTUM = 16 << 10;
+    static constexpr std::chrono::milliseconds BURST {100};
+    static constexpr std::chrono::milliseconds CLAIM_TIMEOUT {50};
+
+    /**
+     * @brief bytes transfer may send right now, if it's 0 transfer should ask again after retry_after
+     *
+     */
+    struct Grant {
+        size_t bytes;
+        Clock::duration retry_after;
+    };
+
+    /**
+     * @brief
+     *
+     * @param rate bytes per second, 0 - unlimited
+     * @param now
+     */
+    void set_rate(uint64_t rate, Clock::time_point now = Clock::now()) {
+        std::lock_guard lock {m_mutex};
+        refill(now);
+        m_rate = rate;
+        m_tokens = std::min(m_tokens, capacity());
+    }
+
+    uint64_t rate() const {
+        return m_rate;
+    }
+
+    bool limited() const {
+        return m_rate != 0;
+    }
+
+    /**
+     * @brief
+     *
+     * @param priority
+     * @return uint64_t id of new transfer for acquire and close, it carries priority of transfer
+     */
+    uint64_t open(Priority priority = Priority::BULK) {
+        return m_next_transfer++ * PRIORITIES + static_cast<uint64_t>(priority);
+    }
+
+    /**
+     * @brief takes tokens for up to wanted bytes
+     *
+     * @param transfer
+     * @param wanted
+     * @param now
+     * @return Grant
+     */
+    Grant acquire(uint64_t transfer, size_t wanted, Clock::time_point now = Clock::now()) {
+        std::lock_guard lock {m_mutex};
+        if (m_rate == 0) {
+            for (auto& queue: m_waiting) {
+                queue.clear();
+            }
+            m_turn.reset();
+            return {wanted, Clock::duration::zero()};
+        }
+        refill(now);
+        auto& head_queue = this->head_queue();
+        if (m_turn && waiting_locked() > 1 && head_queue.front() != transfer && now - *m_turn > CLAIM_TIMEOUT) {
+            const uint64_t stale = head_queue.front();
+            head_queue.pop_front();
+            (head_queue.empty() ? m_waiting.back() : head_queue).push_back(stale);
+            m_turn = now;
+        }
+        auto [queue, queued, position] = find(transfer);
+        const size_t needed = std::min(wanted, QUANTUM);
+        if (position == 0 && m_tokens >= static_cast<double>(needed)) {
+            const size_t granted = std::min<size_t>(std::min(wanted, QUANTUM), static_cast<size_t>(m_tokens));
+            m_tokens -= static_cast<double>(granted);
+            if (queue) {
+                queue->pop_front();
+            }
+            m_turn.reset();
+            update_turn(now);
+            return {granted, Clock::duration::zero()};
+        }
+        if (!queue) {
+            auto& own = m_waiting[transfer % PRIORITIES];
+            if (own.empty() && &own == &m_waiting.front() && !m_waiting.back().empty()) {
+                // interactive transfer goes ahead of bulk one which waits for its turn
+                m_turn.reset();
+            }
+            own.push_back(transfer);
+        }
+        update_turn(now);
+        // every transfer ahead takes its quantum first
+        const double deficit = static_cast<double>((position + 1) * QUANTUM) - m_tokens;
+        const auto delay = std::chrono::duration<double>(std::max(deficit, 1.0) / static_cast<double>(m_rate));
+        return {0, std::max<Clock::duration>(std::chrono::duration_cast<Clock::duration>(delay), std::chrono::milliseconds(1))};
+    }
+
+    /**
+     * @brief takes tokens for bytes which were already transferred (e.g. received data), bucket may go into debt
+     *
+     * @param bytes
+     * @param now
+     */
+    void debit(size_t bytes, Clock::time_point now = Clock::now()) {
+        std::lock_guard lock {m_mutex};
+        if (m_rate == 0) {
+            return;
+        }
+        refill(now);
+        m_tokens -= static_cast<double>(bytes);
+    }
+
+    /**
+     * @brief forgets finished transfer, so it doesn't hold its turn
+     *
+     * @param transfer
+     */
+    void close(uint64_t transfer) {
+        std::lock_guard lock {m_mutex};
+        const auto [queue, queued, position] = find(transfer);
+        if (!queue) {
+            return;
+        }
+        if (position == 0) {
+            m_turn.reset();
+        }
+        queue->erase(queued);
+    }
+
+    /**
+     * @brief
+     *
+     * @return size_t number of transfers waiting for their turn
+     */
+    size_t waiting() const {
+        std::lock_guard lock {m_mutex};
+        return waiting_locked();
+    }
+
+private:
+    /**
+     * @brief where transfer waits
+     *
+     */
+    struct Place {
+        /**
+         * @brief nullptr if transfer doesn't wait
+         *
+         */
+        std::deque<uint64_t>* queue;
+        std::deque<uint64_t>::iterator queued;
+        /**
+         * @brief number of transfers which go before it, for transfer which doesn't wait - before it once it's queued
+         *
+         */
+        size_t position;
+    };
+
+    Place find(uint64_t transfer) {
+        size_t ahead = 0;
+        for (auto& queue: m_waiting) {
+            const auto queued = std::find(queue.begin(), queue.end(), transfer);
+            if (queued != queue.end()) {
+                return {&queue, queued, ahead + static_cast<size_t>(queued - queue.begin())};
+            }
+            ahead += queue.size();
+        }
+        // transfer which doesn't wait would be queued at the end of queue of its priority
+        size_t position = 0;
+        for (size_t priority = 0; priority <= transfer % PRIORITIES; priority++) {
+            position += m_waiting[priority].size();
+        }
+        return {nullptr, {}, position};
+    }
+
+    std::deque<uint64_t>& head_queue() {
+        return m_waiting.front().empty() ? m_waiting.back() : m_waiting.front();
+    }
+
+    size_t waiting_locked() const {
+        size_t waiting = 0;
+        for (const auto& queue: m_waiting) {
+            waiting += queue.size();
+        }
+        return waiting;
+    }
+
+    double capacity() const {
+        return std::max(static_cast<double>(QUANTUM), static_cast<double>(m_rate) * std::chrono::duration<double>(BURST).count());
+    }
+
+    void refill(Clock::time_point now) {
+        if (m_last && now > *m_last) {
+            m_tokens = std::min(capacity(), m_tokens + static_cast<double>(m_rate) * std::chrono::duration<double>(now - *m_last).count());
+        } else if (!m_last) {
+            m_tokens = capacity();
+        }
+        if (!m_last || now > *m_last) {
+            m_last = now;
+        }
+    }
+
+    /**
+     * @brief turn of head transfer starts once bucket has its quantum
+     *
+     * @param now
+     */
+    void update_turn(Clock::time_point now) {
+        if (!m_turn && waiting_locked() > 0 && m_tokens >= static_cast<double>(QUANTUM)) {
+            m_turn = now;
+        }
+    }
+
+    mutable std::mutex m_mutex;
+    std::atomic<uint64_t> m_rate = 0;
+    std::atomic<uint64_t> m_next_transfer = 1;
+    double m_tokens = 0;
+    std::optional<Clock::time_point> m_last;
+    /**
+     * @brief transfers waiting for their turn by priority, interactive ones first
+     *
+     */
+    std::array<std::deque<uint64_t>, PRIORITIES> m_waiting;
+    /**
+     * @brief since when head of m_waiting can take its quantum
+     *
+     */
+    std::optional<Clock::time_point> m_turn;
+};
+
+/**
+ * @brief upload and download limiters of client, shared by all workers
+ *
+ */
+struct Bandwidth {
+    void apply(RateLimits limits) {
+        upload.set_rate(limits.upload);
+        download.set_rate(limits.download);
+    }
+
+    RateLimits limits() const {
+        return {upload.rate(), download.rate()};
+    }
+
+    RateLimiter upload;
+    RateLimiter download;
+};
+}
@@ -0,0 +1,160 @@
+#pragma once
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "Priority.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Limits number of bulk requests open on connection at once, the rest wait in FIFO queue of client.<br>
+ * HTTP/2 session queues streams beyond server's concurrency limit in order of submission, so without the limit interactive request
+ * submitted during full sync would wait for thousands of bulk ones. Interactive requests are never queued, but requests of the same key
+ * (e.g. path) stay in order of submission: queued bulk requests of key are submitted right before interactive one, whatever the limit.
+ * Queued requests of different groups (e.g. synced roots) are let in by turns, FIFO within group.<br>
+ * Should be used from single thread (worker's event loop)
+ */
+class BulkLimiter {
+public:
+    /**
+     * @brief called once request is closed (or failed to be submitted), lets next bulk request in. No-op once limiter is reset or gone
+     *
+     */
+    using Release = std::function<void()>;
+    /**
+     * @brief submits request, must call release exactly once
+     *
+     */
+    using Submit = std::function<void(Release release)>;
+
+    explicit BulkLimiter(size_t limit) : m_limit {limit}, m_state {std::make_shared<State>()} {
+
+    }
+
+    /**
+     * @brief submits request right away if it's interactive or less than limit bulk requests are open, otherwise once one of them is released
+     *
+     * @param priority
+     * @param submit
+     * @param group
+     * @param key requests of the same key and group are submitted in order, empty key isn't ordered with anything
+     */
+    void submit(Priority priority, Submit submit, size_t group = 0, std::string_view key = {}) {
+        if (priority == Priority::INTERACTIVE) {
+            if (!key.empty() && group < m_state->queues.size()) {
+                promote(m_state, group, key);
+            }
+            submit([]() {});
+            return;
+        }
+        auto& queues = m_state->queues;
+        if (group >= queues.size()) {
+            queues.resize(group + 1);
+        }
+        queues[group].push_back({std::move(submit), std::string(key)});
+        m_state->queued++;
+        drain(m_state);
+    }
+
+    /**
+     * @brief forgets open requests, e.g. when their connection is gone without closing them. Queued requests are kept
+     *
+     */
+    void reset() {
+        auto state = std::make_shared<State>();
+        state->queues = std::move(m_state->queues);
+        state->next = m_state->next;
+        state->queued = std::exchange(m_state->queued, 0);
+        m_state->queues.clear();
+        m_state = std::move(state);
+        drain(m_state);
+    }
+
+    size_t open() const {
+        return m_state->open;
+    }
+
+    size_t queued() const {
+        return m_state->queued;
+    }
+
+private:
+    struct Queued {
+        Submit submit;
+        std::string key;
+    };
+
+    struct State {
+        /**
+         * @brief 
+         * 
+         * @return Submit oldest request of next group which has any
+         */
+        Submit take() {
+            for (size_t i = 0; i < queues.size(); i++) {
+                const size_t index = (next + i) % queues.size();
+                if (queues[index].empty()) {
+                    continue;
+                }
+                auto submit = std::move(queues[index].front().submit);
+                queues[index].pop_front();
+                next = index + 1;
+                queued--;
+                return submit;
+            }
+            return nullptr;
+        }
+
+        size_t open = 0;
+        std::vector<std::deque<Queued>> queues;
+        size_t next = 0;
+        size_t queued = 0;
+    };
+
+    void drain(const std::shared_ptr<State>& state) {
+        while (state->open < m_limit && state->queued > 0) {
+            start(state, state->take());
+        }
+    }
+
+    /**
+     * @brief submits queued requests of key in order, so request which goes ahead of queue doesn't overtake them
+     *
+     */
+    void promote(const std::shared_ptr<State>& state, size_t group, std::string_view key) {
+        std::vector<Submit> promoted;
+        std::erase_if(state->queues[group], [&promoted, key](Queued& queued) {
+            if (queued.key != key) {
+                return false;
+            }
+            promoted.push_back(std::move(queued.submit));
+            return true;
+        });
+        state->queued -= promoted.size();
+        for (auto& submit: promoted) {
+            start(state, std::move(submit));
+        }
+    }
+
+    void start(const std::shared_ptr<State>& state, Submit submit) {
+        state->open++;
+        submit([this, weak = std::weak_ptr<State>(state), released = std::make_shared<bool>(false)]() {
+            const auto state = weak.lock();
+            if (!state || *released) {
+                return;
+            }
+            *released = true;
+            state->open--;
+            drain(state);
+        });
+    }
+
+    size_t m_limit;
+    std::shared_ptr<State> m_state;
+};
+}
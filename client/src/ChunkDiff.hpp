@@ -0,0 +1,149 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "FileChunk.hpp"
+#include "MappedFile.hpp"
+
+namespace rusync {
+
+/**
+ * @brief called for each patch produced by diff_chunks. end is true for the last patch, after which file should be truncated
+ * 
+ */
+using PatchCallback = std::function<void(uint64_t offset, std::string data, bool end)>;
+
+namespace detail {
+
+/**
+ * @brief reads FILE* through one reused buffer, for diff_chunks over buffered stream
+ *
+ */
+class StreamSource {
+public:
+    explicit StreamSource(FILE* stream) : m_stream {stream}, m_position {static_cast<uint64_t>(ftell(stream))} {
+
+    }
+
+    uint64_t position() const {
+        return m_position;
+    }
+
+    std::string_view view(uint64_t offset, uint64_t length) {
+        if (offset != m_position) {
+            fseek(m_stream, offset, SEEK_SET);
+            m_position = offset;
+        }
+        if (m_buffer.size() < length) {
+            m_buffer.resize(length);
+        }
+        const auto bytes_read = fread(m_buffer.data(), 1, length, m_stream);
+        m_position += bytes_read;
+        return {m_buffer.data(), bytes_read};
+    }
+
+private:
+    FILE* m_stream;
+    uint64_t m_position;
+    std::string m_buffer;
+};
+
+/**
+ * @brief diff_chunks over any source with view(offset, length), which returns shorter view at end of file
+ *
+ */
+template <typename Source>
+void diff_chunks(Source& source, uint64_t start, uint64_t file_size, const std::vector<FileChunk>& remote_chunks, const PatchCallback& emit,
+                 std::vector<FileChunk>* synced_chunks, HashAlgorithm algorithm) {
+    const auto chunk_size = static_cast<uint32_t>(calculate_chunk_size(file_size));
+    bool aligned = synced_chunks != nullptr;
+    bool patched = false;
+    bool ended = false;
+    uint64_t offset = start;
+    // final patch, which synced chunks past its offset are hashed from, so they match what server got even if file changes meanwhile
+    std::string rest;
+    for (const auto& remote_chunk: remote_chunks) {
+        const auto data = source.view(offset, remote_chunk.size);
+        if (data.size() < remote_chunk.size) { //read less than remote chunk
+            rest = data;
+            ended = true;
+            break;
+        }
+        const auto hash = hash_bytes(algorithm, data.data(), data.size());
+        if (aligned && remote_chunk.size == chunk_size) {
+            synced_chunks->push_back({chunk_size, hash});
+        } else {
+            aligned = false;
+        }
+        if (hash != remote_chunk.hash) {
+            // only changed chunks are copied, patch outlives the source
+            emit(offset, std::string(data), false);
+            patched = true;
+        }
+        offset += remote_chunk.size;
+    }
+    if (!ended) { //read til end
+        rest = source.view(offset, file_size > offset ? file_size - offset : 0);
+    }
+    const uint64_t rest_offset = offset;
+    if (synced_chunks) {
+        offset = start + synced_chunks->size() * chunk_size;
+        // chunks before final patch are unchanged by it and read again, chunk which straddles it is joined with its start
+        while (offset + chunk_size <= rest_offset) {
+            const auto data = source.view(offset, chunk_size);
+            synced_chunks->push_back({static_cast<uint32_t>(data.size()), hash_bytes(algorithm, data.data(), data.size())});
+            offset += chunk_size;
+        }
+        std::string piece {source.view(offset, rest_offset - offset)};
+        for (uint64_t position = 0; position < rest.size() || !piece.empty();) {
+            const auto taken = std::min<uint64_t>(chunk_size - piece.size(), rest.size() - position);
+            piece.append(rest, position, taken);
+            position += taken;
+            synced_chunks->push_back({static_cast<uint32_t>(piece.size()), hash_bytes(algorithm, piece.data(), piece.size())});
+            piece.clear();
+        }
+    }
+    if (ended || !rest.empty() || patched) { // empty patch just commits session
+        emit(rest_offset, std::move(rest), true);
+    }
+}
+}
+
+/**
+ * @brief compares local file with chunks of remote file and emits patches which turn remote file into local one.<br>
+ * Chunks with different hash are sent as is, tail of local file which is not covered by remote chunks is sent as final patch.
+ * Final patch (possibly empty) is emitted whenever anything was patched or file size differs, so patch session is always committed
+ * 
+ * @param stream local file, read from current position
+ * @param file_size size of local file
+ * @param remote_chunks 
+ * @param emit 
+ * @param synced_chunks if provided, filled with chunks of local file as server computes them once patches are applied (see compute_chunks_for_file).
+ * Hashes of chunks which match remote chunk grid are reused, rest of file is hashed again
+ * @param algorithm algorithm of remote chunk hashes
+ */
+inline void diff_chunks(FILE* stream, uint64_t file_size, const std::vector<FileChunk>& remote_chunks, const PatchCallback& emit,
+                        std::vector<FileChunk>* synced_chunks = nullptr, HashAlgorithm algorithm = HashAlgorithm::XXHASH64) {
+    detail::StreamSource source {stream};
+    detail::diff_chunks(source, source.position(), file_size, remote_chunks, emit, synced_chunks, algorithm);
+}
+
+/**
+ * @brief same as diff_chunks of stream, but hashes chunks of large file in place within its mapped window
+ * 
+ * @param file local file, whole file is compared
+ * @param remote_chunks 
+ * @param emit 
+ * @param synced_chunks 
+ * @param algorithm 
+ * @throw std::system_error if file could not be mapped
+ */
+inline void diff_chunks(MappedFile& file, const std::vector<FileChunk>& remote_chunks, const PatchCallback& emit,
+                        std::vector<FileChunk>* synced_chunks = nullptr, HashAlgorithm algorithm = HashAlgorithm::XXHASH64) {
+    detail::diff_chunks(file, 0, file.size(), remote_chunks, emit, synced_chunks, algorithm);
+}
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+#include <xxhash.h>
+#include "FileChunk.hpp"
+
+namespace rusync {
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Persistent shadow of server state of synced files: chunk list of file as server holds it and server's version of file.<br>
+ * Lets client diff modified file locally and send patches right away instead of requesting /meta. Patches are tagged with version,
+ * so server rejects them if its file was changed since then.<br>
+ * Each shadow is a separate file within dir, named after hash of synced path, so shadows are safe to use from all workers without locking
+ */
+class ChunkShadows {
+public:
+    struct Shadow {
+        /**
+         * @brief opaque version of file returned by server after patch was committed
+         *
+         */
+        std::string version;
+        HashAlgorithm hash_algorithm;
+        std::vector<FileChunk> chunks;
+    };
+
+    explicit ChunkShadows(fs::path dir) : m_dir {std::move(dir)} {
+
+    }
+
+    /**
+     * @brief
+     *
+     * @param path synced path
+     * @return std::optional<Shadow> nullopt if there is no shadow or it's corrupted
+     */
+    std::optional<Shadow> load(const std::string& path) const {
+        std::ifstream stream {file_for(path), std::ios::binary};
+        uint32_t magic = 0;
+        uint32_t path_size = 0;
+        uint32_t version_size = 0;
+        uint8_t algorithm_id = 0;
+        uint64_t chunks = 0;
+        stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        stream.read(reinterpret_cast<char*>(&path_size), sizeof(path_size));
+        if (!stream || magic != MAGIC || path_size != path.size()) {
+            return std::nullopt;
+        }
+        std::string stored_path(path_size, '\0');
+        stream.read(stored_path.data(), stored_path.size());
+        stream.read(reinterpret_cast<char*>(&version_size), sizeof(version_size));
+        if (!stream || stored_path != path || version_size > MAX_VERSION_SIZE) {
+            return std::nullopt;
+        }
+        Shadow shadow {std::string(version_size, '\0'), HashAlgorithm::XXHASH64, {}};
+        stream.read(shadow.version.data(), shadow.version.size());
+        stream.read(reinterpret_cast<char*>(&algorithm_id), sizeof(algorithm_id));
+        stream.read(reinterpret_cast<char*>(&chunks), sizeof(chunks));
+        const auto algorithm = hash_algorithm_from(uint64_t{algorithm_id});
+        if (!stream || !algorithm || chunks > MAX_CHUNKS) {
+            return std::nullopt;
+        }
+        shadow.hash_algorithm = *algorithm;
+        shadow.chunks.resize(chunks);
+        for (auto& chunk: shadow.chunks) {
+            stream.read(reinterpret_cast<char*>(&chunk.size), sizeof(chunk.size));
+            stream.read(reinterpret_cast<char*>(&chunk.hash), sizeof(chunk.hash));
+        }
+        if (!stream) {
+            return std::nullopt;
+        }
+        return shadow;
+    }
+
+    /**
+     * @brief replaces shadow of path atomically
+     *
+     * @param path synced path
+     * @param shadow
+     * @return false if shadow could not be written
+     */
+    bool store(const std::string& path, const Shadow& shadow) const {
+        std::error_code ec;
+        fs::create_directories(m_dir, ec);
+        const auto file = file_for(path);
+        // unique per thread, so concurrent stores of the same path don't write into the same temporary file
+        const auto tmp = fs::path(file) += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        {
+            std::ofstream stream {tmp, std::ios::binary | std::ios::trunc};
+            const uint32_t path_size = path.size();
+            const uint32_t version_size = shadow.version.size();
+            const uint8_t algorithm_id = static_cast<uint8_t>(shadow.hash_algorithm);
+            const uint64_t chunks = shadow.chunks.size();
+            stream.write(reinterpret_cast<const char*>(&MAGIC), sizeof(MAGIC));
+            stream.write(reinterpret_cast<const char*>(&path_size), sizeof(path_size));
+            stream.write(path.data(), path.size());
+            stream.write(reinterpret_cast<const char*>(&version_size), sizeof(version_size));
+            stream.write(shadow.version.data(), shadow.version.size());
+            stream.write(reinterpret_cast<const char*>(&algorithm_id), sizeof(algorithm_id));
+            stream.write(reinterpret_cast<const char*>(&chunks), sizeof(chunks));
+            for (const auto& chunk: shadow.chunks) {
+                stream.write(reinterpret_cast<const char*>(&chunk.size), sizeof(chunk.size));
+                stream.write(reinterpret_cast<const char*>(&chunk.hash), sizeof(chunk.hash));
+            }
+            if (!stream.flush()) {
+                fs::remove(tmp, ec);
+                return false;
+            }
+        }
+        fs::rename(tmp, file, ec);
+        return !ec;
+    }
+
+    /**
+     * @brief forgets shadow, e.g. file was removed or uploaded whole
+     *
+     * @param path
+     */
+    void remove(const std::string& path) const {
+        std::error_code ec;
+        fs::remove(file_for(path), ec);
+    }
+
+private:
+    fs::path file_for(const std::string& path) const {
+        return m_dir / std::to_string(XXH64(path.data(), path.size(), 0));
+    }
+
+    // "RUS2", shadows of previous format (without hash algorithm) are ignored
+    static constexpr uint32_t MAGIC = 0x32535552;
+    static constexpr uint32_t MAX_VERSION_SIZE = 256;
+    static constexpr uint64_t MAX_CHUNKS = 1ull << 32;
+
+    fs::path m_dir;
+};
+}
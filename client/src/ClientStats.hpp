@@ -0,0 +1,290 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+#include "Metrics.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Transfer and sync statistics of client, shared by SyncApp, all workers and their ServerAPI objects.<br>
+ * Every value is sharded per thread (see Metrics.hpp), so workers never contend on recording. Exported as JSON by SyncApp
+ */
+class ClientStats {
+public:
+    /**
+     * @brief same order as Worker::Operation
+     *
+     */
+    enum Operation {INITIAL_SYNC, ADDED, REMOVED, MODIFIED, OPERATIONS};
+    enum Request {DESCRIPTION, META, UPLOAD_FILE, UPLOAD_DIR, GET_FILE, PATCH, REMOVE, UPLOAD_RANGE, RECEIVED_RANGES, GET_RANGE, APPEND, REQUESTS};
+
+    /**
+     * @brief records finished request
+     *
+     * @param request
+     * @param ok true if server responded with 200
+     * @param duration time from submitting request till stream was closed
+     */
+    void record_request(Request request, bool ok, std::chrono::nanoseconds duration) {
+        (ok ? m_requests[request] : m_failed_requests[request]).add();
+        m_request_durations[request].record(duration);
+    }
+
+    void record_sent(Request request, uint64_t bytes) {
+        m_sent_bytes[request].add(bytes);
+    }
+
+    void record_received(Request request, uint64_t bytes) {
+        m_received_bytes[request].add(bytes);
+    }
+
+    /**
+     * @brief records worker operation from its start till its last request is closed (for INITIAL_SYNC - till the whole sync is done)
+     *
+     * @param operation
+     * @param duration
+     */
+    void record_operation(Operation operation, std::chrono::nanoseconds duration) {
+        m_operations[operation].add();
+        m_operation_durations[operation].record(duration);
+    }
+
+    /**
+     * @brief operation was postponed since worker is not connected to server
+     *
+     */
+    void record_deferred() {
+        m_deferred_operations.add();
+    }
+
+    /**
+     * @brief records scan of client dir
+     *
+     * @param files number of regular files found
+     * @param bytes their total size
+     */
+    void record_scan(uint64_t files, uint64_t bytes) {
+        m_scanned_files.add(files);
+        m_scanned_bytes.add(bytes);
+    }
+
+    void record_hashed(uint64_t bytes) {
+        m_hashed_bytes.add(bytes);
+    }
+
+    /**
+     * @brief records size of local file whose content is sent to server (whole, by patches or by ranges).<br>
+     * Compared with sent bytes it shows how much delta sync and resume saved
+     *
+     * @param bytes
+     */
+    void record_upload_file(uint64_t bytes) {
+        m_upload_file_bytes.add(bytes);
+    }
+
+    /**
+     * @brief records size of remote file which is downloaded (whole or by ranges)
+     *
+     * @param bytes
+     */
+    void record_download_file(uint64_t bytes) {
+        m_download_file_bytes.add(bytes);
+    }
+
+    /**
+     * @brief records full sync: from start of scan till all its requests were finished
+     *
+     * @param duration
+     */
+    void record_full_sync(std::chrono::nanoseconds duration) {
+        m_full_syncs.add();
+        m_full_sync_durations.record(duration);
+    }
+
+    void record_connect() {
+        m_connects.add();
+    }
+
+    void record_reconnect() {
+        m_reconnects.add();
+    }
+
+    static const char* operation_name(Operation operation) {
+        return OPERATION_NAMES[operation];
+    }
+
+    static const char* request_name(Request request) {
+        return REQUEST_NAMES[request];
+    }
+
+    /**
+     * @brief requests submitted and not closed yet
+     *
+     */
+    Gauge in_flight_requests;
+
+    /**
+     * @brief
+     *
+     * @param queued_operations operations posted to worker pool and not started yet
+     * @param pending_modifications modified files waiting for debounce timeout
+     * @return std::string statistics as JSON object
+     */
+    std::string to_json(size_t queued_operations, size_t pending_modifications) const {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer {buffer};
+        writer.StartObject();
+        writer.Key("scan");
+        writer.StartObject();
+        writer.Key("files");
+        writer.Uint64(m_scanned_files.value());
+        writer.Key("bytes");
+        writer.Uint64(m_scanned_bytes.value());
+        writer.Key("hashed_bytes");
+        writer.Uint64(m_hashed_bytes.value());
+        writer.EndObject();
+
+        uint64_t upload_sent = 0;
+        for (const auto request: {UPLOAD_FILE, PATCH, UPLOAD_RANGE, APPEND}) {
+            upload_sent += m_sent_bytes[request].value();
+        }
+        uint64_t download_received = 0;
+        for (const auto request: {GET_FILE, GET_RANGE}) {
+            download_received += m_received_bytes[request].value();
+        }
+        writer.Key("upload");
+        write_transfer(writer, m_upload_file_bytes.value(), upload_sent);
+        writer.Key("download");
+        write_transfer(writer, m_download_file_bytes.value(), download_received);
+
+        writer.Key("requests");
+        writer.StartObject();
+        for (size_t request = 0; request < REQUESTS; request++) {
+            writer.Key(REQUEST_NAMES[request]);
+            writer.StartObject();
+            writer.Key("ok");
+            writer.Uint64(m_requests[request].value());
+            writer.Key("failed");
+            writer.Uint64(m_failed_requests[request].value());
+            writer.Key("sent_bytes");
+            writer.Uint64(m_sent_bytes[request].value());
+            writer.Key("received_bytes");
+            writer.Uint64(m_received_bytes[request].value());
+            writer.Key("latency");
+            write_histogram(writer, m_request_durations[request]);
+            writer.EndObject();
+        }
+        writer.EndObject();
+
+        writer.Key("operations");
+        writer.StartObject();
+        for (size_t operation = 0; operation < OPERATIONS; operation++) {
+            writer.Key(OPERATION_NAMES[operation]);
+            writer.StartObject();
+            writer.Key("count");
+            writer.Uint64(m_operations[operation].value());
+            writer.Key("duration");
+            write_histogram(writer, m_operation_durations[operation]);
+            writer.EndObject();
+        }
+        writer.Key("deferred");
+        writer.Uint64(m_deferred_operations.value());
+        writer.EndObject();
+
+        writer.Key("full_sync");
+        writer.StartObject();
+        writer.Key("count");
+        writer.Uint64(m_full_syncs.value());
+        writer.Key("duration");
+        write_histogram(writer, m_full_sync_durations);
+        writer.EndObject();
+
+        writer.Key("queues");
+        writer.StartObject();
+        writer.Key("queued_operations");
+        writer.Uint64(queued_operations);
+        writer.Key("pending_modifications");
+        writer.Uint64(pending_modifications);
+        writer.Key("in_flight_requests");
+        writer.Int64(in_flight_requests.value());
+        writer.EndObject();
+
+        writer.Key("connection");
+        writer.StartObject();
+        writer.Key("connects");
+        writer.Uint64(m_connects.value());
+        writer.Key("reconnects");
+        writer.Uint64(m_reconnects.value());
+        writer.EndObject();
+        writer.EndObject();
+        return std::string(buffer.GetString(), buffer.GetSize());
+    }
+
+private:
+    using JsonWriter = rapidjson::Writer<rapidjson::StringBuffer>;
+
+    static void write_transfer(JsonWriter& writer, uint64_t file_bytes, uint64_t wire_bytes) {
+        writer.StartObject();
+        writer.Key("file_bytes");
+        writer.Uint64(file_bytes);
+        writer.Key("wire_bytes");
+        writer.Uint64(wire_bytes);
+        writer.Key("saved_ratio");
+        writer.Double(file_bytes == 0 || wire_bytes > file_bytes ? 0.0 : 1.0 - static_cast<double>(wire_bytes) / file_bytes);
+        writer.EndObject();
+    }
+
+    /**
+     * @brief writes histogram as {count, sum_seconds, buckets: {<upper bound in seconds>: cumulative count}}
+     *
+     */
+    static void write_histogram(JsonWriter& writer, const Histogram& histogram) {
+        const auto snapshot = histogram.snapshot();
+        writer.StartObject();
+        writer.Key("count");
+        writer.Uint64(snapshot.count());
+        writer.Key("sum_seconds");
+        writer.Double(snapshot.sum_seconds);
+        writer.Key("buckets");
+        writer.StartObject();
+        for (size_t i = 0; i < histogram.bounds().size(); i++) {
+            std::ostringstream bound;
+            bound << histogram.bounds()[i];
+            writer.Key(bound.str().c_str());
+            writer.Uint64(snapshot.cumulative[i]);
+        }
+        writer.Key("+Inf");
+        writer.Uint64(snapshot.count());
+        writer.EndObject();
+        writer.EndObject();
+    }
+
+    static constexpr std::array<const char*, OPERATIONS> OPERATION_NAMES {"initial_sync", "added", "removed", "modified"};
+    static constexpr std::array<const char*, REQUESTS> REQUEST_NAMES {
+        "description", "meta", "upload_file", "upload_dir", "get_file", "patch", "remove", "upload_range", "received_ranges", "get_range", "append"
+    };
+
+    std::array<Counter, REQUESTS> m_requests;
+    std::array<Counter, REQUESTS> m_failed_requests;
+    std::array<Counter, REQUESTS> m_sent_bytes;
+    std::array<Counter, REQUESTS> m_received_bytes;
+    std::array<Histogram, REQUESTS> m_request_durations;
+    std::array<Counter, OPERATIONS> m_operations;
+    std::array<Histogram, OPERATIONS> m_operation_durations;
+    Counter m_deferred_operations;
+    Counter m_scanned_files;
+    Counter m_scanned_bytes;
+    Counter m_hashed_bytes;
+    Counter m_upload_file_bytes;
+    Counter m_download_file_bytes;
+    Counter m_full_syncs;
+    Histogram m_full_sync_durations;
+    Counter m_connects;
+    Counter m_reconnects;
+};
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace rusync {
+
+/**
+ * @brief Token of piece of work which spans many requests (e.g. full sync). Requests hold token of code which issued them till their streams
+ * are closed and make it current again for their callbacks, so requests issued by callbacks belong to the same work
+ */
+using Completion = std::shared_ptr<void>;
+
+/**
+ * @brief
+ *
+ * @return Completion& completion of work which calling thread is doing right now, empty by default
+ */
+inline Completion& current_completion() {
+    thread_local Completion completion;
+    return completion;
+}
+
+/**
+ * @brief
+ *
+ * @param done called by whichever thread releases last copy of completion
+ * @return Completion which holds current completion till it's done, so work started within other work is part of it
+ */
+inline Completion make_completion(std::function<void()> done) {
+    return Completion {nullptr, [done = std::move(done), parent = current_completion()](void*) {
+        done();
+    }};
+}
+
+/**
+ * @brief Sets completion of work done by calling thread while scope is alive, restores previous one on exit
+ *
+ */
+class CompletionScope {
+public:
+    explicit CompletionScope(Completion completion) : m_previous {std::exchange(current_completion(), std::move(completion))} {
+
+    }
+
+    CompletionScope(const CompletionScope&) = delete;
+    CompletionScope& operator=(const CompletionScope&) = delete;
+
+    ~CompletionScope() {
+        current_completion() = std::move(m_previous);
+    }
+
+private:
+    Completion m_previous;
+};
+}
@@ -1,13 +1,30 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdlib>
 #include <filesystem>
+#include <iterator>
+#include <optional>
 #include <string>
+#include <vector>
+#include "Bandwidth.hpp"
+#include "Hash.hpp"
+#include "Logger.hpp"
 
 namespace rusync {
 namespace fs = std::filesystem;
 struct Config {
     /**
-     * @brief path to client dir
+     * @brief synced dir and key which server stores it under
+     * 
+     */
+    struct Root {
+        fs::path path;
+        std::string key;
+    };
+
+    /**
+     * @brief path to client dir (root this config is for)
      * 
      */
     fs::path path;
@@ -19,14 +36,123 @@ struct Config {
      */
     std::string key;
     /**
-     * @brief conivinient function which converts input args to Config object
+     * @brief algorithm of file and chunk hashes which client asks server for, XXH3 unless RUSYNC_HASH=xxh64 is set
+     * 
+     */
+    HashAlgorithm hash_algorithm = HashAlgorithm::XXHASH3;
+    /**
+     * @brief upload/download limits, RUSYNC_UPLOAD_LIMIT and RUSYNC_DOWNLOAD_LIMIT (e.g. 512K, 0 - unlimited) by default,
+     * overridden by windows of RUSYNC_BANDWIDTH_SCHEDULE (e.g. "08:00-18:00=512K/4M;22:00-06:00=0/0")
+     * 
+     */
+    BandwidthSchedule bandwidth;
+    /**
+     * @brief all roots served by client process, the first one is path and key of args
+     * 
+     */
+    std::vector<Root> roots;
+    /**
+     * @brief index of path and key within roots
+     * 
+     */
+    size_t root = 0;
+    /**
+     * @brief 
+     * 
+     * @param index 
+     * @return Config copy of config with path and key of roots[index]
+     */
+    Config for_root(size_t index) const {
+        Config conf = *this;
+        conf.path = roots[index].path;
+        conf.key = roots[index].key;
+        conf.root = index;
+        return conf;
+    }
+
+    /**
+     * @brief conivinient function which converts input args to Config object.<br>
+     * Args are path, host, port and key, optionally followed by pairs of path and key of other roots
      * 
      * @param argc 
      * @param argv 
      * @return Config 
      */
     static Config from_args(int argc, char** argv) {
-        return {argv[1], argv[2], argv[3], argv[4]};
+        Config conf;
+        conf.path = argv[1];
+        conf.server_host = argv[2];
+        conf.server_port = argv[3];
+        conf.key = argv[4];
+        conf.roots.push_back({conf.path, conf.key});
+        for (int i = 5; i + 1 < argc; i += 2) {
+            conf.roots.push_back({argv[i], argv[i + 1]});
+        }
+        if (const char* hash = std::getenv("RUSYNC_HASH")) {
+            conf.hash_algorithm = hash_algorithm_from(hash).value_or(conf.hash_algorithm);
+        }
+        RateLimits limits;
+        if (const char* upload = std::getenv("RUSYNC_UPLOAD_LIMIT")) {
+            limits.upload = parse_limit("RUSYNC_UPLOAD_LIMIT", upload);
+        }
+        if (const char* download = std::getenv("RUSYNC_DOWNLOAD_LIMIT")) {
+            limits.download = parse_limit("RUSYNC_DOWNLOAD_LIMIT", download);
+        }
+        conf.bandwidth = BandwidthSchedule {limits};
+        if (const char* schedule = std::getenv("RUSYNC_BANDWIDTH_SCHEDULE")) {
+            if (auto parsed = BandwidthSchedule::parse(schedule, limits)) {
+                conf.bandwidth = std::move(*parsed);
+            } else {
+                RUSYNC_LOG(ERROR) << "Ignoring malformed RUSYNC_BANDWIDTH_SCHEDULE: " << schedule;
+            }
+        }
+        return conf;
+    }
+
+    /**
+     * @brief roots must not share key, as server stores both of them in one dir, and must not overlap, as events of nested root would be synced under two keys
+     * 
+     * @return std::optional<std::string> description of first conflict between roots, nullopt if roots are valid
+     */
+    std::optional<std::string> roots_conflict() const {
+        for (size_t i = 0; i < roots.size(); i++) {
+            for (size_t j = i + 1; j < roots.size(); j++) {
+                if (roots[i].key == roots[j].key) {
+                    return "roots " + roots[i].path.string() + " and " + roots[j].path.string() + " have the same key " + roots[i].key;
+                }
+                if (nested(roots[i].path, roots[j].path) || nested(roots[j].path, roots[i].path)) {
+                    return "roots " + roots[i].path.string() + " and " + roots[j].path.string() + " overlap";
+                }
+            }
+        }
+        return std::nullopt;
+    }
+
+private:
+    /**
+     * @brief 
+     * 
+     * @param parent 
+     * @param path 
+     * @return true if path is parent or is within it, after both are resolved
+     */
+    static bool nested(const fs::path& parent, const fs::path& path) {
+        const fs::path resolved_parent = fs::weakly_canonical(fs::absolute(parent)).lexically_normal();
+        const fs::path resolved = fs::weakly_canonical(fs::absolute(path)).lexically_normal();
+        auto parent_end = resolved_parent.end();
+        // trailing separator is kept as empty last element
+        if (parent_end != resolved_parent.begin() && std::prev(parent_end)->empty()) {
+            parent_end--;
+        }
+        return std::mismatch(resolved_parent.begin(), parent_end, resolved.begin(), resolved.end()).first == parent_end;
+    }
+
+    static uint64_t parse_limit(const char* name, const char* value) {
+        const auto rate = parse_rate(value);
+        if (!rate) {
+            RUSYNC_LOG(ERROR) << "Ignoring malformed " << name << ": " << value;
+        }
+        return rate.value_or(0);
     }
 };
 }
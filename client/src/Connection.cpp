@@ -0,0 +1,53 @@
+#include "Connection.hpp"
+#include "Logger.hpp"
+
+namespace rusync {
+
+Connection::Connection(const Config& conf, boost::asio::io_service& io_service, ClientStats& stats) :
+    m_conf(conf), m_io_service(io_service), m_stats(stats), m_retry_timer(io_service, CONNECTION_RETRY_TIMEOUT) {
+    create_session();
+}
+
+Connection::~Connection() {
+    m_session->shutdown();
+}
+
+bool Connection::connected() const {
+    return m_connected;
+}
+
+nghttp2::asio_http2::client::session& Connection::session() {
+    return *m_session;
+}
+
+BulkLimiter& Connection::bulk() {
+    return m_bulk;
+}
+
+void Connection::create_session() {
+    m_session = std::make_unique<nghttp2::asio_http2::client::session>(m_io_service, m_conf.server_host, m_conf.server_port);
+    m_session->on_connect([this](boost::asio::ip::tcp::resolver::iterator /*endpoint_it*/) {
+        RUSYNC_LOG(INFO) << "Successfully connected to " <<  m_conf.server_host << ":" << m_conf.server_port;
+        m_connected = true;
+        m_stats.record_connect();
+    });
+    m_session->on_error([this](const boost::system::error_code &ec) {
+        RUSYNC_LOG(WARN) << "Error occured on connecting to " << m_conf.server_host << ":" << m_conf.server_port << " : " << ec.message() <<
+            ". Will retry in " << CONNECTION_RETRY_TIMEOUT.total_seconds() << " seconds";
+        m_stats.record_reconnect();
+        retry_connection();
+    });
+    // streams of previous session are gone with it, queued requests go to the new one
+    m_bulk.reset();
+}
+
+void Connection::retry_connection() {
+    m_retry_timer.expires_at(m_retry_timer.expires_at() + CONNECTION_RETRY_TIMEOUT);
+    m_retry_timer.async_wait([this](const boost::system::error_code & err) {
+        if (err == boost::asio::error::operation_aborted) {
+            return;
+        }
+        create_session();
+    });
+}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "BulkLimiter.hpp"
+#include "ClientStats.hpp"
+#include "Config.hpp"
+#include "boost/asio/io_service.hpp"
+#include <nghttp2/asio_http2_client.h>
+#include <memory>
+#include "boost/date_time/posix_time/posix_time_duration.hpp"
+
+namespace rusync {
+
+/**
+ * @brief HTTP/2 session to server, reconnected on failure. Shared by ServerAPI of all roots served by worker, so number of
+ * connections doesn't grow with number of roots
+ *
+ */
+class Connection {
+public:
+    Connection(const Config& conf, boost::asio::io_service& io_service, ClientStats& stats);
+    ~Connection();
+
+    /**
+     * @brief
+     *
+     * @return true is currently connected to server
+     * @return false otherwise
+     */
+    bool connected() const;
+
+    /**
+     * @brief
+     *
+     * @return nghttp2::asio_http2::client::session& current session, replaced on reconnect
+     */
+    nghttp2::asio_http2::client::session& session();
+
+    /**
+     * @brief
+     *
+     * @return BulkLimiter& admission of bulk requests of all roots to session
+     */
+    BulkLimiter& bulk();
+
+private:
+    /**
+     * @brief Establishes tcp connection to server
+     *
+     */
+    void create_session();
+    /**
+     * @brief schedule connection retry within CONNECTION_RETRY_TIMEOUT seconds
+     *
+     */
+    void retry_connection();
+
+    std::unique_ptr<nghttp2::asio_http2::client::session> m_session;
+    const Config& m_conf;
+    boost::asio::io_service& m_io_service;
+    ClientStats& m_stats;
+    bool m_connected = false;
+    const boost::posix_time::seconds CONNECTION_RETRY_TIMEOUT = boost::posix_time::seconds{2};
+    boost::asio::deadline_timer m_retry_timer;
+    /**
+     * @brief leaves server's concurrent streams (100 by default) to interactive requests
+     *
+     */
+    static constexpr size_t MAX_BULK_STREAMS = 32;
+    BulkLimiter m_bulk {MAX_BULK_STREAMS};
+};
+}
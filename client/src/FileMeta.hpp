@@ -0,0 +1,49 @@
+#pragma once
+#include <stdexcept>
+#include <vector>
+#include "BinaryParser.hpp"
+#include "FileChunk.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Parsed response of meta API
+ * 
+ */
+struct FileMeta {
+    bool is_file;
+    /**
+     * @brief algorithm of chunk hashes
+     * 
+     */
+    HashAlgorithm hash_algorithm;
+    /**
+     * @brief chunks of remote file, empty for dirs
+     * 
+     */
+    std::vector<FileChunk> chunks;
+};
+
+/**
+ * @brief parses meta API response: flags byte followed by (size, hash) of each chunk.<br>
+ * Lowest bit of flags is is_file, rest is id of HashAlgorithm, so response of server which doesn't know algorithms (0 or 1) is XXH64
+ * 
+ * @param data 
+ * @param length 
+ * @return FileMeta 
+ */
+inline FileMeta parse_meta(const unsigned char* data, size_t length) {
+    BinaryParser parser {data, length};
+    const auto flags = parser.read<uint8_t>();
+    const auto algorithm = hash_algorithm_from(static_cast<uint64_t>(flags >> 1));
+    if (!algorithm) {
+        throw std::invalid_argument{"Unknown hash algorithm"};
+    }
+    FileMeta meta {(flags & 1) != 0, *algorithm, {}};
+    meta.chunks.reserve(parser.get_bytes_remain() / (sizeof(uint32_t) + sizeof(uint64_t)));
+    while(parser.get_bytes_remain() != 0) {
+        meta.chunks.push_back({parser.read<uint32_t>(), parser.read<uint64_t>()});
+    }
+    return meta;
+}
+}
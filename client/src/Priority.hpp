@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace rusync {
+
+/**
+ * @brief Class of sync work. Interactive work (changes reported by watcher) goes ahead of bulk work (initial sync, trees of files,
+ * large transfers) both in worker queues and on the wire, so edit of single file propagates quickly while full sync is in progress
+ */
+enum class Priority : uint8_t {INTERACTIVE = 0, BULK = 1};
+
+/**
+ * @brief number of priority classes, classes with lower value go first
+ *
+ */
+inline constexpr size_t PRIORITIES = 2;
+
+inline const char* priority_name(Priority priority) {
+    return priority == Priority::INTERACTIVE ? "interactive" : "bulk";
+}
+
+/**
+ * @brief
+ *
+ * @return Priority& priority of work which calling thread is doing right now, interactive by default
+ */
+inline Priority& current_priority() {
+    thread_local Priority priority = Priority::INTERACTIVE;
+    return priority;
+}
+
+/**
+ * @brief Sets priority of work done by calling thread while scope is alive (e.g. requests submitted by operation), restores previous one on exit
+ *
+ */
+class PriorityScope {
+public:
+    explicit PriorityScope(Priority priority) : m_previous {std::exchange(current_priority(), priority)} {
+
+    }
+
+    PriorityScope(const PriorityScope&) = delete;
+    PriorityScope& operator=(const PriorityScope&) = delete;
+
+    ~PriorityScope() {
+        current_priority() = m_previous;
+    }
+
+private:
+    Priority m_previous;
+};
+}
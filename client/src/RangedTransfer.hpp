@@ -0,0 +1,121 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "TransferJournal.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Splits transfer of single large file into byte ranges which are sent concurrently over separate HTTP/2 streams.<br>
+ * Number of ranges in flight (parallelism) and range size grow with file size. At most parallelism ranges are in flight at once,
+ * next range is started as soon as one of previous is done, so memory usage is bounded by parallelism * part_size.
+ * All callbacks are expected to be called from the same thread (worker's event loop).
+ */
+class RangedTransfer {
+public:
+    /**
+     * @brief files starting from this size are transferred by ranges
+     *
+     */
+    static constexpr uint64_t THRESHOLD = 16'000'000;
+    static constexpr uint64_t MIN_PART_SIZE = 4'000'000;
+    static constexpr uint64_t MAX_PART_SIZE = 64'000'000;
+    static constexpr unsigned MAX_PARALLELISM = 8;
+
+    struct Plan {
+        uint64_t part_size;
+        unsigned parallelism;
+        uint64_t parts;
+    };
+
+    /**
+     * @brief computes how file of provided size should be split. One more stream for each 16MB, up to MAX_PARALLELISM
+     *
+     * @param size
+     * @return Plan
+     */
+    static Plan plan(uint64_t size) {
+        const unsigned parallelism = static_cast<unsigned>(std::clamp<uint64_t>(size / THRESHOLD, 1, MAX_PARALLELISM));
+        const uint64_t part_size = std::clamp<uint64_t>((size + parallelism - 1) / parallelism, MIN_PART_SIZE, MAX_PART_SIZE);
+        return {part_size, parallelism, std::max<uint64_t>((size + part_size - 1) / part_size, 1)};
+    }
+
+    /**
+     * @brief called when range is done, ok is false if range failed
+     *
+     */
+    using DoneCb = std::function<void(bool ok)>;
+    using SendRange = std::function<void(uint64_t offset, uint64_t length, DoneCb done)>;
+
+    /**
+     * @brief transfers size bytes range by range using send
+     *
+     * @param size
+     * @param send starts transfer of single range and calls provided DoneCb once it's finished
+     * @param done called once all ranges are done or first failure was observed and ranges in flight are finished
+     */
+    static void run(uint64_t size, SendRange send, DoneCb done) {
+        run(size, {{0, size}}, std::move(send), std::move(done));
+    }
+
+    /**
+     * @brief transfers only missing parts of file, used to resume interrupted transfer.
+     * Parts are split into ranges according to plan of whole file
+     *
+     * @param size size of whole file
+     * @param missing sorted not overlapping [offset, end) parts which should be transferred
+     * @param send
+     * @param done
+     */
+    static void run(uint64_t size, const std::vector<RangeSet::Range>& missing, SendRange send, DoneCb done) {
+        const auto transfer_plan = plan(size);
+        std::vector<RangeSet::Range> ranges;
+        for (const auto& [offset, end]: missing) {
+            for (uint64_t position = offset; position < end; position += transfer_plan.part_size) {
+                ranges.emplace_back(position, std::min(end - position, transfer_plan.part_size));
+            }
+        }
+        if (ranges.empty()) {
+            done(true);
+            return;
+        }
+        auto state = std::make_shared<State>(State{std::move(ranges), 0, 0, false, std::move(send), std::move(done)});
+        for (unsigned i = 0; i < transfer_plan.parallelism && state->next < state->ranges.size() && !state->failed; i++) {
+            send_next(state);
+        }
+    }
+
+private:
+    struct State {
+        /**
+         * @brief (offset, length) of ranges to transfer
+         *
+         */
+        std::vector<RangeSet::Range> ranges;
+        size_t next;
+        unsigned in_flight;
+        bool failed;
+        SendRange send;
+        DoneCb done;
+    };
+
+    static void send_next(std::shared_ptr<State> state) {
+        const auto [offset, length] = state->ranges[state->next++];
+        state->in_flight++;
+        state->send(offset, length, [state](bool ok) {
+            state->in_flight--;
+            state->failed = state->failed || !ok;
+            if (!state->failed && state->next < state->ranges.size()) {
+                send_next(state);
+                return;
+            }
+            if (state->in_flight == 0) {
+                state->done(!state->failed);
+            }
+        });
+    }
+};
+}
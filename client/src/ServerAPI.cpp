@@ -1,159 +1,590 @@
 #include "ServerAPI.hpp"
+#include <algorithm>
 #include <string>
-#include <syncstream>
 #include "BinaryParser.hpp"
+#include "Completion.hpp"
+#include "Logger.hpp"
+#include "Tracing.hpp"
+#include "FileMeta.hpp"
 #include "boost/asio/io_service.hpp"
 #include "boost/asio/post.hpp"
+#include "boost/asio/steady_timer.hpp"
 #include "nghttp2/asio_http2.h"
-#include <rapidjson/document.h>
-#include <numeric>
+#include "DescriptionJson.hpp"
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace rusync {
-ServerAPI::ServerAPI(const Config& conf, boost::asio::io_service& io_service) : 
-    m_conf(conf), m_retry_timer(io_service, CONNECTION_RETRY_TIMEOUT) {
-    create_session(io_service);
-}
+/**
+ * @brief Client side span of request, linked by flow event with span of request handler on server (see TRACE_HEADER).<br>
+ * Ended on network thread, so flow start is written there too, with the time request was submitted
+ */
+class RequestSpan {
+public:
+    explicit RequestSpan(ClientStats::Request request) : 
+        m_span {ClientStats::request_name(request), "request"}, m_trace {Tracer::current_trace()}, m_id {Tracer::new_id()} {
+
+    }
 
-ServerAPI::~ServerAPI() {
-    m_session->shutdown();
+    std::string header_value() const {
+        return Tracer::header_value(m_trace, m_id);
+    }
+
+    void end(bool ok) {
+        if (!m_span.active()) {
+            return;
+        }
+        TraceScope scope {m_trace};
+        Tracer::instance().flow(true, m_id, m_span.start());
+        m_span.arg("ok", ok ? "true" : "false");
+        m_span.end();
+    }
+
+private:
+    TraceSpan m_span;
+    uint64_t m_trace;
+    uint64_t m_id;
+};
+
+namespace {
+/**
+ * @brief starts span of request if tracing is enabled and adds its context to request headers
+ *
+ * @param request
+ * @param headers
+ * @return std::shared_ptr<RequestSpan> nullptr if tracing is disabled
+ */
+std::shared_ptr<RequestSpan> trace_request(ClientStats::Request request, nghttp2::asio_http2::header_map& headers) {
+    if (!Tracer::enabled()) {
+        return nullptr;
+    }
+    auto span = std::make_shared<RequestSpan>(request);
+    headers.emplace(TRACE_HEADER, nghttp2::asio_http2::header_value{span->header_value(), false});
+    return span;
 }
 
-void ServerAPI::create_session(boost::asio::io_service &io_service ) {
-    m_session = std::make_unique<nghttp2::asio_http2::client::session>(io_service, m_conf.server_host, m_conf.server_port);
-    m_session->on_connect([this](boost::asio::ip::tcp::resolver::iterator endpoint_it) {
-        std::osyncstream(std::cout) << "Successfully connected to " <<  m_conf.server_host << ":" << m_conf.server_port << std::endl;
-        m_connected = true;
-    });
-    m_session->on_error([this, &io_service](const boost::system::error_code &ec) {
-        std::osyncstream(std::cout) << "Error occured on connecting to " << m_conf.server_host << ":" << m_conf.server_port << " : " << ec.message() << 
-            ". Will retry in " << CONNECTION_RETRY_TIMEOUT.total_seconds() << " seconds" << std::endl;
-        retry_connection(io_service);
-    });
+/**
+ * @brief adds content-length of request body, so server reserves buffer for it once instead of growing it frame by frame
+ *
+ * @param headers
+ * @param size
+ */
+void set_content_length(nghttp2::asio_http2::header_map& headers, uint64_t size) {
+    if (size > 0) {
+        headers.emplace("content-length", nghttp2::asio_http2::header_value{std::to_string(size), false});
+    }
 }
 
-void ServerAPI::retry_connection(boost::asio::io_service &io_service) {
-    m_retry_timer.expires_at(m_retry_timer.expires_at() + CONNECTION_RETRY_TIMEOUT);
-    m_retry_timer.async_wait([this, &io_service](const boost::system::error_code & err) {
-        if (err == boost::asio::error::operation_aborted) {
-            return;
+/**
+ * @brief body of request which is sent within upload limit. Its generator defers stream while limiter has no tokens for it,
+ * timer resumes stream once it's its turn
+ *
+ */
+struct ShapedUpload {
+    ShapedUpload(boost::asio::io_service& io_service, RateLimiter& limiter, Priority priority) :
+        limiter {limiter}, transfer {limiter.open(priority)}, timer {io_service} {
+
+    }
+
+    RateLimiter& limiter;
+    const uint64_t transfer;
+    boost::asio::steady_timer timer;
+    const nghttp2::asio_http2::client::request* req = nullptr;
+    bool closed = false;
+};
+
+/**
+ * @brief
+ *
+ * @param data
+ * @return nghttp2::asio_http2::generator_cb generator which sends data in pieces requested by session
+ */
+nghttp2::asio_http2::generator_cb body_generator(std::string data) {
+    struct Body {
+        std::string data;
+        size_t sent = 0;
+    };
+    auto body = std::make_shared<Body>(Body{std::move(data)});
+    return [body](uint8_t* buf, size_t len, uint32_t* data_flags) -> ssize_t {
+        const auto size = std::min(len, body->data.size() - body->sent);
+        std::copy_n(body->data.data() + body->sent, size, buf);
+        body->sent += size;
+        if (body->sent == body->data.size()) {
+            *data_flags |= NGHTTP2_DATA_FLAG_EOF;
         }
-        create_session(io_service);
-    });
+        return size;
+    };
+}
 }
 
-void ServerAPI::get_files_description(GetFilesDescriptionCallback cb) {
-    perform_http_request(DESCRIPTION_PATH, "GET", [cb](std::vector<char> data){
-        std::osyncstream(std::cout) << "Recevied file descriptors, data: " << std::string(data.data(), data.size()) << std::endl;
-        rapidjson::Document document;
-        document.Parse(data.data(), data.size());
-        if (!document.IsArray()) {
-            std::cerr << "Invalid JSON schema in response" << std::endl;
-            return;
+ServerAPI::ServerAPI(const Config& conf, Connection& connection, boost::asio::io_service& io_service, ClientStats& stats, Bandwidth& bandwidth) : 
+    m_conf(conf), m_connection(connection), m_stats(stats), m_bandwidth(bandwidth), m_io_service(io_service) {
+
+}
+
+void ServerAPI::get_files_description(const EntryTable& local, GetFilesDescriptionCallback cb) {
+    QueryBuilder params;
+    params.add("hash", hash_algorithm_name(local.hash_algorithm()));
+    params.add("tree", "1");
+    std::string known_dirs;
+    for (const auto& entry: local) {
+        if (entry.type == DirEntry::DIR && known_dirs.size() < MAX_KNOWN_DIRS * sizeof(uint64_t)) {
+            const uint64_t digest = EntryTable::subtree_digest(entry.path, entry.hash);
+            known_dirs.append(reinterpret_cast<const char*>(&digest), sizeof(digest));
         }
-        std::set<DirEntry> remote_entries;
-        for (const auto& entry: document.GetArray()) {
-            remote_entries.insert({
-                entry["path"].GetString(),
-                entry["type"] == "file" ? DirEntry::FILE : DirEntry::DIR,
-                entry["hash"].GetUint64()
-            });
+    }
+    perform_http_request(ClientStats::DESCRIPTION, DESCRIPTION_PATH, "GET", "", std::move(params), std::move(known_dirs), [cb](std::vector<char> data){
+        RUSYNC_LOG(DEBUG) << "Recevied files description, size: " << data.size();
+        RUSYNC_LOG(TRACE) << "Files description: " << std::string_view(data.data(), data.size());
+        auto remote_entries = parse_description(data.data(), data.size());
+        if (!remote_entries) {
+            RUSYNC_LOG(ERROR) << "Invalid JSON schema in response";
+            return;
         }
-        cb(std::move(remote_entries));
+        cb(std::move(*remote_entries));
     });
     
 }
 bool ServerAPI::connected() const {
-    return m_connected;
+    return m_connection.connected();
 }
 
 void ServerAPI::upload_file(std::string file, const std::string& path) {
-    QueryParamsMap params;
-    params["path"] = path;
-    params["type"] = "file";
-    perform_http_request(FILES_PATH, "POST", std::move(params), std::move(file));
+    QueryBuilder params;
+    params.add("path", path);
+    params.add("type", "file");
+    perform_http_request(ClientStats::UPLOAD_FILE, FILES_PATH, "POST", path, std::move(params), std::move(file));
 }
 
 void ServerAPI::remove_file(const std::string& path) {
-    QueryParamsMap params;
-    params["path"] = path;
-    perform_http_request(FILES_PATH, "DELETE", std::move(params));
+    QueryBuilder params;
+    params.add("path", path);
+    perform_http_request(ClientStats::REMOVE, FILES_PATH, "DELETE", path, std::move(params));
 }
 
 void ServerAPI::upload_dir(const std::string& path) {
-    QueryParamsMap params;
-    params["path"] = path;
-    params["type"] = "dir";
-    perform_http_request(FILES_PATH, "POST", std::move(params));
+    QueryBuilder params;
+    params.add("path", path);
+    params.add("type", "dir");
+    perform_http_request(ClientStats::UPLOAD_DIR, FILES_PATH, "POST", path, std::move(params));
 }
 
 void ServerAPI::get_file(const std::string& path, GetFileCallback cb) {
-    QueryParamsMap params;
-    params["path"] = path;
-    perform_http_request(FILES_PATH, "GET", std::move(params), "", [cb, path](std::vector<char> data){
-        std::osyncstream(std::cout) << "Recevied file with path: " << path << ", size: " << data.size() << std::endl;
+    QueryBuilder params;
+    params.add("path", path);
+    perform_http_request(ClientStats::GET_FILE, FILES_PATH, "GET", path, std::move(params), "", [cb, path](std::vector<char> data){
+        RUSYNC_LOG(DEBUG) << "Recevied file with path: " << path << ", size: " << data.size();
         cb(std::move(data));
     });
 }
 
-void ServerAPI::upload_patch(const std::string& path, uint64_t offset, std::string data, bool end) {
-    QueryParamsMap params;
-    params["path"] = path;
-    params["offset"] = std::to_string(offset);
+void ServerAPI::upload_patch(const std::string& path, uint64_t offset, std::string data, bool end, const std::string& session,
+                             const std::string& version, PatchCallback cb) {
+    QueryBuilder params;
+    params.add("path", path);
+    params.add("offset", offset);
     if (end) {
-        params["end"] = "1";
+        params.add("end", "1");
+    }
+    if (!session.empty()) {
+        params.add("session", session);
+    }
+    if (!version.empty()) {
+        params.add("version", version);
     }
-    perform_http_request(FILES_PATH, "PATCH", std::move(params), std::move(data));
+    if (!cb) {
+        perform_http_request(ClientStats::PATCH, FILES_PATH, "PATCH", path, std::move(params), std::move(data));
+        return;
+    }
+    const std::string uri = make_uri(FILES_PATH, params);
+    const auto priority = request_priority(data.size());
+    admit(priority, path, [this, uri, priority, data = std::move(data), cb](BulkLimiter::Release release) mutable {
+        const auto data_size = data.size();
+        nghttp2::asio_http2::header_map headers;
+        set_content_length(headers, data_size);
+        auto span = trace_request(ClientStats::PATCH, headers);
+        boost::system::error_code ec;
+        const auto* req = submit_request(ec, "PATCH", uri, std::move(data), std::move(headers), priority, release);
+        if (!req) {
+            RUSYNC_LOG(ERROR) << "Failed to perform request for " << uri << ", reason: " << ec.message();
+            m_stats.record_request(ClientStats::PATCH, false, std::chrono::nanoseconds(0));
+            release();
+            cb(std::nullopt);
+            return;
+        }
+        m_stats.record_sent(ClientStats::PATCH, data_size);
+        auto body = std::make_shared<std::string>();
+        stream_response(req, ClientStats::PATCH, "PATCH", uri, [body](const uint8_t* chunk, size_t len) {
+            body->append(reinterpret_cast<const char*>(chunk), len);
+        }, [body, cb, release](bool ok) {
+            release();
+            cb(ok ? std::optional<std::string>{std::move(*body)} : std::nullopt);
+        }, std::move(span));
+    });
+}
+
+void ServerAPI::append_file(const std::string& path, uint64_t offset, std::string data, DoneCallback cb) {
+    QueryBuilder params;
+    params.add("path", path);
+    params.add("offset", offset);
+    params.add("end", "1");
+    params.add("append", "1");
+    const std::string uri = make_uri(FILES_PATH, params);
+    const auto priority = request_priority(data.size());
+    admit(priority, path, [this, uri, priority, data = std::move(data), cb](BulkLimiter::Release release) mutable {
+        const auto data_size = data.size();
+        nghttp2::asio_http2::header_map headers;
+        set_content_length(headers, data_size);
+        auto span = trace_request(ClientStats::APPEND, headers);
+        boost::system::error_code ec;
+        const auto* req = submit_request(ec, "PATCH", uri, std::move(data), std::move(headers), priority, release);
+        if (!req) {
+            RUSYNC_LOG(ERROR) << "Failed to perform request for " << uri << ", reason: " << ec.message();
+            m_stats.record_request(ClientStats::APPEND, false, std::chrono::nanoseconds(0));
+            release();
+            cb(false);
+            return;
+        }
+        m_stats.record_sent(ClientStats::APPEND, data_size);
+        stream_response(req, ClientStats::APPEND, "PATCH", uri, DataCallback(), [cb, release](bool ok) {
+            release();
+            cb(ok);
+        }, std::move(span));
+    });
+}
+
+void ServerAPI::upload_range(const std::string& path, const fs::path& local_path, uint64_t offset, uint64_t length, 
+                             uint64_t size, const std::string& transfer, DoneCallback cb) {
+    const int fd = open(local_path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        RUSYNC_LOG(ERROR) << "Failed to open " << local_path << " for ranged upload";
+        m_stats.record_request(ClientStats::UPLOAD_RANGE, false, std::chrono::nanoseconds(0));
+        cb(false);
+        return;
+    }
+    // closed once stream is done with generator
+    auto file = share_fd(fd);
+    QueryBuilder params;
+    params.add("path", path);
+    params.add("type", "file");
+    params.add("transfer", transfer);
+    params.add("offset", offset);
+    params.add("size", size);
+    const std::string uri = make_uri(FILES_PATH, params);
+    auto position = std::make_shared<uint64_t>(offset);
+    const uint64_t end = offset + length;
+    nghttp2::asio_http2::generator_cb generator = [file, position, end, &stats = m_stats](uint8_t* buf, size_t len, uint32_t* data_flags) -> ssize_t {
+        const auto bytes_read = pread(*file, buf, std::min<uint64_t>(len, end - *position), *position);
+        if (bytes_read < 0) {
+            return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+        *position += bytes_read;
+        stats.record_sent(ClientStats::UPLOAD_RANGE, bytes_read);
+        if (*position == end || bytes_read == 0) {
+            *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+        }
+        return bytes_read;
+    };
+    admit(Priority::BULK, path, [this, uri, length, generator = std::move(generator), cb](BulkLimiter::Release release) mutable {
+        nghttp2::asio_http2::header_map headers;
+        set_content_length(headers, length);
+        auto span = trace_request(ClientStats::UPLOAD_RANGE, headers);
+        boost::system::error_code ec;
+        const auto* req = submit_request(ec, "POST", uri, std::move(generator), std::move(headers), Priority::BULK, release);
+        if (!req) {
+            RUSYNC_LOG(ERROR) << "Failed to perform request for " << uri << ", reason: " << ec.message();
+            m_stats.record_request(ClientStats::UPLOAD_RANGE, false, std::chrono::nanoseconds(0));
+            release();
+            cb(false);
+            return;
+        }
+        stream_response(req, ClientStats::UPLOAD_RANGE, "POST", uri, DataCallback(), [cb, release](bool ok) {
+            release();
+            cb(ok);
+        }, std::move(span));
+    });
+}
+
+void ServerAPI::get_received_ranges(const std::string& path, const std::string& transfer, uint64_t size, GetReceivedRangesCallback cb) {
+    QueryBuilder params;
+    params.add("path", path);
+    params.add("transfer", transfer);
+    params.add("size", size);
+    const std::string uri = make_uri(FILES_PATH, params);
+    // starts ranged upload, so it's queued together with its ranges
+    admit(Priority::BULK, path, [this, uri, cb](BulkLimiter::Release release) {
+        nghttp2::asio_http2::header_map headers;
+        auto span = trace_request(ClientStats::RECEIVED_RANGES, headers);
+        boost::system::error_code ec;
+        const auto* req = m_connection.session().submit(ec, "GET", uri, std::move(headers), stream_priority(Priority::BULK));
+        if (!req) {
+            RUSYNC_LOG(ERROR) << "Failed to perform request for " << uri << ", reason: " << ec.message();
+            m_stats.record_request(ClientStats::RECEIVED_RANGES, false, std::chrono::nanoseconds(0));
+            release();
+            cb({});
+            return;
+        }
+        auto data = std::make_shared<std::vector<uint8_t>>();
+        stream_response(req, ClientStats::RECEIVED_RANGES, "GET", uri, [data](const uint8_t* chunk, size_t len) {
+            data->insert(data->end(), chunk, chunk + len);
+        }, [data, cb, release](bool ok) {
+            release();
+            std::vector<RangeSet::Range> ranges;
+            BinaryParser parser {data->data(), data->size()};
+            while (ok && parser.get_bytes_remain() >= 2 * sizeof(uint64_t)) {
+                const auto offset = parser.read<uint64_t>();
+                ranges.emplace_back(offset, parser.read<uint64_t>());
+            }
+            cb(std::move(ranges));
+        }, std::move(span));
+    });
+}
+
+void ServerAPI::get_range(const std::string& path, uint64_t offset, uint64_t length, DataCallback data_cb, DoneCallback cb) {
+    if (m_bandwidth.download.limited() && length > SHAPED_RANGE_PIECE) {
+        get_range(path, offset, SHAPED_RANGE_PIECE, data_cb, [this, path, offset, length, data_cb, cb](bool ok) {
+            if (!ok) {
+                cb(false);
+                return;
+            }
+            get_range(path, offset + SHAPED_RANGE_PIECE, length - SHAPED_RANGE_PIECE, data_cb, cb);
+        });
+        return;
+    }
+    QueryBuilder params;
+    params.add("path", path);
+    params.add("offset", offset);
+    params.add("length", length);
+    const std::string uri = make_uri(FILES_PATH, params);
+    admit_download(Priority::BULK, path, [this, uri, data_cb, cb](BulkLimiter::Release release) {
+        nghttp2::asio_http2::header_map headers;
+        auto span = trace_request(ClientStats::GET_RANGE, headers);
+        boost::system::error_code ec;
+        const auto* req = m_connection.session().submit(ec, "GET", uri, std::move(headers), stream_priority(Priority::BULK));
+        if (!req) {
+            RUSYNC_LOG(ERROR) << "Failed to perform request for " << uri << ", reason: " << ec.message();
+            m_stats.record_request(ClientStats::GET_RANGE, false, std::chrono::nanoseconds(0));
+            release();
+            cb(false);
+            return;
+        }
+        stream_response(req, ClientStats::GET_RANGE, "GET", uri, data_cb, [cb, release](bool ok) {
+            release();
+            cb(ok);
+        }, std::move(span));
+    });
+}
+
+void ServerAPI::stream_response(const nghttp2::asio_http2::client::request* req, ClientStats::Request request, const std::string& method, const std::string& uri,
+                                DataCallback data_cb, DoneCallback cb, std::shared_ptr<RequestSpan> span) {
+    auto finished = std::make_shared<bool>(false);
+    m_stats.in_flight_requests.add(1);
+    const auto completion = current_completion();
+    auto finish = [finished, cb, request, span, completion, &stats = m_stats, started = std::chrono::steady_clock::now()](bool ok) {
+        if (!*finished) {
+            *finished = true;
+            stats.in_flight_requests.add(-1);
+            stats.record_request(request, ok, std::chrono::steady_clock::now() - started);
+            if (span) {
+                span->end(ok);
+            }
+            CompletionScope scope {completion};
+            cb(ok);
+        }
+    };
+    req->on_response([finish, data_cb, method, uri, request, completion, &stats = m_stats, &download = m_bandwidth.download](const nghttp2::asio_http2::client::response& resp) {
+        RUSYNC_LOG(DEBUG) << "Performed " << method << " request to " << url_decode(uri) << ", response code: " << resp.status_code();
+        if (resp.status_code() != 200) {
+            finish(false);
+            return;
+        }
+        resp.on_data([finish, data_cb, request, completion, &stats, &download](const uint8_t* data, size_t len) {
+            if (len == 0) {
+                finish(true);
+                return;
+            }
+            stats.record_received(request, len);
+            download.debit(len);
+            if (data_cb) {
+                CompletionScope scope {completion};
+                data_cb(data, len);
+            }
+        });
+    });
+    req->on_close([finish](uint32_t /*error_code*/) {
+        // no-op if response was already completed
+        finish(false);
+    });
 }
 
 void ServerAPI::get_meta(const std::string& path, GetMetaCallback cb) {
-    QueryParamsMap params;
-    params["path"] = path;
-    perform_http_request(META_PATH, "GET", std::move(params), "", [cb, path](std::vector<char> data){
-        std::osyncstream(std::cout) << "Recevied meta object with path: " << path << ", size: " << data.size() << std::endl;
-        std::vector<FileChunk> remote_chunks;
-        BinaryParser parser {reinterpret_cast<const unsigned char*>(data.data()), data.size()};
-        const bool is_file = parser.read<uint8_t>();
-        while(parser.get_bytes_remain() != 0) {
-            remote_chunks.push_back({parser.read<uint32_t>(), parser.read<uint64_t>()});
-        }
-        cb(is_file, std::move(remote_chunks));
+    QueryBuilder params;
+    params.add("path", path);
+    params.add("hash", hash_algorithm_name(m_conf.hash_algorithm));
+    perform_http_request(ClientStats::META, META_PATH, "GET", path, std::move(params), "", [cb, path](std::vector<char> data){
+        RUSYNC_LOG(DEBUG) << "Recevied meta object with path: " << path << ", size: " << data.size();
+        auto meta = parse_meta(reinterpret_cast<const unsigned char*>(data.data()), data.size());
+        cb(meta.is_file, std::move(meta.chunks), meta.hash_algorithm);
     });
 }
 
 
 
-void ServerAPI::perform_http_request(const std::string& path, 
+void ServerAPI::perform_http_request(ClientStats::Request request,
+                            const std::string& path, 
                             const std::string& method,
                             ReceiveCb receive_cb) {
-    return perform_http_request(path, method, QueryParamsMap(), "", std::move(receive_cb));
+    return perform_http_request(request, path, method, "", QueryBuilder(), "", std::move(receive_cb));
 }
 
-void ServerAPI::perform_http_request(const std::string& path, 
+void ServerAPI::perform_http_request(ClientStats::Request request,
+                            const std::string& path, 
                             const std::string& method, 
-                            QueryParamsMap&& query,
+                            const std::string& file,
+                            QueryBuilder&& query,
                             std::string data,
                             ReceiveCb receive_cb) {
-    const std::string query_params = std::accumulate(query.begin(), query.end(), "key=" + m_conf.key, [](const std::string accum, const auto& pair) {
-        return accum + "&" + pair.first + "=" + pair.second;
+    std::string uri = make_uri(path, query);
+    const auto priority = request_priority(data.size());
+    auto submit = [this, request, method, uri, priority, data = std::move(data), receive_cb, completion = current_completion()](BulkLimiter::Release release) mutable {
+        const auto data_size = data.size();
+        nghttp2::asio_http2::header_map headers;
+        set_content_length(headers, data_size);
+        auto span = trace_request(request, headers);
+        boost::system::error_code ec;
+        const auto* req = submit_request(ec, method, uri, std::move(data), std::move(headers), priority, release);
+        if (!req) {
+            RUSYNC_LOG(ERROR) << "Failed to perform request for " << uri << ", reason: " << ec.message();
+            m_stats.record_request(request, false, std::chrono::nanoseconds(0));
+            release();
+            return;
+        }
+        m_stats.record_sent(request, data_size);
+        m_stats.in_flight_requests.add(1);
+        auto ok = std::make_shared<bool>(false);
+        req->on_response([receive_cb, method, uri, request, ok, completion, &stats = m_stats, &download = m_bandwidth.download](const nghttp2::asio_http2::client::response& resp){
+            RUSYNC_LOG(DEBUG) << "Performed " << method << " request to " << url_decode(uri) << ", response code: " << resp.status_code();
+            if (resp.status_code() != 200) {
+                return;
+            }
+            *ok = true;
+            if (receive_cb) {
+                on_full_data([receive_cb, request, completion, &stats, &download](std::vector<char> data) {
+                    stats.record_received(request, data.size());
+                    download.debit(data.size());
+                    CompletionScope scope {completion};
+                    receive_cb(std::move(data));
+                }, resp);
+            }
+        });
+        req->on_close([request, ok, span, release, &stats = m_stats, started = std::chrono::steady_clock::now()](uint32_t error_code) {
+            release();
+            stats.in_flight_requests.add(-1);
+            stats.record_request(request, *ok && error_code == 0, std::chrono::steady_clock::now() - started);
+            if (span) {
+                span->end(*ok && error_code == 0);
+            }
+        });
+    };
+    if (shaped_download(request)) {
+        admit_download(priority, file, std::move(submit));
+    } else {
+        admit(priority, file, std::move(submit));
+    }
+}
+
+Priority ServerAPI::request_priority(uint64_t body_size) {
+    return body_size >= BULK_BODY_SIZE ? Priority::BULK : current_priority();
+}
+
+nghttp2::asio_http2::client::priority_spec ServerAPI::stream_priority(Priority priority) {
+    // streams depend on root, so interactive stream gets most of bandwidth even if all bulk streams are open
+    return {0, priority == Priority::INTERACTIVE ? INTERACTIVE_WEIGHT : BULK_WEIGHT};
+}
+
+void ServerAPI::admit(Priority priority, const std::string& file, BulkLimiter::Submit submit) {
+    m_connection.bulk().submit(priority, [trace = Tracer::current_trace(), completion = current_completion(), submit = std::move(submit)](BulkLimiter::Release release) {
+        TraceScope scope {trace};
+        CompletionScope completion_scope {completion};
+        // request holds completion till it's released, i.e. till its stream is closed
+        submit([completion, release = std::move(release)]() {
+            release();
+        });
+    }, m_conf.root, file);
+}
+
+void ServerAPI::admit_download(Priority priority, const std::string& file, BulkLimiter::Submit submit) {
+    admit(priority, file, [this, priority, submit = std::move(submit)](BulkLimiter::Release release) mutable {
+        wait_download(m_bandwidth.download.open(priority), [submit = std::move(submit), release = std::move(release), completion = current_completion()]() mutable {
+            CompletionScope scope {completion};
+            submit(std::move(release));
+        });
     });
-    std::string uri = "http://" + m_conf.server_host + ":" + m_conf.server_port + path + "?" + url_encode(query_params);
-    boost::system::error_code ec;
-    const auto* req = m_session->submit(ec, method, uri, std::move(data));
-    if (!req) {
-        std::osyncstream(std::cerr) << "Failed to perform request for " << uri << ", reason: " << ec.message() << std::endl;
+}
+
+void ServerAPI::wait_download(uint64_t transfer, std::function<void()> start) {
+    const auto grant = m_bandwidth.download.acquire(transfer, RateLimiter::QUANTUM);
+    if (grant.bytes > 0) {
+        start();
         return;
     }
-    req->on_response([receive_cb, method, uri](const nghttp2::asio_http2::client::response& resp){
-        std::osyncstream(std::cout) << "Performed " << method << " request to " << nghttp2::asio_http2::percent_decode(uri) << ", response code: " << resp.status_code() << std::endl;
-        if (resp.status_code() != 200) {
+    auto timer = std::make_shared<boost::asio::steady_timer>(m_io_service, grant.retry_after);
+    timer->async_wait([this, timer, transfer, start = std::move(start), trace = Tracer::current_trace()](const boost::system::error_code& err) mutable {
+        if (err == boost::asio::error::operation_aborted) {
             return;
         }
-        if (receive_cb) {
-            on_full_data(receive_cb, resp);
-        }
+        TraceScope scope {trace};
+        wait_download(transfer, std::move(start));
     });
-    return;
+}
+
+const nghttp2::asio_http2::client::request* ServerAPI::submit_request(boost::system::error_code& ec, const std::string& method, const std::string& uri,
+                                                                      std::string data, nghttp2::asio_http2::header_map headers, Priority priority,
+                                                                      BulkLimiter::Release& release) {
+    if (data.empty() || !m_bandwidth.upload.limited()) {
+        return m_connection.session().submit(ec, method, uri, std::move(data), std::move(headers), stream_priority(priority));
+    }
+    return submit_request(ec, method, uri, body_generator(std::move(data)), std::move(headers), priority, release);
+}
+
+const nghttp2::asio_http2::client::request* ServerAPI::submit_request(boost::system::error_code& ec, const std::string& method, const std::string& uri,
+                                                                      nghttp2::asio_http2::generator_cb generator, nghttp2::asio_http2::header_map headers,
+                                                                      Priority priority, BulkLimiter::Release& release) {
+    if (!m_bandwidth.upload.limited()) {
+        return m_connection.session().submit(ec, method, uri, std::move(generator), std::move(headers), stream_priority(priority));
+    }
+    auto upload = std::make_shared<ShapedUpload>(m_io_service, m_bandwidth.upload, priority);
+    auto shaped = [upload, generator = std::move(generator)](uint8_t* buf, size_t len, uint32_t* data_flags) -> ssize_t {
+        const auto grant = upload->limiter.acquire(upload->transfer, len);
+        if (grant.bytes == 0) {
+            upload->timer.expires_after(grant.retry_after);
+            upload->timer.async_wait([upload](const boost::system::error_code& err) {
+                if (!err && !upload->closed && upload->req) {
+                    upload->req->resume();
+                }
+            });
+            return NGHTTP2_ERR_DEFERRED;
+        }
+        return generator(buf, grant.bytes, data_flags);
+    };
+    const auto* req = m_connection.session().submit(ec, method, uri, std::move(shaped), std::move(headers), stream_priority(priority));
+    upload->req = req;
+    release = [upload, release = std::move(release)]() {
+        upload->closed = true;
+        upload->timer.cancel();
+        upload->limiter.close(upload->transfer);
+        release();
+    };
+    return req;
+}
+
+bool ServerAPI::shaped_download(ClientStats::Request request) {
+    // meta is small and gates interactive patches, it's only debited
+    return request == ClientStats::GET_FILE || request == ClientStats::GET_RANGE || request == ClientStats::DESCRIPTION;
+}
 
+std::string ServerAPI::make_uri(const std::string& path, const QueryBuilder& query) const {
+    return rusync::make_uri(m_conf.server_host, m_conf.server_port, path, m_conf.key, query);
 }
 
 }
\ No newline at end of file
@@ -1,44 +1,56 @@
 #pragma once
+#include "Bandwidth.hpp"
+#include "BulkLimiter.hpp"
+#include "ClientStats.hpp"
 #include "Config.hpp"
+#include "Connection.hpp"
 #include "FileChunk.hpp"
 #include "boost/asio/io_service.hpp"
 #include <nghttp2/asio_http2_client.h>
 #include "DirEntry.hpp"
+#include "EntryTable.hpp"
 #include <functional>
+#include <memory>
+#include <optional>
 #include <vector>
 #include "Utils.hpp"
-#include "boost/date_time/posix_time/posix_time_duration.hpp"
+#include "TransferJournal.hpp"
 
 namespace rusync {
+class RequestSpan;
+
 /**
- * @brief Contains methods for work with remote server
+ * @brief Contains methods for work with remote server on behalf of one root, requests go to Connection shared by all roots.<br>
+ * Requests get priority of calling code (see PriorityScope), bodies of at least BULK_BODY_SIZE and ranges are always bulk.
+ * They also hold Completion of calling code till their streams are closed, and make it current for their callbacks.
+ * Priority is sent as HTTP/2 stream weight, and bulk requests are admitted by BulkLimiter of connection.<br>
+ * Request bodies are sent within upload limit of Bandwidth frame by frame. Received data is debited from download limit,
+ * and downloads of files, ranges and description wait while it's exhausted
  * 
  */
 class ServerAPI {
 public:
-    ServerAPI(const Config& conf, boost::asio::io_service& io_service);
-    ~ServerAPI();
-
     /**
-     * @brief Establishes tcp connection to server
-     * 
-     * @param io_service 
-     */
-    void create_session(boost::asio::io_service& io_service);
-    /**
-     * @brief schedule connection retry within CONNECTION_RETRY_TIMEOUT seconds
+     * @brief 
      * 
+     * @param conf config of root, its key is sent with requests
+     * @param connection shared with ServerAPI of other roots, bulk requests of roots are admitted by turns
      * @param io_service 
+     * @param stats 
+     * @param bandwidth 
      */
-    void retry_connection(boost::asio::io_service& io_service);
+    ServerAPI(const Config& conf, Connection& connection, boost::asio::io_service& io_service, ClientStats& stats, Bandwidth& bandwidth);
 
-    using GetFilesDescriptionCallback = std::function<void(std::set<DirEntry>)>;
+    using GetFilesDescriptionCallback = std::function<void(EntryTable)>;
     /**
-     * @brief Get the files description object as set of DirEntry and passes it into provided cb
+     * @brief Get the files description object as set of DirEntry and passes it into provided cb.<br>
+     * Server is asked for hash algorithm of config, table is hashed with XXH64 if server doesn't support it.
+     * Server is also asked for hashes of dirs, and subtrees equal to ones of local table come as pruned dirs without their entries
      * 
+     * @param local sorted table of local dir, its dirs are sent as subtree digests
      * @param cb 
      */
-    void get_files_description(GetFilesDescriptionCallback cb);
+    void get_files_description(const EntryTable& local, GetFilesDescriptionCallback cb);
 
     /**
      * @brief upload file to server
@@ -63,6 +75,12 @@ public:
      */
     void get_file(const std::string& path, GetFileCallback cb);
 
+    /**
+     * @brief called once patch is finished with version of file returned by server (empty if server doesn't report it), nullopt if patch failed or was rejected
+     * 
+     */
+    using PatchCallback = std::function<void(std::optional<std::string> version)>;
+
     /**
      * @brief uploads file patch to server
      * 
@@ -70,8 +88,12 @@ public:
      * @param offset - positon in bytes from which patch starts
      * @param data  - binary data to patch
      * @param end - if true - this is the last chunk, meaning that all data after that chunk will be truncated
+     * @param session - id of patch session. Server applies all patches of session atomically when patch with end == true is received
+     * @param version - if not empty, server rejects patch unless its file has this version (see ChunkShadows)
+     * @param cb - optional, called once patch is finished
      */
-    void upload_patch(const std::string& path, uint64_t offset, std::string data, bool end = false);
+    void upload_patch(const std::string& path, uint64_t offset, std::string data, bool end = false, const std::string& session = "",
+                      const std::string& version = "", PatchCallback cb = PatchCallback());
 
     /**
      * @brief remove file using path
@@ -80,10 +102,69 @@ public:
      */
     void remove_file(const std::string& path);
 
-    using GetMetaCallback = std::function<void(bool is_file, std::vector<FileChunk>)>;
+    /**
+     * @brief called with next portion of response body
+     * 
+     */
+    using DataCallback = std::function<void(const uint8_t* data, size_t len)>;
+    /**
+     * @brief called once request is finished. ok is false if server responded with error or stream was closed before response ended
+     * 
+     */
+    using DoneCallback = std::function<void(bool ok)>;
+
+    /**
+     * @brief uploads range of local file as part of ranged upload. Data is streamed from local file without loading it to memory
+     * 
+     * @param path path to file at server
+     * @param local_path path to local file
+     * @param offset offset of range within file
+     * @param length length of range
+     * @param size size of whole file
+     * @param transfer id of ranged upload, same for all ranges of file
+     * @param cb 
+     */
+    void upload_range(const std::string& path, const fs::path& local_path, uint64_t offset, uint64_t length, 
+                      uint64_t size, const std::string& transfer, DoneCallback cb);
 
     /**
-     * @brief Get the meta object from server and pass it as vector<FileChunk> to provided cb
+     * @brief appends data to file on server. Server rejects append if its copy of file is not offset bytes long
+     * 
+     * @param path - path to file on server
+     * @param offset - synced length of file, position of appended data
+     * @param data 
+     * @param cb called with false if append was rejected or failed
+     */
+    void append_file(const std::string& path, uint64_t offset, std::string data, DoneCallback cb);
+
+    using GetReceivedRangesCallback = std::function<void(std::vector<RangeSet::Range>)>;
+
+    /**
+     * @brief requests ranges which server already received for ranged upload, so interrupted upload can be resumed
+     * 
+     * @param path path to file at server
+     * @param transfer id of ranged upload
+     * @param size size of whole file
+     * @param cb called with received ranges, empty if server doesn't know transfer or request failed
+     */
+    void get_received_ranges(const std::string& path, const std::string& transfer, uint64_t size, GetReceivedRangesCallback cb);
+
+    /**
+     * @brief downloads range of remote file. Data is passed to data_cb as it arrives.<br>
+     * With download limit range is requested by pieces of SHAPED_RANGE_PIECE one after another, so each of them waits for limit
+     * 
+     * @param path path to file at server
+     * @param offset 
+     * @param length 
+     * @param data_cb 
+     * @param cb 
+     */
+    void get_range(const std::string& path, uint64_t offset, uint64_t length, DataCallback data_cb, DoneCallback cb);
+
+    using GetMetaCallback = std::function<void(bool is_file, std::vector<FileChunk>, HashAlgorithm algorithm)>;
+
+    /**
+     * @brief Get the meta object from server and pass it as vector<FileChunk> to provided cb, together with algorithm of chunk hashes
      * 
      * @param path 
      * @param cb 
@@ -98,45 +179,162 @@ public:
      */
     bool connected() const;
 
+    /**
+     * @brief bounds burst of data which single range request may receive beyond download limit
+     * 
+     */
+    static constexpr uint64_t SHAPED_RANGE_PIECE = 1 << 20;
+
 private:
     using ReceiveCb = std::function<void(std::vector<char>)>;
-    using QueryParamsMap = std::map<std::string, std::string>;
 
     /**
      * @brief convinient method for perfoming request wihout query params
      * 
+     * @param request request type for stats
      * @param path 
      * @param method 
      * @param receive_cb 
      */
-    void perform_http_request(const std::string& path, 
+    void perform_http_request(ClientStats::Request request,
+                              const std::string& path, 
                               const std::string& method,
                               ReceiveCb receive_cb = ReceiveCb());
 
     /**
      * @brief Performs actual HTTP/2 request and passes result as vector<char> to provided receive_cb
      * 
+     * @param request - request type for stats
      * @param path - http path (e.g. /files)
      * @param method - http method
-     * @param query - map of params in form of [key, value]
+     * @param file - synced path which request is about, requests of the same file are admitted in order. Empty if there is none
+     * @param query - params except key, which is added by make_uri
      * @param data - optional data for request
      * @param receive_cb 
      */
-    void perform_http_request(const std::string& path, 
+    void perform_http_request(ClientStats::Request request,
+                              const std::string& path, 
                               const std::string& method, 
-                              QueryParamsMap&& query = QueryParamsMap(),
+                              const std::string& file,
+                              QueryBuilder&& query = QueryBuilder(),
                               std::string data = "",
                               ReceiveCb receive_cb = ReceiveCb());
 
     
-    std::unique_ptr<nghttp2::asio_http2::client::session> m_session;
+    /**
+     * @brief builds request uri with key and provided params
+     * 
+     * @param path 
+     * @param query 
+     * @return std::string 
+     */
+    std::string make_uri(const std::string& path, const QueryBuilder& query) const;
+
+    /**
+     * @brief subscribes to response of req. cb is called exactly once: after last portion of data was passed to data_cb or on failure
+     * 
+     * @param req 
+     * @param request request type for stats
+     * @param method 
+     * @param uri 
+     * @param data_cb 
+     * @param cb 
+     * @param span trace span of request, ended together with it. nullptr if tracing is disabled
+     */
+    void stream_response(const nghttp2::asio_http2::client::request* req, ClientStats::Request request, const std::string& method, const std::string& uri,
+                         DataCallback data_cb, DoneCallback cb, std::shared_ptr<RequestSpan> span);
+
+    /**
+     * @brief 
+     * 
+     * @param body_size 
+     * @return Priority bulk if calling code does bulk work or body is large
+     */
+    static Priority request_priority(uint64_t body_size);
+
+    static nghttp2::asio_http2::client::priority_spec stream_priority(Priority priority);
+
+    /**
+     * @brief submits request through BulkLimiter, trace of calling code is restored if submit is delayed
+     * 
+     * @param priority 
+     * @param file synced path of request, interactive request doesn't overtake queued bulk ones of the same file
+     * @param submit 
+     */
+    void admit(Priority priority, const std::string& file, BulkLimiter::Submit submit);
+
+    /**
+     * @brief same as admit, but request is submitted once download limit lets it in
+     * 
+     * @param priority 
+     * @param file 
+     * @param submit 
+     */
+    void admit_download(Priority priority, const std::string& file, BulkLimiter::Submit submit);
+
+    /**
+     * @brief calls start once download limiter grants transfer its quantum, retries by timer until then
+     * 
+     * @param transfer 
+     * @param start 
+     */
+    void wait_download(uint64_t transfer, std::function<void()> start);
+
+    /**
+     * @brief submits request with body. Body is sent within upload limit if it's set, release is then extended to stop shaping of stream
+     * 
+     * @param ec 
+     * @param method 
+     * @param uri 
+     * @param data 
+     * @param headers 
+     * @param priority 
+     * @param release release of request, must be called once request is closed
+     * @return const nghttp2::asio_http2::client::request* nullptr if request wasn't submitted
+     */
+    const nghttp2::asio_http2::client::request* submit_request(boost::system::error_code& ec, const std::string& method, const std::string& uri,
+                                                               std::string data, nghttp2::asio_http2::header_map headers, Priority priority,
+                                                               BulkLimiter::Release& release);
+
+    const nghttp2::asio_http2::client::request* submit_request(boost::system::error_code& ec, const std::string& method, const std::string& uri,
+                                                               nghttp2::asio_http2::generator_cb generator, nghttp2::asio_http2::header_map headers,
+                                                               Priority priority, BulkLimiter::Release& release);
+
+    /**
+     * @brief 
+     * 
+     * @param request 
+     * @return true if request downloads file data and so waits for download limit
+     */
+    static bool shaped_download(ClientStats::Request request);
+
     const Config& m_conf;
+    Connection& m_connection;
+    /**
+     * @brief outlives ServerAPI, so it's safe to use from stream callbacks which may be called after ServerAPI is gone
+     * 
+     */
+    ClientStats& m_stats;
+    /**
+     * @brief shared by all workers and outlives them, same as m_stats
+     * 
+     */
+    Bandwidth& m_bandwidth;
+    boost::asio::io_service& m_io_service;
     const char* FILES_PATH = "/files";
     const char* DESCRIPTION_PATH = "/files_description";
     const char* META_PATH = "/meta";
-    bool m_connected = false;
-    const boost::posix_time::seconds CONNECTION_RETRY_TIMEOUT = boost::posix_time::seconds{2}; 
-    boost::asio::deadline_timer m_retry_timer;
+    /**
+     * @brief same as threshold of server's BULK io lane
+     * 
+     */
+    static constexpr uint64_t BULK_BODY_SIZE = 1'000'000;
+    /**
+     * @brief HTTP/2 weights (1..256), stream shares bandwidth with its siblings in proportion to weight
+     * 
+     */
+    static constexpr int32_t INTERACTIVE_WEIGHT = 256;
+    static constexpr int32_t BULK_WEIGHT = 1;
 };
 }
 
@@ -0,0 +1,342 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Completion.hpp"
+#include "Logger.hpp"
+#include "Priority.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Work-stealing scheduler over per-key serial queues (strands).<br>
+ * Tasks posted with the same key are executed one after another in FIFO order, tasks with different keys may run in parallel.<br>
+ * Every strand is first queued on its home executor (hash(key) % size), but idle executors steal ready strands from the back of busy ones,
+ * so one hot key or one long task doesn't leave the other executors idle.
+ * A strand is owned by exactly one executor while it has a task running, the next task of that strand is picked only after the previous one finished.
+ * Task runs with its own Completion, and it's finished once all copies of it are released, so work the task started asynchronously
+ * (e.g. requests, which may go through connections of other executors) is done before the next task of strand starts.<br>
+ * Ready strands are queued by priority: executors take (and steal) interactive strands before any bulk one. Strand with interactive task
+ * is interactive as a whole, so interactive task posted after bulk ones of the same key waits only for them, not for bulk work of other keys.
+ * Bulk work is not picked while interactive work is ready, which is fine as long as interactive work is small.<br>
+ * Strands belong to groups (e.g. synced roots), within priority executors take ready strands of groups in turn, so group with
+ * thousands of queued strands doesn't hold back the others
+ */
+class StrandScheduler {
+public:
+    /**
+     * @brief Scheduled task, receives index of executor which runs it
+     *
+     */
+    using Task = std::function<void(size_t executor)>;
+    using Handler = std::function<void()>;
+
+    /**
+     * @brief Posts provided handler for execution on executor with given index (e.g. into worker's io_service)
+     *
+     */
+    using Dispatch = std::function<void(size_t executor, Handler handler)>;
+
+    /**
+     * @brief Construct a new Strand Scheduler object
+     *
+     * @param size number of executors
+     * @param dispatch
+     */
+    StrandScheduler(size_t size, Dispatch dispatch) :
+        m_dispatch {std::move(dispatch)},
+        m_executors(std::max<size_t>(size, 1))
+    {
+
+    }
+
+    /**
+     * @brief post task which should be executed in order with all other tasks of the same key
+     *
+     * @param key unique across groups
+     * @param task
+     * @param priority
+     * @param group
+     */
+    void post(const std::string& key, Task task, Priority priority = Priority::INTERACTIVE, size_t group = 0) {
+        std::unique_lock lock {m_mutex};
+        auto& strand = m_strands[key];
+        if (!strand) {
+            strand = std::make_shared<Strand>();
+            strand->key = key;
+            strand->group = group;
+        }
+        strand->add(std::move(task), priority);
+        m_pending++;
+        if (!strand->scheduled) {
+            strand->scheduled = true;
+            enqueue(strand, std::hash<std::string>{}(key) % m_executors.size(), lock);
+        } else if (!strand->running && strand->queued != strand->priority()) {
+            promote(strand);
+        }
+    }
+
+    /**
+     * @brief post task without ordering requirements
+     *
+     * @param task
+     * @param priority
+     * @param group
+     */
+    void post(Task task, Priority priority = Priority::INTERACTIVE, size_t group = 0) {
+        std::unique_lock lock {m_mutex};
+        auto strand = std::make_shared<Strand>();
+        strand->group = group;
+        strand->add(std::move(task), priority);
+        strand->scheduled = true;
+        m_pending++;
+        enqueue(strand, m_next_executor++ % m_executors.size(), lock);
+    }
+
+    /**
+     * @brief executors are gone (e.g. their threads are stopped), so strands whose completions are released afterwards are not queued anymore
+     *
+     */
+    void stop() {
+        std::lock_guard lock {m_mutex};
+        m_stopped = true;
+    }
+
+    /**
+     * @brief number of tasks which are queued but not started yet
+     *
+     * @return size_t
+     */
+    size_t pending() const {
+        std::lock_guard lock {m_mutex};
+        return m_pending;
+    }
+
+private:
+    struct Strand {
+        void add(Task task, Priority priority) {
+            tasks.emplace_back(std::move(task), priority);
+            interactive += priority == Priority::INTERACTIVE;
+        }
+
+        Priority priority() const {
+            return interactive > 0 ? Priority::INTERACTIVE : Priority::BULK;
+        }
+
+        std::string key;
+        size_t group = 0;
+        std::deque<std::pair<Task, Priority>> tasks;
+        /**
+         * @brief number of interactive tasks in tasks
+         *
+         */
+        size_t interactive = 0;
+        /**
+         * @brief true if strand is queued on some executor or its task is running right now
+         *
+         */
+        bool scheduled = false;
+        bool running = false;
+        /**
+         * @brief executor and queue which hold strand while it's scheduled but not running
+         *
+         */
+        size_t executor = 0;
+        Priority queued = Priority::INTERACTIVE;
+    };
+
+    /**
+     * @brief ready strands of one priority by group, groups are served in turn
+     *
+     */
+    struct Ready {
+        void push(std::shared_ptr<Strand> strand) {
+            if (strand->group >= groups.size()) {
+                groups.resize(strand->group + 1);
+            }
+            groups[strand->group].push_back(std::move(strand));
+            size++;
+        }
+
+        void erase(const std::shared_ptr<Strand>& strand) {
+            auto& group = groups[strand->group];
+            group.erase(std::find(group.begin(), group.end(), strand));
+            size--;
+        }
+
+        /**
+         * @brief
+         *
+         * @param back true to take from the back (stealing), oldest strand is taken otherwise
+         * @return std::shared_ptr<Strand> strand of next group which has any
+         */
+        std::shared_ptr<Strand> take(bool back) {
+            for (size_t i = 0; i < groups.size(); i++) {
+                const size_t index = (next + i) % groups.size();
+                auto& group = groups[index];
+                if (group.empty()) {
+                    continue;
+                }
+                auto strand = std::move(back ? group.back() : group.front());
+                back ? group.pop_back() : group.pop_front();
+                next = index + 1;
+                size--;
+                return strand;
+            }
+            return nullptr;
+        }
+
+        std::vector<std::deque<std::shared_ptr<Strand>>> groups;
+        size_t next = 0;
+        size_t size = 0;
+    };
+
+    struct Executor {
+        /**
+         * @brief ready strands by priority
+         *
+         */
+        std::array<Ready, PRIORITIES> ready;
+        /**
+         * @brief true if run() is posted to or is being executed by executor
+         *
+         */
+        bool active = false;
+    };
+
+    /**
+     * @brief queue ready strand. If preferred executor is busy while some other is idle - idle one takes the strand
+     *
+     * @param strand
+     * @param preferred
+     * @param lock
+     */
+    void enqueue(std::shared_ptr<Strand> strand, size_t preferred, std::unique_lock<std::mutex>& lock) {
+        size_t target = preferred;
+        if (m_executors[target].active) {
+            for (size_t i = 0; i < m_executors.size(); i++) {
+                if (!m_executors[i].active) {
+                    target = i;
+                    break;
+                }
+            }
+        }
+        push(std::move(strand), target);
+        if (!m_executors[target].active) {
+            m_executors[target].active = true;
+            lock.unlock();
+            m_dispatch(target, [this, target]() { run(target); });
+        }
+    }
+
+    void push(std::shared_ptr<Strand> strand, size_t index) {
+        strand->executor = index;
+        strand->queued = strand->priority();
+        m_executors[index].ready[static_cast<size_t>(strand->queued)].push(std::move(strand));
+    }
+
+    /**
+     * @brief moves queued bulk strand which got interactive task into interactive queue of the same executor
+     *
+     * @param strand
+     */
+    void promote(const std::shared_ptr<Strand>& strand) {
+        m_executors[strand->executor].ready[static_cast<size_t>(strand->queued)].erase(strand);
+        push(strand, strand->executor);
+    }
+
+    /**
+     * @brief takes strand of the highest priority: from own queue or steals one from the back of the longest queue of other executors
+     *
+     * @param index
+     * @return std::shared_ptr<Strand> nullptr if there is nothing to do
+     */
+    std::shared_ptr<Strand> take(size_t index) {
+        for (size_t priority = 0; priority < PRIORITIES; priority++) {
+            auto& own = m_executors[index].ready[priority];
+            if (own.size > 0) {
+                return own.take(false);
+            }
+            Ready* victim = nullptr;
+            for (auto& executor: m_executors) {
+                auto& ready = executor.ready[priority];
+                if (ready.size > 0 && (!victim || ready.size > victim->size)) {
+                    victim = &ready;
+                }
+            }
+            if (victim) {
+                return victim->take(true);
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief executes single task and reposts itself, so other handlers of executor (e.g. network callbacks) are not starved
+     *
+     * @param index
+     */
+    void run(size_t index) {
+        std::unique_lock lock {m_mutex};
+        auto strand = take(index);
+        if (!strand) {
+            m_executors[index].active = false;
+            return;
+        }
+        m_pending--;
+        Task task = std::move(strand->tasks.front().first);
+        strand->interactive -= strand->tasks.front().second == Priority::INTERACTIVE;
+        strand->tasks.pop_front();
+        strand->running = true;
+        lock.unlock();
+        {
+            CompletionScope completion {make_completion([this, strand, index]() {
+                finish(strand, index);
+            })};
+            try {
+                task(index);
+            } catch (const std::exception& err) {
+                RUSYNC_LOG(ERROR) << "Exception occured in scheduled task: " << err.what();
+            }
+        }
+        m_dispatch(index, [this, index]() { run(index); });
+    }
+
+    /**
+     * @brief called once completion of task of strand is released, queues strand again if it has more tasks
+     *
+     * @param strand
+     * @param index executor which ran the task
+     */
+    void finish(std::shared_ptr<Strand> strand, size_t index) {
+        std::unique_lock lock {m_mutex};
+        if (m_stopped) {
+            return;
+        }
+        strand->running = false;
+        if (!strand->tasks.empty()) {
+            enqueue(std::move(strand), index, lock);
+        } else {
+            strand->scheduled = false;
+            if (!strand->key.empty()) {
+                m_strands.erase(strand->key);
+            }
+        }
+    }
+
+    Dispatch m_dispatch;
+    mutable std::mutex m_mutex;
+    std::vector<Executor> m_executors;
+    std::unordered_map<std::string, std::shared_ptr<Strand>> m_strands;
+    size_t m_next_executor = 0;
+    size_t m_pending = 0;
+    bool m_stopped = false;
+};
+}
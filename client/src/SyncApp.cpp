@@ -1,14 +1,29 @@
 #include "SyncApp.hpp"
+#include <ctime>
 
 namespace rusync {
 SyncApp::SyncApp(const Config& config) :
     m_conf{config}, 
-    m_worker_pool {m_conf, std::max(1u, (unsigned)std::thread::hardware_concurrency())}, 
-    m_resync_timer{m_service, boost::posix_time::seconds{10}} {
+    m_worker_pool {m_conf, std::max(1u, (unsigned)std::thread::hardware_concurrency()), m_stats, m_bandwidth}, 
+    m_resync_timer{m_service, boost::posix_time::seconds{10}},
+    m_stats_timer{m_service},
+    m_bandwidth_timer{m_service},
+    m_stats_signal{m_service, SIGUSR1} {
 
+    apply_bandwidth_schedule();
     m_file_watcher = std::make_unique<efsw::FileWatcher>();
-    m_file_watcher->addWatch(config.path, this, true);
+    for (size_t root = 0; root < m_conf.roots.size(); root++) {
+        m_ignore.push_back(IgnoreRules::load(m_conf.roots[root].path));
+        const auto watch = m_file_watcher->addWatch(m_conf.roots[root].path.string(), this, true);
+        if (watch < 0) {
+            RUSYNC_LOG(ERROR) << "Failed to watch " << m_conf.roots[root].path << ": " << efsw::Errors::Log::getLastErrorLog();
+            continue;
+        }
+        m_watches[watch] = root;
+    }
     m_file_watcher->watch();
+    schedule_stats_export();
+    wait_stats_signal();
     full_sync();
     m_service.run();
 }
@@ -18,33 +33,126 @@ void SyncApp::full_sync() {
         m_service.stop();
         return;
     }
-    m_worker_pool.post_operation<Worker::INITIAL_SYNC>();
+    for (size_t root = 0; root < m_conf.roots.size(); root++) {
+        m_worker_pool.post_operation<Worker::INITIAL_SYNC>(root);
+    }
     m_resync_timer.async_wait([this](const boost::system::error_code&){
         m_resync_timer.expires_at(m_resync_timer.expires_at() + boost::posix_time::seconds{10});
         full_sync();
     });
 }
 
+void SyncApp::schedule_stats_export() {
+    m_stats_timer.expires_from_now(STATS_EXPORT_INTERVAL);
+    m_stats_timer.async_wait([this](const boost::system::error_code& err) {
+        if (err == boost::asio::error::operation_aborted) {
+            return;
+        }
+        export_stats();
+        schedule_stats_export();
+    });
+}
+
+void SyncApp::apply_bandwidth_schedule() {
+    const std::time_t now = std::time(nullptr);
+    std::tm local {};
+    localtime_r(&now, &local);
+    const auto limits = m_conf.bandwidth.at(local.tm_hour * 60 + local.tm_min);
+    if (limits != m_bandwidth.limits()) {
+        RUSYNC_LOG(INFO) << "Bandwidth limits (bytes/s, 0 - unlimited): upload " << limits.upload << ", download " << limits.download;
+        m_bandwidth.apply(limits);
+    }
+    m_bandwidth_timer.expires_from_now(BANDWIDTH_SCHEDULE_INTERVAL);
+    m_bandwidth_timer.async_wait([this](const boost::system::error_code& err) {
+        if (err == boost::asio::error::operation_aborted) {
+            return;
+        }
+        apply_bandwidth_schedule();
+    });
+}
+
+void SyncApp::wait_stats_signal() {
+    m_stats_signal.async_wait([this](const boost::system::error_code& err, int /*signal*/) {
+        if (err == boost::asio::error::operation_aborted) {
+            return;
+        }
+        std::osyncstream(std::cout) << export_stats() << std::endl;
+        wait_stats_signal();
+    });
+}
+
+std::string SyncApp::export_stats() {
+    auto stats = m_stats.to_json(m_worker_pool.pending(), m_modified_timers.size());
+    std::error_code ec;
+    fs::create_directories(m_conf.path / INTERNAL_DIR, ec);
+    const fs::path path = m_conf.path / INTERNAL_DIR / STATS_FILE;
+    const fs::path tmp_path = fs::path(path) += ".tmp";
+    {
+        std::ofstream file {tmp_path, std::ios::trunc};
+        file << stats;
+    }
+    fs::rename(tmp_path, path, ec);
+    if (ec) {
+        RUSYNC_LOG(ERROR) << "Failed to save stats to " << path << ": " << ec.message();
+    }
+    return stats;
+}
+
+void SyncApp::schedule_modified(size_t root, const fs::path& path) {
+    boost::asio::post(m_service, [this, root, path]() {
+        auto& timer = m_modified_timers[{root, path}];
+        if (!timer) {
+            timer = std::make_unique<boost::asio::deadline_timer>(m_service);
+        }
+        timer->expires_from_now(MODIFY_DEBOUNCE_TIMEOUT);
+        timer->async_wait([this, root, path](const boost::system::error_code& err) {
+            if (err == boost::asio::error::operation_aborted) {
+                return;
+            }
+            m_modified_timers.erase({root, path});
+            m_worker_pool.post_operation<Worker::MODIFIED>(root, path);
+        });
+    });
+}
+
 void SyncApp::handleFileAction( efsw::WatchID watchid, const std::string& dir, const std::string& filename, efsw::Action action, std::string oldFilename ) {
+    const auto watch = m_watches.find(watchid);
+    if (watch == m_watches.end()) {
+        return;
+    }
+    const size_t root = watch->second;
+    const fs::path& root_path = m_conf.roots[root].path;
+    const fs::path truncated_path = truncate_path(fs::path(dir) / filename, root_path);
+    if (!truncated_path.empty() && *truncated_path.begin() == INTERNAL_DIR) {
+        return;
+    }
+    std::error_code ec;
+    if (truncated_path == IGNORE_FILE) {
+        // ignore file itself is synced, so server applies the same rules
+        m_ignore[root] = IgnoreRules::load(root_path);
+    } else if (m_ignore[root].ignored(truncated_path.native(), fs::is_directory(root_path / truncated_path, ec))) {
+        RUSYNC_LOG(TRACE) << "Ignoring event for " << truncated_path;
+        return;
+    }
     switch( action )
     {
     case efsw::Actions::Add:
-        std::osyncstream(std::cout) << "DIR (" << dir << ") FILE (" << filename << ") has event Added" << std::endl;
-        m_worker_pool.post_operation<Worker::ADDED>(truncate_path(fs::path(dir) / filename, m_conf.path));
+        RUSYNC_LOG(DEBUG) << "DIR (" << dir << ") FILE (" << filename << ") has event Added";
+        m_worker_pool.post_operation<Worker::ADDED>(root, truncated_path);
         break;
     case efsw::Actions::Delete:
-        std::osyncstream(std::cout) << "DIR (" << dir << ") FILE (" << filename << ") has event Delete" << std::endl;
-        m_worker_pool.post_operation<Worker::REMOVED>(truncate_path(fs::path(dir) / filename, m_conf.path));
+        RUSYNC_LOG(DEBUG) << "DIR (" << dir << ") FILE (" << filename << ") has event Delete";
+        m_worker_pool.post_operation<Worker::REMOVED>(root, truncated_path);
         break;
     case efsw::Actions::Modified:
-        std::osyncstream(std::cout) << "DIR (" << dir << ") FILE (" << filename << ") has event Modified" << std::endl;
-        m_worker_pool.post_operation<Worker::MODIFIED>(truncate_path(fs::path(dir) / filename, m_conf.path));
+        RUSYNC_LOG(DEBUG) << "DIR (" << dir << ") FILE (" << filename << ") has event Modified";
+        schedule_modified(root, truncated_path);
         break;
     case efsw::Actions::Moved:
-            std::osyncstream(std::cout) << "DIR (" << dir << ") FILE (" << filename << ") has event Moved from (" << oldFilename << ")" << std::endl;
+            RUSYNC_LOG(DEBUG) << "DIR (" << dir << ") FILE (" << filename << ") has event Moved from (" << oldFilename << ")";
         break;
     default:
-        std::osyncstream(std::cout) << "Should never happen!" << std::endl;
+        RUSYNC_LOG(ERROR) << "Should never happen!";
     }
 }   
 }
\ No newline at end of file
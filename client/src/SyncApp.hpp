@@ -1,9 +1,16 @@
 #pragma once
+#include "Bandwidth.hpp"
+#include "ClientStats.hpp"
 #include "Config.hpp"
+#include "IgnoreRules.hpp"
 #include "WorkerPool.hpp"
 #include "efsw/efsw.hpp"
+#include <iostream>
 #include <syncstream>
 #include <boost/asio.hpp>
+#include <map>
+#include <utility>
+#include <vector>
 
 
 namespace rusync {
@@ -35,11 +42,73 @@ public:
      */
     void handleFileAction( efsw::WatchID watchid, const std::string& dir, const std::string& filename, efsw::Action action, std::string oldFilename ) override;
 private:
+    /**
+     * @brief defers modify operation for MODIFY_DEBOUNCE_TIMEOUT, so burst of events for the same file results in single patch upload.<br>
+     * Debouncing is done here and not within Worker since operations for the same path could be executed by different workers
+     * 
+     * @param root index of root within Config::roots
+     * @param path 
+     */
+    void schedule_modified(size_t root, const fs::path& path);
+
+    /**
+     * @brief writes stats as JSON to STATS_FILE within INTERNAL_DIR every STATS_EXPORT_INTERVAL
+     * 
+     */
+    void schedule_stats_export();
+
+    /**
+     * @brief prints stats as JSON to stdout (and also saves them to STATS_FILE) on every SIGUSR1
+     * 
+     */
+    void wait_stats_signal();
+
+    /**
+     * @brief atomically replaces STATS_FILE with current stats
+     * 
+     * @return std::string stats as JSON
+     */
+    std::string export_stats();
+
+    /**
+     * @brief applies limits of bandwidth schedule for current local time, then again every BANDWIDTH_SCHEDULE_INTERVAL
+     * 
+     */
+    void apply_bandwidth_schedule();
+
     Config m_conf;
+    /**
+     * @brief rules of IGNORE_FILE of each root, events of ignored paths are dropped. Used only by watcher thread, reloaded once ignore file changes
+     * 
+     */
+    std::vector<IgnoreRules> m_ignore;
+    ClientStats m_stats;
+    Bandwidth m_bandwidth;
+    /**
+     * @brief uses stats and bandwidth, so it's declared after them
+     * 
+     */
     WorkerPool m_worker_pool;
     std::unique_ptr<efsw::FileWatcher> m_file_watcher;
+    /**
+     * @brief root of each watch, filled before watcher is started
+     * 
+     */
+    std::map<efsw::WatchID, size_t> m_watches;
     boost::asio::io_service m_service;
     boost::asio::deadline_timer m_resync_timer;
+    boost::asio::deadline_timer m_stats_timer;
+    boost::asio::deadline_timer m_bandwidth_timer;
+    boost::asio::signal_set m_stats_signal;
+    /**
+     * @brief list of deffered timers for modify operation by root and path
+     * 
+     */
+    std::map<std::pair<size_t, fs::path>, std::unique_ptr<boost::asio::deadline_timer>> m_modified_timers;
+    const boost::posix_time::seconds MODIFY_DEBOUNCE_TIMEOUT = boost::posix_time::seconds{2};
+    const boost::posix_time::seconds STATS_EXPORT_INTERVAL = boost::posix_time::seconds{30};
+    const boost::posix_time::seconds BANDWIDTH_SCHEDULE_INTERVAL = boost::posix_time::seconds{60};
+    const char* STATS_FILE = "stats.json";
 
 };
 }
\ No newline at end of file
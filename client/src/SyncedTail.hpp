@@ -0,0 +1,179 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <xxhash.h>
+
+namespace rusync {
+
+/**
+ * @brief What client knows about content of file which was synced to server: its length and hashes of small windows at start of file and before its end.<br>
+ * Used to upload growing files (logs, journals) by appending only new bytes: if file wasn't replaced, didn't shrink and both windows are unchanged,
+ * synced prefix is considered unchanged without rehashing it. In-place rewrites between the windows aren't detected and server accepts append by length alone,
+ * so after VERIFY_EVERY appends file is synced by regular patch, which compares whole content and catches such rewrites up.
+ * Server rejects append if its copy has other length, then client falls back to regular patch too
+ */
+struct SyncedTail {
+    static constexpr uint64_t HEAD_WINDOW = 4096;
+    static constexpr uint64_t TAIL_WINDOW = 65536;
+    /**
+     * @brief appended data is sent by single request, larger appends are synced by regular patch
+     *
+     */
+    static constexpr uint64_t MAX_APPEND = 64'000'000;
+    static constexpr uint32_t VERIFY_EVERY = 64;
+
+    uint64_t length;
+    ino_t inode;
+    uint64_t head_hash;
+    uint64_t tail_hash;
+    /**
+     * @brief appends since whole file was last uploaded or patched
+     *
+     */
+    uint32_t appends = 0;
+
+    bool needs_verify() const {
+        return appends >= VERIFY_EVERY;
+    }
+
+    /**
+     * @brief captures first length bytes of file
+     *
+     * @param fd opened file
+     * @param length synced length, should not exceed file size
+     * @return std::optional<SyncedTail> nullopt if file could not be read
+     */
+    static std::optional<SyncedTail> from_fd(int fd, uint64_t length) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return std::nullopt;
+        }
+        const auto head = hash_window(fd, 0, std::min(length, HEAD_WINDOW));
+        const auto tail = hash_window(fd, length - std::min(length, TAIL_WINDOW), std::min(length, TAIL_WINDOW));
+        if (!head || !tail) {
+            return std::nullopt;
+        }
+        return SyncedTail{length, st.st_ino, *head, *tail};
+    }
+
+    /**
+     * @brief checks that file still starts with synced content, reads at most HEAD_WINDOW + TAIL_WINDOW bytes
+     *
+     * @param fd opened file
+     * @return true if data after length could be appended to server's copy
+     */
+    bool prefix_of(int fd) const {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_ino != inode || static_cast<uint64_t>(st.st_size) < length) {
+            return false;
+        }
+        const auto current = from_fd(fd, length);
+        return current && current->head_hash == head_hash && current->tail_hash == tail_hash;
+    }
+
+    /**
+     * @brief reads length bytes at offset, retrying short reads
+     *
+     * @param fd
+     * @param offset
+     * @param length
+     * @return std::optional<std::string> nullopt if file is shorter or read failed
+     */
+    static std::optional<std::string> read(int fd, uint64_t offset, uint64_t length) {
+        std::string buffer;
+        buffer.resize(length);
+        uint64_t done = 0;
+        while (done < length) {
+            const auto result = pread(fd, buffer.data() + done, length - done, offset + done);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            }
+            if (result <= 0) {
+                return std::nullopt;
+            }
+            done += result;
+        }
+        return buffer;
+    }
+
+private:
+    static std::optional<uint64_t> hash_window(int fd, uint64_t offset, uint64_t length) {
+        const auto data = read(fd, offset, length);
+        if (!data) {
+            return std::nullopt;
+        }
+        return XXH64(data->data(), data->size(), 0);
+    }
+};
+
+/**
+ * @brief SyncedTail of files uploaded by client, shared by all workers since operations for the same path could be executed by any of them.
+ * At most MAX_TAILS files are kept, least recently used ones are dropped first (their next change is synced by regular patch)
+ */
+class SyncedTails {
+public:
+    static constexpr size_t MAX_TAILS = 65536;
+
+    explicit SyncedTails(size_t max_tails = MAX_TAILS) : m_max_tails {max_tails} {
+
+    }
+
+    std::optional<SyncedTail> get(const std::string& path) {
+        std::lock_guard lock {m_mutex};
+        const auto it = m_tails.find(path);
+        if (it == m_tails.end()) {
+            return std::nullopt;
+        }
+        m_order.splice(m_order.begin(), m_order, it->second.second);
+        return it->second.first;
+    }
+
+    void set(const std::string& path, const SyncedTail& tail) {
+        std::lock_guard lock {m_mutex};
+        const auto it = m_tails.find(path);
+        if (it != m_tails.end()) {
+            it->second.first = tail;
+            m_order.splice(m_order.begin(), m_order, it->second.second);
+            return;
+        }
+        if (m_tails.size() >= m_max_tails) {
+            m_tails.erase(m_order.back());
+            m_order.pop_back();
+        }
+        m_order.push_front(path);
+        m_tails.emplace(path, std::make_pair(tail, m_order.begin()));
+    }
+
+    void erase(const std::string& path) {
+        std::lock_guard lock {m_mutex};
+        const auto it = m_tails.find(path);
+        if (it != m_tails.end()) {
+            m_order.erase(it->second.second);
+            m_tails.erase(it);
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard lock {m_mutex};
+        return m_tails.size();
+    }
+
+private:
+    const size_t m_max_tails;
+    mutable std::mutex m_mutex;
+    /**
+     * @brief paths from most to least recently used
+     *
+     */
+    std::list<std::string> m_order;
+    std::unordered_map<std::string, std::pair<SyncedTail, std::list<std::string>::iterator>> m_tails;
+};
+}
@@ -1,202 +1,476 @@
 #include "Worker.hpp"
+#include "ChunkDiff.hpp"
+#include "Completion.hpp"
+#include "RangedTransfer.hpp"
+#include "ReadEngine.hpp"
+#include <fcntl.h>
+#include <unistd.h>
 
 
 namespace rusync {
 
 namespace fs = std::filesystem;
 
-Worker::Worker(const Config& conf) : 
-m_thread{m_io_service}, m_conf {conf} {
+Worker::Worker(const Config& conf, ClientStats& stats, Bandwidth& bandwidth, SyncedTails& tails, std::atomic<HashAlgorithm>& hash_algorithm, WorkerThread& thread, Repost repost) : 
+m_conf {conf}, m_stats {stats}, m_bandwidth {bandwidth}, m_tails {tails}, m_hash_algorithm {hash_algorithm}, m_shadows {m_conf.path / INTERNAL_DIR / "shadows"},
+m_thread {thread}, m_io_service {thread.io_service()}, m_repost {std::move(repost)} {
     boost::asio::post(m_io_service, [this]() {
-        m_api = std::make_unique<ServerAPI>(m_conf, m_io_service);
+        m_api = std::make_unique<ServerAPI>(m_conf, m_thread.connection(), m_io_service, m_stats, m_bandwidth);
     });
 }
 
-Worker::~Worker() {
-    m_io_service.stop();
-}
-
 
 void Worker::file_added(const fs::path& path) {
     if (!fs::exists(m_conf.path / path)) {
-        std::osyncstream(std::cout) << "File " << path << " was added, but now seems like it's gone" << std::endl;
+        RUSYNC_LOG(DEBUG) << "File " << path << " was added, but now seems like it's gone";
         return;
     }
     if (fs::is_regular_file(m_conf.path / path)) {
-        std::osyncstream(std::cout) << "File " << path << " was added, uploading it to server" << std::endl;
+        RUSYNC_LOG(DEBUG) << "File " << path << " was added, uploading it to server";
         upload_file(path);
     } else if (fs::is_directory(m_conf.path / path)) {
+        // tree of files (e.g. copied or unpacked) must not hold back edits of other files
+        PriorityScope bulk {Priority::BULK};
         m_api->upload_dir(path);
-        for (const auto& entry: fs::recursive_directory_iterator(m_conf.path / path)) {
+        std::vector<fs::path> files;
+        const auto ignore = IgnoreRules::load(m_conf.path);
+        for (auto it = fs::recursive_directory_iterator(m_conf.path / path); it != fs::recursive_directory_iterator(); it++) {
+            const auto& entry = *it;
             fs::path truncated_path = truncate_path(entry.path(), m_conf.path);
+            if (ignore.ignored_entry(truncated_path.native(), entry.is_directory())) {
+                if (entry.is_directory()) {
+                    it.disable_recursion_pending();
+                }
+                continue;
+            }
             if (entry.is_regular_file()) {
-                std::osyncstream(std::cout) << "File " << path << " was added, uploading it to server" << std::endl;
-                upload_file(truncated_path);
+                RUSYNC_LOG(DEBUG) << "File " << truncated_path << " was added, uploading it to server";
+                files.push_back(std::move(truncated_path));
             } else if (entry.is_directory()) {
                 m_api->upload_dir(truncated_path);
             }
         }
+        upload_files(files);
     }
 }
 
 void Worker::file_removed(const fs::path& path) {
+    m_tails.erase(path.string());
+    m_shadows.remove(path.string());
     m_api->remove_file(path);
 }
 
 void Worker::file_modified(const fs::path& path) {
-    if (!fs::exists(m_conf.path / path)) {
-        std::osyncstream(std::cout) << "File " << path << " was modified, but now seems like it's gone" << std::endl;
+    if (!fs::is_regular_file(m_conf.path / path)) {
+        RUSYNC_LOG(DEBUG) << "File " << path << " was modified, but now seems like it's gone";
         return;
     }
-    if (!m_modified_timer[path]) {
-        m_modified_timer[path] = std::make_unique<boost::asio::deadline_timer>(m_io_service, boost::posix_time::seconds{2});
+    RUSYNC_LOG(DEBUG) << "File " << path << " was modified";
+    if (upload_appended(path)) {
+        return;
     }
-    m_modified_timer[path]->expires_from_now(boost::posix_time::seconds{2});
-    m_modified_timer[path]->async_wait([this, path](const boost::system::error_code& err){
-        if (err == boost::asio::error::operation_aborted) {
-            return;
+    const auto entry = DirEntry::from_path(m_conf.path / path, m_conf.path, m_hash_algorithm);
+    m_stats.record_hashed(entry.size);
+    upload_patch(entry);
+}
+
+void Worker::upload_file(const fs::path& path) {
+    upload_files({path});
+}
+
+void Worker::upload_files(const std::vector<fs::path>& paths) {
+    std::vector<fs::path> small_files;
+    std::vector<fs::path> full_paths;
+    for (const auto& path: paths) {
+        m_shadows.remove(path.string());
+        std::error_code ec;
+        const auto size = fs::file_size(m_conf.path / path, ec);
+        if (!ec && size >= RangedTransfer::THRESHOLD) {
+            upload_file_ranged(path, size);
+            continue;
         }
-        if (!fs::is_regular_file(m_conf.path / path)) {
+        small_files.push_back(path);
+        full_paths.push_back(m_conf.path / path);
+    }
+    // small files are read together by ReadEngine, each one is uploaded as soon as it's read
+    std::map<size_t, std::string> buffers;
+    ReadEngine::acquire()->read_files(full_paths, ReadEngine::BUFFER_SIZE, [&buffers](size_t file, uint64_t, const char* data, size_t size) {
+        buffers[file].append(data, size);
+    }, [this, &buffers, &small_files, &full_paths](size_t file, bool ok) {
+        std::string buffer = std::move(buffers[file]);
+        buffers.erase(file);
+        if (!ok) {
             return;
         }
-        std::osyncstream(std::cout) << "File " << path << " was modified" << std::endl;
-        const auto entry = DirEntry::from_path(m_conf.path / path, m_conf.path);
-        upload_patch(entry);
-        m_modified_timer.erase(path);
+        const auto& path = small_files[file];
+        m_stats.record_upload_file(buffer.size());
+        const int fd = open(full_paths[file].c_str(), O_RDONLY);
+        if (fd >= 0) {
+            remember_tail(path, fd, buffer.size());
+            close(fd);
+        }
+        m_api->upload_file(std::move(buffer), path);
     });
 }
 
-void Worker::upload_file(const fs::path& path) {
-    std::ifstream file {m_conf.path / path, std::ios::binary};
-    if (!file.is_open()) {
+bool Worker::upload_appended(const fs::path& path) {
+    const auto tail = m_tails.get(path.string());
+    if (!tail) {
+        return false;
+    }
+    const int fd = open((m_conf.path / path).c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        m_tails.erase(path.string());
+        return false;
+    }
+    const uint64_t size = st.st_size;
+    std::optional<std::string> appended;
+    if (!tail->needs_verify() && size > tail->length && size - tail->length <= SyncedTail::MAX_APPEND && tail->prefix_of(fd)) {
+        appended = SyncedTail::read(fd, tail->length, size - tail->length);
+    }
+    if (!appended) {
+        close(fd);
+        m_tails.erase(path.string());
+        return false;
+    }
+    // next append may be posted before this one is finished, so it continues from new length
+    remember_tail(path, fd, size, tail->appends + 1);
+    // append changes version of server's file
+    m_shadows.remove(path.string());
+    close(fd);
+    RUSYNC_LOG(DEBUG) << "Appending " << appended->size() << " bytes to " << path << " at offset " << tail->length;
+    m_stats.record_upload_file(appended->size());
+    m_api->append_file(path, tail->length, std::move(*appended), [this, path](bool ok) {
+        if (!ok) {
+            RUSYNC_LOG(INFO) << "Append to " << path << " was rejected, uploading patch";
+            m_tails.erase(path.string());
+            // patch goes through scheduler, so it's ordered with other operations on path
+            m_repost(MODIFIED, path);
+        }
+    });
+    return true;
+}
+
+void Worker::remember_tail(const fs::path& path, int fd, uint64_t size, uint32_t appends) {
+    if (auto tail = SyncedTail::from_fd(fd, size)) {
+        tail->appends = appends;
+        m_tails.set(path.string(), *tail);
+    } else {
+        m_tails.erase(path.string());
+    }
+}
+
+void Worker::upload_file_ranged(const fs::path& path, uint64_t size) {
+    // same version of file always gets the same transfer id, so upload interrupted by disconnect is resumed by next attempt
+    const std::string version = path.string() + ":" + std::to_string(size) + ":" 
+        + std::to_string(fs::last_write_time(m_conf.path / path).time_since_epoch().count());
+    const std::string transfer = std::to_string(XXH64(version.data(), version.size(), 0));
+    m_api->get_received_ranges(path, transfer, size, [this, path, size, transfer, trace = Tracer::current_trace()](std::vector<RangeSet::Range> ranges) {
+        RangeSet received;
+        for (const auto& [offset, end]: ranges) {
+            received.add(offset, end);
+        }
+        const auto plan = RangedTransfer::plan(size);
+        m_stats.record_upload_file(size);
+        RUSYNC_LOG(INFO) << "Uploading " << path << " by " << plan.parts << " ranges of " << plan.part_size << " bytes, " 
+            << plan.parallelism << " at once" << (ranges.empty() ? "" : ", resuming after " + std::to_string(received.bytes()) + " bytes");
+        RangedTransfer::run(size, received.missing(size), [this, path, size, transfer, trace](uint64_t offset, uint64_t length, RangedTransfer::DoneCb done) {
+            // ranges are started from callbacks of previous ones, so trace of operation is restored explicitly
+            TraceScope scope {trace};
+            m_api->upload_range(path, m_conf.path / path, offset, length, size, transfer, std::move(done));
+        }, [path](bool ok) {
+            if (ok) {
+                RUSYNC_LOG(INFO) << "Ranged upload of " << path << " finished";
+            } else {
+                RUSYNC_LOG(WARN) << "Ranged upload of " << path << " failed, it will be resumed by next attempt";
+            }
+        });
+    });
+}
+
+void Worker::download_file(const DirEntry& entry, HashAlgorithm algorithm) {
+    // whole file would arrive at once past download limit, ranges are requested by pieces which wait for it
+    if (entry.size >= RangedTransfer::THRESHOLD || (m_bandwidth.download.limited() && entry.size > ServerAPI::SHAPED_RANGE_PIECE)) {
+        download_file_ranged(entry, algorithm);
         return;
     }
-    std::string buffer;
-    buffer.resize(fs::file_size(m_conf.path / path));
-    file.read(buffer.data(), buffer.size());
-    m_api->upload_file(std::move(buffer), path);
+    m_stats.record_download_file(entry.size);
+    m_api->get_file(entry.path, [this, entry](std::vector<char> data){
+        std::ofstream file {m_conf.path / entry.path, std::ios::binary};
+        file.write(data.data(), data.size());
+    });
+}
+
+void Worker::download_file_ranged(const DirEntry& entry, HashAlgorithm algorithm) {
+    // file is assembled aside and moved into client dir only when all ranges are received.
+    // Partial file is named after remote version of file, so it's resumed only if file was not changed at server meanwhile
+    const fs::path partial_dir = m_conf.path / INTERNAL_DIR / "partial";
+    fs::create_directories(partial_dir);
+    const std::string prefix = std::to_string(std::hash<std::string>{}(entry.path)) + "_";
+    const fs::path partial = partial_dir / (prefix + std::to_string(entry.hash));
+    const fs::path journal_path = fs::path(partial) += ".journal";
+    for (const auto& item: fs::directory_iterator(partial_dir)) {
+        const auto name = item.path().filename().string();
+        if (name.starts_with(prefix) && item.path() != partial && item.path() != journal_path) {
+            fs::remove(item.path());
+        }
+    }
+    std::error_code ec;
+    auto journal = TransferJournal::load(journal_path);
+    const bool resume = journal && journal->size() == entry.size && fs::file_size(partial, ec) == entry.size;
+    const int fd = open(partial.c_str(), resume ? O_RDWR : O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || (!resume && ftruncate(fd, entry.size) != 0)) {
+        RUSYNC_LOG(ERROR) << "Failed to create " << partial << " for ranged download";
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    auto file = share_fd(fd);
+    auto state = std::make_shared<TransferJournal>(resume ? std::move(*journal) : TransferJournal::create(journal_path, entry.size, entry.path));
+    const auto plan = RangedTransfer::plan(entry.size);
+    m_stats.record_download_file(entry.size);
+    RUSYNC_LOG(INFO) << "Downloading " << entry.path << " by " << plan.parts << " ranges of " << plan.part_size << " bytes, " 
+        << plan.parallelism << " at once" << (resume ? ", resuming after " + std::to_string(state->received().bytes()) + " bytes" : "");
+    RangedTransfer::run(entry.size, state->received().missing(entry.size), [this, entry, file, state, trace = Tracer::current_trace()](uint64_t offset, uint64_t length, RangedTransfer::DoneCb done) {
+        TraceScope scope {trace};
+        auto position = std::make_shared<uint64_t>(offset);
+        auto failed = std::make_shared<bool>(false);
+        m_api->get_range(entry.path, offset, length, [file, position, failed](const uint8_t* data, size_t len) {
+            while (len > 0 && !*failed) {
+                const auto written = pwrite(*file, data, len, *position);
+                if (written < 0) {
+                    *failed = errno != EINTR;
+                    continue;
+                }
+                data += written;
+                len -= written;
+                *position += written;
+            }
+        }, [done, failed, file, state, offset, position](bool ok) {
+            // received part is recorded even if stream broke in the middle of range, but only once its data is durable,
+            // so resumed download never skips lost data
+            if (!*failed && *position > offset && fdatasync(*file) == 0) {
+                try {
+                    state->record(offset, *position);
+                } catch (const std::exception& err) {
+                    RUSYNC_LOG(ERROR) << err.what();
+                }
+            }
+            done(ok && !*failed);
+        });
+    }, [this, entry, algorithm, file, partial, state](bool ok) {
+        std::error_code ec;
+        if (ok && fsync(*file) == 0) {
+            // ranges could be read from different versions of server's file
+            const auto hash = hash_files({partial}, algorithm).front();
+            if (hash != entry.hash) {
+                RUSYNC_LOG(WARN) << "Ranged download of " << entry.path << " doesn't match hash of remote file, dropping it";
+                fs::remove(partial, ec);
+                state->remove();
+                return;
+            }
+            fs::create_directories((m_conf.path / entry.path).parent_path(), ec);
+            fs::rename(partial, m_conf.path / entry.path, ec);
+        }
+        if (!ok || ec) {
+            RUSYNC_LOG(WARN) << "Ranged download of " << entry.path << " failed, received " << state->received().bytes() 
+                << " bytes will be reused by next attempt";
+            return;
+        }
+        state->remove();
+        RUSYNC_LOG(INFO) << "Ranged download of " << entry.path << " finished";
+    });
 }
 
 void Worker::perform_initial_sync() {
-    std::osyncstream(std::cout) << "Performing initial sync for " << m_conf.path << std::endl;
-    std::set<DirEntry> local_entries = extract_entries_from_path(m_conf.path);
-    std::osyncstream(std::cout) << "After scanning input dir following entries were found: " << std::endl;
-    for (const auto& entry: local_entries) {
-        std::osyncstream(std::cout) << "path: " << entry.path << " hash: " << entry.hash << " type: " << entry.type_str() << std::endl;
-    }
-    m_api->get_files_description([local_entries, this](std::set<DirEntry> remote_entries) {
-        download_missing(local_entries, remote_entries);
-        upload_missing(local_entries, remote_entries);
-        apply_patches(local_entries, remote_entries);
+    RUSYNC_LOG(DEBUG) << "Performing initial sync for " << m_conf.path;
+    const auto started = std::chrono::steady_clock::now();
+    TraceSpan scan_span {"scan", "worker"};
+    // rules are read on every sync, so edits of ignore file apply without restart
+    auto ignore = std::make_shared<const IgnoreRules>(IgnoreRules::load(m_conf.path));
+    // shared with description callback instead of being copied into it
+    // unreadable files are not listed, but they aren't removed locally either, so their server copies are not downloaded over them
+    auto unreadable = std::make_shared<std::set<std::string, std::less<>>>();
+    auto local_entries = std::make_shared<const EntryTable>(extract_entries_from_path<EntryTable>(m_conf.path, m_hash_algorithm, *ignore, unreadable.get()));
+    uint64_t files = 0;
+    uint64_t bytes = 0;
+    for (const auto& entry: *local_entries) {
+        if (entry.type == DirEntry::FILE) {
+            files++;
+            bytes += entry.size;
+        }
+    }
+    // every scanned file is hashed as a whole
+    m_stats.record_scan(files, bytes);
+    m_stats.record_hashed(bytes);
+    scan_span.arg("bytes", std::to_string(bytes));
+    scan_span.end();
+    RUSYNC_LOG(DEBUG) << "After scanning input dir " << local_entries->size() << " entries were found";
+    for (const auto& entry: *local_entries) {
+        RUSYNC_LOG(DEBUG) << "path: " << entry.path << " hash: " << entry.hash << " type: " << entry.type_str();
+    }
+    m_api->get_files_description(*local_entries, [local_entries, ignore, unreadable, this, started, trace = Tracer::current_trace()](EntryTable remote_entries) mutable {
+        TraceScope scope {trace};
+        PriorityScope priority {Priority::BULK};
+        // sync is finished once requests issued below and by their callbacks are closed
+        CompletionScope completion {make_completion([&stats = m_stats, started]() {
+            stats.record_full_sync(std::chrono::steady_clock::now() - started);
+        })};
+        if (remote_entries.hash_algorithm() != local_entries->hash_algorithm()) {
+            RUSYNC_LOG(WARN) << "Server doesn't support " << hash_algorithm_name(local_entries->hash_algorithm()) << ", scanning again with "
+                << hash_algorithm_name(remote_entries.hash_algorithm());
+            // next syncs of root scan with algorithm of server from the start
+            m_hash_algorithm = remote_entries.hash_algorithm();
+            TraceSpan rescan_span {"scan", "worker"};
+            unreadable->clear();
+            local_entries = std::make_shared<const EntryTable>(extract_entries_from_path<EntryTable>(m_conf.path, remote_entries.hash_algorithm(), *ignore, unreadable.get()));
+        }
+        TraceSpan span {"compare_description", "worker"};
+        auto diff = diff_entries(*local_entries, remote_entries);
+        // server which doesn't know rules (or has older ignore file) still lists ignored entries
+        const auto remote_ignored = [&ignore](const EntryTable::Entry* entry) {
+            return ignore->ignored(entry->path, entry->type == DirEntry::DIR);
+        };
+        std::erase_if(diff.removed, remote_ignored);
+        std::erase_if(diff.removed, [&unreadable](const EntryTable::Entry* entry) {
+            return unreadable->contains(entry->path);
+        });
+        std::erase_if(diff.modified, remote_ignored);
+        download_missing(diff.removed, remote_entries.hash_algorithm());
+        upload_missing(diff.added);
+        apply_patches(diff.modified);
     });
 }
 
-void Worker::upload_missing(const std::set<DirEntry>& local_entries, const std::set<DirEntry>& remote_entries) {
-    std::set<DirEntry> exists_in_local_not_in_response;
-    std::set_difference(local_entries.begin(), local_entries.end(),
-                        remote_entries.begin(), remote_entries.end(),
-                        std::inserter(exists_in_local_not_in_response, exists_in_local_not_in_response.end()));
+void Worker::upload_missing(const std::vector<const EntryTable::Entry*>& exists_in_local_not_in_response) {
     if (exists_in_local_not_in_response.empty()) {
-        std::osyncstream(std::cout) << "All local entries presented on server" << std::endl;
+        RUSYNC_LOG(DEBUG) << "All local entries presented on server";
     } else {
-        std::osyncstream(std::cout) << "new local entries: " << std::endl;
-        for (const auto& entry: exists_in_local_not_in_response) {
-            std::osyncstream(std::cout) << "path: " << entry.path << " hash: " << entry.hash << " type: " << entry.type_str() << std::endl;
+        RUSYNC_LOG(INFO) << "new local entries: " << exists_in_local_not_in_response.size();
+        for (const auto* entry: exists_in_local_not_in_response) {
+            RUSYNC_LOG(DEBUG) << "path: " << entry->path << " hash: " << entry->hash << " type: " << entry->type_str();
         }
     }
-    for (const auto& entry: exists_in_local_not_in_response) {
-        if (entry.type == DirEntry::DIR) {
-            if (fs::is_empty(m_conf.path / entry.path)) {
-                m_api->upload_dir(entry.path);
+    std::vector<fs::path> files;
+    for (const auto* entry: exists_in_local_not_in_response) {
+        if (entry->type == DirEntry::DIR) {
+            if (fs::is_empty(m_conf.path / entry->path)) {
+                m_api->upload_dir(std::string(entry->path));
             }
         } else {
-            upload_file(entry.path);
+            files.emplace_back(entry->path);
         }
         
     }
+    upload_files(files);
 }
 
-void Worker::download_missing(const std::set<DirEntry>& local_entries, const std::set<DirEntry>& remote_entries) {
-    std::set<DirEntry> exist_in_remote_not_in_local;
-    std::set_difference(remote_entries.begin(), remote_entries.end(),
-                        local_entries.begin(), local_entries.end(),
-                        std::inserter(exist_in_remote_not_in_local, exist_in_remote_not_in_local.end()));
+void Worker::download_missing(const std::vector<const EntryTable::Entry*>& exist_in_remote_not_in_local, HashAlgorithm algorithm) {
     if (exist_in_remote_not_in_local.empty()) {
-        std::osyncstream(std::cout) << "All remote entries presented on local machine" << std::endl;
+        RUSYNC_LOG(DEBUG) << "All remote entries presented on local machine";
     } else {
-        std::osyncstream(std::cout) << "new remote entries: " << std::endl;
-        for (const auto& entry: exist_in_remote_not_in_local) {
-            std::osyncstream(std::cout) << "path: " << entry.path << " hash: " << entry.hash << " type: " << entry.type_str() << std::endl;
+        RUSYNC_LOG(INFO) << "new remote entries: " << exist_in_remote_not_in_local.size();
+        for (const auto* entry: exist_in_remote_not_in_local) {
+            RUSYNC_LOG(DEBUG) << "path: " << entry->path << " hash: " << entry->hash << " type: " << entry->type_str();
         }
     }
-    for (const auto& entry: exist_in_remote_not_in_local) {
-        if (entry.type == DirEntry::DIR) {
-            fs::create_directory(m_conf.path / entry.path);
+    for (const auto* entry: exist_in_remote_not_in_local) {
+        if (entry->type == DirEntry::DIR) {
+            fs::create_directory(m_conf.path / entry->path);
             continue;
         }
-        m_api->get_file(entry.path, [this, entry](std::vector<char> data){
-            std::ofstream file {m_conf.path / entry.path, std::ios::binary};
-            file.write(data.data(), data.size());
-        });
+        download_file(entry->to_dir_entry(), algorithm);
     }
 }
 
-void Worker::apply_patches(const std::set<DirEntry>& local_entries, const std::set<DirEntry>& remote_entries) {
-    std::set<DirEntry> with_different_hash;
-    for (const auto& entry: local_entries) {
-        if (remote_entries.contains(entry) && remote_entries.find(entry)->hash != entry.hash) {
-            with_different_hash.insert(entry);
-        }
-    }
-
+void Worker::apply_patches(const std::vector<const EntryTable::Entry*>& with_different_hash) {
     if (with_different_hash.empty()) {
-        std::osyncstream(std::cout) << "No diff in hashes was found" << std::endl;
+        RUSYNC_LOG(DEBUG) << "No diff in hashes was found";
     } else {
-        std::osyncstream(std::cout) << "Files with different hashes: " << std::endl;
-        for (const auto& entry: with_different_hash) {
-            std::osyncstream(std::cout) << "path: " << entry.path << " hash: " << entry.hash << " type: " << entry.type_str() << std::endl;
+        RUSYNC_LOG(INFO) << "Files with different hashes: " << with_different_hash.size();
+        for (const auto* entry: with_different_hash) {
+            RUSYNC_LOG(DEBUG) << "path: " << entry->path << " hash: " << entry->hash << " type: " << entry->type_str();
         }
     }
 
-    for (const auto& entry: with_different_hash) {
-        upload_patch(entry);
+    for (const auto* entry: with_different_hash) {
+        // growing files are synced by their new bytes, as for watcher events
+        if (!upload_appended(std::string(entry->path))) {
+            upload_patch(entry->to_dir_entry());
+        }
     }
 }
 
 void Worker::upload_patch(const DirEntry& entry) {
-    m_api->get_meta(entry.path, [entry, this](bool is_file, std::vector<FileChunk> remote_chunks) {
-        FILE* stream = fopen((m_conf.path / entry.path).c_str(), "rb");
-        if (stream == nullptr) {
-            std::osyncstream(std::cerr) << "Upload patch: error in opening " << m_conf.path / entry.path << std::endl;
+    if (auto shadow = m_shadows.load(entry.path)) {
+        RUSYNC_LOG(DEBUG) << "Diffing " << entry.path << " against its shadow of version " << shadow->version;
+        patch_file(entry, shadow->chunks, shadow->hash_algorithm, shadow->version);
+        return;
+    }
+    m_api->get_meta(entry.path, [entry, this, trace = Tracer::current_trace(), priority = current_priority()](bool is_file, std::vector<FileChunk> remote_chunks, HashAlgorithm algorithm) {
+        TraceScope scope {trace};
+        PriorityScope priority_scope {priority};
+        patch_file(entry, remote_chunks, algorithm, "");
+    });
+}
+
+void Worker::patch_file(const DirEntry& entry, const std::vector<FileChunk>& remote_chunks, HashAlgorithm algorithm, const std::string& version) {
+    TraceSpan span {"diff_chunks", "worker", {{"path", entry.path}}};
+    std::error_code ec;
+    const auto file_size = fs::file_size(m_conf.path / entry.path, ec);
+    // large files are diffed within mapped window, smaller ones by buffered reads
+    auto mapped = !ec && file_size >= MappedFile::THRESHOLD ? MappedFile::open(m_conf.path / entry.path) : std::nullopt;
+    FILE* stream = mapped ? nullptr : fopen((m_conf.path / entry.path).c_str(), "rb");
+    if (ec || (!mapped && stream == nullptr)) {
+        RUSYNC_LOG(ERROR) << "Upload patch: error in opening " << m_conf.path / entry.path;
+        return;
+    }
+    // all patches below are applied by server at once, when patch with end flag is received
+    const std::string session = std::to_string(m_random());
+    const uint64_t diffed_size = mapped ? mapped->size() : file_size;
+    m_stats.record_upload_file(diffed_size);
+    m_stats.record_hashed(diffed_size);
+    auto synced_chunks = std::make_shared<std::vector<FileChunk>>();
+    const PatchCallback emit = [this, &entry, &session, &version, algorithm, synced_chunks](uint64_t offset, std::string data, bool end) {
+        if (!end) {
+            m_api->upload_patch(entry.path, offset, std::move(data), end, session);
             return;
         }
-        std::string buffer;
-        int remote_index = 0;
-        while(!feof(stream) && remote_index < remote_chunks.size()) {
-            const auto& remote_chunk = remote_chunks[remote_index];
-            buffer.resize(remote_chunk.size);
-            const auto before_read = ftell(stream);
-            const auto bytes_read = fread(buffer.data(), 1, buffer.size(), stream);
-            XXH64_hash_t chunk_hash = XXH64(buffer.data(), buffer.size(), 0);
-            if (bytes_read < remote_chunk.size) { //read less than remote chunk
-                buffer.resize(bytes_read);
-                m_api->upload_patch(entry.path, before_read, std::move(buffer), true);
-                continue;
+        // server checks version when session is committed, so shadow is only trusted if nobody changed file since it was stored
+        m_api->upload_patch(entry.path, offset, std::move(data), end, session, version,
+            [this, entry, synced_chunks, algorithm, used_shadow = !version.empty()](std::optional<std::string> new_version) {
+            if (new_version && !new_version->empty()) {
+                m_shadows.store(entry.path, {std::move(*new_version), algorithm, std::move(*synced_chunks)});
+                return;
             }
-            if (chunk_hash != remote_chunk.hash) {
-                m_api->upload_patch(entry.path, before_read, std::move(buffer));
-            }
-            remote_index++;
-        }
-        if (!feof(stream)) { //read til end
-            const auto current_pos = ftell(stream);
-            std::string buffer;
-            buffer.resize(fs::file_size(m_conf.path / entry.path) - current_pos);
-            const auto bytes_read = fread(buffer.data(), 1, buffer.size(), stream);
-            if (bytes_read != 0) {
-                m_api->upload_patch(entry.path, current_pos, std::move(buffer), true);
+            m_shadows.remove(entry.path);
+            if (!new_version && used_shadow) {
+                // file is hashed again by worker, in order with later operations for the same path. Tail remembered after diff wasn't committed either
+                RUSYNC_LOG(INFO) << "Shadow of " << entry.path << " is outdated, requesting meta";
+                m_tails.erase(entry.path);
+                m_repost(MODIFIED, entry.path);
             }
+        });
+    };
+    if (mapped) {
+        try {
+            diff_chunks(*mapped, remote_chunks, emit, synced_chunks.get(), algorithm);
+        } catch (const std::system_error& err) {
+            // session is never committed, so server keeps its file as is
+            RUSYNC_LOG(ERROR) << "Upload patch: failed to map " << m_conf.path / entry.path << ", " << err.what();
+            return;
         }
-    });
+        // following appends to file are sent without fetching meta
+        remember_tail(entry.path, mapped->fd(), diffed_size);
+        return;
+    }
+    diff_chunks(stream, file_size, remote_chunks, emit, synced_chunks.get(), algorithm);
+    remember_tail(entry.path, fileno(stream), file_size);
+    fclose(stream);
 }
 }
\ No newline at end of file
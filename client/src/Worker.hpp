@@ -1,13 +1,24 @@
 #pragma once
+#include "ChunkShadows.hpp"
+#include "ClientStats.hpp"
+#include "Completion.hpp"
 #include "Config.hpp"
+#include "Logger.hpp"
+#include "Priority.hpp"
 #include "ServerAPI.hpp"
-#include "Thread.hpp"
+#include "SyncedTail.hpp"
+#include "Tracing.hpp"
+#include "WorkerThread.hpp"
+#include <atomic>
 #include <exception>
 #include <set>
 #include <boost/asio.hpp>
 #include <DirEntry.hpp>
+#include "EntryTable.hpp"
+#include <functional>
 #include <map>
-#include <syncstream>
+#include <optional>
+#include <random>
 
 namespace rusync {
 
@@ -16,88 +27,196 @@ class ServerAPI;
 namespace fs = std::filesystem;
 
 /**
- * @brief Basic unit which perform all main operations on files
+ * @brief Basic unit which perform all main operations on files of one root. Runs on WorkerThread shared with workers of other roots
  * 
  */
 class Worker {
 public:
-    Worker(const Config& conf);
-    ~Worker();
-
     /**
      * @brief List of Worker operations
      * 
      */
     enum Operation {INITIAL_SYNC, ADDED, REMOVED, MODIFIED};
+    static_assert(MODIFIED + 1 == ClientStats::OPERATIONS);
+
+    /**
+     * @brief posts operation of worker's root back to WorkerPool, so it's ordered with other operations for the same path.
+     * Path is empty for INITIAL_SYNC
+     * 
+     */
+    using Repost = std::function<void(Operation operation, const std::optional<fs::path>& path)>;
+
+    /**
+     * @brief Construct a new Worker object
+     * 
+     * @param conf config of root
+     * @param stats 
+     * @param bandwidth 
+     * @param tails synced tails of files of root, shared by all workers of root
+     * @param hash_algorithm algorithm which root is hashed with, shared by all workers of root. Starts as configured one and is replaced by
+     * algorithm server falls back to, so following scans use it right away
+     * @param thread thread which runs worker, must be stopped before worker is destroyed
+     * @param repost 
+     */
+    Worker(const Config& conf, ClientStats& stats, Bandwidth& bandwidth, SyncedTails& tails, std::atomic<HashAlgorithm>& hash_algorithm, WorkerThread& thread, Repost repost);
 
     /**
-     * @brief Dispatched operation args to specific handler
+     * @brief changes reported by watcher are interactive, full sync is bulk. Added dir is uploaded as bulk by file_added itself
+     * 
+     * @param operation 
+     * @return Priority 
+     */
+    static constexpr Priority priority_of(Operation operation) {
+        return operation == INITIAL_SYNC ? Priority::BULK : Priority::INTERACTIVE;
+    }
+
+    /**
+     * @brief Executes operation right away. Should be called only from worker's thread
      * 
      * @tparam operation 
      * @tparam Args 
      * @param args 
      */
     template <Operation operation, typename ... Args>
-    void perform_operation(Args... args);
+    void execute_operation(Args... args);
 
 private:
     void file_added(const fs::path& path);
     void file_removed(const fs::path& path);
     void file_modified(const fs::path& path);
     void upload_file(const fs::path& path);
+    /**
+     * @brief uploads files, small ones are read at once by ReadEngine, large ones are uploaded by ranges
+     * 
+     * @param paths 
+     */
+    void upload_files(const std::vector<fs::path>& paths);
+    /**
+     * @brief uploads only data appended to file since it was synced last time (see SyncedTail)
+     * 
+     * @param path 
+     * @return false if file can't be synced by append, tail of file is forgotten then
+     */
+    bool upload_appended(const fs::path& path);
+    /**
+     * @brief remembers first size bytes of file as synced
+     * 
+     * @param path 
+     * @param fd opened file
+     * @param size 
+     * @param appends appends since file was verified as a whole (see SyncedTail::VERIFY_EVERY)
+     */
+    void remember_tail(const fs::path& path, int fd, uint64_t size, uint32_t appends = 0);
+    /**
+     * @brief uploads large file by concurrent ranges (see RangedTransfer)
+     * 
+     * @param path 
+     * @param size 
+     */
+    void upload_file_ranged(const fs::path& path, uint64_t size);
+    /**
+     * @brief 
+     * 
+     * @param entry 
+     * @param algorithm algorithm of entry's hash
+     */
+    void download_file(const DirEntry& entry, HashAlgorithm algorithm);
+    /**
+     * @brief downloads large file by concurrent ranges (see RangedTransfer). Assembled file is moved into place only if its hash matches entry
+     * 
+     * @param entry 
+     * @param algorithm algorithm of entry's hash
+     */
+    void download_file_ranged(const DirEntry& entry, HashAlgorithm algorithm);
     void perform_initial_sync();
-    void upload_missing(const std::set<DirEntry>& local_entries, const std::set<DirEntry>& remote_entries);
-    void download_missing(const std::set<DirEntry>& local_entries, const std::set<DirEntry>& remote_entries);
-    void apply_patches(const std::set<DirEntry>& local_entries, const std::set<DirEntry>& remote_entries);
+    void upload_missing(const std::vector<const EntryTable::Entry*>& exists_in_local_not_in_response);
+    void download_missing(const std::vector<const EntryTable::Entry*>& exist_in_remote_not_in_local, HashAlgorithm algorithm);
+    void apply_patches(const std::vector<const EntryTable::Entry*>& with_different_hash);
+    /**
+     * @brief diffs file against its shadow (see ChunkShadows) or, if there is none, against chunks requested from server
+     * 
+     * @param entry 
+     */
     void upload_patch(const DirEntry& entry);
+    /**
+     * @brief sends patches which turn remote file into local one, stores shadow of result
+     * 
+     * @param entry 
+     * @param remote_chunks 
+     * @param algorithm algorithm of remote chunk hashes
+     * @param version version of remote file, which remote_chunks describe. Empty if chunks were received from server right now
+     */
+    void patch_file(const DirEntry& entry, const std::vector<FileChunk>& remote_chunks, HashAlgorithm algorithm, const std::string& version);
 
     Config m_conf;
-    boost::asio::io_service m_io_service;
+    ClientStats& m_stats;
+    Bandwidth& m_bandwidth;
+    SyncedTails& m_tails;
+    std::atomic<HashAlgorithm>& m_hash_algorithm;
+    ChunkShadows m_shadows;
+    WorkerThread& m_thread;
+    boost::asio::io_service& m_io_service;
     std::unique_ptr<ServerAPI> m_api;
-    Thread m_thread;
+    Repost m_repost;
     /**
      * @brief list of deffered timers for operations wihch was queued while client was disconnected from server
      * 
      */
     std::vector<std::shared_ptr<boost::asio::deadline_timer>> m_reschedule_timers;
 
+    std::unique_ptr<boost::asio::deadline_timer> m_sync_timer;
     /**
-     * @brief list of deffered timers for modify operation
+     * @brief source of patch session ids
      * 
      */
-    std::map<fs::path, std::unique_ptr<boost::asio::deadline_timer>> m_modified_timer;
-    std::unique_ptr<boost::asio::deadline_timer> m_sync_timer;
+    std::mt19937_64 m_random {std::random_device{}()};
 };
 
 template <Worker::Operation operation, typename ... Args>
-void Worker::perform_operation(Args... args) {
-    boost::asio::post(m_io_service, [this, ...args = std::move(args)]() {
-        try {
-            if (!m_api) {
-                m_api = std::make_unique<ServerAPI>(m_conf, m_io_service);
-            }
-            if (!m_api->connected()) {
-                auto reschedule_timer = std::make_shared<boost::asio::deadline_timer>(m_io_service, boost::posix_time::seconds(2));
-                reschedule_timer->async_wait([this, ...args = std::move(args), reschedule_timer](const boost::system::error_code& /*e*/) {
-                    perform_operation<operation>(std::move(args)...);
-                    m_reschedule_timers.erase(std::remove(m_reschedule_timers.begin(), m_reschedule_timers.end(), reschedule_timer));
-                });
-                m_reschedule_timers.push_back(reschedule_timer);
-                return;
-            }
-            if constexpr (operation == INITIAL_SYNC) {
-                perform_initial_sync();
-            } else if constexpr (operation == ADDED) {
-                file_added(args...);
-            } else if constexpr (operation == REMOVED) {
-                file_removed(args...);
-            } else if constexpr (operation == MODIFIED) {
-                file_modified(args...);
+void Worker::execute_operation(Args... args) {
+    try {
+        if (!m_api) {
+            m_api = std::make_unique<ServerAPI>(m_conf, m_thread.connection(), m_io_service, m_stats, m_bandwidth);
+        }
+        if (!m_api->connected()) {
+            m_stats.record_deferred();
+            auto reschedule_timer = std::make_shared<boost::asio::deadline_timer>(m_io_service, boost::posix_time::seconds(2));
+            // timer holds completion of operation, so scheduler doesn't start operations for the same path posted meanwhile till it's retried
+            reschedule_timer->async_wait([this, ...args = std::move(args), reschedule_timer, completion = current_completion()](const boost::system::error_code& /*e*/) {
+                m_reschedule_timers.erase(std::remove(m_reschedule_timers.begin(), m_reschedule_timers.end(), reschedule_timer));
+                CompletionScope scope {completion};
+                execute_operation<operation>(args...);
+            });
+            m_reschedule_timers.push_back(reschedule_timer);
+            return;
+        }
+        // operation is done once requests issued by it and by their callbacks are closed
+        CompletionScope completion {make_completion([&stats = m_stats, started = std::chrono::steady_clock::now()]() {
+            stats.record_operation(static_cast<ClientStats::Operation>(operation), std::chrono::steady_clock::now() - started);
+        })};
+        PriorityScope priority {priority_of(operation)};
+        TraceSpan span {ClientStats::operation_name(static_cast<ClientStats::Operation>(operation)), "worker"};
+        if (span.active()) {
+            span.arg("priority", priority_name(priority_of(operation)));
+        }
+        if constexpr (sizeof...(args) > 0) {
+            if (span.active()) {
+                span.arg("path", [](const fs::path& path, auto&&...) {
+                    return path.string();
+                }(args...));
             }
-        } catch(const std::exception& err) {
-            std::osyncstream(std::cerr) << "Exception occured: " << err.what() << std::endl;
         }
-
-    });
+        if constexpr (operation == INITIAL_SYNC) {
+            perform_initial_sync();
+        } else if constexpr (operation == ADDED) {
+            file_added(args...);
+        } else if constexpr (operation == REMOVED) {
+            file_removed(args...);
+        } else if constexpr (operation == MODIFIED) {
+            file_modified(args...);
+        }
+    } catch(const std::exception& err) {
+        RUSYNC_LOG(ERROR) << "Exception occured: " << err.what();
+    }
 }
 }
\ No newline at end of file
@@ -1,9 +1,13 @@
 #pragma once
 #include <filesystem>
 #include <memory>
+#include <optional>
 #include <thread>
 #include <vector>
+#include "StrandScheduler.hpp"
+#include "Tracing.hpp"
 #include "Worker.hpp"
+#include "WorkerThread.hpp"
 
 
 namespace rusync {
@@ -12,39 +16,135 @@ namespace fs = std::filesystem;
 class WorkerPool {
 public:
     /**
-     * @brief Construct a new Worker Pool object of size size
-     * 
-     * @param conf 
-     * @param size 
+     * @brief Construct a new Worker Pool object of size threads. Each thread runs worker of every root of conf and shares one connection between them
+     *
+     * @param conf
+     * @param size
+     * @param stats shared by all workers
+     * @param bandwidth limits shared by all workers
      */
-    WorkerPool(const Config& conf, unsigned size) {
+    WorkerPool(const Config& conf, unsigned size, ClientStats& stats, Bandwidth& bandwidth) :
+        m_scheduler {size, [this](size_t index, StrandScheduler::Handler handler) {
+            m_threads[index]->post(std::move(handler));
+        }}
+    {
         for (unsigned i = 0; i < size; i++) {
-            m_workers.push_back(std::make_unique<Worker>(conf));
+            m_threads.push_back(std::make_unique<WorkerThread>(conf, stats));
+        }
+        for (size_t root = 0; root < conf.roots.size(); root++) {
+            const Config root_conf = conf.for_root(root);
+            m_tails.push_back(std::make_unique<SyncedTails>());
+            m_hash_algorithms.push_back(std::make_unique<std::atomic<HashAlgorithm>>(root_conf.hash_algorithm));
+            auto& workers = m_workers.emplace_back();
+            for (unsigned i = 0; i < size; i++) {
+                workers.push_back(std::make_unique<Worker>(root_conf, stats, bandwidth, *m_tails.back(), *m_hash_algorithms.back(), *m_threads[i],
+                    [this, root](Worker::Operation operation, const std::optional<fs::path>& path) {
+                        repost(root, operation, path);
+                    }));
+            }
+        }
+    }
+
+    ~WorkerPool() {
+        // workers are referenced by handlers of threads and by callbacks of their sessions
+        for (auto& thread: m_threads) {
+            thread->stop();
+        }
+        // completions held by closed requests don't queue strands to stopped threads
+        m_scheduler.stop();
+        for (auto& thread: m_threads) {
+            thread->close_connection();
         }
     }
 
     /**
-     * @brief post operation to worker. if request contains path as first parameter - operations for same files will be always perfromed by the same worker.<br>
-     * Otherwise - round robin is used to balance load
-     * 
-     * @tparam operation 
-     * @tparam Args 
-     * @param args 
+     * @brief post operation to worker of root. if request contains path as first parameter - operations for same files will be always performed one after another in order of posting.<br>
+     * Any idle worker could take them, so busy worker doesn't hold operations for other paths. Next operation for path starts only once requests
+     * of previous one are closed, so server gets them in order even if they are sent by connections of different threads.<br>
+     * Operations are queued by Worker::priority_of, so watcher-driven operations go ahead of full sync. Within priority roots are served in turn,
+     * so big sync of one root doesn't starve others.<br>
+     * Each operation starts new trace, time spent in queue is recorded as its first span
+     *
+     * @tparam operation
+     * @tparam Args
+     * @param root index of root within Config::roots
+     * @param args
      */
     template<Worker::Operation operation, typename ... Args>
-    void post_operation(Args... args) {
+    void post_operation(size_t root, Args... args) {
         if constexpr (sizeof...(args) > 0) {
-            const size_t hash = [](const fs::path& path, auto&&...) {
-                return fs::hash_value(path);
+            const std::string key = [root](const fs::path& path, auto&&...) {
+                return std::to_string(root) + ":" + path.string();
             }(args...);
-            m_workers[hash % m_workers.size()]->perform_operation<operation>(std::move(args)...);
-            return;
+            m_scheduler.post(key, [this, root, posted = trace_time(), ...args = std::move(args)](size_t index) {
+                TraceScope trace;
+                trace_queued(posted);
+                m_workers[root][index]->execute_operation<operation>(args...);
+            }, Worker::priority_of(operation), root);
+        } else {
+            m_scheduler.post([this, root, posted = trace_time()](size_t index) {
+                TraceScope trace;
+                trace_queued(posted);
+                m_workers[root][index]->execute_operation<operation>();
+            }, Worker::priority_of(operation), root);
         }
-        m_workers[m_current_worker_index % m_workers.size()]->perform_operation<operation>(std::move(args)...);
-        m_current_worker_index++;
+    }
+    /**
+     * @brief number of operations which are queued but not started yet
+     *
+     * @return size_t
+     */
+    size_t pending() const {
+        return m_scheduler.pending();
     }
 private:
-    std::vector<std::unique_ptr<Worker>> m_workers;
-    std::atomic<uint32_t> m_current_worker_index = 0;
+    void repost(size_t root, Worker::Operation operation, const std::optional<fs::path>& path) {
+        switch (operation) {
+        case Worker::INITIAL_SYNC:
+            post_operation<Worker::INITIAL_SYNC>(root);
+            break;
+        case Worker::ADDED:
+            post_operation<Worker::ADDED>(root, *path);
+            break;
+        case Worker::REMOVED:
+            post_operation<Worker::REMOVED>(root, *path);
+            break;
+        case Worker::MODIFIED:
+            post_operation<Worker::MODIFIED>(root, *path);
+            break;
+        }
+    }
+
+    static uint64_t trace_time() {
+        return Tracer::enabled() ? Tracer::now() : 0;
+    }
+
+    static void trace_queued(uint64_t posted) {
+        if (posted != 0) {
+            Tracer::instance().complete("queued", "worker", posted, Tracer::now());
+        }
+    }
+
+    StrandScheduler m_scheduler;
+    /**
+     * @brief per root
+     *
+     */
+    std::vector<std::unique_ptr<SyncedTails>> m_tails;
+    /**
+     * @brief per root, see Worker::Worker
+     *
+     */
+    std::vector<std::unique_ptr<std::atomic<HashAlgorithm>>> m_hash_algorithms;
+    /**
+     * @brief joined before scheduler and tails are destroyed
+     *
+     */
+    std::vector<std::unique_ptr<WorkerThread>> m_threads;
+    /**
+     * @brief indexed by root, then by thread
+     *
+     */
+    std::vector<std::vector<std::unique_ptr<Worker>>> m_workers;
 };
-}
\ No newline at end of file
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "ClientStats.hpp"
+#include "Config.hpp"
+#include "Connection.hpp"
+#include "Thread.hpp"
+#include <boost/asio.hpp>
+#include <functional>
+#include <memory>
+#include <optional>
+
+namespace rusync {
+
+/**
+ * @brief Event loop thread with its connection to server. Workers of all roots with the same index run on it and share its connection,
+ * so number of threads and connections doesn't grow with number of roots
+ *
+ */
+class WorkerThread {
+public:
+    WorkerThread(const Config& conf, ClientStats& stats) : m_conf {conf}, m_stats {stats} {
+        m_thread.emplace(m_io_service);
+    }
+
+    WorkerThread(const WorkerThread&) = delete;
+    WorkerThread& operator=(const WorkerThread&) = delete;
+
+    ~WorkerThread() {
+        stop();
+    }
+
+    boost::asio::io_service& io_service() {
+        return m_io_service;
+    }
+
+    /**
+     * @brief connection is established on first use. Should be called only from thread
+     *
+     * @return Connection&
+     */
+    Connection& connection() {
+        if (!m_connection) {
+            m_connection = std::make_unique<Connection>(m_conf, m_io_service, m_stats);
+        }
+        return *m_connection;
+    }
+
+    /**
+     * @brief post arbitrary handler to event loop
+     *
+     * @param handler
+     */
+    void post(std::function<void()> handler) {
+        boost::asio::post(m_io_service, std::move(handler));
+    }
+
+    /**
+     * @brief stops event loop and joins thread, pending handlers are dropped. Workers must be stopped before they are destroyed
+     *
+     */
+    void stop() {
+        m_io_service.stop();
+        m_thread.reset();
+    }
+
+    /**
+     * @brief closes connection to server. Should be called after stop and before workers are destroyed, as session callbacks reference them
+     *
+     */
+    void close_connection() {
+        m_connection.reset();
+    }
+
+private:
+    Config m_conf;
+    ClientStats& m_stats;
+    boost::asio::io_service m_io_service;
+    std::unique_ptr<Connection> m_connection;
+    std::optional<Thread> m_thread;
+};
+}
@@ -4,29 +4,40 @@
 #include <syncstream>
 #include "SyncApp.hpp"
 #include "Config.hpp"
+#include "Logger.hpp"
+#include "Tracing.hpp"
 
 namespace fs = std::filesystem;
 namespace rusync {
 
 void sigtermHandler( int signum) {
     stopped = true;
-    std::osyncstream(std::cout) << "Cought SIGTERM" << std::endl;
+    RUSYNC_LOG(INFO) << "Cought SIGTERM";
 }
 
 
 int start(int argc, char** argv) {
     signal(SIGTERM, sigtermHandler);
-    if (argc != 5) {
-        std::osyncstream(std::cout) << "Usage: rusync_client <path/to/folder> <server_ip> <port> <key>" << std::endl;
+    if (argc < 5 || argc % 2 == 0) {
+        std::osyncstream(std::cout) << "Usage: rusync_client <path/to/folder> <server_ip> <port> <key> [<path/to/folder> <key>]..." << std::endl;
         return -1; 
     }
     Config conf = Config::from_args(argc, argv);
-    if (!fs::exists(conf.path)) {
-        std::cerr << "Please provide existing input directory" << std::endl;
-        return -2;
+    for (const auto& root: conf.roots) {
+        if (!fs::exists(root.path)) {
+            std::cerr << "Please provide existing input directory, " << root.path << " doesn't exist" << std::endl;
+            return -2;
+        }
+    }
+    if (auto conflict = conf.roots_conflict()) {
+        std::cerr << "Please provide distinct keys and non-overlapping directories, " << *conflict << std::endl;
+        return -3;
+    }
+    if (const char* trace_file = std::getenv("RUSYNC_TRACE_FILE"); trace_file && !Tracer::instance().start(trace_file, "rusync_client")) {
+        RUSYNC_LOG(ERROR) << "Failed to open trace file " << trace_file;
     }
     SyncApp app {conf};
-    std::osyncstream(std::cout) << "Client exiting..." << std::endl;
+    RUSYNC_LOG(INFO) << "Client exiting...";
     
     return 0;
 
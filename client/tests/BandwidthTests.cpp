@@ -0,0 +1,195 @@
+#include <gtest/gtest.h>
+#include <map>
+#include "Bandwidth.hpp"
+
+using namespace std::chrono_literals;
+
+TEST(BandwidthTest, parse_rate) {
+    EXPECT_EQ(rusync::parse_rate("0"), 0);
+    EXPECT_EQ(rusync::parse_rate("300000"), 300000);
+    EXPECT_EQ(rusync::parse_rate("512K"), 512 * 1024);
+    EXPECT_EQ(rusync::parse_rate("2m"), 2 * 1024 * 1024);
+    EXPECT_EQ(rusync::parse_rate("1G"), 1ull << 30);
+    EXPECT_FALSE(rusync::parse_rate(""));
+    EXPECT_FALSE(rusync::parse_rate("K"));
+    EXPECT_FALSE(rusync::parse_rate("10KB"));
+    EXPECT_FALSE(rusync::parse_rate("-1"));
+}
+
+TEST(BandwidthTest, schedule) {
+    const auto schedule = rusync::BandwidthSchedule::parse("08:00-18:00=512K/4M;22:00-06:30=0/1M", {100, 200});
+    ASSERT_TRUE(schedule);
+    ASSERT_EQ(schedule->windows().size(), 2);
+    EXPECT_EQ(schedule->at(7 * 60 + 59), (rusync::RateLimits{100, 200}));
+    EXPECT_EQ(schedule->at(8 * 60), (rusync::RateLimits{512 << 10, 4 << 20}));
+    EXPECT_EQ(schedule->at(18 * 60), (rusync::RateLimits{100, 200}));
+    // wraps over midnight
+    EXPECT_EQ(schedule->at(23 * 60), (rusync::RateLimits{0, 1 << 20}));
+    EXPECT_EQ(schedule->at(0), (rusync::RateLimits{0, 1 << 20}));
+    EXPECT_EQ(schedule->at(6 * 60 + 29), (rusync::RateLimits{0, 1 << 20}));
+    EXPECT_EQ(schedule->at(6 * 60 + 30), (rusync::RateLimits{100, 200}));
+}
+
+TEST(BandwidthTest, malformed_schedule) {
+    EXPECT_TRUE(rusync::BandwidthSchedule::parse("", {}));
+    EXPECT_TRUE(rusync::BandwidthSchedule::parse("00:00-24:00=1M/1M", {}));
+    EXPECT_FALSE(rusync::BandwidthSchedule::parse("8:00-18:00=1M/1M", {}));
+    EXPECT_FALSE(rusync::BandwidthSchedule::parse("08:00-18:60=1M/1M", {}));
+    EXPECT_FALSE(rusync::BandwidthSchedule::parse("08:00-18:00=1M", {}));
+    EXPECT_TRUE(rusync::BandwidthSchedule::parse("08:00-18:00=1M/1M;", {}));
+    EXPECT_FALSE(rusync::BandwidthSchedule::parse("08:00-18:00=1M/1M;;", {}));
+    EXPECT_FALSE(rusync::BandwidthSchedule::parse("08:00-18:00=1X/1M", {}));
+}
+
+TEST(BandwidthTest, unlimited_grants_everything) {
+    rusync::RateLimiter limiter;
+    const auto grant = limiter.acquire(limiter.open(), 1 << 20);
+    EXPECT_EQ(grant.bytes, 1 << 20);
+    EXPECT_EQ(limiter.waiting(), 0);
+}
+
+TEST(BandwidthTest, rate_is_enforced) {
+    constexpr uint64_t RATE = 1 << 20;
+    rusync::RateLimiter limiter;
+    auto now = rusync::RateLimiter::Clock::time_point();
+    limiter.set_rate(RATE, now);
+    const auto transfer = limiter.open();
+    uint64_t sent = 0;
+    const auto started = now;
+    while (now - started < 10s) {
+        const auto grant = limiter.acquire(transfer, 64 << 10, now);
+        if (grant.bytes == 0) {
+            EXPECT_GT(grant.retry_after, 0ms);
+            now += grant.retry_after;
+            continue;
+        }
+        EXPECT_LE(grant.bytes, rusync::RateLimiter::QUANTUM);
+        sent += grant.bytes;
+    }
+    // burst of BURST on top of rate
+    EXPECT_GE(sent, 10 * RATE);
+    EXPECT_LE(sent, 10 * RATE + RATE / 10 + rusync::RateLimiter::QUANTUM);
+}
+
+TEST(BandwidthTest, capacity_is_shared_evenly) {
+    rusync::RateLimiter limiter;
+    auto now = rusync::RateLimiter::Clock::time_point();
+    limiter.set_rate(1 << 20, now);
+    std::map<uint64_t, uint64_t> sent;
+    std::map<uint64_t, rusync::RateLimiter::Clock::time_point> wakeup;
+    for (int i = 0; i < 4; i++) {
+        wakeup[limiter.open()] = now;
+    }
+    const auto started = now;
+    while (now - started < 10s) {
+        // transfer which wakes up first asks next
+        auto next = std::min_element(wakeup.begin(), wakeup.end(), [](const auto& a, const auto& b) {
+            return a.second < b.second;
+        });
+        now = std::max(now, next->second);
+        const auto grant = limiter.acquire(next->first, 1 << 20, now);
+        sent[next->first] += grant.bytes;
+        next->second = now + grant.retry_after;
+    }
+    for (const auto& [transfer, bytes]: sent) {
+        EXPECT_NEAR(static_cast<double>(bytes), static_cast<double>(sent.begin()->second), 2.0 * rusync::RateLimiter::QUANTUM);
+    }
+}
+
+TEST(BandwidthTest, transfers_take_turns) {
+    rusync::RateLimiter limiter;
+    auto now = rusync::RateLimiter::Clock::time_point();
+    limiter.set_rate(rusync::RateLimiter::QUANTUM * 10, now);
+    const auto first = limiter.open();
+    const auto second = limiter.open();
+    limiter.debit(rusync::RateLimiter::QUANTUM, now);
+    EXPECT_EQ(limiter.acquire(second, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    EXPECT_EQ(limiter.acquire(first, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    now += 100ms;
+    // second asked first, so it goes first even though first asks first now
+    EXPECT_EQ(limiter.acquire(first, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    EXPECT_EQ(limiter.acquire(second, rusync::RateLimiter::QUANTUM, now).bytes, rusync::RateLimiter::QUANTUM);
+    now += 100ms;
+    EXPECT_EQ(limiter.acquire(first, rusync::RateLimiter::QUANTUM, now).bytes, rusync::RateLimiter::QUANTUM);
+    EXPECT_EQ(limiter.waiting(), 0);
+}
+
+TEST(BandwidthTest, interactive_transfers_go_first) {
+    rusync::RateLimiter limiter;
+    auto now = rusync::RateLimiter::Clock::time_point();
+    limiter.set_rate(rusync::RateLimiter::QUANTUM * 10, now);
+    std::vector<uint64_t> bulk;
+    for (int i = 0; i < 3; i++) {
+        bulk.push_back(limiter.open());
+    }
+    const auto interactive = limiter.open(rusync::Priority::INTERACTIVE);
+    limiter.debit(rusync::RateLimiter::QUANTUM * 2, now);
+    for (const auto transfer: bulk) {
+        EXPECT_EQ(limiter.acquire(transfer, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    }
+    const auto grant = limiter.acquire(interactive, rusync::RateLimiter::QUANTUM, now);
+    EXPECT_EQ(grant.bytes, 0);
+    // only quantum of interactive transfer is waited for, not quanta of bulk ones queued before it
+    EXPECT_LT(grant.retry_after, 250ms);
+    now += 300ms;
+    EXPECT_EQ(limiter.acquire(bulk.front(), rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    EXPECT_EQ(limiter.acquire(interactive, rusync::RateLimiter::QUANTUM, now).bytes, rusync::RateLimiter::QUANTUM);
+    now += 100ms;
+    EXPECT_EQ(limiter.acquire(bulk.front(), rusync::RateLimiter::QUANTUM, now).bytes, rusync::RateLimiter::QUANTUM);
+    EXPECT_EQ(limiter.waiting(), 2);
+}
+
+TEST(BandwidthTest, stale_turn_moves_to_others) {
+    rusync::RateLimiter limiter;
+    auto now = rusync::RateLimiter::Clock::time_point();
+    limiter.set_rate(rusync::RateLimiter::QUANTUM * 10, now);
+    const auto stuck = limiter.open();
+    const auto active = limiter.open();
+    limiter.debit(rusync::RateLimiter::QUANTUM, now);
+    EXPECT_EQ(limiter.acquire(stuck, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    EXPECT_EQ(limiter.acquire(active, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    EXPECT_EQ(limiter.waiting(), 2);
+    now += 200ms;
+    // stuck had its turn, but didn't take it
+    EXPECT_EQ(limiter.acquire(active, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    now += rusync::RateLimiter::CLAIM_TIMEOUT + 1ms;
+    EXPECT_EQ(limiter.acquire(active, rusync::RateLimiter::QUANTUM, now).bytes, rusync::RateLimiter::QUANTUM);
+}
+
+TEST(BandwidthTest, closed_transfer_gives_up_turn) {
+    rusync::RateLimiter limiter;
+    auto now = rusync::RateLimiter::Clock::time_point();
+    limiter.set_rate(rusync::RateLimiter::QUANTUM * 10, now);
+    const auto closed = limiter.open();
+    const auto active = limiter.open();
+    limiter.debit(rusync::RateLimiter::QUANTUM, now);
+    EXPECT_EQ(limiter.acquire(closed, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    limiter.close(closed);
+    now += 200ms;
+    EXPECT_EQ(limiter.acquire(active, rusync::RateLimiter::QUANTUM, now).bytes, rusync::RateLimiter::QUANTUM);
+}
+
+TEST(BandwidthTest, debit_delays_next_transfer) {
+    constexpr uint64_t RATE = 1 << 20;
+    rusync::RateLimiter limiter;
+    auto now = rusync::RateLimiter::Clock::time_point();
+    limiter.set_rate(RATE, now);
+    limiter.debit(2 * RATE, now);
+    const auto grant = limiter.acquire(limiter.open(), rusync::RateLimiter::QUANTUM, now);
+    EXPECT_EQ(grant.bytes, 0);
+    EXPECT_GT(grant.retry_after, 1800ms);
+    EXPECT_LT(grant.retry_after, 2100ms);
+}
+
+TEST(BandwidthTest, lifting_limit_releases_waiting) {
+    rusync::RateLimiter limiter;
+    auto now = rusync::RateLimiter::Clock::time_point();
+    limiter.set_rate(rusync::RateLimiter::QUANTUM, now);
+    const auto transfer = limiter.open();
+    EXPECT_GT(limiter.acquire(transfer, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    EXPECT_EQ(limiter.acquire(transfer, rusync::RateLimiter::QUANTUM, now).bytes, 0);
+    limiter.set_rate(0, now);
+    EXPECT_FALSE(limiter.limited());
+    EXPECT_EQ(limiter.acquire(transfer, 1 << 20, now).bytes, 1 << 20);
+    EXPECT_EQ(limiter.waiting(), 0);
+}
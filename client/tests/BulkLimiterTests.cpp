@@ -0,0 +1,133 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "BulkLimiter.hpp"
+
+namespace {
+
+/**
+ * @brief records submitted requests, keeps their release callbacks to close them later
+ *
+ */
+struct Requests {
+    rusync::BulkLimiter::Submit request(const std::string& name) {
+        return [this, name](rusync::BulkLimiter::Release release) {
+            submitted.push_back(name);
+            open.push_back(std::move(release));
+        };
+    }
+    void close_first() {
+        auto release = std::move(open.front());
+        open.erase(open.begin());
+        release();
+    }
+    std::vector<std::string> submitted;
+    std::vector<rusync::BulkLimiter::Release> open;
+};
+
+}
+
+TEST(BulkLimiter, bulk_requests_wait_for_open_ones) {
+    rusync::BulkLimiter limiter {2};
+    Requests requests;
+    for (const std::string name: {"b1", "b2", "b3", "b4"}) {
+        limiter.submit(rusync::Priority::BULK, requests.request(name));
+    }
+    EXPECT_EQ(requests.submitted, (std::vector<std::string>{"b1", "b2"}));
+    EXPECT_EQ(limiter.open(), 2);
+    EXPECT_EQ(limiter.queued(), 2);
+    requests.close_first();
+    EXPECT_EQ(requests.submitted, (std::vector<std::string>{"b1", "b2", "b3"}));
+    requests.close_first();
+    requests.close_first();
+    requests.close_first();
+    EXPECT_EQ(requests.submitted.size(), 4);
+    EXPECT_EQ(limiter.open(), 0);
+    EXPECT_EQ(limiter.queued(), 0);
+}
+
+TEST(BulkLimiter, interactive_requests_are_not_queued) {
+    rusync::BulkLimiter limiter {1};
+    Requests requests;
+    limiter.submit(rusync::Priority::BULK, requests.request("b1"));
+    limiter.submit(rusync::Priority::BULK, requests.request("b2"));
+    limiter.submit(rusync::Priority::INTERACTIVE, requests.request("edit"));
+    EXPECT_EQ(requests.submitted, (std::vector<std::string>{"b1", "edit"}));
+    // releasing interactive request doesn't let bulk one in
+    requests.open.back()();
+    EXPECT_EQ(limiter.queued(), 1);
+}
+
+TEST(BulkLimiter, groups_are_let_in_by_turns) {
+    rusync::BulkLimiter limiter {1};
+    Requests requests;
+    for (const std::string name: {"a1", "a2", "a3"}) {
+        limiter.submit(rusync::Priority::BULK, requests.request(name), 0);
+    }
+    for (const std::string name: {"b1", "b2"}) {
+        limiter.submit(rusync::Priority::BULK, requests.request(name), 1);
+    }
+    EXPECT_EQ(limiter.queued(), 4);
+    for (int i = 0; i < 4; i++) {
+        requests.close_first();
+    }
+    EXPECT_EQ(requests.submitted, (std::vector<std::string>{"a1", "b1", "a2", "b2", "a3"}));
+    EXPECT_EQ(limiter.queued(), 0);
+}
+
+TEST(BulkLimiter, release_is_counted_once) {
+    rusync::BulkLimiter limiter {1};
+    Requests requests;
+    limiter.submit(rusync::Priority::BULK, requests.request("b1"));
+    limiter.submit(rusync::Priority::BULK, requests.request("b2"));
+    limiter.submit(rusync::Priority::BULK, requests.request("b3"));
+    auto release = requests.open.front();
+    release();
+    release();
+    EXPECT_EQ(requests.submitted, (std::vector<std::string>{"b1", "b2"}));
+    EXPECT_EQ(limiter.open(), 1);
+}
+
+TEST(BulkLimiter, reset_forgets_open_requests) {
+    rusync::BulkLimiter limiter {1};
+    Requests requests;
+    limiter.submit(rusync::Priority::BULK, requests.request("b1"));
+    limiter.submit(rusync::Priority::BULK, requests.request("b2"));
+    limiter.reset();
+    EXPECT_EQ(requests.submitted, (std::vector<std::string>{"b1", "b2"}));
+    // stream of previous connection is closed late, it doesn't let third request in
+    limiter.submit(rusync::Priority::BULK, requests.request("b3"));
+    requests.close_first();
+    EXPECT_EQ(requests.submitted.size(), 2);
+    requests.close_first();
+    EXPECT_EQ(requests.submitted.size(), 3);
+}
+
+TEST(BulkLimiter, release_after_limiter_is_gone) {
+    Requests requests;
+    {
+        rusync::BulkLimiter limiter {1};
+        limiter.submit(rusync::Priority::BULK, requests.request("b1"));
+        limiter.submit(rusync::Priority::BULK, requests.request("b2"));
+    }
+    requests.close_first();
+    EXPECT_EQ(requests.submitted.size(), 1);
+}
+
+TEST(BulkLimiter, interactive_request_keeps_order_of_its_key) {
+    rusync::BulkLimiter limiter {1};
+    Requests requests;
+    limiter.submit(rusync::Priority::BULK, requests.request("other"), 0, "other");
+    limiter.submit(rusync::Priority::BULK, requests.request("upload file"), 0, "file");
+    limiter.submit(rusync::Priority::BULK, requests.request("upload other"), 0, "other");
+    limiter.submit(rusync::Priority::BULK, requests.request("upload file of root 1"), 1, "file");
+    limiter.submit(rusync::Priority::INTERACTIVE, requests.request("delete file"), 0, "file");
+    // queued upload goes first, otherwise it would recreate deleted file
+    EXPECT_EQ(requests.submitted, (std::vector<std::string>{"other", "upload file", "delete file"}));
+    EXPECT_EQ(limiter.open(), 2);
+    EXPECT_EQ(limiter.queued(), 2);
+    requests.close_first();
+    requests.close_first();
+    requests.close_first();
+    EXPECT_EQ(requests.submitted, (std::vector<std::string>{"other", "upload file", "delete file", "upload file of root 1"}));
+}
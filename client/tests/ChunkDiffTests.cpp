@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <unistd.h>
+#include <xxhash.h>
+#include "ChunkDiff.hpp"
+#include "FileMeta.hpp"
+
+namespace {
+
+using Patch = std::tuple<uint64_t, std::string, bool>;
+
+std::vector<FileChunk> chunks_of(const std::string& content, uint32_t chunk_size) {
+    std::vector<FileChunk> chunks;
+    for (size_t offset = 0; offset < content.size(); offset += chunk_size) {
+        const auto chunk = content.substr(offset, chunk_size);
+        chunks.push_back({static_cast<uint32_t>(chunk.size()), XXH64(chunk.data(), chunk.size(), 0)});
+    }
+    return chunks;
+}
+
+std::vector<Patch> diff(const std::string& local, const std::string& remote, uint32_t chunk_size) {
+    std::vector<Patch> patches;
+    FILE* stream = fmemopen(const_cast<char*>(local.data()), local.size(), "rb");
+    rusync::diff_chunks(stream, local.size(), chunks_of(remote, chunk_size), [&patches](uint64_t offset, std::string data, bool end) {
+        patches.emplace_back(offset, std::move(data), end);
+    });
+    fclose(stream);
+    return patches;
+}
+
+}
+
+TEST(ChunkDiff, same_file) {
+    EXPECT_TRUE(diff("0123456789", "0123456789", 4).empty());
+}
+
+TEST(ChunkDiff, changed_chunk) {
+    EXPECT_EQ(diff("0123xx6789", "0123456789", 4), (std::vector<Patch>{{4, "xx67", false}, {10, "", true}}));
+}
+
+TEST(ChunkDiff, appended_tail) {
+    EXPECT_EQ(diff("0123456789ab", "01234567", 4), (std::vector<Patch>{{8, "89ab", true}}));
+}
+
+TEST(ChunkDiff, truncated_file) {
+    EXPECT_EQ(diff("012345", "0123456789", 4), (std::vector<Patch>{{4, "45", true}}));
+}
+
+TEST(FileMeta, parse) {
+    unsigned char buffer[1 + 2 * (sizeof(uint32_t) + sizeof(uint64_t))];
+    buffer[0] = 1;
+    const uint32_t size = 1000;
+    const uint64_t hashes[] = {42, 43};
+    for (size_t i = 0; i < 2; i++) {
+        memcpy(buffer + 1 + i * 12, &size, sizeof(size));
+        memcpy(buffer + 1 + i * 12 + sizeof(size), &hashes[i], sizeof(hashes[i]));
+    }
+    const auto meta = rusync::parse_meta(buffer, sizeof(buffer));
+    EXPECT_TRUE(meta.is_file);
+    ASSERT_EQ(meta.chunks.size(), 2);
+    EXPECT_EQ(meta.chunks[1].size, 1000);
+    EXPECT_EQ(meta.chunks[1].hash, 43);
+}
+
+TEST(FileMeta, parse_hash_algorithm) {
+    const unsigned char dir[] = {static_cast<uint8_t>(rusync::HashAlgorithm::XXHASH3) << 1};
+    const auto meta = rusync::parse_meta(dir, sizeof(dir));
+    EXPECT_FALSE(meta.is_file);
+    EXPECT_EQ(meta.hash_algorithm, rusync::HashAlgorithm::XXHASH3);
+    const unsigned char old_server[] = {1};
+    EXPECT_EQ(rusync::parse_meta(old_server, sizeof(old_server)).hash_algorithm, rusync::HashAlgorithm::XXHASH64);
+    const unsigned char unknown[] = {0xfe};
+    EXPECT_THROW(rusync::parse_meta(unknown, sizeof(unknown)), std::invalid_argument);
+}
+
+TEST(ChunkDiff, synced_chunks_match_server_chunks) {
+    const std::string local = std::string(2500, 'a') + std::string(1200, 'b');
+    // same grid, shifted grid and remote file smaller than local one
+    for (const auto& [remote, chunk_size]: std::vector<std::pair<std::string, uint32_t>>{
+            {std::string(2500, 'a') + std::string(1000, 'c'), 1000},
+            {local, 700},
+            {std::string(1500, 'a'), 1000}}) {
+        std::vector<FileChunk> synced;
+        FILE* stream = fmemopen(const_cast<char*>(local.data()), local.size(), "rb");
+        rusync::diff_chunks(stream, local.size(), chunks_of(remote, chunk_size), [](uint64_t, std::string, bool) {}, &synced);
+        fclose(stream);
+        const auto expected = chunks_of(local, rusync::calculate_chunk_size(local.size()));
+        ASSERT_EQ(synced.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); i++) {
+            EXPECT_EQ(synced[i].size, expected[i].size);
+            EXPECT_EQ(synced[i].hash, expected[i].hash);
+        }
+    }
+}
+
+TEST(ChunkDiff, synced_tail_is_hashed_from_emitted_patch) {
+    // file is rewritten after its tail was read, synced chunks should still describe what was sent
+    struct ChangingSource {
+        std::string_view view(uint64_t offset, uint64_t length) {
+            const auto result = std::string_view(content).substr(std::min<uint64_t>(offset, content.size()), length);
+            if (offset + result.size() == content.size()) {
+                previous = content;
+                content.replace(offset, result.size(), result.size(), 'z');
+                return std::string_view(previous).substr(offset, length);
+            }
+            return result;
+        }
+        std::string content;
+        std::string previous;
+    };
+    ChangingSource source {std::string(1000, 'a') + std::string(2700, 'b')};
+    const uint32_t chunk_size = rusync::calculate_chunk_size(source.content.size());
+    const auto expected = chunks_of(source.content, chunk_size);
+    std::vector<Patch> patches;
+    std::vector<FileChunk> synced;
+    rusync::detail::diff_chunks(source, 0, source.content.size(), chunks_of(std::string(1000, 'a'), 1000), [&patches](uint64_t offset, std::string data, bool end) {
+        patches.emplace_back(offset, std::move(data), end);
+    }, &synced, rusync::HashAlgorithm::XXHASH64);
+    ASSERT_EQ(patches.size(), 1);
+    EXPECT_EQ(std::get<1>(patches[0]), std::string(2700, 'b'));
+    ASSERT_EQ(synced.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(synced[i].hash, expected[i].hash);
+    }
+}
+
+TEST(ChunkDiff, mapped_file_matches_stream) {
+    // crosses several windows, so chunks which span window boundary are checked too
+    const uint64_t size = rusync::MappedFile::WINDOW + 3 * rusync::MappedFile::HUGE_PAGE + 123;
+    std::string local(size, '\0');
+    for (size_t i = 0; i < local.size(); i++) {
+        local[i] = static_cast<char>(i * 131 + i / 7919);
+    }
+    const auto chunk_size = rusync::calculate_chunk_size(local.size());
+    std::string remote = local.substr(0, size - 5000);
+    remote[chunk_size * 3 + 1] ^= 0x1;
+    remote[rusync::MappedFile::WINDOW + 7] ^= 0x1;
+    const auto path = std::filesystem::temp_directory_path() / ("rusync_mapped_diff_" + std::to_string(getpid()));
+    std::ofstream {path, std::ios::binary} << local;
+    const auto remote_chunks = chunks_of(remote, chunk_size);
+    std::vector<Patch> mapped_patches;
+    std::vector<FileChunk> mapped_synced;
+    {
+        auto file = rusync::MappedFile::open(path);
+        ASSERT_TRUE(file);
+        rusync::diff_chunks(*file, remote_chunks, [&mapped_patches](uint64_t offset, std::string data, bool end) {
+            mapped_patches.emplace_back(offset, std::move(data), end);
+        }, &mapped_synced);
+    }
+    std::vector<Patch> stream_patches;
+    std::vector<FileChunk> stream_synced;
+    FILE* stream = fopen(path.c_str(), "rb");
+    rusync::diff_chunks(stream, local.size(), remote_chunks, [&stream_patches](uint64_t offset, std::string data, bool end) {
+        stream_patches.emplace_back(offset, std::move(data), end);
+    }, &stream_synced);
+    fclose(stream);
+    const auto computed = rusync::compute_chunks_for_file(path);
+    std::filesystem::remove(path);
+    EXPECT_EQ(mapped_patches.size(), 3);
+    EXPECT_TRUE(mapped_patches == stream_patches);
+    ASSERT_EQ(mapped_synced.size(), computed.size());
+    ASSERT_EQ(stream_synced.size(), computed.size());
+    for (size_t i = 0; i < computed.size(); i++) {
+        EXPECT_EQ(mapped_synced[i].hash, computed[i].hash);
+        EXPECT_EQ(stream_synced[i].hash, computed[i].hash);
+    }
+}
+
+TEST(MappedFile, truncated_file_is_seen_as_shorter) {
+    const uint64_t size = rusync::MappedFile::WINDOW + rusync::MappedFile::HUGE_PAGE;
+    const auto path = std::filesystem::temp_directory_path() / ("rusync_mapped_truncated_" + std::to_string(getpid()));
+    std::ofstream {path, std::ios::binary} << std::string(size, 'a');
+    auto file = rusync::MappedFile::open(path);
+    ASSERT_TRUE(file);
+    EXPECT_EQ(file->view(0, 10), "aaaaaaaaaa");
+    std::filesystem::resize_file(path, rusync::MappedFile::WINDOW + 100);
+    // next window would end past end of file, reading it must not raise SIGBUS
+    EXPECT_EQ(file->view(rusync::MappedFile::WINDOW + 50, 1000).size(), 50);
+    EXPECT_TRUE(file->view(rusync::MappedFile::WINDOW + 200, 10).empty());
+    file.reset();
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "ClientStats.hpp"
+
+using namespace std::chrono_literals;
+
+TEST(ClientStats, empty) {
+    rusync::ClientStats stats;
+    const auto json = stats.to_json(0, 0);
+    EXPECT_NE(json.find("\"upload\":{\"file_bytes\":0,\"wire_bytes\":0,\"saved_ratio\":0.0}"), std::string::npos);
+    EXPECT_NE(json.find("\"queues\":{\"queued_operations\":0,\"pending_modifications\":0,\"in_flight_requests\":0}"), std::string::npos);
+}
+
+TEST(ClientStats, delta_sync_savings) {
+    rusync::ClientStats stats;
+    stats.record_upload_file(1000);
+    stats.record_sent(rusync::ClientStats::PATCH, 100);
+    stats.record_sent(rusync::ClientStats::UPLOAD_RANGE, 150);
+    stats.record_sent(rusync::ClientStats::META, 1000);
+    const auto json = stats.to_json(3, 2);
+    EXPECT_NE(json.find("\"upload\":{\"file_bytes\":1000,\"wire_bytes\":250,\"saved_ratio\":0.75}"), std::string::npos);
+    EXPECT_NE(json.find("\"queued_operations\":3,\"pending_modifications\":2"), std::string::npos);
+}
+
+TEST(ClientStats, requests_from_many_threads) {
+    constexpr int THREADS = 8;
+    constexpr int REQUESTS = 1000;
+    rusync::ClientStats stats;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&stats]() {
+            for (int i = 0; i < REQUESTS; i++) {
+                stats.in_flight_requests.add(1);
+                stats.record_request(rusync::ClientStats::GET_FILE, i % 2 == 0, 1ms);
+                stats.in_flight_requests.add(-1);
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    const auto json = stats.to_json(0, 0);
+    EXPECT_NE(json.find("\"get_file\":{\"ok\":4000,\"failed\":4000,"), std::string::npos);
+    EXPECT_NE(json.find("\"in_flight_requests\":0"), std::string::npos);
+}
+
+TEST(ClientStats, operations_and_full_sync) {
+    rusync::ClientStats stats;
+    stats.record_operation(rusync::ClientStats::INITIAL_SYNC, 20ms);
+    stats.record_full_sync(3s);
+    stats.record_reconnect();
+    const auto json = stats.to_json(0, 0);
+    EXPECT_NE(json.find("\"initial_sync\":{\"count\":1,\"duration\":{\"count\":1,"), std::string::npos);
+    EXPECT_NE(json.find("\"full_sync\":{\"count\":1,\"duration\":{\"count\":1,\"sum_seconds\":3.0,"), std::string::npos);
+    EXPECT_NE(json.find("\"2.5\":0,\"5\":1"), std::string::npos);
+    EXPECT_NE(json.find("\"connection\":{\"connects\":0,\"reconnects\":1}"), std::string::npos);
+}
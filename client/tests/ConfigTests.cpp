@@ -0,0 +1,33 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include "Config.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+rusync::Config with_roots(std::vector<rusync::Config::Root> roots) {
+    rusync::Config conf;
+    conf.roots = std::move(roots);
+    return conf;
+}
+
+}
+
+TEST(Config, distinct_roots_are_valid) {
+    const fs::path dir = fs::temp_directory_path();
+    EXPECT_FALSE(with_roots({{dir / "a", "k1"}, {dir / "b", "k2"}, {dir / "ab", "k3"}}).roots_conflict());
+    EXPECT_FALSE(with_roots({{dir / "a", "k1"}}).roots_conflict());
+}
+
+TEST(Config, roots_with_same_key_conflict) {
+    const fs::path dir = fs::temp_directory_path();
+    EXPECT_TRUE(with_roots({{dir / "a", "k1"}, {dir / "b", "k2"}, {dir / "c", "k1"}}).roots_conflict());
+}
+
+TEST(Config, overlapping_roots_conflict) {
+    const fs::path dir = fs::temp_directory_path();
+    EXPECT_TRUE(with_roots({{dir / "a", "k1"}, {dir / "a" / "b", "k2"}}).roots_conflict());
+    EXPECT_TRUE(with_roots({{dir / "a" / "b", "k1"}, {dir / "a/", "k2"}}).roots_conflict());
+    EXPECT_TRUE(with_roots({{dir / "a", "k1"}, {dir / "x" / ".." / "a", "k2"}}).roots_conflict());
+}
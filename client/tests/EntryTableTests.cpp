@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "EntryTable.hpp"
+
+namespace {
+std::vector<std::string> paths(const std::vector<const rusync::EntryTable::Entry*>& entries) {
+    std::vector<std::string> result;
+    for (const auto* entry: entries) {
+        result.emplace_back(entry->path);
+    }
+    return result;
+}
+}
+
+TEST(EntryTable, sorts_and_keeps_last_duplicate) {
+    rusync::EntryTable table;
+    table.add("b/file", rusync::DirEntry::FILE, 1, 10);
+    table.add("a", rusync::DirEntry::DIR, 0);
+    table.add("b/file", rusync::DirEntry::FILE, 2, 20);
+    EXPECT_FALSE(table.sorted());
+    table.sort();
+    ASSERT_EQ(table.size(), 2);
+    EXPECT_EQ(table[0].path, "a");
+    EXPECT_EQ(table[1].path, "b/file");
+    EXPECT_EQ(table[0].subtree_end, 1u);
+    EXPECT_EQ(table[1].hash, 2u);
+    EXPECT_EQ(table[1].size, 20u);
+}
+
+TEST(EntryTable, find) {
+    rusync::EntryTable table;
+    for (const auto* path: {"a", "a/b", "a/c", "d"}) {
+        table.add(path, rusync::DirEntry::FILE, 1);
+    }
+    table.sort();
+    EXPECT_TRUE(table.sorted());
+    ASSERT_NE(table.find("a/c"), nullptr);
+    EXPECT_EQ(table.find("a/c")->path, "a/c");
+    EXPECT_EQ(table.find("a/bb"), nullptr);
+    EXPECT_EQ(table.find(""), nullptr);
+}
+
+TEST(EntryTable, paths_survive_move_and_growth) {
+    rusync::EntryTable table;
+    const std::string long_path(100000, 'x');
+    for (int i = 0; i < 20000; i++) {
+        table.add("dir/" + std::to_string(i), rusync::DirEntry::FILE, i);
+    }
+    table.add(long_path, rusync::DirEntry::FILE, 0);
+    table.sort();
+    rusync::EntryTable moved = std::move(table);
+    ASSERT_NE(moved.find("dir/12345"), nullptr);
+    EXPECT_EQ(moved.find("dir/12345")->hash, 12345u);
+    ASSERT_NE(moved.find(long_path), nullptr);
+}
+
+TEST(EntryTable, diff) {
+    rusync::EntryTable local;
+    local.add("a", rusync::DirEntry::DIR, 0);
+    local.add("a/same", rusync::DirEntry::FILE, 1);
+    local.add("a/changed", rusync::DirEntry::FILE, 2);
+    local.add("local_only", rusync::DirEntry::FILE, 3);
+    local.sort();
+    rusync::EntryTable remote;
+    remote.add("remote_only", rusync::DirEntry::FILE, 4);
+    remote.add("a/changed", rusync::DirEntry::FILE, 5);
+    remote.add("a/same", rusync::DirEntry::FILE, 1);
+    remote.add("a", rusync::DirEntry::DIR, 0);
+    remote.add("0", rusync::DirEntry::DIR, 0);
+    remote.sort();
+
+    const auto diff = rusync::diff_entries(local, remote);
+    EXPECT_EQ(paths(diff.added), std::vector<std::string>{"local_only"});
+    EXPECT_EQ(paths(diff.removed), (std::vector<std::string>{"0", "remote_only"}));
+    EXPECT_EQ(paths(diff.modified), std::vector<std::string>{"a/changed"});
+    EXPECT_EQ(diff.modified[0]->hash, 2u);
+}
+
+TEST(EntryTable, diff_with_empty) {
+    rusync::EntryTable local;
+    local.add("x", rusync::DirEntry::FILE, 1);
+    local.sort();
+    const rusync::EntryTable remote;
+    const auto diff = rusync::diff_entries(local, remote);
+    EXPECT_EQ(diff.added.size(), 1);
+    EXPECT_TRUE(diff.removed.empty());
+    EXPECT_TRUE(diff.modified.empty());
+}
+
+TEST(EntryTable, dir_followed_by_its_subtree) {
+    EXPECT_LT(rusync::EntryTable::compare_paths("a/z", "a-b"), 0);
+    EXPECT_LT(rusync::EntryTable::compare_paths("a", "a/b"), 0);
+    EXPECT_EQ(rusync::EntryTable::compare_paths("a/b", "a/b"), 0);
+    rusync::EntryTable table;
+    table.add("a-b", rusync::DirEntry::FILE, 1);
+    table.add("a/z", rusync::DirEntry::FILE, 2);
+    table.add("a", rusync::DirEntry::DIR, 0);
+    table.sort();
+    ASSERT_EQ(table.size(), 3);
+    EXPECT_EQ(table[0].path, "a");
+    EXPECT_EQ(table[1].path, "a/z");
+    EXPECT_EQ(table[2].path, "a-b");
+    EXPECT_EQ(table[0].subtree_end, 2u);
+    EXPECT_NE(table[0].hash, 0u);
+}
+
+namespace {
+rusync::EntryTable make_tree(uint64_t changed_hash) {
+    rusync::EntryTable table;
+    table.add("docs", rusync::DirEntry::DIR, 0);
+    table.add("docs/readme", rusync::DirEntry::FILE, 1);
+    table.add("src", rusync::DirEntry::DIR, 0);
+    table.add("src/lib", rusync::DirEntry::DIR, 0);
+    table.add("src/lib/a.cpp", rusync::DirEntry::FILE, changed_hash);
+    table.add("src/main.cpp", rusync::DirEntry::FILE, 3);
+    table.sort();
+    return table;
+}
+
+uint64_t hash_of(const rusync::EntryTable& table, std::string_view path) {
+    return table.find(path)->hash;
+}
+}
+
+TEST(EntryTable, merkle_hashes) {
+    const auto tree = make_tree(2);
+    const auto same = make_tree(2);
+    const auto changed = make_tree(20);
+    EXPECT_EQ(tree.root_hash(), same.root_hash());
+    EXPECT_NE(tree.root_hash(), changed.root_hash());
+    EXPECT_EQ(hash_of(tree, "docs"), hash_of(changed, "docs"));
+    EXPECT_NE(hash_of(tree, "src"), hash_of(changed, "src"));
+    EXPECT_NE(hash_of(tree, "src/lib"), hash_of(changed, "src/lib"));
+    EXPECT_EQ(rusync::EntryTable().root_hash(), rusync::EntryTable().root_hash());
+}
+
+TEST(EntryTable, diff_skips_equal_subtrees) {
+    const auto tree = make_tree(2);
+    const auto diff = rusync::diff_entries(tree, make_tree(2));
+    EXPECT_TRUE(diff.added.empty() && diff.removed.empty() && diff.modified.empty());
+
+    const auto changed = rusync::diff_entries(tree, make_tree(20));
+    EXPECT_EQ(paths(changed.modified), std::vector<std::string>{"src/lib/a.cpp"});
+    EXPECT_TRUE(changed.added.empty());
+    EXPECT_TRUE(changed.removed.empty());
+}
+
+TEST(EntryTable, dir_hash_ignores_received_value) {
+    rusync::EntryTable local;
+    local.add("d", rusync::DirEntry::DIR, 0);
+    local.add("d/f", rusync::DirEntry::FILE, 5);
+    local.sort();
+    rusync::EntryTable remote;
+    remote.add("d", rusync::DirEntry::DIR, 12345);
+    remote.add("d/f", rusync::DirEntry::FILE, 5);
+    remote.sort();
+    EXPECT_EQ(local.root_hash(), remote.root_hash());
+    EXPECT_EQ(hash_of(local, "d"), hash_of(remote, "d"));
+}
+
+TEST(EntryTable, pruned_subtree_is_equal_to_local_one) {
+    const auto local = make_tree(2);
+    rusync::EntryTable remote;
+    // server left out subtree of docs, since client sent its digest
+    remote.add_pruned("docs", hash_of(local, "docs"));
+    remote.add("src", rusync::DirEntry::DIR, 0);
+    remote.add("src/lib", rusync::DirEntry::DIR, 0);
+    remote.add("src/lib/a.cpp", rusync::DirEntry::FILE, 20);
+    remote.add("src/main.cpp", rusync::DirEntry::FILE, 3);
+    remote.sort();
+    EXPECT_EQ(hash_of(remote, "docs"), hash_of(local, "docs"));
+    EXPECT_EQ(remote.find("docs")->subtree_end, 1u);
+    const auto diff = rusync::diff_entries(local, remote);
+    EXPECT_EQ(paths(diff.modified), std::vector<std::string>{"src/lib/a.cpp"});
+    EXPECT_TRUE(diff.added.empty());
+    EXPECT_TRUE(diff.removed.empty());
+    // the same subtree under other path has other digest
+    EXPECT_NE(rusync::EntryTable::subtree_digest("docs", 1), rusync::EntryTable::subtree_digest("doc", 1));
+}
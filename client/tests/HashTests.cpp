@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <xxhash.h>
+#include "Hash.hpp"
+
+TEST(Hash, algorithm_names) {
+    for (const auto algorithm: {rusync::HashAlgorithm::XXHASH64, rusync::HashAlgorithm::XXHASH3}) {
+        EXPECT_EQ(rusync::hash_algorithm_from(rusync::hash_algorithm_name(algorithm)), algorithm);
+        EXPECT_EQ(rusync::hash_algorithm_from(uint64_t{static_cast<uint8_t>(algorithm)}), algorithm);
+    }
+    EXPECT_EQ(rusync::hash_algorithm_from("md5"), std::nullopt);
+    EXPECT_EQ(rusync::hash_algorithm_from(uint64_t{2}), std::nullopt);
+}
+
+TEST(Hash, selected_implementation_matches_reference) {
+    std::string data;
+    // short, mid-size and long inputs of XXH3 take different code paths, only long ones are vectorized
+    for (const size_t size: {0, 3, 16, 128, 240, 241, 1000, 31622, 100000}) {
+        data.resize(size);
+        for (size_t i = 0; i < size; i++) {
+            data[i] = static_cast<char>(i * 131 + size);
+        }
+        EXPECT_EQ(rusync::hash_bytes(rusync::HashAlgorithm::XXHASH3, data.data(), data.size()), XXH3_64bits(data.data(), data.size()))
+            << size << " bytes, " << rusync::hash_implementation();
+        EXPECT_EQ(rusync::hash_bytes(rusync::HashAlgorithm::XXHASH64, data.data(), data.size()), XXH64(data.data(), data.size(), 0));
+    }
+}
+
+TEST(Hash, hasher_by_parts_matches_hash_bytes) {
+    std::string data(300000, '\0');
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<char>(i * 31 + 7);
+    }
+    for (const auto algorithm: {rusync::HashAlgorithm::XXHASH64, rusync::HashAlgorithm::XXHASH3}) {
+        for (const size_t part: {1, 240, 4096, 131072}) {
+            rusync::Hasher hasher {algorithm};
+            for (size_t offset = 0; offset < data.size(); offset += part) {
+                hasher.update(data.data() + offset, std::min(part, data.size() - offset));
+            }
+            EXPECT_EQ(hasher.digest(), rusync::hash_bytes(algorithm, data.data(), data.size())) << part << " bytes parts";
+        }
+        EXPECT_EQ(rusync::Hasher{algorithm}.digest(), rusync::hash_bytes(algorithm, nullptr, 0));
+    }
+}
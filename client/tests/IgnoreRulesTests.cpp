@@ -0,0 +1,135 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <unistd.h>
+#include "DirEntry.hpp"
+#include "IgnoreRules.hpp"
+
+namespace fs = std::filesystem;
+using rusync::IgnoreRules;
+
+TEST(IgnoreRules, empty_ignores_nothing) {
+    const auto rules = IgnoreRules::parse("# comment\n\n   \n");
+    EXPECT_TRUE(rules.empty());
+    EXPECT_FALSE(rules.ignored("a/b.txt", false));
+}
+
+TEST(IgnoreRules, literal_name_matches_at_any_depth) {
+    const auto rules = IgnoreRules::parse("node_modules\n.DS_Store\r\n");
+    EXPECT_EQ(rules.size(), 2);
+    EXPECT_TRUE(rules.ignored_entry("node_modules", true));
+    EXPECT_TRUE(rules.ignored_entry("web/app/node_modules", true));
+    EXPECT_TRUE(rules.ignored_entry("photos/.DS_Store", false));
+    EXPECT_FALSE(rules.ignored_entry("node_modules2", true));
+    EXPECT_TRUE(rules.ignored("web/node_modules/react/index.js", false));
+}
+
+TEST(IgnoreRules, suffixes) {
+    const auto rules = IgnoreRules::parse("*.o\n*~\n*.tar.gz\n");
+    EXPECT_TRUE(rules.ignored_entry("src/main.o", false));
+    EXPECT_TRUE(rules.ignored_entry("notes.txt~", false));
+    EXPECT_TRUE(rules.ignored_entry("backup.tar.gz", false));
+    EXPECT_FALSE(rules.ignored_entry("backup.gz", false));
+    EXPECT_FALSE(rules.ignored_entry("main.cpp", false));
+    // '*' doesn't cross dirs, but name is matched at any depth
+    EXPECT_FALSE(rules.ignored_entry("a.o/b", false));
+}
+
+TEST(IgnoreRules, dir_only) {
+    const auto rules = IgnoreRules::parse("build/\n");
+    EXPECT_TRUE(rules.ignored_entry("build", true));
+    EXPECT_TRUE(rules.ignored_entry("lib/build", true));
+    EXPECT_FALSE(rules.ignored_entry("build", false));
+    EXPECT_TRUE(rules.ignored("build/out.bin", false));
+}
+
+TEST(IgnoreRules, anchored) {
+    const auto rules = IgnoreRules::parse("/out\ndocs/tmp\n");
+    EXPECT_TRUE(rules.ignored_entry("out", true));
+    EXPECT_FALSE(rules.ignored_entry("src/out", true));
+    EXPECT_TRUE(rules.ignored_entry("docs/tmp", false));
+    EXPECT_FALSE(rules.ignored_entry("x/docs/tmp", false));
+}
+
+TEST(IgnoreRules, globs) {
+    const auto rules = IgnoreRules::parse("log-?.txt\n[Tt]emp*\n*.[ch]pp.bak\ncache/*/data\n**/generated/*.rs\nvendor/**\n");
+    EXPECT_TRUE(rules.ignored_entry("a/log-1.txt", false));
+    EXPECT_FALSE(rules.ignored_entry("a/log-12.txt", false));
+    EXPECT_TRUE(rules.ignored_entry("Temporary", true));
+    EXPECT_TRUE(rules.ignored_entry("x/temp", false));
+    EXPECT_FALSE(rules.ignored_entry("x/stemp", false));
+    EXPECT_TRUE(rules.ignored_entry("main.cpp.bak", false));
+    EXPECT_FALSE(rules.ignored_entry("main.cxx.bak", false));
+    EXPECT_TRUE(rules.ignored_entry("cache/v1/data", false));
+    EXPECT_FALSE(rules.ignored_entry("cache/v1/v2/data", false));
+    EXPECT_TRUE(rules.ignored_entry("generated/a.rs", false));
+    EXPECT_TRUE(rules.ignored_entry("crates/x/generated/a.rs", false));
+    EXPECT_FALSE(rules.ignored_entry("vendor", true));
+    EXPECT_TRUE(rules.ignored_entry("vendor/lib", true));
+    EXPECT_TRUE(rules.ignored_entry("vendor/lib/a.go", false));
+}
+
+TEST(IgnoreRules, many_double_stars_match_in_polynomial_time) {
+    std::string pattern;
+    for (int i = 0; i < 12; i++) {
+        pattern += "**/a/";
+    }
+    const auto rules = IgnoreRules::parse(pattern + "b\n");
+    std::string path;
+    for (int i = 0; i < 64; i++) {
+        path += "a/";
+    }
+    // backtracking over every split of parts between stars would never finish
+    EXPECT_FALSE(rules.ignored_entry(path + "c", false));
+    EXPECT_TRUE(rules.ignored_entry(path + "b", false));
+    EXPECT_FALSE(rules.ignored_entry("a/a/b", false));
+}
+
+TEST(IgnoreRules, rules_are_capped) {
+    std::string text = std::string(IgnoreRules::MAX_PATTERN + 1, 'x') + "\n";
+    for (size_t i = 0; i < IgnoreRules::MAX_RULES + 10; i++) {
+        text += "name" + std::to_string(i) + "\n";
+    }
+    const auto rules = IgnoreRules::parse(text);
+    EXPECT_EQ(rules.size(), IgnoreRules::MAX_RULES);
+    EXPECT_TRUE(rules.ignored("name0", false));
+    EXPECT_FALSE(rules.ignored(std::string(IgnoreRules::MAX_PATTERN + 1, 'x'), false));
+    EXPECT_FALSE(rules.ignored("name" + std::to_string(IgnoreRules::MAX_RULES + 5), false));
+}
+
+TEST(IgnoreRules, last_matching_rule_wins) {
+    const auto rules = IgnoreRules::parse("*.log\n!important.log\nlogs/\n!logs/\n\\!bang\n\\#hash\n");
+    EXPECT_TRUE(rules.ignored_entry("debug.log", false));
+    EXPECT_FALSE(rules.ignored_entry("important.log", false));
+    EXPECT_FALSE(rules.ignored_entry("logs", true));
+    EXPECT_TRUE(rules.ignored_entry("!bang", false));
+    EXPECT_TRUE(rules.ignored_entry("#hash", false));
+    const auto reignored = IgnoreRules::parse("!keep.tmp\n*.tmp\n");
+    EXPECT_TRUE(reignored.ignored_entry("keep.tmp", false));
+}
+
+TEST(IgnoreRules, file_within_ignored_dir_cant_be_reincluded) {
+    const auto rules = IgnoreRules::parse("build/\n!build/keep.txt\n");
+    EXPECT_FALSE(rules.ignored_entry("build/keep.txt", false));
+    EXPECT_TRUE(rules.ignored("build/keep.txt", false));
+}
+
+TEST(IgnoreRules, scan_prunes_ignored_dirs) {
+    const fs::path dir = fs::temp_directory_path() / ("rusync_ignore_" + std::to_string(getpid()));
+    fs::create_directories(dir / "src");
+    fs::create_directories(dir / "node_modules" / "react");
+    std::ofstream(dir / "src" / "main.cpp") << "int main() {}";
+    std::ofstream(dir / "src" / "main.o") << "obj";
+    std::ofstream(dir / "node_modules" / "react" / "index.js") << "js";
+    std::ofstream(dir / rusync::IGNORE_FILE) << "node_modules/\n*.o\n";
+    const auto entries = rusync::extract_entries_from_path(dir, rusync::HashAlgorithm::XXHASH64, IgnoreRules::load(dir));
+    std::set<std::string> paths;
+    for (const auto& entry: entries) {
+        paths.insert(entry.path);
+    }
+    EXPECT_EQ(paths, (std::set<std::string>{".rusyncignore", "src", "src/main.cpp"}));
+    EXPECT_TRUE(IgnoreRules::load(dir / "src").empty());
+    fs::remove_all(dir);
+}
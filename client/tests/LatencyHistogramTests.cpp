@@ -0,0 +1,44 @@
+#include <gtest/gtest.h>
+#include "LatencyHistogram.hpp"
+
+using namespace std::chrono_literals;
+
+TEST(LatencyHistogram, empty) {
+    rusync::LatencyHistogram histogram;
+    EXPECT_EQ(histogram.count(), 0);
+    EXPECT_EQ(histogram.percentile(0.99), 0us);
+}
+
+TEST(LatencyHistogram, small_values_are_exact) {
+    rusync::LatencyHistogram histogram;
+    for (int i = 1; i <= 10; i++) {
+        histogram.record(std::chrono::microseconds(i));
+    }
+    EXPECT_EQ(histogram.percentile(0.5), 5us);
+    EXPECT_EQ(histogram.percentile(1), 10us);
+    EXPECT_EQ(histogram.max(), 10us);
+}
+
+TEST(LatencyHistogram, relative_precision) {
+    rusync::LatencyHistogram histogram;
+    for (int i = 1; i <= 100000; i++) {
+        histogram.record(std::chrono::microseconds(i));
+    }
+    const auto p99 = histogram.percentile(0.99).count();
+    EXPECT_GE(p99, 99000);
+    EXPECT_LE(p99, 99000 * 1.04);
+    EXPECT_EQ(histogram.percentile(1), 100000us);
+}
+
+TEST(LatencyHistogram, merge) {
+    rusync::LatencyHistogram first;
+    rusync::LatencyHistogram second;
+    first.record(1ms);
+    second.record(1s);
+    second.record(1s);
+    first.merge(second);
+    EXPECT_EQ(first.count(), 3);
+    EXPECT_EQ(first.max(), 1s);
+    EXPECT_LE(first.percentile(0.3).count(), 1000 * 1.04);
+    EXPECT_GE(first.percentile(0.5).count(), 1'000'000 * 0.96);
+}
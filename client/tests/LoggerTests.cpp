@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Logger.hpp"
+
+TEST(Logger, level_from_name) {
+    EXPECT_EQ(rusync::log_level_from("debug"), rusync::LogLevel::DEBUG);
+    EXPECT_EQ(rusync::log_level_from("off"), rusync::LogLevel::OFF);
+    EXPECT_EQ(rusync::log_level_from("verbose"), std::nullopt);
+}
+
+TEST(Logger, ring_keeps_order_and_drops_when_full) {
+    rusync::LogRing ring {4};
+    const auto now = std::chrono::system_clock::now();
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(ring.push(rusync::LogLevel::INFO, now, std::to_string(i)));
+    }
+    EXPECT_FALSE(ring.push(rusync::LogLevel::INFO, now, "dropped"));
+    rusync::LogRing::Message message;
+    for (int i = 0; i < 4; i++) {
+        ASSERT_TRUE(ring.pop(message));
+        EXPECT_EQ(std::string(message.text, message.length), std::to_string(i));
+    }
+    EXPECT_FALSE(ring.pop(message));
+    EXPECT_TRUE(ring.push(rusync::LogLevel::WARN, now, "after wrap"));
+    ASSERT_TRUE(ring.pop(message));
+    EXPECT_EQ(message.level, rusync::LogLevel::WARN);
+}
+
+TEST(Logger, ring_truncates_long_message) {
+    rusync::LogRing ring {2};
+    ring.push(rusync::LogLevel::INFO, std::chrono::system_clock::now(), std::string(1000, 'x'));
+    rusync::LogRing::Message message;
+    ASSERT_TRUE(ring.pop(message));
+    EXPECT_EQ(message.length, rusync::LogRing::MAX_MESSAGE);
+}
+
+TEST(Logger, ring_concurrent_producers) {
+    constexpr int THREADS = 4;
+    constexpr int MESSAGES = 5000;
+    rusync::LogRing ring {256};
+    std::atomic<int> producing = THREADS;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&ring, &producing, t]() {
+            for (int i = 0; i < MESSAGES; i++) {
+                const auto text = std::to_string(t) + ":" + std::to_string(i);
+                while (!ring.push(rusync::LogLevel::INFO, std::chrono::system_clock::now(), text)) {
+                    std::this_thread::yield();
+                }
+            }
+            producing--;
+        });
+    }
+    std::set<std::string> received;
+    std::vector<int> last(THREADS, -1);
+    bool ordered = true;
+    auto message = std::make_unique<rusync::LogRing::Message>();
+    while (producing > 0 || received.size() < THREADS * MESSAGES) {
+        if (!ring.pop(*message)) {
+            std::this_thread::yield();
+            continue;
+        }
+        const std::string text {message->text, message->length};
+        const auto separator = text.find(':');
+        const int thread = std::stoi(text.substr(0, separator));
+        const int index = std::stoi(text.substr(separator + 1));
+        ordered = ordered && index > last[thread];
+        last[thread] = index;
+        received.insert(text);
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(received.size(), THREADS * MESSAGES);
+    EXPECT_TRUE(ordered);
+}
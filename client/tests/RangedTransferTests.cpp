@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <vector>
+#include "RangedTransfer.hpp"
+
+using rusync::RangedTransfer;
+
+TEST(RangedTransferTests, plan_small_file) {
+    const auto plan = RangedTransfer::plan(RangedTransfer::THRESHOLD);
+    EXPECT_EQ(plan.parallelism, 1);
+    EXPECT_EQ(plan.part_size, RangedTransfer::THRESHOLD);
+    EXPECT_EQ(plan.parts, 1);
+}
+
+TEST(RangedTransferTests, plan_grows_with_size) {
+    const auto plan = RangedTransfer::plan(4 * RangedTransfer::THRESHOLD);
+    EXPECT_EQ(plan.parallelism, 4);
+    EXPECT_EQ(plan.part_size, RangedTransfer::THRESHOLD);
+    EXPECT_EQ(plan.parts, 4);
+}
+
+TEST(RangedTransferTests, plan_is_bounded) {
+    const uint64_t size = 10'000'000'000;
+    const auto plan = RangedTransfer::plan(size);
+    EXPECT_EQ(plan.parallelism, RangedTransfer::MAX_PARALLELISM);
+    EXPECT_EQ(plan.part_size, RangedTransfer::MAX_PART_SIZE);
+    EXPECT_EQ(plan.parts, (size + plan.part_size - 1) / plan.part_size);
+}
+
+TEST(RangedTransferTests, run_covers_file_with_bounded_window) {
+    const uint64_t size = 3 * RangedTransfer::THRESHOLD + 123;
+    std::vector<std::pair<uint64_t, RangedTransfer::DoneCb>> in_flight;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    size_t max_in_flight = 0;
+    int done_calls = 0;
+    bool result = false;
+    RangedTransfer::run(size, [&](uint64_t offset, uint64_t length, RangedTransfer::DoneCb done) {
+        ranges.emplace_back(offset, length);
+        in_flight.emplace_back(offset, std::move(done));
+        max_in_flight = std::max(max_in_flight, in_flight.size());
+    }, [&](bool ok) {
+        done_calls++;
+        result = ok;
+    });
+    while (!in_flight.empty()) {
+        auto done = std::move(in_flight.front().second);
+        in_flight.erase(in_flight.begin());
+        done(true);
+    }
+    EXPECT_EQ(done_calls, 1);
+    EXPECT_TRUE(result);
+    EXPECT_EQ(max_in_flight, RangedTransfer::plan(size).parallelism);
+    uint64_t expected_offset = 0;
+    for (const auto& [offset, length]: ranges) {
+        EXPECT_EQ(offset, expected_offset);
+        expected_offset += length;
+    }
+    EXPECT_EQ(expected_offset, size);
+}
+
+TEST(RangedTransferTests, run_stops_on_failure) {
+    const uint64_t size = 8 * RangedTransfer::THRESHOLD;
+    std::vector<RangedTransfer::DoneCb> in_flight;
+    size_t started = 0;
+    int done_calls = 0;
+    bool result = true;
+    RangedTransfer::run(size, [&](uint64_t, uint64_t, RangedTransfer::DoneCb done) {
+        started++;
+        in_flight.push_back(std::move(done));
+    }, [&](bool ok) {
+        done_calls++;
+        result = ok;
+    });
+    const size_t initial = started;
+    in_flight[0](false);
+    for (size_t i = 1; i < in_flight.size(); i++) {
+        in_flight[i](true);
+    }
+    EXPECT_EQ(started, initial);
+    EXPECT_EQ(done_calls, 1);
+    EXPECT_FALSE(result);
+}
+
+TEST(RangedTransferTests, run_empty_file) {
+    bool result = false;
+    RangedTransfer::run(0, [](uint64_t, uint64_t, RangedTransfer::DoneCb) {
+        FAIL();
+    }, [&](bool ok) {
+        result = ok;
+    });
+    EXPECT_TRUE(result);
+}
+
+TEST(RangedTransferTests, run_only_missing) {
+    const uint64_t size = 4 * RangedTransfer::THRESHOLD;
+    const uint64_t part = RangedTransfer::plan(size).part_size;
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    bool result = false;
+    RangedTransfer::run(size, {{part / 2, part}, {3 * part, size}}, [&](uint64_t offset, uint64_t length, RangedTransfer::DoneCb done) {
+        ranges.emplace_back(offset, length);
+        done(true);
+    }, [&](bool ok) {
+        result = ok;
+    });
+    EXPECT_TRUE(result);
+    EXPECT_EQ(ranges, (std::vector<std::pair<uint64_t, uint64_t>>{{part / 2, part / 2}, {3 * part, part}}));
+}
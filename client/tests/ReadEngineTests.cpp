@@ -0,0 +1,145 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "ReadEngine.hpp"
+
+namespace fs = std::filesystem;
+using rusync::ReadEngine;
+
+namespace {
+class ReadEngineTests : public ::testing::TestWithParam<bool> {
+protected:
+    void SetUp() override {
+        m_dir = fs::temp_directory_path() / ("rusync_read_engine_" + std::to_string(getpid()));
+        fs::create_directories(m_dir);
+    }
+
+    void TearDown() override {
+        fs::remove_all(m_dir);
+    }
+
+    fs::path write(const std::string& name, size_t size) {
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; i++) {
+            data[i] = static_cast<char>(i * 131 + name.size());
+        }
+        const auto path = m_dir / name;
+        std::ofstream {path, std::ios::binary} << data;
+        m_contents[path] = std::move(data);
+        return path;
+    }
+
+    fs::path m_dir;
+    std::map<fs::path, std::string> m_contents;
+};
+}
+
+TEST_P(ReadEngineTests, delivers_blocks_in_order) {
+    ReadEngine engine {GetParam()};
+    std::vector<fs::path> paths;
+    // more files than queue depth, small ones and ones which take many blocks
+    for (size_t i = 0; i < ReadEngine::QUEUE_DEPTH * 2; i++) {
+        paths.push_back(write("file" + std::to_string(i), i % 3 == 0 ? 1000 * i + 1 : ReadEngine::BUFFER_SIZE * (i % 5) + i));
+    }
+    std::vector<std::string> read(paths.size());
+    std::vector<int> done(paths.size());
+    engine.read_files(paths, 4096, [&read, &paths](size_t file, uint64_t offset, const char* data, size_t size) {
+        EXPECT_EQ(offset, read[file].size());
+        EXPECT_TRUE(size == 4096 || offset + size == fs::file_size(paths[file]));
+        read[file].append(data, size);
+    }, [&done](size_t file, bool ok) {
+        EXPECT_TRUE(ok);
+        done[file]++;
+    });
+    for (size_t i = 0; i < paths.size(); i++) {
+        EXPECT_EQ(done[i], 1) << paths[i];
+        EXPECT_EQ(read[i], m_contents[paths[i]]) << paths[i];
+    }
+}
+
+TEST_P(ReadEngineTests, reports_missing_and_empty_files) {
+    ReadEngine engine {GetParam()};
+    const std::vector<fs::path> paths {write("empty", 0), m_dir / "missing", write("data", 10)};
+    std::vector<size_t> blocks(paths.size());
+    std::map<size_t, bool> done;
+    engine.read_files(paths, ReadEngine::BUFFER_SIZE, [&blocks](size_t file, uint64_t, const char*, size_t) {
+        blocks[file]++;
+    }, [&done](size_t file, bool ok) {
+        EXPECT_FALSE(done.contains(file));
+        done[file] = ok;
+    });
+    EXPECT_EQ(done, (std::map<size_t, bool>{{0, true}, {1, false}, {2, true}}));
+    EXPECT_EQ(blocks, (std::vector<size_t>{0, 0, 1}));
+}
+
+TEST_P(ReadEngineTests, engine_is_reusable_after_callback_throws) {
+    ReadEngine engine {GetParam()};
+    const std::vector<fs::path> paths {write("large", ReadEngine::BUFFER_SIZE * 8), write("small", 100)};
+    EXPECT_THROW(engine.read_files(paths, 4096, [](size_t, uint64_t, const char*, size_t) {
+        throw std::runtime_error("consumer failed");
+    }, [](size_t, bool) {}), std::runtime_error);
+    std::string read;
+    engine.read_files({paths[1]}, 4096, [&read](size_t, uint64_t, const char* data, size_t size) {
+        read.append(data, size);
+    }, [](size_t, bool ok) {
+        EXPECT_TRUE(ok);
+    });
+    EXPECT_EQ(read, m_contents[paths[1]]);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends, ReadEngineTests, ::testing::Values(true, false), [](const auto& info) {
+    return info.param ? "uring" : "threads";
+});
+
+TEST(ReadEngine, hash_files_matches_hash_bytes) {
+    const auto dir = fs::temp_directory_path() / ("rusync_hash_files_" + std::to_string(getpid()));
+    fs::create_directories(dir);
+    std::vector<fs::path> paths;
+    std::vector<std::string> contents;
+    for (size_t size: {0ul, 1ul, 100000ul, ReadEngine::BUFFER_SIZE * 3 + 17}) {
+        contents.emplace_back(size, static_cast<char>('a' + paths.size()));
+        paths.push_back(dir / std::to_string(size));
+        std::ofstream {paths.back(), std::ios::binary} << contents.back();
+    }
+    paths.push_back(dir / "missing");
+    for (const auto algorithm: {rusync::HashAlgorithm::XXHASH64, rusync::HashAlgorithm::XXHASH3}) {
+        const auto hashes = rusync::hash_files(paths, algorithm);
+        ASSERT_EQ(hashes.size(), paths.size());
+        for (size_t i = 0; i < contents.size(); i++) {
+            EXPECT_EQ(hashes[i], rusync::hash_bytes(algorithm, contents[i].data(), contents[i].size())) << paths[i];
+        }
+        EXPECT_EQ(hashes.back(), std::nullopt);
+    }
+    fs::remove_all(dir);
+}
+
+TEST(ReadEngine, engines_are_pooled_between_threads) {
+    {
+        auto engine = ReadEngine::acquire();
+        auto other = ReadEngine::acquire();
+        EXPECT_NE(engine.get(), other.get());
+    }
+    // every thread is served by engines of the pool, so no more of them exist than MAX_ENGINES
+    std::mutex mutex;
+    std::set<const ReadEngine*> used;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < ReadEngine::MAX_ENGINES * 2; i++) {
+        threads.emplace_back([&]() {
+            auto engine = ReadEngine::acquire();
+            std::lock_guard lock {mutex};
+            used.insert(engine.get());
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    EXPECT_LE(used.size(), ReadEngine::MAX_ENGINES);
+}
@@ -0,0 +1,283 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <map>
+#include <set>
+#include <boost/asio.hpp>
+#include "StrandScheduler.hpp"
+
+namespace {
+
+/**
+ * @brief set of single-threaded event loops, mimics workers of WorkerPool
+ *
+ */
+struct Executors {
+    explicit Executors(size_t size) : contexts(size) {
+        for (auto& context: contexts) {
+            guards.push_back(boost::asio::make_work_guard(context));
+            threads.emplace_back([&context]() { context.run(); });
+        }
+    }
+    ~Executors() {
+        join();
+    }
+    /**
+     * @brief waits till all posted handlers are done. Should be called before scheduler is destroyed
+     *
+     */
+    void join() {
+        for (auto& guard: guards) {
+            guard.reset();
+        }
+        for (auto& thread: threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+    rusync::StrandScheduler::Dispatch dispatch() {
+        return [this](size_t index, rusync::StrandScheduler::Handler handler) {
+            boost::asio::post(contexts[index], std::move(handler));
+        };
+    }
+    std::deque<boost::asio::io_context> contexts;
+    std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> guards;
+    std::vector<std::thread> threads;
+};
+
+}
+
+TEST(StrandScheduler, same_key_in_fifo_order) {
+    Executors executors {4};
+    rusync::StrandScheduler scheduler {4, executors.dispatch()};
+    std::mutex mutex;
+    std::map<std::string, std::vector<int>> executed;
+    std::promise<void> done;
+    std::atomic<int> remaining = 4 * 200;
+    for (int i = 0; i < 200; i++) {
+        for (const std::string key: {"a", "b", "c", "d"}) {
+            scheduler.post(key, [&, key, i](size_t) {
+                {
+                    std::lock_guard lock {mutex};
+                    executed[key].push_back(i);
+                }
+                if (--remaining == 0) {
+                    done.set_value();
+                }
+            });
+        }
+    }
+    done.get_future().wait();
+    executors.join();
+    for (const auto& [key, order]: executed) {
+        ASSERT_EQ(order.size(), 200);
+        EXPECT_TRUE(std::is_sorted(order.begin(), order.end())) << "key: " << key;
+    }
+}
+
+TEST(StrandScheduler, same_key_never_runs_concurrently) {
+    Executors executors {4};
+    rusync::StrandScheduler scheduler {4, executors.dispatch()};
+    std::atomic<int> running = 0;
+    std::atomic<bool> overlapped = false;
+    std::atomic<int> remaining = 100;
+    std::promise<void> done;
+    for (int i = 0; i < 100; i++) {
+        scheduler.post("hot", [&](size_t) {
+            if (++running > 1) {
+                overlapped = true;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            running--;
+            if (--remaining == 0) {
+                done.set_value();
+            }
+        });
+    }
+    done.get_future().wait();
+    executors.join();
+    EXPECT_FALSE(overlapped);
+}
+
+TEST(StrandScheduler, idle_executor_steals_work) {
+    Executors executors {2};
+    rusync::StrandScheduler scheduler {2, executors.dispatch()};
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<size_t> blocked_on;
+    // occupy one executor, everything posted meanwhile should be run by another one
+    scheduler.post("blocker", [&](size_t index) {
+        blocked_on.set_value(index);
+        released.wait();
+    });
+    const size_t busy = blocked_on.get_future().get();
+    std::atomic<int> remaining = 16;
+    std::promise<void> done;
+    std::mutex mutex;
+    std::set<size_t> used;
+    for (int i = 0; i < 16; i++) {
+        scheduler.post("key" + std::to_string(i), [&](size_t index) {
+            {
+                std::lock_guard lock {mutex};
+                used.insert(index);
+            }
+            if (--remaining == 0) {
+                done.set_value();
+            }
+        });
+    }
+    EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    release.set_value();
+    executors.join();
+    EXPECT_EQ(used.size(), 1);
+    EXPECT_FALSE(used.contains(busy));
+}
+
+TEST(StrandScheduler, pending_counts_not_started_tasks) {
+    std::vector<rusync::StrandScheduler::Handler> queued;
+    rusync::StrandScheduler scheduler {1, [&](size_t, rusync::StrandScheduler::Handler handler) {
+        queued.push_back(std::move(handler));
+    }};
+    scheduler.post("a", [](size_t) {});
+    scheduler.post("a", [](size_t) {});
+    scheduler.post([](size_t) {});
+    EXPECT_EQ(scheduler.pending(), 3);
+    while (!queued.empty()) {
+        auto handler = std::move(queued.front());
+        queued.erase(queued.begin());
+        handler();
+    }
+    EXPECT_EQ(scheduler.pending(), 0);
+}
+
+namespace {
+
+/**
+ * @brief single executor which runs handlers only when asked, so order of picked tasks is deterministic
+ *
+ */
+struct ManualExecutor {
+    rusync::StrandScheduler::Dispatch dispatch() {
+        return [this](size_t, rusync::StrandScheduler::Handler handler) {
+            queued.push_back(std::move(handler));
+        };
+    }
+    void run() {
+        while (!queued.empty()) {
+            auto handler = std::move(queued.front());
+            queued.erase(queued.begin());
+            handler();
+        }
+    }
+    std::vector<rusync::StrandScheduler::Handler> queued;
+};
+
+}
+
+TEST(StrandScheduler, interactive_tasks_go_before_bulk) {
+    ManualExecutor executor;
+    rusync::StrandScheduler scheduler {1, executor.dispatch()};
+    std::vector<std::string> executed;
+    for (const std::string key: {"bulk1", "bulk2", "bulk3"}) {
+        scheduler.post(key, [&executed, key](size_t) { executed.push_back(key); }, rusync::Priority::BULK);
+    }
+    scheduler.post("edit", [&executed](size_t) { executed.push_back("edit"); });
+    scheduler.post([&executed](size_t) { executed.push_back("any"); });
+    executor.run();
+    EXPECT_EQ(executed, (std::vector<std::string>{"edit", "any", "bulk1", "bulk2", "bulk3"}));
+}
+
+TEST(StrandScheduler, interactive_task_promotes_its_strand) {
+    ManualExecutor executor;
+    rusync::StrandScheduler scheduler {1, executor.dispatch()};
+    std::vector<std::string> executed;
+    scheduler.post("other", [&executed](size_t) { executed.push_back("other"); }, rusync::Priority::BULK);
+    scheduler.post("file", [&executed](size_t) { executed.push_back("file bulk"); }, rusync::Priority::BULK);
+    // keeps order within key, but doesn't wait for bulk work of other keys
+    scheduler.post("file", [&executed](size_t) { executed.push_back("file edit"); });
+    executor.run();
+    EXPECT_EQ(executed, (std::vector<std::string>{"file bulk", "file edit", "other"}));
+    EXPECT_EQ(scheduler.pending(), 0);
+}
+
+TEST(StrandScheduler, strand_waits_for_completion_of_its_task) {
+    ManualExecutor executor;
+    rusync::StrandScheduler scheduler {1, executor.dispatch()};
+    std::vector<std::string> executed;
+    rusync::Completion request;
+    scheduler.post("file", [&](size_t) {
+        executed.push_back("file upload");
+        // e.g. request which is still in flight once task returns
+        request = rusync::make_completion([&executed]() { executed.push_back("request closed"); });
+    });
+    scheduler.post("file", [&executed](size_t) { executed.push_back("file removal"); });
+    scheduler.post("other", [&executed](size_t) { executed.push_back("other"); });
+    executor.run();
+    EXPECT_EQ(executed, (std::vector<std::string>{"file upload", "other"}));
+    EXPECT_EQ(scheduler.pending(), 1);
+    request.reset();
+    executor.run();
+    EXPECT_EQ(executed, (std::vector<std::string>{"file upload", "other", "request closed", "file removal"}));
+    EXPECT_EQ(scheduler.pending(), 0);
+}
+
+TEST(StrandScheduler, groups_are_served_by_turns) {
+    ManualExecutor executor;
+    rusync::StrandScheduler scheduler {1, executor.dispatch()};
+    std::vector<std::string> executed;
+    // big sync of first root is queued before a few files of second one
+    for (const std::string key: {"0:a", "0:b", "0:c", "0:d"}) {
+        scheduler.post(key, [&executed, key](size_t) { executed.push_back(key); }, rusync::Priority::BULK, 0);
+    }
+    for (const std::string key: {"1:a", "1:b"}) {
+        scheduler.post(key, [&executed, key](size_t) { executed.push_back(key); }, rusync::Priority::BULK, 1);
+    }
+    executor.run();
+    EXPECT_EQ(executed, (std::vector<std::string>{"0:a", "1:a", "0:b", "1:b", "0:c", "0:d"}));
+    EXPECT_EQ(scheduler.pending(), 0);
+}
+
+TEST(StrandScheduler, interactive_task_is_stolen_before_bulk) {
+    Executors executors {2};
+    rusync::StrandScheduler scheduler {2, executors.dispatch()};
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<void> blocked;
+    // both executors are busy, so everything below is queued
+    std::atomic<int> started = 0;
+    for (const std::string key: {"blocker1", "blocker2"}) {
+        scheduler.post(key, [&](size_t) {
+            if (++started == 2) {
+                blocked.set_value();
+            }
+            released.wait();
+        }, rusync::Priority::BULK);
+    }
+    blocked.get_future().wait();
+    std::mutex mutex;
+    std::vector<std::string> executed;
+    std::atomic<int> remaining = 11;
+    std::promise<void> done;
+    auto record = [&](const std::string& name) {
+        {
+            std::lock_guard lock {mutex};
+            executed.push_back(name);
+        }
+        if (--remaining == 0) {
+            done.set_value();
+        }
+    };
+    for (int i = 0; i < 10; i++) {
+        scheduler.post("bulk" + std::to_string(i), [&record, i](size_t) { record("bulk" + std::to_string(i)); }, rusync::Priority::BULK);
+    }
+    scheduler.post("edit", [&record](size_t) { record("edit"); });
+    release.set_value();
+    EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    executors.join();
+    ASSERT_EQ(executed.size(), 11);
+    // two executors are released at once, each takes interactive work first if there is any
+    const auto edit = std::find(executed.begin(), executed.end(), "edit") - executed.begin();
+    EXPECT_LT(edit, 2);
+}
@@ -0,0 +1,125 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include "SyncedTail.hpp"
+
+namespace fs = std::filesystem;
+using rusync::SyncedTail;
+
+namespace {
+class SyncedTailTests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        write(std::string(100000, 'a') + std::string(100000, 'b'), std::ios::trunc);
+    }
+
+    void TearDown() override {
+        fs::remove(m_path);
+    }
+
+    void write(const std::string& data, std::ios::openmode mode) {
+        std::ofstream stream {m_path, std::ios::binary | std::ios::out | mode};
+        stream << data;
+    }
+
+    void overwrite(uint64_t offset, const std::string& data) {
+        std::fstream stream {m_path, std::ios::binary | std::ios::in | std::ios::out};
+        stream.seekp(offset);
+        stream << data;
+    }
+
+    SyncedTail capture() {
+        const int fd = open(m_path.c_str(), O_RDONLY);
+        auto tail = SyncedTail::from_fd(fd, fs::file_size(m_path));
+        close(fd);
+        EXPECT_TRUE(tail);
+        return *tail;
+    }
+
+    bool prefix_of_file(const SyncedTail& tail) {
+        const int fd = open(m_path.c_str(), O_RDONLY);
+        const bool result = tail.prefix_of(fd);
+        close(fd);
+        return result;
+    }
+
+    const fs::path m_path = fs::temp_directory_path() / ("rusync_synced_tail_" + std::to_string(getpid()));
+};
+}
+
+TEST_F(SyncedTailTests, append_keeps_prefix) {
+    const auto tail = capture();
+    EXPECT_EQ(tail.length, 200000);
+    EXPECT_TRUE(prefix_of_file(tail));
+    write("appended line\n", std::ios::app);
+    EXPECT_TRUE(prefix_of_file(tail));
+    const int fd = open(m_path.c_str(), O_RDONLY);
+    EXPECT_EQ(SyncedTail::read(fd, tail.length, 14), "appended line\n");
+    EXPECT_FALSE(SyncedTail::read(fd, tail.length, 15));
+    close(fd);
+}
+
+TEST_F(SyncedTailTests, rewrite_near_end_is_detected) {
+    const auto tail = capture();
+    overwrite(199990, "x");
+    write("appended", std::ios::app);
+    EXPECT_FALSE(prefix_of_file(tail));
+}
+
+TEST_F(SyncedTailTests, rewrite_of_head_is_detected) {
+    const auto tail = capture();
+    overwrite(10, "x");
+    EXPECT_FALSE(prefix_of_file(tail));
+}
+
+TEST_F(SyncedTailTests, truncation_is_detected) {
+    const auto tail = capture();
+    write("short", std::ios::trunc);
+    EXPECT_FALSE(prefix_of_file(tail));
+}
+
+TEST_F(SyncedTailTests, replaced_file_is_detected) {
+    const auto tail = capture();
+    const auto copy = m_path.string() + ".copy";
+    fs::copy_file(m_path, copy);
+    std::ofstream {copy, std::ios::app} << "more";
+    fs::rename(copy, m_path);
+    EXPECT_FALSE(prefix_of_file(tail));
+}
+
+TEST(SyncedTails, shared_registry) {
+    rusync::SyncedTails tails;
+    EXPECT_FALSE(tails.get("log"));
+    tails.set("log", SyncedTail{10, 1, 2, 3});
+    EXPECT_EQ(tails.get("log")->length, 10);
+    tails.erase("log");
+    EXPECT_FALSE(tails.get("log"));
+}
+
+TEST(SyncedTails, least_recently_used_is_dropped) {
+    rusync::SyncedTails tails {2};
+    tails.set("a", SyncedTail{1, 1, 2, 3});
+    tails.set("b", SyncedTail{2, 1, 2, 3});
+    EXPECT_TRUE(tails.get("a"));
+    tails.set("c", SyncedTail{3, 1, 2, 3});
+    EXPECT_EQ(tails.size(), 2);
+    EXPECT_TRUE(tails.get("a"));
+    EXPECT_FALSE(tails.get("b"));
+    EXPECT_TRUE(tails.get("c"));
+    tails.erase("a");
+    tails.set("d", SyncedTail{4, 1, 2, 3});
+    EXPECT_TRUE(tails.get("c"));
+    EXPECT_TRUE(tails.get("d"));
+}
+
+TEST(SyncedTails, appends_are_verified_periodically) {
+    SyncedTail tail {10, 1, 2, 3};
+    EXPECT_FALSE(tail.needs_verify());
+    tail.appends = SyncedTail::VERIFY_EVERY - 1;
+    EXPECT_FALSE(tail.needs_verify());
+    tail.appends++;
+    EXPECT_TRUE(tail.needs_verify());
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Tracing.hpp"
+
+TEST(Tracing, header_round_trip) {
+    const auto value = rusync::Tracer::header_value(0x1234abcd, 42);
+    EXPECT_EQ(value, "000000001234abcd:000000000000002a");
+    const auto ids = rusync::Tracer::parse_header(value);
+    ASSERT_TRUE(ids);
+    EXPECT_EQ(ids->first, 0x1234abcdu);
+    EXPECT_EQ(ids->second, 42u);
+}
+
+TEST(Tracing, malformed_header) {
+    EXPECT_FALSE(rusync::Tracer::parse_header(""));
+    EXPECT_FALSE(rusync::Tracer::parse_header("abc"));
+    EXPECT_FALSE(rusync::Tracer::parse_header("abc:"));
+    EXPECT_FALSE(rusync::Tracer::parse_header("xyz:1"));
+    EXPECT_FALSE(rusync::Tracer::parse_header("00000000000000001:1"));
+}
+
+TEST(Tracing, disabled_span_is_inactive) {
+    rusync::TraceSpan span {"noop", "test"};
+    EXPECT_FALSE(span.active());
+}
+
+TEST(Tracing, spans_written_as_json_array) {
+    const auto path = std::filesystem::temp_directory_path() / "rusync_tracing_test.json";
+    auto& tracer = rusync::Tracer::instance();
+    ASSERT_TRUE(tracer.start(path, "test"));
+    {
+        rusync::TraceScope trace {0xabc};
+        rusync::TraceSpan span {"operation", "worker", {{"path", "a\"b"}}};
+        EXPECT_TRUE(span.active());
+        tracer.flow(true, 7, span.start());
+    }
+    {
+        rusync::TraceScope trace {0xdef};
+        EXPECT_EQ(rusync::Tracer::current_trace(), 0xdefu);
+    }
+    EXPECT_EQ(rusync::Tracer::current_trace(), 0u);
+    tracer.stop();
+    EXPECT_FALSE(rusync::Tracer::enabled());
+
+    std::ifstream stream {path};
+    std::stringstream content;
+    content << stream.rdbuf();
+    const auto json = content.str();
+    std::filesystem::remove(path);
+    EXPECT_EQ(json.substr(0, 2), "[\n");
+    EXPECT_EQ(json.substr(json.size() - 2), "\n]");
+    EXPECT_NE(json.find("\"name\":\"process_name\",\"ph\":\"M\""), std::string::npos);
+    EXPECT_NE(json.find("\"name\":\"operation\",\"cat\":\"worker\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(json.find("\"args\":{\"trace\":\"0000000000000abc\",\"path\":\"a\\\"b\"}"), std::string::npos);
+    EXPECT_NE(json.find("\"ph\":\"s\",\"id\":\"0x0000000000000007\""), std::string::npos);
+    EXPECT_EQ(json.find(",\n]"), std::string::npos);
+}
+
+TEST(Tracing, batches_of_concurrent_spans_are_all_written) {
+    const auto path = std::filesystem::temp_directory_path() / "rusync_tracing_concurrent_test.json";
+    auto& tracer = rusync::Tracer::instance();
+    ASSERT_TRUE(tracer.start(path, "test"));
+    constexpr int THREADS = 4;
+    constexpr int SPANS = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([]() {
+            for (int i = 0; i < SPANS; i++) {
+                rusync::TraceSpan span {"span", "test"};
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    tracer.stop();
+
+    std::ifstream stream {path};
+    std::stringstream content;
+    content << stream.rdbuf();
+    const auto json = content.str();
+    std::filesystem::remove(path);
+    size_t spans = 0;
+    for (auto position = json.find("\"name\":\"span\""); position != std::string::npos; position = json.find("\"name\":\"span\"", position + 1)) {
+        spans++;
+    }
+    EXPECT_EQ(spans, THREADS * SPANS);
+    EXPECT_EQ(json.substr(json.size() - 2), "\n]");
+    EXPECT_EQ(json.find(",\n]"), std::string::npos);
+}
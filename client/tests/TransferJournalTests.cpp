@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include "TransferJournal.hpp"
+
+namespace fs = std::filesystem;
+using rusync::RangeSet;
+using rusync::TransferJournal;
+
+TEST(RangeSetTests, merges_ranges) {
+    RangeSet set;
+    set.add(10, 20);
+    set.add(30, 40);
+    set.add(20, 25);
+    set.add(5, 12);
+    EXPECT_EQ(set.ranges(), (std::vector<RangeSet::Range>{{5, 25}, {30, 40}}));
+    set.add(0, 100);
+    EXPECT_EQ(set.ranges(), (std::vector<RangeSet::Range>{{0, 100}}));
+    EXPECT_TRUE(set.covers(100));
+    EXPECT_FALSE(set.covers(101));
+}
+
+TEST(RangeSetTests, missing_ranges) {
+    RangeSet set;
+    EXPECT_EQ(set.missing(10), (std::vector<RangeSet::Range>{{0, 10}}));
+    set.add(2, 4);
+    set.add(6, 8);
+    EXPECT_EQ(set.missing(10), (std::vector<RangeSet::Range>{{0, 2}, {4, 6}, {8, 10}}));
+    EXPECT_EQ(set.bytes(), 4);
+    set.add(0, 2);
+    set.add(8, 10);
+    EXPECT_EQ(set.missing(10), (std::vector<RangeSet::Range>{{4, 6}}));
+}
+
+TEST(TransferJournalTests, survives_reload) {
+    const fs::path path = fs::temp_directory_path() / ("rusync_journal_" + std::to_string(getpid()));
+    {
+        auto journal = TransferJournal::create(path, 100, "some/file");
+        journal.record(0, 10);
+        journal.record(50, 60);
+        EXPECT_FALSE(journal.complete());
+    }
+    {
+        // torn trailing record is ignored
+        std::ofstream stream {path, std::ios::binary | std::ios::app};
+        stream.write("xyz", 3);
+    }
+    auto journal = TransferJournal::load(path);
+    ASSERT_TRUE(journal);
+    EXPECT_EQ(journal->size(), 100);
+    EXPECT_EQ(journal->key(), "some/file");
+    EXPECT_EQ(journal->received().ranges(), (std::vector<RangeSet::Range>{{0, 10}, {50, 60}}));
+    journal->remove();
+    EXPECT_FALSE(fs::exists(path));
+    EXPECT_FALSE(TransferJournal::load(path));
+}
+
+TEST(TransferJournalTests, rejects_corrupted) {
+    const fs::path path = fs::temp_directory_path() / ("rusync_journal_bad_" + std::to_string(getpid()));
+    {
+        std::ofstream stream {path, std::ios::binary};
+        stream << "not a journal at all";
+    }
+    EXPECT_FALSE(TransferJournal::load(path));
+    fs::remove(path);
+}
@@ -1,8 +1,73 @@
 #include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
 #include "Utils.hpp"
 
 TEST(EncodeUrl, basic_encode_test) {
     std::string source = "key=abc&path=test file.cpp";
     std::string encoded = rusync::url_encode(source);
     EXPECT_TRUE(encoded == "key%3Dabc%26path%3Dtest%20file.cpp");
-}
\ No newline at end of file
+}
+TEST(ParseParams, basic_parse_test) {
+    const auto params = rusync::parse_params("key=abc&path=test file.cpp&end");
+    ASSERT_EQ(params.size(), 3);
+    EXPECT_EQ(params.at("key"), "abc");
+    EXPECT_EQ(params.at("path"), "test file.cpp");
+    EXPECT_EQ(params.at("end"), "");
+}
+
+TEST(ParseParams, value_with_separator) {
+    const auto params = rusync::parse_params("path=a=b");
+    EXPECT_EQ(params.at("path"), "a=b");
+    EXPECT_TRUE(rusync::parse_params("").empty());
+}
+
+TEST(ParseParams, malformed_query) {
+    const auto params = rusync::parse_params("=v&a=1&&flag&b=2&");
+    EXPECT_EQ(params.at("a"), "1");
+    EXPECT_EQ(params.at("b"), "2");
+    EXPECT_EQ(params.at("flag"), "");
+    EXPECT_EQ(params.at(""), "");
+    EXPECT_EQ(rusync::parse_params("&").size(), 1);
+}
+
+TEST(ParseParams, lookups) {
+    const auto params = rusync::parse_params("offset=42&path=a&bad=4x&path=b");
+    EXPECT_EQ(params.number("offset"), 42);
+    EXPECT_EQ(params.at("path"), "b");
+    EXPECT_THROW(params.number("bad"), std::invalid_argument);
+    EXPECT_THROW(params.at("missing"), std::out_of_range);
+    EXPECT_EQ(params.get("missing"), std::nullopt);
+    EXPECT_FALSE(params.contains("missing"));
+    std::string many;
+    for (size_t i = 0; i <= rusync::QueryParams::MAX_INDEXED; i++) {
+        many += "p" + std::to_string(i) + "=" + std::to_string(i) + "&";
+    }
+    // params after indexed ones are found by scanning query
+    const auto copy = rusync::parse_params(many + "end");
+    EXPECT_EQ(copy.size(), rusync::QueryParams::MAX_INDEXED + 2);
+    EXPECT_EQ(copy.number("p16"), 16);
+    EXPECT_EQ(copy.at("end"), "");
+}
+
+TEST(EncodeUrl, decode) {
+    EXPECT_EQ(rusync::url_decode("key%3Dabc%26path%3Dtest%20file.cpp"), "key=abc&path=test file.cpp");
+    // malformed escapes are kept as is
+    EXPECT_EQ(rusync::url_decode("100%%2g%4"), "100%%2g%4");
+    std::string all;
+    for (int c = 0; c < 256; c++) {
+        all.push_back(static_cast<char>(c));
+    }
+    EXPECT_EQ(rusync::url_decode(rusync::url_encode(all)), all);
+}
+
+TEST(EncodeUrl, query_builder_matches_encoded_query) {
+    rusync::QueryBuilder query;
+    query.add("path", "dir/a b&c=d.txt").add("offset", uint64_t{1234}).add("end", "1");
+    // servers decode whole query before splitting it, so builder encodes separators too
+    EXPECT_EQ(rusync::make_uri("host", "80", "/files", "k y", query),
+              "http://host:80/files?" + rusync::url_encode("key=k y&path=dir/a b&c=d.txt&offset=1234&end=1"));
+    const auto params = rusync::QueryParams::decode(rusync::url_encode("key=abc&path=x y"));
+    EXPECT_EQ(params.at("path"), "x y");
+    EXPECT_EQ(rusync::make_uri("host", "80", "/files_description", "abc", {}), "http://host:80/files_description?key%3Dabc");
+}
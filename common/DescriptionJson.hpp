@@ -0,0 +1,176 @@
+#pragma once
+#include <algorithm>
+#include <optional>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include "DirEntry.hpp"
+#include "EntryTable.hpp"
+
+namespace rusync {
+
+namespace detail {
+/**
+ * @brief rapidjson output stream which appends to byte container (std::string, std::vector<char>)
+ * 
+ * @tparam Output 
+ */
+template <typename Output>
+struct AppendStream {
+    typedef char Ch;
+
+    void Put(Ch c) {
+        out.push_back(c);
+    }
+
+    void Flush() {
+
+    }
+
+    Output& out;
+};
+}
+
+/**
+ * @brief at most this many subtree digests of client's dirs are sent with files description request
+ * 
+ */
+inline constexpr size_t MAX_KNOWN_DIRS = 1 << 20;
+
+/**
+ * @brief what client asked for by query params of files description request
+ * 
+ */
+struct DescriptionOptions {
+    /**
+     * @brief algorithm of hashes, it's set when client asked for specific algorithm
+     * 
+     */
+    std::optional<HashAlgorithm> algorithm;
+    /**
+     * @brief client knows Merkle hashes of dirs. Otherwise dirs are sent with hash 0, which older clients compare with 0 of their own scan
+     * 
+     */
+    bool dir_hashes = false;
+    /**
+     * @brief sorted subtree digests (see EntryTable::subtree_digest) of client's dirs. Dir with one of them is sent as pruned, without its subtree
+     * 
+     */
+    std::vector<uint64_t> known_dirs;
+};
+
+/**
+ * @brief builds body of files description response: JSON array of {path, type, hash, size} objects, pruned dirs have "pruned": true.<br>
+ * If algorithm is set, array is wrapped into {"hash_algorithm": <id>, "entries": [...]} object
+ * 
+ * @tparam Entries container of DirEntry or EntryTable, only subtrees of EntryTable can be pruned
+ * @tparam Output byte container, e.g. pooled buffer of response
+ * @param entries 
+ * @param options 
+ * @param out json is appended to it as entries are written, no document is built in between
+ */
+template <typename Entries, typename Output>
+void serialize_description(const Entries& entries, const DescriptionOptions& options, Output& out) {
+    detail::AppendStream<Output> stream {out};
+    rapidjson::Writer<detail::AppendStream<Output>> writer {stream};
+    if (options.algorithm) {
+        writer.StartObject();
+        writer.Key("hash_algorithm");
+        writer.Uint(static_cast<uint8_t>(*options.algorithm));
+        writer.Key("entries");
+    }
+    writer.StartArray();
+    for (auto it = entries.begin(); it != entries.end();) {
+        const auto& entry = *it++;
+        const bool dir = entry.type == DirEntry::DIR;
+        bool pruned = false;
+        if constexpr (std::is_same_v<Entries, EntryTable>) {
+            pruned = dir && options.dir_hashes &&
+                std::binary_search(options.known_dirs.begin(), options.known_dirs.end(), EntryTable::subtree_digest(entry.path, entry.hash));
+            if (pruned) {
+                it = entries.begin() + entry.subtree_end;
+            }
+        }
+        writer.StartObject();
+        writer.Key("path");
+        writer.String(entry.path.data(), static_cast<rapidjson::SizeType>(entry.path.size()));
+        writer.Key("type");
+        writer.String(entry.type_str().c_str());
+        writer.Key("hash");
+        writer.Uint64(dir && !options.dir_hashes ? 0 : entry.hash);
+        writer.Key("size");
+        writer.Uint64(entry.size);
+        if (pruned) {
+            writer.Key("pruned");
+            writer.Bool(true);
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+    if (options.algorithm) {
+        writer.EndObject();
+    }
+}
+
+/**
+ * @brief same as above, but with string of its own
+ * 
+ * @tparam Entries 
+ * @param entries 
+ * @param options 
+ * @return std::string 
+ */
+template <typename Entries>
+std::string serialize_description(const Entries& entries, const DescriptionOptions& options = {}) {
+    std::string out;
+    serialize_description(entries, options, out);
+    return out;
+}
+
+/**
+ * @brief parses body of files description response
+ * 
+ * @param data 
+ * @param size 
+ * @return std::optional<EntryTable> sorted table (hashes of dirs are recomputed, except for pruned ones), nullopt if data doesn't match schema.
+ * Plain array is hashed with XXH64, otherwise algorithm of table is read from hash_algorithm
+ */
+inline std::optional<EntryTable> parse_description(const char* data, size_t size) {
+    rapidjson::Document document;
+    document.Parse(data, size);
+    auto algorithm = std::make_optional(HashAlgorithm::XXHASH64);
+    const rapidjson::Value* array = &document;
+    if (document.IsObject()) {
+        if (!document.HasMember("hash_algorithm") || !document["hash_algorithm"].IsUint() || !document.HasMember("entries")) {
+            return std::nullopt;
+        }
+        algorithm = hash_algorithm_from(uint64_t{document["hash_algorithm"].GetUint()});
+        array = &document["entries"];
+    }
+    if (!algorithm || !array->IsArray()) {
+        return std::nullopt;
+    }
+    EntryTable entries;
+    entries.set_hash_algorithm(*algorithm);
+    entries.reserve(array->Size());
+    for (const auto& entry: array->GetArray()) {
+        const auto& path = entry["path"];
+        const auto type = entry["type"] == "file" ? DirEntry::FILE : DirEntry::DIR;
+        if (type == DirEntry::DIR && entry.HasMember("pruned") && entry["pruned"].IsTrue()) {
+            entries.add_pruned(std::string_view(path.GetString(), path.GetStringLength()), entry["hash"].GetUint64());
+            continue;
+        }
+        entries.add(
+            std::string_view(path.GetString(), path.GetStringLength()),
+            type,
+            entry["hash"].GetUint64(),
+            entry.HasMember("size") ? entry["size"].GetUint64() : 0
+        );
+    }
+    entries.sort();
+    return entries;
+}
+}
@@ -5,8 +5,9 @@ namespace rusync {
 
 DirEntry::DirEntry(const std::string& path,
         DirEntry::Type type,
-        uint64_t hash
-) : path {path}, type {type}, hash {hash} {
+        uint64_t hash,
+        uint64_t size
+) : path {path}, type {type}, hash {hash}, size {size} {
 
 }
 
@@ -17,16 +18,18 @@ std::string DirEntry::type_str() const {
     return "dir";
 }
 
-DirEntry DirEntry::from_path(fs::path path, fs::path origin) {
-    XXH64_hash_t hash = 0;
+DirEntry DirEntry::from_path(fs::path path, fs::path origin, HashAlgorithm algorithm) {
+    uint64_t hash = 0;
+    uint64_t size = 0;
     if (fs::is_regular_file(path)) {
-        std::ifstream file {path};
-        std::vector<char> buffer;
-        buffer.resize(fs::file_size(path));
-        file.read(buffer.data(), buffer.size());
-        hash = XXH64(buffer.data(), buffer.size(), 0);
+        size = fs::file_size(path);
+        const auto file_hash = hash_files({path}, algorithm).front();
+        if (!file_hash) {
+            throw fs::filesystem_error("Failed to read file", path, std::make_error_code(std::errc::io_error));
+        }
+        hash = *file_hash;
     }
     
-    return {truncate_path(path, origin), fs::is_directory(path) ? DirEntry::DIR : DirEntry::FILE, hash};
+    return {truncate_path(path, origin), fs::is_directory(path) ? DirEntry::DIR : DirEntry::FILE, hash, size};
 }
 }
\ No newline at end of file
@@ -2,13 +2,15 @@
 #include <cassert>
 #include <string>
 #include <set>
-#include <xxhash.h>
+#include "Hash.hpp"
+#include "IgnoreRules.hpp"
 #include <filesystem>
 #include <fstream>
 #include <vector>
-#include <iostream>
-#include <syncstream>
 #include <boost/assert.hpp>
+#include "Logger.hpp"
+#include "ReadEngine.hpp"
+#include "Utils.hpp"
 
 namespace rusync {
 
@@ -20,7 +22,7 @@ namespace fs = std::filesystem;
  */
 struct DirEntry {
     enum Type {FILE, DIR} type;
-    DirEntry(const std::string& path, Type type, uint64_t hash);
+    DirEntry(const std::string& path, Type type, uint64_t hash, uint64_t size = 0);
     
     /**
      * @brief truncated path to entry (without path to client dir)
@@ -29,10 +31,16 @@ struct DirEntry {
     std::string path;
 
     /**
-     * @brief Entry hash. For files computed with XXH64 alg with seed=0. For dirs hash is always 0
+     * @brief Entry hash. For files computed with HashAlgorithm of scan (XXH64 by default). For dirs it's 0 after scan, Merkle hash of children is computed by EntryTable
      * 
      */
     uint64_t hash;
+
+    /**
+     * @brief Size of file in bytes. For dirs size is always 0
+     * 
+     */
+    uint64_t size;
     
     /**
      * @brief converts entry type to string
@@ -47,9 +55,10 @@ struct DirEntry {
      * @param path - path to entry
      * @param origin - path to client dir. Need to perform truncation.<br>
      * e.g. if path == "client_dir/test.txt" and origin == "client_dir" result DirEntry.path will be equal to "test.txt"
+     * @param algorithm algorithm of file hash
      * @return DirEntry 
      */
-    static DirEntry from_path(fs::path path, fs::path origin);
+    static DirEntry from_path(fs::path path, fs::path origin, HashAlgorithm algorithm = HashAlgorithm::XXHASH64);
 };
 
 
@@ -62,33 +71,99 @@ inline bool operator == (const DirEntry& l, const DirEntry& r) {
     return l.hash == r.hash && l.path == r.path && l.type == r.type; 
 }
 
+/**
+ * @brief Name of dir within client dir for rusync's own files (e.g. partial downloads). It's never synced
+ * 
+ */
+inline const fs::path INTERNAL_DIR = ".rusync";
+
+/**
+ * @brief number of files hashed at once by extract_entries_from_path
+ * 
+ */
+inline constexpr size_t SCAN_BATCH = 1024;
+
 /**
  * @brief Extracts entries from path and returns it as container T of DirEntry. Only counts regular files and dirs
  * 
- * @tparam T 
+ * @tparam T std::set, sequence container or table with push_back and sort (e.g. EntryTable), which is sorted after scan
  * @param path 
+ * @param algorithm algorithm of file hashes, it's stored by tables which have set_hash_algorithm
+ * @param ignore ignored entries are skipped, ignored dirs aren't walked at all
+ * @param unreadable if provided, receives paths of files which could not be read. They are skipped, as their hash is unknown
  * @return T 
  */
 template <typename T = std::set<DirEntry>> 
-T extract_entries_from_path(const std::string& path) {
+T extract_entries_from_path(const std::string& path, HashAlgorithm algorithm = HashAlgorithm::XXHASH64, const IgnoreRules& ignore = IgnoreRules(),
+                            std::set<std::string, std::less<>>* unreadable = nullptr) {
     T result;
+    const auto add = [&result](DirEntry entry) {
+        if constexpr (std::is_same_v<T, std::set<DirEntry>>) {
+            result.insert(std::move(entry));
+        } else {
+            result.push_back(std::move(entry));
+        }
+    };
+    // files are hashed by batches, so ReadEngine reads many of them at once
+    std::vector<fs::path> files;
+    std::vector<uint64_t> sizes;
+    const auto hash_batch = [&]() {
+        const auto hashes = hash_files(files, algorithm);
+        for (size_t i = 0; i < files.size(); i++) {
+            if (!hashes[i]) {
+                std::error_code ec;
+                if (fs::exists(files[i], ec)) {
+                    RUSYNC_LOG(WARN) << "Skipping " << files[i] << ", it could not be read";
+                    if (unreadable) {
+                        unreadable->insert(truncate_path(files[i], path).string());
+                    }
+                }
+                continue;
+            }
+            add({truncate_path(files[i], path), DirEntry::FILE, *hashes[i], sizes[i]});
+        }
+        files.clear();
+        sizes.clear();
+    };
     try {
-        for (const auto& entry: fs::recursive_directory_iterator{path}) {
+        for (auto it = fs::recursive_directory_iterator{path}; it != fs::recursive_directory_iterator{}; it++) {
+            const auto& entry = *it;
+            if (it.depth() == 0 && entry.path().filename() == INTERNAL_DIR) {
+                it.disable_recursion_pending();
+                continue;
+            }
             if (!entry.is_directory() && !entry.is_regular_file()) {
                 continue;
             }
+            if (!ignore.empty() && ignore.ignored_entry(truncate_path(entry.path(), path).native(), entry.is_directory())) {
+                if (entry.is_directory()) {
+                    it.disable_recursion_pending();
+                }
+                continue;
+            }
             try {
-                if constexpr (std::is_same_v<T, std::set<DirEntry>>) {
-                    result.insert(DirEntry::from_path(entry, path));
-                } else {
-                    result.push_back(DirEntry::from_path(entry, path));
+                if (entry.is_directory()) {
+                    add({truncate_path(entry.path(), path), DirEntry::DIR, 0});
+                    continue;
+                }
+                sizes.push_back(entry.file_size());
+                files.push_back(entry.path());
+                if (files.size() == SCAN_BATCH) {
+                    hash_batch();
                 }
             } catch (fs::filesystem_error& err) {
-                std::osyncstream(std::cerr) << "Error occured while extracting entry from  " << entry.path() << ", " << err.what() << std::endl; 
+                RUSYNC_LOG(ERROR) << "Error occured while extracting entry from  " << entry.path() << ", " << err.what();
             }
         } 
     } catch (fs::filesystem_error& err) {
-        std::osyncstream(std::cerr) << "Error occured while iterating over  " << path << ", " << err.what() << std::endl; 
+        RUSYNC_LOG(ERROR) << "Error occured while iterating over  " << path << ", " << err.what();
+    }
+    hash_batch();
+    if constexpr (requires { result.set_hash_algorithm(algorithm); }) {
+        result.set_hash_algorithm(algorithm);
+    }
+    if constexpr (requires { result.sort(); }) {
+        result.sort();
     }
     return result;
 }
@@ -0,0 +1,367 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <xxhash.h>
+#include "DirEntry.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Compact table of dir entries sorted by path, used for diffing client dir against files description.<br>
+ * Entries are stored contiguously and their paths are interned into arena blocks owned by table, so table of millions of entries
+ * costs a few allocations instead of a node and a string per entry. Table is move-only since entries point into its arena.<br>
+ * Paths are ordered component-wise (see compare_paths), so every dir is directly followed by its subtree. Once sorted, each dir gets
+ * Merkle hash of its children (names, types and hashes), which lets diff skip unchanged subtrees
+ */
+class EntryTable {
+public:
+    struct Entry {
+        std::string_view path;
+        uint64_t hash;
+        uint64_t size;
+        DirEntry::Type type;
+        /**
+         * @brief index of first entry after subtree of this dir (next index for files)
+         * 
+         */
+        uint32_t subtree_end;
+        /**
+         * @brief dir was received without its subtree (see add_pruned), so its hash is kept as received
+         * 
+         */
+        bool pruned;
+
+        std::string type_str() const {
+            return type == DirEntry::FILE ? "file" : "dir";
+        }
+
+        DirEntry to_dir_entry() const {
+            return {std::string(path), type, hash, size};
+        }
+    };
+
+    using const_iterator = std::vector<Entry>::const_iterator;
+
+    EntryTable() = default;
+    EntryTable(EntryTable&&) = default;
+    EntryTable& operator=(EntryTable&&) = default;
+    EntryTable(const EntryTable&) = delete;
+    EntryTable& operator=(const EntryTable&) = delete;
+
+    /**
+     * @brief adds entry, path is copied into arena. Table should be sorted after entries are added out of order
+     * 
+     * @param path 
+     * @param type 
+     * @param hash 
+     * @param size 
+     */
+    void add(std::string_view path, DirEntry::Type type, uint64_t hash, uint64_t size = 0) {
+        if (!m_entries.empty() && compare_paths(path, m_entries.back().path) <= 0) {
+            m_sorted = false;
+        }
+        m_indexed = false;
+        m_entries.push_back({intern(path), hash, size, type, 0, false});
+    }
+
+    /**
+     * @brief adds dir which peer left out together with its subtree, since it has the same one (see subtree_digest). Its hash isn't recomputed
+     * 
+     * @param path 
+     * @param hash Merkle hash of dir
+     */
+    void add_pruned(std::string_view path, uint64_t hash) {
+        add(path, DirEntry::DIR, hash);
+        m_entries.back().pruned = true;
+    }
+
+    /**
+     * @brief
+     * 
+     * @param path 
+     * @param hash Merkle hash of dir
+     * @return uint64_t digest of dir with its path, peers with equal digests of dir have the same subtree
+     */
+    static uint64_t subtree_digest(std::string_view path, uint64_t hash) {
+        return XXH64(path.data(), path.size(), hash);
+    }
+
+    /**
+     * @brief same as add, allows to fill table with extract_entries_from_path
+     * 
+     * @param entry 
+     */
+    void push_back(const DirEntry& entry) {
+        add(entry.path, entry.type, entry.hash, entry.size);
+    }
+
+    void reserve(size_t entries) {
+        m_entries.reserve(entries);
+    }
+
+    /**
+     * @brief sorts entries by path and computes hashes of dirs. If path was added several times only last entry is kept.<br>
+     * Hashes of dirs are always recomputed from their children, whatever was added, except for pruned dirs
+     * 
+     */
+    void sort() {
+        if (!m_sorted) {
+            std::stable_sort(m_entries.begin(), m_entries.end(), [](const Entry& l, const Entry& r) {
+                return compare_paths(l.path, r.path) < 0;
+            });
+            size_t last = 0;
+            for (size_t i = 1; i < m_entries.size(); i++) {
+                if (m_entries[i].path != m_entries[last].path) {
+                    last++;
+                }
+                m_entries[last] = m_entries[i];
+            }
+            m_entries.resize(m_entries.empty() ? 0 : last + 1);
+            m_sorted = true;
+        }
+        if (!m_indexed) {
+            build_tree();
+            m_indexed = true;
+        }
+    }
+
+    bool sorted() const {
+        return m_sorted && m_indexed;
+    }
+
+    /**
+     * @brief hash of top level entries, computed the same way as hash of dir. Table must be sorted
+     * 
+     * @return uint64_t 
+     */
+    uint64_t root_hash() const {
+        assert(sorted());
+        return m_root_hash;
+    }
+
+    /**
+     * @brief algorithm of file hashes. Dir hashes are always XXH64 of children's records
+     * 
+     * @return HashAlgorithm 
+     */
+    HashAlgorithm hash_algorithm() const {
+        return m_hash_algorithm;
+    }
+
+    void set_hash_algorithm(HashAlgorithm algorithm) {
+        m_hash_algorithm = algorithm;
+    }
+
+    /**
+     * @brief compares paths component-wise, i.e. as if '/' was smaller than any other char. So "a/b" < "a-b", unlike plain string comparison
+     * 
+     * @param l 
+     * @param r 
+     * @return int negative if l < r, 0 if equal, positive if l > r
+     */
+    static int compare_paths(std::string_view l, std::string_view r) {
+        const auto [l_it, r_it] = std::mismatch(l.begin(), l.end(), r.begin(), r.end());
+        if (l_it == l.end()) {
+            return r_it == r.end() ? 0 : -1;
+        }
+        if (r_it == r.end()) {
+            return 1;
+        }
+        const auto rank = [](char c) {
+            return c == '/' ? 0 : static_cast<unsigned char>(c) + 1;
+        };
+        return rank(*l_it) - rank(*r_it);
+    }
+
+    /**
+     * @brief binary search of entry, table must be sorted
+     * 
+     * @param path 
+     * @return const Entry* nullptr if there is no entry with such path
+     */
+    const Entry* find(std::string_view path) const {
+        assert(m_sorted);
+        const auto it = std::lower_bound(m_entries.begin(), m_entries.end(), path, [](const Entry& entry, std::string_view path) {
+            return compare_paths(entry.path, path) < 0;
+        });
+        return it != m_entries.end() && it->path == path ? &*it : nullptr;
+    }
+
+    size_t size() const {
+        return m_entries.size();
+    }
+
+    bool empty() const {
+        return m_entries.empty();
+    }
+
+    const Entry& operator[](size_t index) const {
+        return m_entries[index];
+    }
+
+    const_iterator begin() const {
+        return m_entries.begin();
+    }
+
+    const_iterator end() const {
+        return m_entries.end();
+    }
+
+private:
+    /**
+     * @brief single pass over sorted entries which links every dir with its subtree and computes dir hashes bottom-up.
+     * Hash of dir is XXH64 of its children's records (name, type, hash) in path order
+     * 
+     */
+    void build_tree() {
+        struct OpenDir {
+            size_t index;
+            std::string children;
+        };
+        std::vector<OpenDir> open {{m_entries.size(), {}}};
+        const auto close_dir = [this, &open](size_t end) {
+            auto dir = std::move(open.back());
+            open.pop_back();
+            Entry& entry = m_entries[dir.index];
+            entry.hash = XXH64(dir.children.data(), dir.children.size(), 0);
+            entry.subtree_end = static_cast<uint32_t>(end);
+            append_child(open.back().children, entry);
+        };
+        for (size_t i = 0; i < m_entries.size(); i++) {
+            Entry& entry = m_entries[i];
+            while (open.size() > 1 && !is_parent(m_entries[open.back().index].path, entry.path)) {
+                close_dir(i);
+            }
+            if (entry.type == DirEntry::DIR && !entry.pruned) {
+                open.push_back({i, {}});
+            } else {
+                entry.subtree_end = static_cast<uint32_t>(i + 1);
+                append_child(open.back().children, entry);
+            }
+        }
+        while (open.size() > 1) {
+            close_dir(m_entries.size());
+        }
+        m_root_hash = XXH64(open.back().children.data(), open.back().children.size(), 0);
+    }
+
+    static bool is_parent(std::string_view dir, std::string_view path) {
+        return path.size() > dir.size() && path[dir.size()] == '/' && path.starts_with(dir);
+    }
+
+    static void append_child(std::string& children, const Entry& entry) {
+        const auto separator = entry.path.rfind('/');
+        const auto name = separator == std::string_view::npos ? entry.path : entry.path.substr(separator + 1);
+        children.append(name);
+        children.push_back('\0');
+        children.push_back(entry.type == DirEntry::FILE ? 'f' : 'd');
+        children.append(reinterpret_cast<const char*>(&entry.hash), sizeof(entry.hash));
+    }
+
+    std::string_view intern(std::string_view path) {
+        if (path.size() > BLOCK_SIZE / 4) {
+            // long paths get own allocation, so current block is still filled up
+            auto& data = m_large_paths.emplace_back(std::make_unique<char[]>(path.size()));
+            memcpy(data.get(), path.data(), path.size());
+            return {data.get(), path.size()};
+        }
+        if (path.size() > BLOCK_SIZE - m_block_used) {
+            m_blocks.push_back(std::make_unique<char[]>(BLOCK_SIZE));
+            m_block_used = 0;
+        }
+        char* data = m_blocks.back().get() + m_block_used;
+        memcpy(data, path.data(), path.size());
+        m_block_used += path.size();
+        return {data, path.size()};
+    }
+
+    static constexpr size_t BLOCK_SIZE = 64 << 10;
+
+    std::vector<Entry> m_entries;
+    std::vector<std::unique_ptr<char[]>> m_blocks;
+    std::vector<std::unique_ptr<char[]>> m_large_paths;
+    size_t m_block_used = BLOCK_SIZE;
+    bool m_sorted = true;
+    bool m_indexed = true;
+    HashAlgorithm m_hash_algorithm = HashAlgorithm::XXHASH64;
+    uint64_t m_root_hash = XXH64(nullptr, 0, 0);
+};
+
+/**
+ * @brief difference between local and remote entries, entries point into compared tables
+ * 
+ */
+struct EntryDiff {
+    /**
+     * @brief local entries which are missing in remote table
+     * 
+     */
+    std::vector<const EntryTable::Entry*> added;
+
+    /**
+     * @brief remote entries which are missing in local table
+     * 
+     */
+    std::vector<const EntryTable::Entry*> removed;
+
+    /**
+     * @brief local entries whose hash differs from remote entry with the same path
+     * 
+     */
+    std::vector<const EntryTable::Entry*> modified;
+};
+
+/**
+ * @brief compares tables by single merge pass over both of them. Roots are compared first, then dirs with equal hashes are skipped
+ * together with their subtrees, so only changed subtrees are walked
+ * 
+ * @param local sorted table
+ * @param remote sorted table, hashed with the same algorithm as local one
+ * @return EntryDiff 
+ */
+inline EntryDiff diff_entries(const EntryTable& local, const EntryTable& remote) {
+    assert(local.sorted() && remote.sorted());
+    assert(local.hash_algorithm() == remote.hash_algorithm());
+    EntryDiff diff;
+    if (local.root_hash() == remote.root_hash()) {
+        return diff;
+    }
+    auto l = local.begin();
+    auto r = remote.begin();
+    while (l != local.end() && r != remote.end()) {
+        const int order = EntryTable::compare_paths(l->path, r->path);
+        if (order < 0) {
+            diff.added.push_back(&*l++);
+        } else if (order > 0) {
+            diff.removed.push_back(&*r++);
+        } else if (l->type == DirEntry::DIR && r->type == DirEntry::DIR) {
+            if (l->hash == r->hash) {
+                l = local.begin() + l->subtree_end;
+                r = remote.begin() + r->subtree_end;
+            } else {
+                l++;
+                r++;
+            }
+        } else {
+            if (l->hash != r->hash) {
+                diff.modified.push_back(&*l);
+            }
+            l++;
+            r++;
+        }
+    }
+    for (; l != local.end(); l++) {
+        diff.added.push_back(&*l);
+    }
+    for (; r != remote.end(); r++) {
+        diff.removed.push_back(&*r);
+    }
+    return diff;
+}
+}
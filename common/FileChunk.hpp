@@ -1,7 +1,73 @@
 #pragma once
+#include <algorithm>
 #include <cstdint>
+#include <filesystem>
+#include <stdexcept>
+#include <vector>
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "ReadEngine.hpp"
 
 struct FileChunk {
     uint32_t size;
     uint64_t hash;
 };
+
+namespace rusync {
+
+/**
+ * @brief computes patch chunk size based of file size
+ * 
+ * @param file_size 
+ * @return size_t 
+ */
+inline size_t calculate_chunk_size(size_t file_size) {
+    if (file_size < 1'000'000) {
+        return 1000;
+    } else if (file_size < 1'000'000'000) {
+        return 31622;
+    }
+    return 100000; 
+}
+
+/**
+ * @brief splits file into chunks of calculate_chunk_size and hashes each chunk. Large files are hashed in place within mapped window (see MappedFile)
+ * if mapping is allowed, other ones are read by ReadEngine with read-ahead, each block holds whole chunks
+ * 
+ * @param path 
+ * @param algorithm 
+ * @param allow_mapping false if file could be truncated while it's hashed, so short read is reported instead of SIGBUS
+ * @return std::vector<FileChunk> 
+ * @throw std::runtime_error if file could not be read
+ */
+inline std::vector<FileChunk> compute_chunks_for_file(const std::filesystem::path& path, HashAlgorithm algorithm = HashAlgorithm::XXHASH64, bool allow_mapping = true) {
+    const uint64_t file_size = std::filesystem::file_size(path);
+    const size_t chunk_size = calculate_chunk_size(file_size);
+    std::vector<FileChunk> chunks;
+    if (allow_mapping && file_size >= MappedFile::THRESHOLD) {
+        auto file = MappedFile::open(path);
+        if (!file) {
+            throw std::runtime_error("Failed to open " + path.string());
+        }
+        chunks.reserve(file->size() / chunk_size + 1);
+        for (uint64_t offset = 0; offset < file->size(); offset += chunk_size) {
+            const auto data = file->view(offset, chunk_size);
+            chunks.push_back({static_cast<uint32_t>(data.size()), hash_bytes(algorithm, data.data(), data.size())});
+        }
+        return chunks;
+    }
+    bool read = false;
+    ReadEngine::acquire()->read_files({path}, ReadEngine::BUFFER_SIZE / chunk_size * chunk_size, [&chunks, chunk_size, algorithm](size_t, uint64_t, const char* data, size_t size) {
+        for (size_t offset = 0; offset < size; offset += chunk_size) {
+            const size_t length = std::min(chunk_size, size - offset);
+            chunks.push_back({static_cast<uint32_t>(length), hash_bytes(algorithm, data + offset, length)});
+        }
+    }, [&read](size_t, bool ok) {
+        read = ok;
+    });
+    if (!read) {
+        throw std::runtime_error("Failed to read " + path.string());
+    }
+    return chunks;
+}
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "Hash.hpp"
+#include <utility>
+#include <xxhash.h>
+
+namespace rusync {
+
+namespace {
+
+using Xxh3 = uint64_t (*)(const void* data, size_t size);
+using Xxh3Update = void (*)(void* state, const void* data, size_t size);
+
+uint64_t xxh3_default(const void* data, size_t size) {
+    return XXH3_64bits(data, size);
+}
+
+void xxh3_update_default(void* state, const void* data, size_t size) {
+    XXH3_64bits_update(static_cast<XXH3_state_t*>(state), data, size);
+}
+
+bool use_avx2() {
+#ifdef RUSYNC_HASH_AVX2
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
+
+Xxh3 xxh3() {
+#ifdef RUSYNC_HASH_AVX2
+    if (use_avx2()) {
+        return detail::xxh3_avx2;
+    }
+#endif
+    return xxh3_default;
+}
+
+Xxh3Update xxh3_update() {
+#ifdef RUSYNC_HASH_AVX2
+    if (use_avx2()) {
+        return detail::xxh3_update_avx2;
+    }
+#endif
+    return xxh3_update_default;
+}
+}
+
+uint64_t hash_bytes(HashAlgorithm algorithm, const void* data, size_t size) {
+    if (algorithm == HashAlgorithm::XXHASH3) {
+        return xxh3()(data, size);
+    }
+    return XXH64(data, size, 0);
+}
+
+const char* hash_implementation() {
+    return use_avx2() ? "avx2" : "default";
+}
+
+Hasher::Hasher(HashAlgorithm algorithm) : m_algorithm {algorithm} {
+    if (m_algorithm == HashAlgorithm::XXHASH3) {
+        auto* state = XXH3_createState();
+        XXH3_64bits_reset(state);
+        m_state = state;
+    } else {
+        auto* state = XXH64_createState();
+        XXH64_reset(state, 0);
+        m_state = state;
+    }
+}
+
+Hasher::Hasher(Hasher&& other) noexcept : m_algorithm {other.m_algorithm}, m_state {std::exchange(other.m_state, nullptr)} {
+
+}
+
+Hasher::~Hasher() {
+    if (!m_state) {
+        return;
+    }
+    if (m_algorithm == HashAlgorithm::XXHASH3) {
+        XXH3_freeState(static_cast<XXH3_state_t*>(m_state));
+    } else {
+        XXH64_freeState(static_cast<XXH64_state_t*>(m_state));
+    }
+}
+
+void Hasher::update(const void* data, size_t size) {
+    if (m_algorithm == HashAlgorithm::XXHASH3) {
+        xxh3_update()(m_state, data, size);
+    } else {
+        XXH64_update(static_cast<XXH64_state_t*>(m_state), data, size);
+    }
+}
+
+uint64_t Hasher::digest() const {
+    if (m_algorithm == HashAlgorithm::XXHASH3) {
+        return XXH3_64bits_digest(static_cast<const XXH3_state_t*>(m_state));
+    }
+    return XXH64_digest(static_cast<const XXH64_state_t*>(m_state));
+}
+}
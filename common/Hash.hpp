@@ -0,0 +1,106 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace rusync {
+
+/**
+ * @brief Algorithm of file and chunk hashes, both with seed 0. Id is sent by server within meta and files description,
+ * so values must never change. Client asks for algorithm by its name (hash query param), server which doesn't know it answers with XXH64
+ */
+enum class HashAlgorithm : uint8_t {XXHASH64 = 0, XXHASH3 = 1};
+
+inline const char* hash_algorithm_name(HashAlgorithm algorithm) {
+    return algorithm == HashAlgorithm::XXHASH3 ? "xxh3" : "xxh64";
+}
+
+/**
+ * @brief
+ *
+ * @param name
+ * @return std::optional<HashAlgorithm> nullopt if algorithm is unknown
+ */
+inline std::optional<HashAlgorithm> hash_algorithm_from(std::string_view name) {
+    if (name == "xxh64") {
+        return HashAlgorithm::XXHASH64;
+    } else if (name == "xxh3") {
+        return HashAlgorithm::XXHASH3;
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief
+ *
+ * @param id algorithm id received from server
+ * @return std::optional<HashAlgorithm> nullopt if id is unknown
+ */
+inline std::optional<HashAlgorithm> hash_algorithm_from(uint64_t id) {
+    if (id > static_cast<uint8_t>(HashAlgorithm::XXHASH3)) {
+        return std::nullopt;
+    }
+    return static_cast<HashAlgorithm>(id);
+}
+
+/**
+ * @brief hashes data with algorithm. XXH3 uses AVX2 implementation if CPU supports it (checked once), SSE2 one otherwise
+ *
+ * @param algorithm
+ * @param data
+ * @param size
+ * @return uint64_t
+ */
+uint64_t hash_bytes(HashAlgorithm algorithm, const void* data, size_t size);
+
+/**
+ * @brief
+ *
+ * @return const char* name of XXH3 implementation selected for this CPU, e.g. for benchmarks
+ */
+const char* hash_implementation();
+
+/**
+ * @brief Incremental hash of data received by parts (e.g. file read by blocks), result is the same as hash_bytes of whole data
+ *
+ */
+class Hasher {
+public:
+    explicit Hasher(HashAlgorithm algorithm);
+    ~Hasher();
+    Hasher(Hasher&& other) noexcept;
+    Hasher& operator=(Hasher&&) = delete;
+    Hasher(const Hasher&) = delete;
+    Hasher& operator=(const Hasher&) = delete;
+
+    void update(const void* data, size_t size);
+    uint64_t digest() const;
+
+private:
+    HashAlgorithm m_algorithm;
+    /**
+     * @brief XXH64_state_t or XXH3_state_t
+     *
+     */
+    void* m_state;
+};
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__clang__)
+#define RUSYNC_HASH_AVX2 1
+namespace detail {
+/**
+ * @brief XXH3 compiled for AVX2 (see HashAvx2.cpp), should be called only if CPU supports it
+ *
+ */
+uint64_t xxh3_avx2(const void* data, size_t size);
+
+/**
+ * @brief XXH3_64bits_update compiled for AVX2, state is XXH3_state_t created and reset by xxhash library.
+ * Both are built from the same header, so layout of state is the same
+ *
+ */
+void xxh3_update_avx2(void* state, const void* data, size_t size);
+}
+#endif
+}
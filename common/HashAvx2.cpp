@@ -0,0 +1,27 @@
+#include "Hash.hpp"
+
+#ifdef RUSYNC_HASH_AVX2
+// xxhash includes intrinsics only if AVX2 is enabled for whole translation unit
+#include <immintrin.h>
+
+// only xxhash is compiled for AVX2, so no AVX2 code can leak into inline functions shared with other translation units
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#ifndef XXH_INLINE_ALL
+#define XXH_INLINE_ALL
+#endif
+#define XXH_VECTOR 2 // XXH_AVX2
+#include <xxhash.h>
+
+namespace rusync::detail {
+
+uint64_t xxh3_avx2(const void* data, size_t size) {
+    return XXH3_64bits(data, size);
+}
+
+void xxh3_update_avx2(void* state, const void* data, size_t size) {
+    XXH3_64bits_update(static_cast<XXH3_state_t*>(state), data, size);
+}
+}
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,414 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace rusync {
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Name of file with ignore rules within root of synced dir. It's synced as any other file, so server applies the same rules
+ *
+ */
+inline const fs::path IGNORE_FILE = ".rusyncignore";
+
+/**
+ * @brief Gitignore-style rules of paths which are not synced: one pattern per line, '#' starts comment, '!' re-includes path,
+ * trailing '/' matches only dirs, pattern with '/' in the beginning or middle is relative to root, otherwise it matches name
+ * at any depth. '*', '?' and '[...]' don't match '/', '**' matches any number of dirs. Last matching rule wins.<br>
+ * Rules are compiled by their shape: literal names and literal paths go to hash maps, "*suffix" patterns (e.g. "*.o") to trie
+ * of reversed suffixes, so typical rules cost one lookup per path whatever their number. Other patterns are matched as globs.<br>
+ * As in git, path within ignored dir is ignored even if rule re-includes it, scans prune ignored dirs as a whole.<br>
+ * Ignore file is synced from clients, so server reads at most MAX_RULES rules and skips patterns longer than MAX_PATTERN
+ */
+class IgnoreRules {
+public:
+    static constexpr size_t MAX_RULES = 10000;
+    static constexpr size_t MAX_PATTERN = 4096;
+
+    IgnoreRules() = default;
+
+    /**
+     * @brief
+     *
+     * @param text content of ignore file
+     * @return IgnoreRules
+     */
+    static IgnoreRules parse(std::string_view text) {
+        IgnoreRules rules;
+        while (!text.empty() && rules.size() < MAX_RULES) {
+            const auto line_end = std::min(text.find('\n'), text.size());
+            rules.add(text.substr(0, line_end));
+            text.remove_prefix(std::min(line_end + 1, text.size()));
+        }
+        return rules;
+    }
+
+    /**
+     * @brief
+     *
+     * @param root synced dir
+     * @return IgnoreRules rules of IGNORE_FILE within root, empty if there is no such file
+     */
+    static IgnoreRules load(const fs::path& root) {
+        std::ifstream file {root / IGNORE_FILE, std::ios::binary};
+        if (!file) {
+            return {};
+        }
+        const std::string text {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+        return parse(text);
+    }
+
+    bool empty() const {
+        return m_rules.empty();
+    }
+
+    size_t size() const {
+        return m_rules.size();
+    }
+
+    /**
+     * @brief checks entry itself, its parent dirs are assumed to be not ignored (e.g. by scan which prunes ignored dirs)
+     *
+     * @param path path relative to root, '/' separated
+     * @param is_dir
+     * @return true if entry is ignored
+     */
+    bool ignored_entry(std::string_view path, bool is_dir) const {
+        if (m_rules.empty() || path.empty()) {
+            return false;
+        }
+        const auto slash = path.rfind('/');
+        const std::string_view name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+        int best = -1;
+        const auto consider = [this, is_dir, &best](const std::vector<int>& indices) {
+            // indices are ascending, so the last applicable one is the best within list
+            for (auto it = indices.rbegin(); it != indices.rend() && *it > best; it++) {
+                if (is_dir || !m_rules[*it].dir_only) {
+                    best = *it;
+                    return;
+                }
+            }
+        };
+        if (const auto found = m_names.find(name); found != m_names.end()) {
+            consider(found->second);
+        }
+        if (const auto found = m_paths.find(path); found != m_paths.end()) {
+            consider(found->second);
+        }
+        // every node on the way matches one of suffixes of name
+        uint32_t node = 0;
+        consider(m_suffixes[node].rules);
+        for (auto it = name.rbegin(); it != name.rend(); it++) {
+            node = m_suffixes[node].child(*it);
+            if (node == 0) {
+                break;
+            }
+            consider(m_suffixes[node].rules);
+        }
+        for (auto it = m_globs.rbegin(); it != m_globs.rend() && it->rule > best; it++) {
+            if ((is_dir || !m_rules[it->rule].dir_only) && it->matches(path, name)) {
+                best = it->rule;
+                break;
+            }
+        }
+        return best >= 0 && !m_rules[best].negated;
+    }
+
+    /**
+     * @brief checks entry and all its parent dirs
+     *
+     * @param path path relative to root, '/' separated
+     * @param is_dir
+     * @return true if entry or one of its parent dirs is ignored
+     */
+    bool ignored(std::string_view path, bool is_dir) const {
+        if (m_rules.empty()) {
+            return false;
+        }
+        for (auto slash = path.find('/'); slash != std::string_view::npos; slash = path.find('/', slash + 1)) {
+            if (ignored_entry(path.substr(0, slash), true)) {
+                return true;
+            }
+        }
+        return ignored_entry(path, is_dir);
+    }
+
+private:
+    /**
+     * @brief lets maps be searched by string_view without building string for each path
+     *
+     */
+    struct StringHash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view value) const {
+            return std::hash<std::string_view>{}(value);
+        }
+    };
+
+    using PatternMap = std::unordered_map<std::string, std::vector<int>, StringHash, std::equal_to<>>;
+
+    struct Rule {
+        bool negated;
+        bool dir_only;
+    };
+
+    /**
+     * @brief node of trie of reversed suffixes, node 0 is root (empty suffix)
+     *
+     */
+    struct SuffixNode {
+        uint32_t child(char c) const {
+            for (const auto& [label, index]: children) {
+                if (label == c) {
+                    return index;
+                }
+            }
+            return 0;
+        }
+
+        std::vector<std::pair<char, uint32_t>> children;
+        std::vector<int> rules;
+    };
+
+    /**
+     * @brief pattern which is matched segment by segment, "**" segment matches any number of path segments
+     *
+     */
+    struct Glob {
+        bool matches(std::string_view path, std::string_view name) const {
+            if (!anchored) {
+                return match_segment(segments.front(), name);
+            }
+            std::vector<std::string_view> parts;
+            while (true) {
+                const auto slash = path.find('/');
+                parts.push_back(path.substr(0, slash));
+                if (slash == std::string_view::npos) {
+                    break;
+                }
+                path.remove_prefix(slash + 1);
+            }
+            return match_segments(parts);
+        }
+
+        /**
+         * @brief as match_segment, but over path segments: "**" backtracks to its last position only, other segments match one part each,
+         * so time is bounded by segments * parts whatever number of "**"
+         *
+         */
+        bool match_segments(const std::vector<std::string_view>& parts) const {
+            size_t segment = 0;
+            size_t part = 0;
+            size_t star = std::string_view::npos;
+            size_t star_part = 0;
+            while (part < parts.size()) {
+                if (segment < segments.size() && segments[segment] == "**") {
+                    // trailing "**" matches contents of dir, i.e. at least one part
+                    if (segment + 1 == segments.size()) {
+                        return true;
+                    }
+                    star = segment++;
+                    star_part = part;
+                    continue;
+                }
+                if (segment < segments.size() && match_segment(segments[segment], parts[part])) {
+                    segment++;
+                    part++;
+                    continue;
+                }
+                if (star == std::string_view::npos) {
+                    return false;
+                }
+                segment = star + 1;
+                part = ++star_part;
+            }
+            while (segment + 1 < segments.size() && segments[segment] == "**") {
+                segment++;
+            }
+            return segment == segments.size();
+        }
+
+        int rule;
+        bool anchored;
+        std::vector<std::string> segments;
+    };
+
+    /**
+     * @brief matches name against glob without '/', '*' backtracks to its last position only, which is enough since it can't cross segments
+     *
+     * @param pattern
+     * @param name
+     * @return true if name matches
+     */
+    static bool match_segment(std::string_view pattern, std::string_view name) {
+        size_t p = 0;
+        size_t n = 0;
+        size_t star = std::string_view::npos;
+        size_t star_name = 0;
+        while (n < name.size()) {
+            if (p < pattern.size() && pattern[p] == '*') {
+                star = p++;
+                star_name = n;
+                continue;
+            }
+            if (p < pattern.size()) {
+                const auto matched = match_char(pattern, p, name[n]);
+                if (matched) {
+                    p = *matched;
+                    n++;
+                    continue;
+                }
+            }
+            if (star == std::string_view::npos) {
+                return false;
+            }
+            p = star + 1;
+            n = ++star_name;
+        }
+        while (p < pattern.size() && pattern[p] == '*') {
+            p++;
+        }
+        return p == pattern.size();
+    }
+
+    /**
+     * @brief
+     *
+     * @param pattern
+     * @param p position of '?', '[' class, escaped or literal char within pattern
+     * @param c
+     * @return std::optional<size_t> position after matched token, nullopt if c doesn't match it
+     */
+    static std::optional<size_t> match_char(std::string_view pattern, size_t p, char c) {
+        if (pattern[p] == '?') {
+            return p + 1;
+        }
+        if (pattern[p] == '\\' && p + 1 < pattern.size()) {
+            return pattern[p + 1] == c ? std::optional<size_t>(p + 2) : std::nullopt;
+        }
+        if (pattern[p] != '[') {
+            return pattern[p] == c ? std::optional<size_t>(p + 1) : std::nullopt;
+        }
+        size_t i = p + 1;
+        const bool negated = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+        if (negated) {
+            i++;
+        }
+        bool matched = false;
+        // ']' right after '[' is a member of class
+        for (bool first = true; i < pattern.size() && (first || pattern[i] != ']'); first = false) {
+            if (i + 2 < pattern.size() && pattern[i + 1] == '-' && pattern[i + 2] != ']') {
+                matched |= pattern[i] <= c && c <= pattern[i + 2];
+                i += 3;
+            } else {
+                matched |= pattern[i] == c;
+                i++;
+            }
+        }
+        if (i >= pattern.size()) {
+            // unterminated class is literal '['
+            return c == '[' ? std::optional<size_t>(p + 1) : std::nullopt;
+        }
+        return matched != negated ? std::optional<size_t>(i + 1) : std::nullopt;
+    }
+
+    static bool has_wildcards(std::string_view pattern) {
+        return pattern.find_first_of("*?[\\") != std::string_view::npos;
+    }
+
+    void add(std::string_view line) {
+        while (!line.empty() && (line.back() == '\r' || (line.back() == ' ' && !(line.size() > 1 && line[line.size() - 2] == '\\')))) {
+            line.remove_suffix(1);
+        }
+        if (line.empty() || line.front() == '#' || line.size() > MAX_PATTERN) {
+            return;
+        }
+        Rule rule {false, false};
+        if (line.front() == '!') {
+            rule.negated = true;
+            line.remove_prefix(1);
+        } else if (line.front() == '\\' && line.size() > 1 && (line[1] == '#' || line[1] == '!')) {
+            line.remove_prefix(1);
+        }
+        if (!line.empty() && line.back() == '/') {
+            rule.dir_only = true;
+            line.remove_suffix(1);
+        }
+        bool anchored = line.find('/') != std::string_view::npos;
+        if (!line.empty() && line.front() == '/') {
+            line.remove_prefix(1);
+        } else if (line.starts_with("**/") && line.find('/', 3) == std::string_view::npos) {
+            // same as pattern without slash
+            line.remove_prefix(3);
+            anchored = false;
+        }
+        if (line.empty()) {
+            return;
+        }
+        const int index = static_cast<int>(m_rules.size());
+        m_rules.push_back(rule);
+        if (!has_wildcards(line)) {
+            (anchored ? m_paths : m_names)[std::string(line)].push_back(index);
+            return;
+        }
+        if (!anchored && line.front() == '*' && !has_wildcards(line.substr(1))) {
+            add_suffix(line.substr(1), index);
+            return;
+        }
+        Glob glob {index, anchored, {}};
+        while (true) {
+            const auto slash = line.find('/');
+            glob.segments.emplace_back(line.substr(0, slash));
+            if (slash == std::string_view::npos) {
+                break;
+            }
+            line.remove_prefix(slash + 1);
+        }
+        m_globs.push_back(std::move(glob));
+    }
+
+    void add_suffix(std::string_view suffix, int rule) {
+        uint32_t node = 0;
+        for (auto it = suffix.rbegin(); it != suffix.rend(); it++) {
+            auto next = m_suffixes[node].child(*it);
+            if (next == 0) {
+                next = static_cast<uint32_t>(m_suffixes.size());
+                m_suffixes[node].children.emplace_back(*it, next);
+                m_suffixes.emplace_back();
+            }
+            node = next;
+        }
+        m_suffixes[node].rules.push_back(rule);
+    }
+
+    std::vector<Rule> m_rules;
+    /**
+     * @brief literal patterns without '/', matched against name of entry
+     *
+     */
+    PatternMap m_names;
+    /**
+     * @brief literal patterns relative to root, matched against whole path
+     *
+     */
+    PatternMap m_paths;
+    std::vector<SuffixNode> m_suffixes {1};
+    /**
+     * @brief in order of rules
+     *
+     */
+    std::vector<Glob> m_globs;
+};
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+
+namespace rusync {
+
+/**
+ * @brief Fixed-size log-linear histogram of latencies with microsecond resolution.<br>
+ * Each power of two is split into SUB_BUCKETS linear buckets, so reported percentiles are within ~3% of real value.
+ * Recording is O(1) and doesn't allocate. Not thread-safe: keep one histogram per thread and merge them for report
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 5;
+    static constexpr uint64_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+
+    void record(std::chrono::nanoseconds latency) {
+        const uint64_t value = std::max<int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(latency).count(), 0);
+        m_buckets[bucket_for(value)]++;
+        m_count++;
+        m_max = std::max(m_max, value);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < m_buckets.size(); i++) {
+            m_buckets[i] += other.m_buckets[i];
+        }
+        m_count += other.m_count;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    uint64_t count() const {
+        return m_count;
+    }
+
+    std::chrono::microseconds max() const {
+        return std::chrono::microseconds(m_max);
+    }
+
+    /**
+     * @brief
+     *
+     * @param p percentile within [0, 1], e.g. 0.99
+     * @return std::chrono::microseconds upper bound of bucket which contains percentile, 0 if histogram is empty
+     */
+    std::chrono::microseconds percentile(double p) const {
+        const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(p * m_count)), 1);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < m_buckets.size(); i++) {
+            seen += m_buckets[i];
+            if (seen >= rank) {
+                return std::chrono::microseconds(std::min(upper_bound(i), m_max));
+            }
+        }
+        return std::chrono::microseconds(0);
+    }
+
+private:
+    static size_t bucket_for(uint64_t value) {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        const unsigned shift = std::bit_width(value) - 1 - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+    }
+
+    static uint64_t upper_bound(size_t bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return bucket;
+        }
+        const unsigned shift = bucket / SUB_BUCKETS - 1;
+        const uint64_t sub = bucket % SUB_BUCKETS + SUB_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::array<uint64_t, 64 * SUB_BUCKETS> m_buckets {};
+    uint64_t m_count = 0;
+    uint64_t m_max = 0;
+};
+}
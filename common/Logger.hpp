@@ -0,0 +1,335 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace rusync {
+
+enum class LogLevel {TRACE, DEBUG, INFO, WARN, ERROR, OFF};
+
+/**
+ * @brief parses level name (trace, debug, info, warn, error, off)
+ *
+ * @param name
+ * @return std::optional<LogLevel> nullopt if name is unknown
+ */
+inline std::optional<LogLevel> log_level_from(std::string_view name) {
+    static constexpr std::array<std::string_view, 6> NAMES {"trace", "debug", "info", "warn", "error", "off"};
+    for (size_t i = 0; i < NAMES.size(); i++) {
+        if (NAMES[i] == name) {
+            return static_cast<LogLevel>(i);
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief Bounded multi-producer single-consumer queue of log messages over fixed array of slots (Vyukov's bounded queue).<br>
+ * push never blocks and never allocates: if ring is full message is dropped. Messages longer than MAX_MESSAGE are truncated
+ */
+class LogRing {
+public:
+    static constexpr size_t MAX_MESSAGE = 480;
+
+    struct Message {
+        LogLevel level;
+        std::chrono::system_clock::time_point time;
+        uint16_t length;
+        char text[MAX_MESSAGE];
+    };
+
+    /**
+     * @brief Construct a new Log Ring object
+     *
+     * @param capacity rounded up to power of two
+     */
+    explicit LogRing(size_t capacity) :
+        m_mask {std::bit_ceil(std::max<size_t>(capacity, 2)) - 1},
+        m_slots {std::make_unique<Slot[]>(m_mask + 1)} {
+        for (size_t i = 0; i <= m_mask; i++) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief can be called from any thread
+     *
+     * @return false if ring is full
+     */
+    bool push(LogLevel level, std::chrono::system_clock::time_point time, std::string_view text) {
+        size_t position = m_tail.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &m_slots[position & m_mask];
+            const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0) {
+                if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        slot->message.level = level;
+        slot->message.time = time;
+        slot->message.length = static_cast<uint16_t>(std::min(text.size(), MAX_MESSAGE));
+        memcpy(slot->message.text, text.data(), slot->message.length);
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief should be called only from single consumer thread
+     *
+     * @param message
+     * @return false if ring is empty
+     */
+    bool pop(Message& message) {
+        Slot& slot = m_slots[m_head & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_head + 1) {
+            return false;
+        }
+        message.level = slot.message.level;
+        message.time = slot.message.time;
+        message.length = slot.message.length;
+        memcpy(message.text, slot.message.text, message.length);
+        slot.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+        m_head++;
+        return true;
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> sequence;
+        Message message;
+    };
+    const size_t m_mask;
+    std::unique_ptr<Slot[]> m_slots;
+    alignas(64) std::atomic<size_t> m_tail = 0;
+    alignas(64) size_t m_head = 0;
+};
+
+/**
+ * @brief Asynchronous leveled logger. Callers only format message and push it into LogRing,
+ * background thread writes messages to stdout (WARN and ERROR to stderr), so logging never takes a lock or waits for terminal.<br>
+ * Messages below ERROR are rate limited (DEFAULT_RATE per second by default), messages over the limit and messages which didn't fit into ring are dropped and
+ * their number is reported by writer thread. Level and rate could be set with RUSYNC_LOG_LEVEL and RUSYNC_LOG_RATE env variables
+ */
+class Logger {
+public:
+    static constexpr size_t CAPACITY = 4096;
+    static constexpr uint32_t DEFAULT_RATE = 2000;
+
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    /**
+     * @brief cheap check which should be done before formatting message, see RUSYNC_LOG
+     *
+     */
+    static bool enabled(LogLevel level) {
+        return level >= s_level.load(std::memory_order_relaxed);
+    }
+
+    static void set_level(LogLevel level) {
+        s_level.store(level, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief
+     *
+     * @param rate max number of messages below ERROR per second, 0 - unlimited
+     */
+    void set_rate(uint32_t rate) {
+        m_rate.store(rate, std::memory_order_relaxed);
+    }
+
+    void log(LogLevel level, std::string_view text) {
+        if (level < LogLevel::ERROR && !within_rate()) {
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (!m_ring.push(level, std::chrono::system_clock::now(), text)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief writes all messages pushed so far
+     *
+     */
+    void flush() {
+        m_flush_requested.store(true, std::memory_order_release);
+        while (m_flush_requested.load(std::memory_order_acquire) && m_running.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(IDLE_SLEEP);
+        }
+    }
+
+    ~Logger() {
+        m_running = false;
+        m_writer.join();
+    }
+
+private:
+    Logger() : m_ring {CAPACITY} {
+        if (const char* rate = std::getenv("RUSYNC_LOG_RATE")) {
+            m_rate = static_cast<uint32_t>(std::strtoul(rate, nullptr, 10));
+        }
+        m_writer = std::thread([this]() {
+            run();
+        });
+    }
+
+    static LogLevel level_from_env() {
+        const char* level = std::getenv("RUSYNC_LOG_LEVEL");
+        return level ? log_level_from(level).value_or(LogLevel::INFO) : LogLevel::INFO;
+    }
+
+    bool within_rate() {
+        const uint32_t rate = m_rate.load(std::memory_order_relaxed);
+        if (rate == 0) {
+            return true;
+        }
+        const int64_t second = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t window = m_window.load(std::memory_order_relaxed);
+        if (window != second && m_window.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+            m_window_count.store(0, std::memory_order_relaxed);
+        }
+        return m_window_count.fetch_add(1, std::memory_order_relaxed) < rate;
+    }
+
+    void run() {
+        auto message = std::make_unique<LogRing::Message>();
+        while (true) {
+            const bool running = m_running.load(std::memory_order_relaxed);
+            const bool flush_requested = m_flush_requested.load(std::memory_order_acquire);
+            bool written = false;
+            while (m_ring.pop(*message)) {
+                write(*message);
+                written = true;
+            }
+            report_lost();
+            if (written || flush_requested) {
+                fflush(stdout);
+                fflush(stderr);
+            }
+            if (flush_requested) {
+                m_flush_requested.store(false, std::memory_order_release);
+            }
+            if (!running) {
+                return;
+            }
+            if (!written) {
+                std::this_thread::sleep_for(IDLE_SLEEP);
+            }
+        }
+    }
+
+    void report_lost() {
+        const auto suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+        const auto dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+        if (suppressed == 0 && dropped == 0) {
+            return;
+        }
+        LogRing::Message message {LogLevel::WARN, std::chrono::system_clock::now(), 0, {}};
+        const auto length = snprintf(message.text, sizeof(message.text), "Log messages lost: %lu over rate limit, %lu due to full buffer",
+            static_cast<unsigned long>(suppressed), static_cast<unsigned long>(dropped));
+        message.length = static_cast<uint16_t>(std::clamp<int>(length, 0, sizeof(message.text) - 1));
+        write(message);
+    }
+
+    static void write(const LogRing::Message& message) {
+        static constexpr std::array<const char*, 5> LEVEL_NAMES {"TRACE", "DEBUG", "INFO", "WARN", "ERROR"};
+        const auto time = std::chrono::system_clock::to_time_t(message.time);
+        const auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(message.time.time_since_epoch()).count() % 1000;
+        std::tm tm;
+        localtime_r(&time, &tm);
+        char prefix[48];
+        const auto prefix_length = strftime(prefix, sizeof(prefix), "%F %T", &tm);
+        FILE* stream = message.level >= LogLevel::WARN ? stderr : stdout;
+        fprintf(stream, "%.*s.%03d %-5s %.*s\n", static_cast<int>(prefix_length), prefix, static_cast<int>(millis),
+            LEVEL_NAMES[static_cast<size_t>(message.level)], static_cast<int>(message.length), message.text);
+    }
+
+    static constexpr std::chrono::milliseconds IDLE_SLEEP {5};
+    static inline std::atomic<LogLevel> s_level = level_from_env();
+
+    LogRing m_ring;
+    std::atomic<uint32_t> m_rate = DEFAULT_RATE;
+    std::atomic<int64_t> m_window = 0;
+    std::atomic<uint32_t> m_window_count = 0;
+    std::atomic<uint64_t> m_suppressed = 0;
+    std::atomic<uint64_t> m_dropped = 0;
+    std::atomic<bool> m_flush_requested = false;
+    std::atomic<bool> m_running = true;
+    std::thread m_writer;
+};
+
+/**
+ * @brief Collects one log message via operator<< into thread-local stream and passes it to Logger when destroyed. Use through RUSYNC_LOG
+ *
+ */
+class LogLine {
+public:
+    explicit LogLine(LogLevel level) : m_level {level}, m_stream {stream()} {
+        m_stream.str({});
+        m_stream.clear();
+    }
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    ~LogLine() {
+        auto text = m_stream.view();
+        while (!text.empty() && text.back() == '\n') {
+            text.remove_suffix(1);
+        }
+        Logger::instance().log(m_level, text);
+    }
+
+    template <typename T>
+    LogLine& operator<<(const T& value) {
+        m_stream << value;
+        return *this;
+    }
+
+    LogLine& operator<<(std::ostream& (*manipulator)(std::ostream&)) {
+        m_stream << manipulator;
+        return *this;
+    }
+
+private:
+    static std::ostringstream& stream() {
+        thread_local std::ostringstream stream;
+        return stream;
+    }
+
+    LogLevel m_level;
+    std::ostringstream& m_stream;
+};
+}
+
+/**
+ * @brief logs message with given level, e.g. RUSYNC_LOG(DEBUG) << "value: " << value;<br>
+ * Message is not formatted (and its arguments are not evaluated) if level is disabled
+ */
+#define RUSYNC_LOG(level) \
+    if (!::rusync::Logger::enabled(::rusync::LogLevel::level)) {} else ::rusync::LogLine(::rusync::LogLevel::level)
@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace rusync {
+
+/**
+ * @brief Read-only view of large file through memory mapped window, so chunks are hashed and diffed in place without copying them into buffers.<br>
+ * File is mapped by windows of WINDOW bytes which start at HUGE_PAGE boundary (kernel may back them with huge pages of page cache),
+ * old window is unmapped when next one is mapped, so address space stays small for files of any size. Windows are advised as sequential,
+ * so kernel reads ahead aggressively and drops pages behind.<br>
+ * Size is taken on open and checked again before each window is mapped, so file truncated meanwhile is seen as shorter one.
+ * File truncated while its current window is being read still raises SIGBUS instead of short read, so it's only used for files of at least
+ * THRESHOLD bytes, which are rarely truncated in place, and only where nothing else truncates them (server reads its files by ReadEngine)
+ */
+class MappedFile {
+public:
+    /**
+     * @brief smaller files are read by buffered reads, mapping costs more than it saves for them
+     *
+     */
+    static constexpr uint64_t THRESHOLD = 8 << 20;
+    static constexpr uint64_t HUGE_PAGE = 2 << 20;
+    static constexpr uint64_t WINDOW = 64 << 20;
+
+    /**
+     * @brief
+     *
+     * @param path
+     * @return std::optional<MappedFile> nullopt if file could not be opened
+     */
+    static std::optional<MappedFile> open(const std::filesystem::path& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return std::nullopt;
+        }
+        return MappedFile{fd, static_cast<uint64_t>(st.st_size)};
+    }
+
+    MappedFile(MappedFile&& other) noexcept :
+        m_fd {std::exchange(other.m_fd, -1)},
+        m_size {other.m_size},
+        m_window {std::exchange(other.m_window, nullptr)},
+        m_window_offset {other.m_window_offset},
+        m_window_size {std::exchange(other.m_window_size, 0)} {
+
+    }
+
+    MappedFile& operator=(MappedFile&&) = delete;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        unmap();
+        if (m_fd >= 0) {
+            close(m_fd);
+        }
+    }
+
+    /**
+     * @brief maps window which contains requested range unless current one does
+     *
+     * @param offset
+     * @param length
+     * @return std::string_view data of range, shorter if range ends after end of file (or file was truncated since it was opened). Valid until next call
+     * @throw std::system_error if window could not be mapped
+     */
+    std::string_view view(uint64_t offset, uint64_t length) {
+        if (offset >= m_size) {
+            return {};
+        }
+        length = std::min(length, m_size - offset);
+        if (offset < m_window_offset || offset + length > m_window_offset + m_window_size) {
+            unmap();
+            // pages past end of truncated file can't be read, so new window ends at its current end
+            struct stat st;
+            if (fstat(m_fd, &st) == 0 && static_cast<uint64_t>(st.st_size) < m_size) {
+                m_size = st.st_size;
+                if (offset >= m_size) {
+                    return {};
+                }
+                length = std::min(length, m_size - offset);
+            }
+            map(offset, length);
+        }
+        return {static_cast<const char*>(m_window) + (offset - m_window_offset), length};
+    }
+
+    uint64_t size() const {
+        return m_size;
+    }
+
+    int fd() const {
+        return m_fd;
+    }
+
+private:
+    MappedFile(int fd, uint64_t size) : m_fd {fd}, m_size {size} {
+
+    }
+
+    void map(uint64_t offset, uint64_t length) {
+        const uint64_t start = offset / HUGE_PAGE * HUGE_PAGE;
+        // range longer than window (e.g. tail patch) gets window of its own size
+        const uint64_t size = std::min(std::max(WINDOW, offset + length - start), m_size - start);
+        void* window = mmap(nullptr, size, PROT_READ, MAP_SHARED, m_fd, start);
+        if (window == MAP_FAILED) {
+            throw std::system_error(errno, std::generic_category(), "mmap");
+        }
+        madvise(window, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+        madvise(window, size, MADV_HUGEPAGE);
+#endif
+        m_window = window;
+        m_window_offset = start;
+        m_window_size = size;
+    }
+
+    void unmap() {
+        if (m_window) {
+            munmap(m_window, m_window_size);
+            m_window = nullptr;
+            m_window_size = 0;
+        }
+    }
+
+    int m_fd;
+    uint64_t m_size;
+    void* m_window = nullptr;
+    uint64_t m_window_offset = 0;
+    uint64_t m_window_size = 0;
+};
+}
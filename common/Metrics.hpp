@@ -0,0 +1,211 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace rusync {
+
+/**
+ * @brief Number of shards of each metric. Every thread writes to its own shard (threads beyond SHARDS share shards), so recording never contends between threads.
+ * Values are summed over shards only when metrics are scraped
+ */
+inline constexpr size_t METRIC_SHARDS = 32;
+
+/**
+ * @brief index of shard of calling thread, assigned on first use
+ * 
+ * @return size_t 
+ */
+inline size_t metric_shard() {
+    static std::atomic<size_t> next_shard = 0;
+    thread_local const size_t shard = next_shard++ % METRIC_SHARDS;
+    return shard;
+}
+
+/**
+ * @brief Monotonic counter. add is relaxed atomic increment of calling thread's shard
+ * 
+ */
+class Counter {
+public:
+    void add(uint64_t value = 1) {
+        m_shards[metric_shard()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        uint64_t result = 0;
+        for (const auto& shard: m_shards) {
+            result += shard.value.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> value = 0;
+    };
+    std::array<Shard, METRIC_SHARDS> m_shards;
+};
+
+/**
+ * @brief Value which goes up and down, e.g. number of requests in progress. Increment and decrement may happen on different threads, only sum of shards is meaningful
+ * 
+ */
+class Gauge {
+public:
+    void add(int64_t value) {
+        m_shards[metric_shard()].value.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    int64_t value() const {
+        int64_t result = 0;
+        for (const auto& shard: m_shards) {
+            result += shard.value.load(std::memory_order_relaxed);
+        }
+        return result;
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<int64_t> value = 0;
+    };
+    std::array<Shard, METRIC_SHARDS> m_shards;
+};
+
+/**
+ * @brief Histogram of durations with fixed bucket bounds, exposed in Prometheus format (cumulative buckets, sum in seconds and count)
+ * 
+ */
+class Histogram {
+public:
+    static constexpr size_t MAX_BUCKETS = 16;
+
+    /**
+     * @brief Construct a new Histogram object
+     * 
+     * @param bounds upper bounds of buckets in seconds, ascending, at most MAX_BUCKETS. +Inf bucket is implicit
+     */
+    Histogram(std::initializer_list<double> bounds = DEFAULT_BOUNDS) : m_bounds(bounds) {
+        if (m_bounds.size() > MAX_BUCKETS) {
+            m_bounds.resize(MAX_BUCKETS);
+        }
+    }
+
+    void record(std::chrono::nanoseconds duration) {
+        const double seconds = std::chrono::duration<double>(duration).count();
+        size_t bucket = 0;
+        while (bucket < m_bounds.size() && seconds > m_bounds[bucket]) {
+            bucket++;
+        }
+        auto& shard = m_shards[metric_shard()];
+        shard.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        shard.sum_ns.fetch_add(std::max<int64_t>(duration.count(), 0), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Snapshot of histogram summed over shards
+     * 
+     */
+    struct Snapshot {
+        /**
+         * @brief cumulative counts, last one is +Inf bucket (total count)
+         * 
+         */
+        std::vector<uint64_t> cumulative;
+        double sum_seconds;
+        uint64_t count() const {
+            return cumulative.back();
+        }
+    };
+
+    Snapshot snapshot() const {
+        Snapshot result {std::vector<uint64_t>(m_bounds.size() + 1, 0), 0};
+        uint64_t sum_ns = 0;
+        for (const auto& shard: m_shards) {
+            for (size_t i = 0; i <= m_bounds.size(); i++) {
+                result.cumulative[i] += shard.buckets[i].load(std::memory_order_relaxed);
+            }
+            sum_ns += shard.sum_ns.load(std::memory_order_relaxed);
+        }
+        for (size_t i = 1; i < result.cumulative.size(); i++) {
+            result.cumulative[i] += result.cumulative[i - 1];
+        }
+        result.sum_seconds = sum_ns / 1e9;
+        return result;
+    }
+
+    const std::vector<double>& bounds() const {
+        return m_bounds;
+    }
+
+    static constexpr std::initializer_list<double> DEFAULT_BOUNDS = {
+        0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10
+    };
+
+private:
+    struct alignas(64) Shard {
+        std::array<std::atomic<uint64_t>, MAX_BUCKETS + 1> buckets {};
+        std::atomic<uint64_t> sum_ns = 0;
+    };
+    std::vector<double> m_bounds;
+    std::array<Shard, METRIC_SHARDS> m_shards;
+};
+
+/**
+ * @brief Writer of Prometheus text exposition format
+ * 
+ */
+class MetricsWriter {
+public:
+    /**
+     * @brief writes HELP and TYPE lines, should be called once per metric name before its samples
+     * 
+     */
+    void header(std::string_view name, std::string_view type, std::string_view help) {
+        m_out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+    }
+
+    /**
+     * @brief 
+     * 
+     * @param name 
+     * @param labels already formatted labels without braces, e.g. endpoint="/files",method="GET". May be empty
+     * @param value 
+     */
+    template <typename T>
+    void sample(std::string_view name, std::string_view labels, T value) {
+        m_out << name;
+        if (!labels.empty()) {
+            m_out << "{" << labels << "}";
+        }
+        m_out << " " << value << "\n";
+    }
+
+    void histogram(std::string_view name, const std::string& labels, const Histogram& histogram) {
+        const auto snapshot = histogram.snapshot();
+        const std::string prefix = labels.empty() ? "" : labels + ",";
+        for (size_t i = 0; i < histogram.bounds().size(); i++) {
+            std::ostringstream bound;
+            bound << histogram.bounds()[i];
+            sample(std::string(name) + "_bucket", prefix + "le=\"" + bound.str() + "\"", snapshot.cumulative[i]);
+        }
+        sample(std::string(name) + "_bucket", prefix + "le=\"+Inf\"", snapshot.count());
+        sample(std::string(name) + "_sum", labels, snapshot.sum_seconds);
+        sample(std::string(name) + "_count", labels, snapshot.count());
+    }
+
+    std::string str() const {
+        return m_out.str();
+    }
+
+private:
+    std::ostringstream m_out;
+};
+}
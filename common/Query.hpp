@@ -0,0 +1,386 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <string.h>
+
+namespace rusync {
+
+namespace detail {
+
+/**
+ * @brief characters which are kept intact by url_encode (RFC 3986 unreserved)
+ *
+ */
+inline constexpr auto UNRESERVED = []() {
+    std::array<bool, 256> table {};
+    for (int c = 0; c < 256; c++) {
+        table[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.' || c == '~';
+    }
+    return table;
+}();
+
+/**
+ * @brief value of hex digit or -1 for other characters
+ *
+ */
+inline constexpr auto HEX_VALUE = []() {
+    std::array<int8_t, 256> table {};
+    for (int c = 0; c < 256; c++) {
+        table[c] = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+    }
+    return table;
+}();
+
+inline constexpr char HEX_DIGITS[] = "0123456789ABCDEF";
+}
+
+/**
+ * @brief percent-encodes value and appends it to out. Unreserved characters are kept, everything else (including '&' and '=') is encoded
+ *
+ * @param out
+ * @param value
+ */
+inline void append_url_encoded(std::string& out, std::string_view value) {
+    size_t encoded = value.size();
+    for (const char c: value) {
+        encoded += detail::UNRESERVED[static_cast<unsigned char>(c)] ? 0 : 2;
+    }
+    size_t position = out.size();
+    out.resize(position + encoded);
+    for (const char c: value) {
+        const auto byte = static_cast<unsigned char>(c);
+        if (detail::UNRESERVED[byte]) {
+            out[position++] = c;
+            continue;
+        }
+        out[position++] = '%';
+        out[position++] = detail::HEX_DIGITS[byte >> 4];
+        out[position++] = detail::HEX_DIGITS[byte & 0xf];
+    }
+}
+
+/**
+ * @brief percent-encode provided url
+ *
+ * @param value
+ * @return std::string encoded
+ */
+inline std::string url_encode(std::string_view value) {
+    std::string encoded;
+    append_url_encoded(encoded, value);
+    return encoded;
+}
+
+/**
+ * @brief percent-decodes value into out, which should have at least value.size() bytes. Malformed escapes are copied as is, like nghttp2's percent_decode does
+ *
+ * @param value
+ * @param out
+ * @return size_t number of decoded bytes
+ */
+inline size_t url_decode_into(std::string_view value, char* out) {
+    size_t size = 0;
+    while (!value.empty()) {
+        // text between escapes is copied at once
+        const auto escape = std::min(value.find('%'), value.size());
+        memcpy(out + size, value.data(), escape);
+        size += escape;
+        value.remove_prefix(escape);
+        if (value.empty()) {
+            break;
+        }
+        const auto high = value.size() > 2 ? detail::HEX_VALUE[static_cast<unsigned char>(value[1])] : -1;
+        const auto low = value.size() > 2 ? detail::HEX_VALUE[static_cast<unsigned char>(value[2])] : -1;
+        if (high >= 0 && low >= 0) {
+            out[size++] = static_cast<char>(high << 4 | low);
+            value.remove_prefix(3);
+        } else {
+            out[size++] = '%';
+            value.remove_prefix(1);
+        }
+    }
+    return size;
+}
+
+inline std::string url_decode(std::string_view value) {
+    std::string decoded(value.size(), '\0');
+    decoded.resize(url_decode_into(value, decoded.data()));
+    return decoded;
+}
+
+/**
+ * @brief calls f(key, value) for each param of decoded query without allocating. Param without '=' has empty value
+ *
+ * @tparam F
+ * @param query decoded query, e.g. "key=abc&path=test.txt"
+ * @param f
+ */
+template <typename F>
+void for_each_param(std::string_view query, F&& f) {
+    while (!query.empty()) {
+        const auto param_end = query.find('&');
+        const auto param = query.substr(0, param_end);
+        const auto separator = param.find('=');
+        if (separator == std::string_view::npos) {
+            f(param, std::string_view());
+        } else {
+            f(param.substr(0, separator), param.substr(separator + 1));
+        }
+        if (param_end == std::string_view::npos) {
+            break;
+        }
+        query.remove_prefix(param_end + 1);
+    }
+}
+
+/**
+ * @brief Query parameters of request. Holds decoded query and offsets of its first MAX_INDEXED params in place, so parsing allocates at most once
+ * and lookup doesn't rescan query. If key is repeated, its last value is used
+ *
+ */
+class QueryParams {
+public:
+    static constexpr size_t MAX_INDEXED = 16;
+
+    QueryParams() = default;
+
+    /**
+     * @brief
+     *
+     * @param raw percent-encoded query as received, e.g. uri().raw_query
+     * @return QueryParams
+     */
+    static QueryParams decode(std::string_view raw) {
+        QueryParams params;
+        params.m_query.resize(raw.size());
+        params.m_query.resize(url_decode_into(raw, params.m_query.data()));
+        params.index();
+        return params;
+    }
+
+    /**
+     * @brief
+     *
+     * @param query decoded query
+     * @return QueryParams
+     */
+    static QueryParams parse(std::string_view query) {
+        QueryParams params;
+        params.m_query = query;
+        params.index();
+        return params;
+    }
+
+    /**
+     * @brief
+     *
+     * @param key
+     * @return std::optional<std::string_view> nullopt if there is no such param. View is valid while params are alive
+     */
+    std::optional<std::string_view> get(std::string_view key) const {
+        if (m_size > MAX_INDEXED) {
+            std::optional<std::string_view> result;
+            for_each_param(m_query, [&result, key](std::string_view param, std::string_view value) {
+                if (param == key) {
+                    result = value;
+                }
+            });
+            return result;
+        }
+        const std::string_view query = m_query;
+        for (size_t i = m_size; i > 0; i--) {
+            const auto& param = m_index[i - 1];
+            if (query.substr(param.key, param.key_size) == key) {
+                return query.substr(param.value, param.value_size);
+            }
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief
+     *
+     * @param key
+     * @return std::string_view
+     * @throw std::out_of_range if there is no such param
+     */
+    std::string_view at(std::string_view key) const {
+        const auto value = get(key);
+        if (!value) {
+            throw std::out_of_range("No query param " + std::string(key));
+        }
+        return *value;
+    }
+
+    /**
+     * @brief
+     *
+     * @param key
+     * @return uint64_t
+     * @throw std::out_of_range if there is no such param, std::invalid_argument if it's not a number
+     */
+    uint64_t number(std::string_view key) const {
+        const auto value = at(key);
+        uint64_t result = 0;
+        const auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+        if (ec != std::errc() || end != value.data() + value.size()) {
+            throw std::invalid_argument("Query param " + std::string(key) + " is not a number");
+        }
+        return result;
+    }
+
+    bool contains(std::string_view key) const {
+        return get(key).has_value();
+    }
+
+    /**
+     * @brief
+     *
+     * @return size_t number of params, repeated keys are counted each time
+     */
+    size_t size() const {
+        return m_size;
+    }
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
+    /**
+     * @brief
+     *
+     * @return const std::string& decoded query, e.g. for logs
+     */
+    const std::string& str() const {
+        return m_query;
+    }
+
+private:
+    /**
+     * @brief offsets within m_query, so copy of params stays valid
+     *
+     */
+    struct Param {
+        uint32_t key;
+        uint32_t key_size;
+        uint32_t value;
+        uint32_t value_size;
+    };
+
+    void index() {
+        for_each_param(m_query, [this](std::string_view key, std::string_view value) {
+            if (m_size < MAX_INDEXED) {
+                // value of param without '=' is empty view which doesn't point into query
+                const auto value_offset = value.empty() ? 0 : value.data() - m_query.data();
+                m_index[m_size] = {static_cast<uint32_t>(key.data() - m_query.data()), static_cast<uint32_t>(key.size()),
+                                   static_cast<uint32_t>(value_offset), static_cast<uint32_t>(value.size())};
+            }
+            m_size++;
+        });
+    }
+
+    std::string m_query;
+    std::array<Param, MAX_INDEXED> m_index {};
+    size_t m_size = 0;
+};
+
+/**
+ * @brief parsing parameters of decoded query. Value is everything after first '=' of param (so "path=a=b" is "a=b"),
+ * param without '=' has empty value and empty params ("a=1&&b=2", trailing '&') are harmless, so malformed query never throws
+ *
+ * @param query decoded query, e.g. "key=abc&path=test.txt"
+ * @return QueryParams
+ */
+inline QueryParams parse_params(std::string_view query) {
+    return QueryParams::parse(query);
+}
+
+/**
+ * @brief Builds encoded query of request into single buffer. Whole query is encoded including separators ("key%3Dabc%26path%3D..."),
+ * which is what servers decode before splitting it
+ *
+ */
+class QueryBuilder {
+public:
+    QueryBuilder() = default;
+
+    QueryBuilder(std::initializer_list<std::pair<std::string_view, std::string_view>> params) {
+        for (const auto& [key, value]: params) {
+            add(key, value);
+        }
+    }
+
+    QueryBuilder& add(std::string_view key, std::string_view value) {
+        if (!m_query.empty()) {
+            m_query += "%26";
+        }
+        append_url_encoded(m_query, key);
+        m_query += "%3D";
+        append_url_encoded(m_query, value);
+        return *this;
+    }
+
+    QueryBuilder& add(std::string_view key, uint64_t value) {
+        char buffer[20];
+        const auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        return add(key, std::string_view(buffer, end - buffer));
+    }
+
+    // string literals would pick uint64_t overload through bool otherwise
+    QueryBuilder& add(std::string_view key, const char* value) {
+        return add(key, std::string_view(value));
+    }
+
+    bool empty() const {
+        return m_query.empty();
+    }
+
+    /**
+     * @brief
+     *
+     * @return const std::string& encoded query
+     */
+    const std::string& str() const {
+        return m_query;
+    }
+
+private:
+    std::string m_query;
+};
+
+/**
+ * @brief builds uri of request to rusync server, key of client goes first
+ *
+ * @param host
+ * @param port
+ * @param path http path (e.g. /files)
+ * @param key key of client
+ * @param query
+ * @return std::string
+ */
+inline std::string make_uri(std::string_view host, std::string_view port, std::string_view path, std::string_view key, const QueryBuilder& query) {
+    constexpr std::string_view SCHEME = "http://";
+    std::string uri;
+    uri.reserve(SCHEME.size() + host.size() + port.size() + path.size() + key.size() * 3 + query.str().size() + 16);
+    uri += SCHEME;
+    uri += host;
+    uri += ':';
+    uri += port;
+    uri += path;
+    uri += "?key%3D";
+    append_url_encoded(uri, key);
+    if (!query.empty()) {
+        uri += "%26";
+        uri += query.str();
+    }
+    return uri;
+}
+}
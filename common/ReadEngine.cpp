@@ -0,0 +1,584 @@
+#include "ReadEngine.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <new>
+#include <system_error>
+#include <thread>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "Logger.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Executes reads submitted by ReadEngine. Each read is identified by slot, i.e. index of buffer it reads into
+ *
+ */
+class ReadEngine::Backend {
+public:
+    struct Completion {
+        size_t slot;
+        /**
+         * @brief number of bytes read or -errno
+         *
+         */
+        int64_t result;
+    };
+
+    virtual ~Backend() = default;
+    virtual void submit(size_t slot, int fd, char* buffer, size_t length, uint64_t offset) = 0;
+    /**
+     * @brief starts submitted reads and waits until at least one read is completed
+     *
+     * @param completions completed reads are appended to it
+     */
+    virtual void wait(std::vector<Completion>& completions) = 0;
+    virtual const char* name() const = 0;
+};
+
+namespace {
+
+/**
+ * @brief reads work either way, but without io_uring they are much slower, so it's reported once (every engine would find the same)
+ *
+ */
+void warn_fallback(const char* reason) {
+    static std::once_flag warned;
+    std::call_once(warned, [reason]() {
+        RUSYNC_LOG(WARN) << "io_uring is not available (" << reason << "), files are read by threads";
+    });
+}
+
+/**
+ * @brief io_uring driven by raw syscalls, so there is no dependency on liburing
+ *
+ */
+class UringBackend : public ReadEngine::Backend {
+public:
+    /**
+     * @brief
+     *
+     * @param buffers all slots, registered with kernel as one fixed buffer if RLIMIT_MEMLOCK allows
+     * @param size total size of buffers
+     * @param slots max number of reads in flight
+     * @return std::unique_ptr<UringBackend> nullptr if io_uring is not available
+     */
+    static std::unique_ptr<UringBackend> create(char* buffers, size_t size, size_t slots) {
+        io_uring_params params {};
+        const int fd = syscall(__NR_io_uring_setup, slots, &params);
+        if (fd < 0) {
+            warn_fallback(strerror(errno));
+            return nullptr;
+        }
+        std::unique_ptr<UringBackend> backend {new UringBackend(fd, slots)};
+        if (!backend->map(params)) {
+            warn_fallback(strerror(errno));
+            return nullptr;
+        }
+        // pages of registered buffer are pinned once instead of on every read
+        iovec buffer {buffers, size};
+        backend->m_fixed = syscall(__NR_io_uring_register, fd, IORING_REGISTER_BUFFERS, &buffer, 1) == 0;
+        if (!backend->m_fixed) {
+            RUSYNC_LOG(DEBUG) << "Failed to register io_uring buffers: " << strerror(errno);
+        }
+        return backend;
+    }
+
+    ~UringBackend() override {
+        if (m_sqes != MAP_FAILED) {
+            munmap(m_sqes, m_sqes_size);
+        }
+        if (m_cq != MAP_FAILED && m_cq != m_sq) {
+            munmap(m_cq, m_cq_size);
+        }
+        if (m_sq != MAP_FAILED) {
+            munmap(m_sq, m_sq_size);
+        }
+        close(m_fd);
+    }
+
+    void submit(size_t slot, int fd, char* buffer, size_t length, uint64_t offset) override {
+        // only this thread writes tail of submission queue
+        const unsigned tail = *m_sq_tail;
+        const unsigned index = tail & *m_sq_mask;
+        io_uring_sqe& sqe = m_sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        if (m_fixed) {
+            sqe.opcode = IORING_OP_READ_FIXED;
+            sqe.addr = reinterpret_cast<uint64_t>(buffer);
+            sqe.len = length;
+            sqe.buf_index = 0;
+        } else {
+            m_iovecs[slot] = {buffer, length};
+            sqe.opcode = IORING_OP_READV;
+            sqe.addr = reinterpret_cast<uint64_t>(&m_iovecs[slot]);
+            sqe.len = 1;
+        }
+        sqe.fd = fd;
+        sqe.off = offset;
+        sqe.user_data = slot;
+        m_sq_array[index] = index;
+        std::atomic_ref<unsigned>(*m_sq_tail).store(tail + 1, std::memory_order_release);
+    }
+
+    void wait(std::vector<Completion>& completions) override {
+        while (true) {
+            // kernel advances head of submission queue as it consumes entries, so retry after EINTR submits only the rest
+            const unsigned to_submit = *m_sq_tail - std::atomic_ref<unsigned>(*m_sq_head).load(std::memory_order_acquire);
+            if (syscall(__NR_io_uring_enter, m_fd, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) >= 0) {
+                break;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+            }
+        }
+        unsigned head = *m_cq_head;
+        const unsigned tail = std::atomic_ref<unsigned>(*m_cq_tail).load(std::memory_order_acquire);
+        for (; head != tail; head++) {
+            const auto& cqe = m_cqes[head & *m_cq_mask];
+            completions.push_back({static_cast<size_t>(cqe.user_data), cqe.res});
+        }
+        std::atomic_ref<unsigned>(*m_cq_head).store(head, std::memory_order_release);
+    }
+
+    const char* name() const override {
+        return "io_uring";
+    }
+
+private:
+    UringBackend(int fd, size_t slots) : m_fd {fd}, m_iovecs(slots) {
+
+    }
+
+    bool map(const io_uring_params& params) {
+        m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+        }
+        m_sq = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+        if (m_sq == MAP_FAILED) {
+            return false;
+        }
+        m_cq = single_mmap ? m_sq : mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+        if (m_cq == MAP_FAILED) {
+            return false;
+        }
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+        auto* sq = static_cast<char*>(m_sq);
+        auto* cq = static_cast<char*>(m_cq);
+        m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        m_sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        m_cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    int m_fd;
+    bool m_fixed = false;
+    /**
+     * @brief iovec of each slot, used if buffers could not be registered. Kept until read is completed
+     *
+     */
+    std::vector<iovec> m_iovecs;
+    void* m_sq = MAP_FAILED;
+    void* m_cq = MAP_FAILED;
+    io_uring_sqe* m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t m_sq_size = 0;
+    size_t m_cq_size = 0;
+    size_t m_sqes_size = 0;
+    unsigned* m_sq_head = nullptr;
+    unsigned* m_sq_tail = nullptr;
+    unsigned* m_sq_mask = nullptr;
+    unsigned* m_sq_array = nullptr;
+    unsigned* m_cq_head = nullptr;
+    unsigned* m_cq_tail = nullptr;
+    unsigned* m_cq_mask = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+};
+
+/**
+ * @brief Fallback which executes reads by blocking pread on threads of ReaderPool
+ *
+ */
+class ThreadBackend : public ReadEngine::Backend {
+public:
+    void submit(size_t slot, int fd, char* buffer, size_t length, uint64_t offset) override;
+
+    void wait(std::vector<Completion>& completions) override {
+        std::unique_lock lock {m_mutex};
+        m_completed_cv.wait(lock, [this]() {
+            return !m_completed.empty();
+        });
+        completions.insert(completions.end(), m_completed.begin(), m_completed.end());
+        m_completed.clear();
+    }
+
+    void complete(Completion completion) {
+        std::lock_guard lock {m_mutex};
+        m_completed.push_back(completion);
+        m_completed_cv.notify_one();
+    }
+
+    const char* name() const override {
+        return "threads";
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_completed_cv;
+    std::vector<Completion> m_completed;
+};
+
+/**
+ * @brief Threads shared by all ThreadBackends, so number of blocking reads in flight doesn't grow with number of engines
+ *
+ */
+class ReaderPool {
+public:
+    struct Job {
+        ThreadBackend* backend;
+        size_t slot;
+        int fd;
+        char* buffer;
+        size_t length;
+        uint64_t offset;
+    };
+
+    static ReaderPool& instance() {
+        static ReaderPool pool;
+        return pool;
+    }
+
+    void post(const Job& job) {
+        std::lock_guard lock {m_mutex};
+        m_jobs.push_back(job);
+        m_jobs_cv.notify_one();
+    }
+
+    ~ReaderPool() {
+        {
+            std::lock_guard lock {m_mutex};
+            m_stopped = true;
+        }
+        m_jobs_cv.notify_all();
+        for (auto& thread: m_threads) {
+            thread.join();
+        }
+    }
+
+private:
+    ReaderPool() {
+        for (size_t i = 0; i < THREADS; i++) {
+            m_threads.emplace_back([this]() {
+                run();
+            });
+        }
+    }
+
+    void run() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock lock {m_mutex};
+                m_jobs_cv.wait(lock, [this]() {
+                    return m_stopped || !m_jobs.empty();
+                });
+                if (m_jobs.empty()) {
+                    return;
+                }
+                job = m_jobs.front();
+                m_jobs.pop_front();
+            }
+            ssize_t result;
+            while ((result = pread(job.fd, job.buffer, job.length, job.offset)) < 0 && errno == EINTR);
+            job.backend->complete({job.slot, result < 0 ? -errno : result});
+        }
+    }
+
+    static constexpr size_t THREADS = 8;
+
+    std::mutex m_mutex;
+    std::condition_variable m_jobs_cv;
+    std::deque<Job> m_jobs;
+    bool m_stopped = false;
+    std::vector<std::thread> m_threads;
+};
+
+void ThreadBackend::submit(size_t slot, int fd, char* buffer, size_t length, uint64_t offset) {
+    ReaderPool::instance().post({this, slot, fd, buffer, length, offset});
+}
+}
+
+void ReadEngine::Buffers::operator()(char* data) const {
+    std::free(data);
+}
+
+namespace {
+
+/**
+ * @brief idle engines of ReadEngine::acquire
+ *
+ */
+class EnginePool {
+public:
+    static EnginePool& instance() {
+        static EnginePool pool;
+        return pool;
+    }
+
+    ReadEngine* acquire() {
+        std::unique_lock lock {m_mutex};
+        m_released_cv.wait(lock, [this]() {
+            return !m_idle.empty() || m_created < ReadEngine::MAX_ENGINES;
+        });
+        if (!m_idle.empty()) {
+            ReadEngine* engine = m_idle.back().release();
+            m_idle.pop_back();
+            return engine;
+        }
+        m_created++;
+        lock.unlock();
+        try {
+            return new ReadEngine();
+        } catch (...) {
+            lock.lock();
+            m_created--;
+            m_released_cv.notify_one();
+            throw;
+        }
+    }
+
+    void release(ReadEngine* engine) {
+        std::lock_guard lock {m_mutex};
+        m_idle.emplace_back(engine);
+        m_released_cv.notify_one();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_released_cv;
+    std::vector<std::unique_ptr<ReadEngine>> m_idle;
+    size_t m_created = 0;
+};
+}
+
+void ReadEngine::Release::operator()(ReadEngine* engine) const {
+    EnginePool::instance().release(engine);
+}
+
+ReadEngine::Lease ReadEngine::acquire() {
+    return Lease {EnginePool::instance().acquire()};
+}
+
+ReadEngine::ReadEngine(bool use_uring) :
+    m_buffers {static_cast<char*>(std::aligned_alloc(4096, QUEUE_DEPTH * BUFFER_SIZE))} {
+    if (!m_buffers) {
+        throw std::bad_alloc();
+    }
+    if (use_uring) {
+        m_backend = UringBackend::create(m_buffers.get(), QUEUE_DEPTH * BUFFER_SIZE, QUEUE_DEPTH);
+    }
+    if (!m_backend) {
+        m_backend = std::make_unique<ThreadBackend>();
+    }
+}
+
+ReadEngine::~ReadEngine() = default;
+
+const char* ReadEngine::backend() const {
+    return m_backend->name();
+}
+
+void ReadEngine::read_files(const std::vector<std::filesystem::path>& paths, size_t block_size, const BlockCallback& on_block, const DoneCallback& on_done) {
+    assert(block_size > 0 && block_size <= BUFFER_SIZE);
+    struct File {
+        int fd;
+        uint64_t size;
+        uint64_t next_submit = 0;
+        uint64_t next_delivery = 0;
+        size_t in_flight = 0;
+        bool failed = false;
+        /**
+         * @brief completed blocks which wait for earlier ones, by offset
+         *
+         */
+        std::map<uint64_t, size_t> ready {};
+    };
+    struct Slot {
+        size_t file;
+        uint64_t offset;
+        size_t length;
+        size_t filled;
+    };
+    std::array<Slot, QUEUE_DEPTH> slots;
+    std::vector<size_t> free_slots;
+    for (size_t slot = QUEUE_DEPTH; slot > 0; slot--) {
+        free_slots.push_back(slot - 1);
+    }
+    // files being read, at most one per slot
+    std::map<size_t, File> active;
+    size_t next_file = 0;
+    size_t in_flight = 0;
+
+    const auto buffer = [this](size_t slot) {
+        return m_buffers.get() + slot * BUFFER_SIZE;
+    };
+    const auto submit_block = [&](size_t index, File& file) {
+        const size_t slot = free_slots.back();
+        free_slots.pop_back();
+        const size_t length = std::min<uint64_t>(block_size, file.size - file.next_submit);
+        slots[slot] = {index, file.next_submit, length, 0};
+        m_backend->submit(slot, file.fd, buffer(slot), length, file.next_submit);
+        file.next_submit += length;
+        file.in_flight++;
+        in_flight++;
+    };
+    const auto finish = [&](std::map<size_t, File>::iterator it) {
+        for (const auto& [offset, slot]: it->second.ready) {
+            free_slots.push_back(slot);
+        }
+        close(it->second.fd);
+        const auto [index, ok] = std::pair{it->first, !it->second.failed};
+        active.erase(it);
+        on_done(index, ok);
+    };
+
+    std::vector<Backend::Completion> completions;
+    // completions which were reaped, but not processed yet, if callback throws they aren't in flight anymore
+    size_t unprocessed = 0;
+    try {
+        while (next_file < paths.size() || !active.empty()) {
+            // new files are opened first, so many small files are read in parallel
+            while (!free_slots.empty() && next_file < paths.size()) {
+                const size_t index = next_file++;
+                const int fd = open(paths[index].c_str(), O_RDONLY | O_CLOEXEC);
+                struct stat st;
+                if (fd < 0 || fstat(fd, &st) != 0) {
+                    if (fd >= 0) {
+                        close(fd);
+                    }
+                    on_done(index, false);
+                    continue;
+                }
+                if (st.st_size == 0) {
+                    close(fd);
+                    on_done(index, true);
+                    continue;
+                }
+                submit_block(index, active.emplace(index, File{.fd = fd, .size = static_cast<uint64_t>(st.st_size)}).first->second);
+            }
+            // rest of slots read ahead within files which are being read
+            for (bool submitted = true; submitted && !free_slots.empty();) {
+                submitted = false;
+                for (auto& [index, file]: active) {
+                    if (free_slots.empty()) {
+                        break;
+                    }
+                    if (!file.failed && file.next_submit < file.size) {
+                        submit_block(index, file);
+                        submitted = true;
+                    }
+                }
+            }
+            if (in_flight == 0) {
+                continue;
+            }
+            completions.clear();
+            m_backend->wait(completions);
+            unprocessed = completions.size();
+            for (const auto& completion: completions) {
+                unprocessed--;
+                Slot& slot = slots[completion.slot];
+                const auto it = active.find(slot.file);
+                File& file = it->second;
+                if (completion.result > 0) {
+                    slot.filled += completion.result;
+                }
+                const bool retry = completion.result == -EINTR || completion.result == -EAGAIN;
+                if (retry || (completion.result > 0 && slot.filled < slot.length)) {
+                    // short read, the rest of block is read by the same slot
+                    m_backend->submit(completion.slot, file.fd, buffer(completion.slot) + slot.filled, slot.length - slot.filled, slot.offset + slot.filled);
+                    continue;
+                }
+                file.in_flight--;
+                in_flight--;
+                if (completion.result <= 0 || file.failed) {
+                    // read error or file was truncated while being read
+                    if (!file.failed) {
+                        RUSYNC_LOG(ERROR) << "Failed to read " << paths[slot.file] << " at offset " << slot.offset << ": "
+                            << (completion.result < 0 ? strerror(-completion.result) : "unexpected end of file");
+                    }
+                    file.failed = true;
+                    free_slots.push_back(completion.slot);
+                } else {
+                    file.ready.emplace(slot.offset, completion.slot);
+                    for (auto ready = file.ready.begin(); ready != file.ready.end() && ready->first == file.next_delivery; ready = file.ready.erase(ready)) {
+                        const Slot& block = slots[ready->second];
+                        on_block(block.file, block.offset, buffer(ready->second), block.length);
+                        file.next_delivery += block.length;
+                        free_slots.push_back(ready->second);
+                    }
+                }
+                if (file.in_flight == 0 && (file.failed || file.next_delivery == file.size)) {
+                    finish(it);
+                }
+            }
+        }
+    } catch (...) {
+        // kernel or reader threads still write into buffers, so they must be done before buffers are reused or freed
+        in_flight -= unprocessed;
+        while (in_flight > 0) {
+            completions.clear();
+            m_backend->wait(completions);
+            in_flight -= completions.size();
+        }
+        for (const auto& [index, file]: active) {
+            close(file.fd);
+        }
+        throw;
+    }
+}
+
+std::vector<std::optional<uint64_t>> hash_files(const std::vector<std::filesystem::path>& paths, HashAlgorithm algorithm) {
+    std::vector<std::optional<uint64_t>> hashes(paths.size());
+    // only files being read have hasher
+    std::map<size_t, Hasher> hashers;
+    ReadEngine::acquire()->read_files(paths, ReadEngine::BUFFER_SIZE, [&hashers, algorithm](size_t file, uint64_t, const char* data, size_t size) {
+        hashers.try_emplace(file, algorithm).first->second.update(data, size);
+    }, [&hashers, &hashes, algorithm](size_t file, bool ok) {
+        const auto it = hashers.find(file);
+        if (ok) {
+            hashes[file] = it == hashers.end() ? hash_bytes(algorithm, nullptr, 0) : it->second.digest();
+        }
+        if (it != hashers.end()) {
+            hashers.erase(it);
+        }
+    });
+    return hashes;
+}
+}
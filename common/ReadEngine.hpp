@@ -0,0 +1,109 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <vector>
+#include "Hash.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Reads whole files keeping many reads in flight, across files and within large file, so scan and hashing keep NVMe queue busy
+ * instead of waiting for one blocking read at a time.<br>
+ * Reads are submitted to io_uring into buffers registered with kernel. If io_uring is not available (old kernel, seccomp in containers)
+ * the same reads are executed by shared pool of reader threads. Either way blocks of every file are delivered in order on calling thread,
+ * so consumer (e.g. Hasher) needs no locking
+ */
+class ReadEngine {
+public:
+    static constexpr size_t QUEUE_DEPTH = 32;
+    /**
+     * @brief size of each of QUEUE_DEPTH buffers, fits largest chunk of calculate_chunk_size
+     *
+     */
+    static constexpr size_t BUFFER_SIZE = 128 << 10;
+
+    /**
+     * @brief called for each block of file, blocks of file are delivered in order
+     *
+     */
+    using BlockCallback = std::function<void(size_t file, uint64_t offset, const char* data, size_t size)>;
+    /**
+     * @brief called once per file after its last block. ok is false if file could not be opened or read, some blocks could be delivered before that
+     *
+     */
+    using DoneCallback = std::function<void(size_t file, bool ok)>;
+
+    class Backend;
+
+    /**
+     * @brief returns engine to pool of acquire
+     *
+     */
+    struct Release {
+        void operator()(ReadEngine* engine) const;
+    };
+    using Lease = std::unique_ptr<ReadEngine, Release>;
+
+    /**
+     * @brief at most MAX_ENGINES engines exist, so their buffers and io_uring instances don't grow with number of threads which read files
+     *
+     */
+    static constexpr size_t MAX_ENGINES = 8;
+
+    /**
+     * @brief engine from pool shared by all threads, created on demand. Engine owns its buffers and io_uring instance, so it's used by one thread at a time.
+     * If all MAX_ENGINES engines are in use, waits for one of them to be released. Thread must release engine before it acquires another one
+     *
+     * @return Lease engine, returned to pool once lease is destroyed
+     */
+    static Lease acquire();
+
+    /**
+     * @brief
+     *
+     * @param use_uring false forces reader threads, e.g. to compare backends
+     */
+    explicit ReadEngine(bool use_uring = true);
+    ~ReadEngine();
+    ReadEngine(const ReadEngine&) = delete;
+    ReadEngine& operator=(const ReadEngine&) = delete;
+
+    /**
+     * @brief reads files, returns once every file is done
+     *
+     * @param paths
+     * @param block_size size of delivered blocks except the last one of file, at most BUFFER_SIZE
+     * @param on_block
+     * @param on_done
+     */
+    void read_files(const std::vector<std::filesystem::path>& paths, size_t block_size, const BlockCallback& on_block, const DoneCallback& on_done);
+
+    /**
+     * @brief
+     *
+     * @return const char* "io_uring" or "threads"
+     */
+    const char* backend() const;
+
+private:
+    struct Buffers {
+        void operator()(char* data) const;
+    };
+
+    std::unique_ptr<char, Buffers> m_buffers;
+    std::unique_ptr<Backend> m_backend;
+};
+
+/**
+ * @brief hashes whole files with engine of ReadEngine::acquire
+ *
+ * @param paths
+ * @param algorithm
+ * @return std::vector<std::optional<uint64_t>> hash of each file, nullopt if file could not be read
+ */
+std::vector<std::optional<uint64_t>> hash_files(const std::vector<std::filesystem::path>& paths, HashAlgorithm algorithm);
+}
@@ -0,0 +1,387 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace rusync {
+
+/**
+ * @brief name of request header which passes trace context from client to server, value is "<trace id>:<span id>" in hex
+ *
+ */
+inline constexpr const char* TRACE_HEADER = "x-rusync-trace";
+
+/**
+ * @brief arguments of span, shown by trace viewer
+ *
+ */
+using TraceArgs = std::vector<std::pair<std::string_view, std::string>>;
+
+/**
+ * @brief Writes spans as Chrome trace-event JSON (complete "X" events and "s"/"f" flow events), so file can be opened in chrome://tracing or Perfetto.<br>
+ * Disabled until start() is called, then each span costs one clock read and one short lock of event buffer. Events are buffered and appended to file in batches
+ * by thread which filled the batch, outside of buffer lock, file is kept a valid JSON array after every batch. Timestamps are wall clock microseconds, so traces of client and server
+ * can be merged into one array (e.g. `jq -s add client.json server.json`) and request flows are linked across processes
+ */
+class Tracer {
+public:
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    static bool enabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief opens trace file and enables tracing
+     *
+     * @param path
+     * @param process_name shown by viewer as name of process
+     * @return false if file could not be opened
+     */
+    bool start(const std::filesystem::path& path, std::string_view process_name) {
+        std::lock_guard file_lock {m_file_mutex};
+        if (m_file) {
+            return true;
+        }
+        m_file = fopen(path.c_str(), "w");
+        if (!m_file) {
+            return false;
+        }
+        m_written = false;
+        fputs("[\n", m_file);
+        write_locked({"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" + std::to_string(getpid()) + ",\"args\":{\"name\":" + quote(process_name) + "}}"});
+        {
+            std::lock_guard lock {m_mutex};
+            m_open = true;
+            m_last_flush = std::chrono::steady_clock::now();
+        }
+        s_enabled = true;
+        return true;
+    }
+
+    /**
+     * @brief writes buffered events and closes file
+     *
+     */
+    void stop() {
+        s_enabled = false;
+        std::lock_guard file_lock {m_file_mutex};
+        if (!m_file) {
+            return;
+        }
+        std::vector<std::string> batch;
+        {
+            std::lock_guard lock {m_mutex};
+            m_open = false;
+            batch.swap(m_events);
+        }
+        write_locked(batch);
+        fclose(m_file);
+        m_file = nullptr;
+    }
+
+    ~Tracer() {
+        stop();
+    }
+
+    /**
+     * @brief
+     *
+     * @return uint64_t microseconds since epoch, timestamp of trace events
+     */
+    static uint64_t now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * @brief random non-zero id of trace or span
+     *
+     * @return uint64_t
+     */
+    static uint64_t new_id() {
+        thread_local std::mt19937_64 random {std::random_device{}()};
+        uint64_t id;
+        while ((id = random()) == 0);
+        return id;
+    }
+
+    /**
+     * @brief trace of operation which is being executed by calling thread, 0 if none. See TraceScope
+     *
+     * @return uint64_t&
+     */
+    static uint64_t& current_trace() {
+        thread_local uint64_t trace = 0;
+        return trace;
+    }
+
+    /**
+     * @brief records complete event of calling thread. trace arg is added if there is current trace
+     *
+     */
+    void complete(std::string_view name, std::string_view category, uint64_t start, uint64_t end, const TraceArgs& args = {}) {
+        std::string event = "{\"name\":" + quote(name) + ",\"cat\":" + quote(category) + ",\"ph\":\"X\",\"ts\":" + std::to_string(start)
+            + ",\"dur\":" + std::to_string(end > start ? end - start : 0) + ids() + ",\"args\":{";
+        bool first = true;
+        if (current_trace() != 0) {
+            event += "\"trace\":\"" + to_hex(current_trace()) + "\"";
+            first = false;
+        }
+        for (const auto& [key, value]: args) {
+            event += (first ? "" : ",") + quote(key) + ":" + quote(value);
+            first = false;
+        }
+        event += "}}";
+        push(std::move(event));
+    }
+
+    /**
+     * @brief records flow event, which links span of one thread (or process) with span of another one
+     *
+     * @param start true for start of flow ("s", bound to enclosing span), false for its end ("f", bound to next span which starts at ts)
+     * @param id same for start and end of flow
+     * @param ts
+     */
+    void flow(bool start, uint64_t id, uint64_t ts) {
+        push(std::string("{\"name\":\"request\",\"cat\":\"flow\",\"ph\":\"") + (start ? "s" : "f\",\"bp\":\"e") + "\",\"id\":\"0x" + to_hex(id)
+            + "\",\"ts\":" + std::to_string(ts) + ids() + "}");
+    }
+
+    static std::string to_hex(uint64_t value) {
+        char buffer[17];
+        snprintf(buffer, sizeof(buffer), "%016lx", static_cast<unsigned long>(value));
+        return buffer;
+    }
+
+    /**
+     * @brief value of TRACE_HEADER
+     *
+     * @param trace
+     * @param span
+     * @return std::string
+     */
+    static std::string header_value(uint64_t trace, uint64_t span) {
+        return to_hex(trace) + ":" + to_hex(span);
+    }
+
+    /**
+     * @brief parses value of TRACE_HEADER
+     *
+     * @param value
+     * @return std::optional<std::pair<uint64_t, uint64_t>> trace and span ids, nullopt if value is malformed
+     */
+    static std::optional<std::pair<uint64_t, uint64_t>> parse_header(std::string_view value) {
+        const auto separator = value.find(':');
+        if (separator == std::string_view::npos) {
+            return std::nullopt;
+        }
+        const auto trace = parse_hex(value.substr(0, separator));
+        const auto span = parse_hex(value.substr(separator + 1));
+        if (!trace || !span) {
+            return std::nullopt;
+        }
+        return std::pair{*trace, *span};
+    }
+
+private:
+    Tracer() = default;
+
+    static std::optional<uint64_t> parse_hex(std::string_view value) {
+        if (value.empty() || value.size() > 16) {
+            return std::nullopt;
+        }
+        uint64_t result = 0;
+        for (const char c: value) {
+            const int digit = c >= '0' && c <= '9' ? c - '0' : (c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1);
+            if (digit < 0) {
+                return std::nullopt;
+            }
+            result = result << 4 | digit;
+        }
+        return result;
+    }
+
+    static std::string ids() {
+        thread_local const std::string ids = ",\"pid\":" + std::to_string(getpid()) + ",\"tid\":" + std::to_string(syscall(SYS_gettid));
+        return ids;
+    }
+
+    static std::string quote(std::string_view value) {
+        std::string result = "\"";
+        for (const char c: value) {
+            if (c == '"' || c == '\\') {
+                result += '\\';
+                result += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[7];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                result += escaped;
+            } else {
+                result += c;
+            }
+        }
+        return result + "\"";
+    }
+
+    void push(std::string event) {
+        std::vector<std::string> batch;
+        {
+            std::lock_guard lock {m_mutex};
+            if (!m_open) {
+                return;
+            }
+            m_events.push_back(std::move(event));
+            const auto now = std::chrono::steady_clock::now();
+            if (m_events.size() < BATCH && now - m_last_flush < FLUSH_INTERVAL) {
+                return;
+            }
+            m_last_flush = now;
+            batch.swap(m_events);
+        }
+        // other threads keep buffering while batch is written
+        std::lock_guard file_lock {m_file_mutex};
+        if (m_file) {
+            write_locked(batch);
+        }
+    }
+
+    /**
+     * @brief appends batch of events, m_file_mutex should be held. Closing bracket written by previous batch is overwritten, so file is valid JSON between batches
+     *
+     * @param batch
+     */
+    void write_locked(const std::vector<std::string>& batch) {
+        if (batch.empty()) {
+            return;
+        }
+        if (m_written) {
+            fseek(m_file, -2, SEEK_END);
+        }
+        for (const auto& event: batch) {
+            fputs(m_written ? ",\n" : "", m_file);
+            fputs(event.c_str(), m_file);
+            m_written = true;
+        }
+        fputs("\n]", m_file);
+        fflush(m_file);
+    }
+
+    static constexpr size_t BATCH = 512;
+    static constexpr std::chrono::seconds FLUSH_INTERVAL {1};
+    static inline std::atomic<bool> s_enabled = false;
+
+    /**
+     * @brief guards buffered events, taken by every span
+     *
+     */
+    std::mutex m_mutex;
+    bool m_open = false;
+    std::vector<std::string> m_events;
+    std::chrono::steady_clock::time_point m_last_flush;
+    /**
+     * @brief guards file, taken only by thread which writes batch. Taken before m_mutex if both are needed
+     *
+     */
+    std::mutex m_file_mutex;
+    FILE* m_file = nullptr;
+    bool m_written = false;
+};
+
+/**
+ * @brief Makes trace current for calling thread until scope ends, so spans and requests of operation are tagged with it.
+ * Previous trace is restored on destruction
+ */
+class TraceScope {
+public:
+    /**
+     * @brief starts new trace if tracing is enabled
+     *
+     */
+    TraceScope() : TraceScope(Tracer::enabled() ? Tracer::new_id() : 0) {
+
+    }
+
+    /**
+     * @brief continues existing trace, e.g. in callback of request
+     *
+     * @param trace
+     */
+    explicit TraceScope(uint64_t trace) : m_previous {std::exchange(Tracer::current_trace(), trace)} {
+
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    ~TraceScope() {
+        Tracer::current_trace() = m_previous;
+    }
+
+private:
+    uint64_t m_previous;
+};
+
+/**
+ * @brief Span which is recorded as complete event when it's ended (explicitly or by destructor). Does nothing if tracing is disabled.<br>
+ * Span could be ended on other thread than it was started (e.g. from request callback), it's recorded with thread and trace which ended it
+ */
+class TraceSpan {
+public:
+    TraceSpan(std::string_view name, std::string_view category, TraceArgs args = {}) :
+        m_start {Tracer::enabled() ? Tracer::now() : 0} {
+        if (m_start != 0) {
+            m_name = name;
+            m_category = category;
+            m_args = std::move(args);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    ~TraceSpan() {
+        end();
+    }
+
+    bool active() const {
+        return m_start != 0;
+    }
+
+    uint64_t start() const {
+        return m_start;
+    }
+
+    void arg(std::string_view key, std::string value) {
+        if (active()) {
+            m_args.emplace_back(key, std::move(value));
+        }
+    }
+
+    void end() {
+        if (active()) {
+            Tracer::instance().complete(m_name, m_category, m_start, Tracer::now(), m_args);
+            m_start = 0;
+        }
+    }
+
+private:
+    uint64_t m_start;
+    std::string m_name;
+    std::string m_category;
+    TraceArgs m_args;
+};
+}
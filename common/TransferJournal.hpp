@@ -0,0 +1,235 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace rusync {
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Set of byte ranges [offset, end). Overlapping and adjacent ranges are merged
+ *
+ */
+class RangeSet {
+public:
+    using Range = std::pair<uint64_t, uint64_t>;
+
+    /**
+     * @brief adds range [offset, end)
+     *
+     * @param offset
+     * @param end
+     */
+    void add(uint64_t offset, uint64_t end) {
+        if (offset >= end) {
+            return;
+        }
+        auto it = m_ranges.upper_bound(offset);
+        if (it != m_ranges.begin() && std::prev(it)->second >= offset) {
+            it--;
+            offset = it->first;
+            end = std::max(end, it->second);
+            it = m_ranges.erase(it);
+        }
+        while (it != m_ranges.end() && it->first <= end) {
+            end = std::max(end, it->second);
+            it = m_ranges.erase(it);
+        }
+        m_ranges[offset] = end;
+    }
+
+    /**
+     * @brief
+     *
+     * @param size
+     * @return true if set contains whole [0, size)
+     */
+    bool covers(uint64_t size) const {
+        return size == 0 || (m_ranges.size() == 1 && m_ranges.begin()->first == 0 && m_ranges.begin()->second >= size);
+    }
+
+    /**
+     * @brief ranges of [0, size) which are not in set
+     *
+     * @param size
+     * @return std::vector<Range>
+     */
+    std::vector<Range> missing(uint64_t size) const {
+        std::vector<Range> result;
+        uint64_t position = 0;
+        for (const auto& [offset, end]: m_ranges) {
+            if (offset >= size) {
+                break;
+            }
+            if (offset > position) {
+                result.emplace_back(position, offset);
+            }
+            position = std::max(position, end);
+        }
+        if (position < size) {
+            result.emplace_back(position, size);
+        }
+        return result;
+    }
+
+    std::vector<Range> ranges() const {
+        return {m_ranges.begin(), m_ranges.end()};
+    }
+
+    /**
+     * @brief total number of bytes within set
+     *
+     * @return uint64_t
+     */
+    uint64_t bytes() const {
+        uint64_t result = 0;
+        for (const auto& [offset, end]: m_ranges) {
+            result += end - offset;
+        }
+        return result;
+    }
+
+private:
+    std::map<uint64_t, uint64_t> m_ranges;
+};
+
+/**
+ * @brief Durable record of byte ranges received by unfinished transfer, so transfer can be resumed after disconnect or restart.<br>
+ * Journal file starts with header (magic, file size, key) followed by appended (offset, end) records.
+ * Caller should append record only after data of range was synced to disk, so journal never claims data which could be lost.
+ * Header and every record are synced before create and record return, truncated trailing record (crash in the middle of append) is ignored on load.
+ */
+class TransferJournal {
+public:
+    /**
+     * @brief creates new empty journal, existing file is overwritten
+     *
+     * @param path journal file
+     * @param size size of transferred file
+     * @param key arbitrary string identifying transfer (e.g. destination path)
+     * @return TransferJournal
+     */
+    static TransferJournal create(fs::path path, uint64_t size, const std::string& key) {
+        const uint32_t key_size = key.size();
+        std::string header;
+        header.append(reinterpret_cast<const char*>(&MAGIC), sizeof(MAGIC));
+        header.append(reinterpret_cast<const char*>(&size), sizeof(size));
+        header.append(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
+        header.append(key);
+        const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw fs::filesystem_error {"Failed to create transfer journal", path, std::error_code{errno, std::generic_category()}};
+        }
+        const bool written = write(fd, header.data(), header.size()) == static_cast<ssize_t>(header.size()) && fsync(fd) == 0;
+        close(fd);
+        if (!written) {
+            throw fs::filesystem_error {"Failed to create transfer journal", path, std::make_error_code(std::errc::io_error)};
+        }
+        return TransferJournal {std::move(path), size, key};
+    }
+
+    /**
+     * @brief loads journal written by previous run
+     *
+     * @param path
+     * @return std::optional<TransferJournal> nullopt if journal is missing or corrupted
+     */
+    static std::optional<TransferJournal> load(fs::path path) {
+        std::ifstream stream {path, std::ios::binary};
+        uint32_t magic = 0;
+        uint64_t size = 0;
+        uint32_t key_size = 0;
+        stream.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        stream.read(reinterpret_cast<char*>(&size), sizeof(size));
+        stream.read(reinterpret_cast<char*>(&key_size), sizeof(key_size));
+        if (!stream || magic != MAGIC || key_size > MAX_KEY_SIZE) {
+            return std::nullopt;
+        }
+        std::string key(key_size, '\0');
+        if (!stream.read(key.data(), key.size())) {
+            return std::nullopt;
+        }
+        TransferJournal journal {std::move(path), size, std::move(key)};
+        uint64_t record[2];
+        while (stream.read(reinterpret_cast<char*>(record), sizeof(record))) {
+            if (record[0] >= record[1] || record[1] > size) {
+                return std::nullopt;
+            }
+            journal.m_received.add(record[0], record[1]);
+        }
+        return journal;
+    }
+
+    /**
+     * @brief appends range to journal, range is counted as received only once record is synced
+     *
+     * @param offset
+     * @param end
+     */
+    void record(uint64_t offset, uint64_t end) {
+        const uint64_t record[2] = {offset, end};
+        const int fd = open(m_path.c_str(), O_WRONLY | O_APPEND);
+        if (fd < 0) {
+            throw fs::filesystem_error {"Failed to open transfer journal", m_path, std::error_code{errno, std::generic_category()}};
+        }
+        const bool written = write(fd, record, sizeof(record)) == sizeof(record) && fdatasync(fd) == 0;
+        close(fd);
+        if (!written) {
+            throw fs::filesystem_error {"Failed to append to transfer journal", m_path, std::make_error_code(std::errc::io_error)};
+        }
+        m_received.add(offset, end);
+    }
+
+    /**
+     * @brief removes journal file
+     *
+     */
+    void remove() const {
+        std::error_code ec;
+        fs::remove(m_path, ec);
+    }
+
+    const RangeSet& received() const {
+        return m_received;
+    }
+
+    bool complete() const {
+        return m_received.covers(m_size);
+    }
+
+    uint64_t size() const {
+        return m_size;
+    }
+
+    const std::string& key() const {
+        return m_key;
+    }
+
+    const fs::path& path() const {
+        return m_path;
+    }
+
+private:
+    TransferJournal(fs::path path, uint64_t size, std::string key) :
+        m_path {std::move(path)}, m_size {size}, m_key {std::move(key)} {
+
+    }
+
+    static constexpr uint32_t MAGIC = 0x4a535552; // "RUSJ"
+    static constexpr uint32_t MAX_KEY_SIZE = 1 << 16;
+
+    fs::path m_path;
+    uint64_t m_size;
+    std::string m_key;
+    RangeSet m_received;
+};
+}
@@ -2,9 +2,11 @@
 #include <functional>
 #include <memory>
 #include <string.h>
-#include <sstream>
-#include <iomanip>
 #include <filesystem>
+#include <map>
+#include <string_view>
+#include <unistd.h>
+#include "Query.hpp"
 
 namespace rusync {
 
@@ -30,6 +32,19 @@ void on_full_data(std::function<void(std::vector<char>)> cb, const ReqT &req) {
     });
 }
 
+/**
+ * @brief wraps file descriptor into shared_ptr which closes it once last owner is gone. Convinient for passing fd between async callbacks
+ * 
+ * @param fd 
+ * @return std::shared_ptr<int> 
+ */
+inline std::shared_ptr<int> share_fd(int fd) {
+    return std::shared_ptr<int>(new int{fd}, [](int* fd) {
+        close(*fd);
+        delete fd;
+    });
+}
+
 /**
  * @brief erases origin from path
  * 
@@ -46,35 +61,5 @@ inline fs::path truncate_path(fs::path path, fs::path origin) {
         truncated_path /= *path_it;
     }
     return truncated_path;
-} 
-
-
-/**
- * @brief percent-encode provided url
- * 
- * @param value 
- * @return std::string encoded 
- */
-inline std::string url_encode(const std::string& value) {
-    std::ostringstream escaped;
-    escaped.fill('0');
-    escaped << std::hex;
-
-    for (std::string::const_iterator i = value.begin(), n = value.end(); i != n; ++i) {
-        std::string::value_type c = (*i);
-
-        // Keep alphanumeric and other accepted characters intact
-        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
-            escaped << c;
-            continue;
-        }
-
-        // Any other characters are percent-encoded
-        escaped << std::uppercase;
-        escaped << '%' << std::setw(2) << int((unsigned char) c);
-        escaped << std::nouppercase;
-    }
-
-    return escaped.str();
 }
-}
\ No newline at end of file
+}
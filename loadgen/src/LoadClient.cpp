@@ -0,0 +1,185 @@
+#include "LoadClient.hpp"
+#include <iostream>
+#include <syncstream>
+
+namespace rusync {
+
+namespace {
+
+std::string random_body(std::mt19937_64& random, size_t size) {
+    std::string result(size, '\0');
+    for (auto& c: result) {
+        c = static_cast<char>('a' + random() % 26);
+    }
+    return result;
+}
+
+}
+
+LoadClient::LoadClient(const LoadConfig& conf, LoadConfig::Workload workload, size_t index, boost::asio::io_service& io_service, LoadStats& stats) :
+    m_conf {conf},
+    m_workload {workload},
+    m_key {conf.key_prefix + "_" + std::to_string(index)},
+    m_io_service {io_service},
+    m_stats {stats},
+    m_timer {io_service},
+    m_random {index} {
+
+}
+
+void LoadClient::start() {
+    m_session = std::make_unique<nghttp2::asio_http2::client::session>(m_io_service, m_conf.server_host, m_conf.server_port);
+    m_session->on_connect([this](boost::asio::ip::tcp::resolver::iterator /*endpoint_it*/) {
+        next_step();
+    });
+    m_session->on_error([this](const boost::system::error_code& ec) {
+        std::osyncstream(std::cerr) << "Client " << m_key << " connection error: " << ec.message() << std::endl;
+        m_stats.connection_errors++;
+        m_stopped = true;
+        m_closed = true;
+    });
+}
+
+void LoadClient::stop() {
+    m_stopped = true;
+    m_timer.cancel();
+    close_if_idle();
+}
+
+void LoadClient::request(RequestType type, const std::string& method, const std::string& path, const QueryBuilder& query, std::string body, DoneCb cb) {
+    const std::string uri = make_uri(m_conf.server_host, m_conf.server_port, path, m_key, query);
+    const size_t body_size = body.size();
+    const auto started = std::chrono::steady_clock::now();
+    auto finished = std::make_shared<bool>(false);
+    auto finish = [this, type, started, finished, cb](bool ok) {
+        if (*finished) {
+            return;
+        }
+        *finished = true;
+        m_in_flight--;
+        auto& stats = m_stats[type];
+        stats.latency.record(std::chrono::steady_clock::now() - started);
+        stats.requests++;
+        if (!ok) {
+            stats.errors++;
+        }
+        cb(ok);
+        close_if_idle();
+    };
+    // the same header as rusync client sends, so server takes the same path for bodies
+    nghttp2::asio_http2::header_map headers;
+    if (body_size > 0) {
+        headers.emplace("content-length", nghttp2::asio_http2::header_value{std::to_string(body_size), false});
+    }
+    boost::system::error_code ec;
+    const auto* req = m_session->submit(ec, method, uri, std::move(body), std::move(headers));
+    if (!req) {
+        m_stats[type].errors++;
+        m_stopped = true;
+        close_if_idle();
+        return;
+    }
+    m_in_flight++;
+    m_stats.bytes_sent += body_size;
+    req->on_response([this, finish](const nghttp2::asio_http2::client::response& resp) {
+        const bool ok = resp.status_code() == 200;
+        resp.on_data([this, finish, ok](const uint8_t* /*data*/, size_t len) {
+            if (len == 0) {
+                finish(ok);
+                return;
+            }
+            m_stats.bytes_received += len;
+        });
+    });
+    req->on_close([finish](uint32_t /*error_code*/) {
+        // no-op if response was already completed
+        finish(false);
+    });
+}
+
+void LoadClient::next_step() {
+    if (m_stopped) {
+        return;
+    }
+    m_iteration++;
+    if (m_workload == LoadConfig::SMALL_FILES) {
+        small_files_step();
+    } else if (m_workload == LoadConfig::LARGE_EDITS) {
+        large_edit_step();
+    } else {
+        polling_step();
+    }
+}
+
+void LoadClient::small_files_step() {
+    const std::string path = "small/" + std::to_string(m_random() % m_conf.files_per_client);
+    // every second step reads back file written by previous one
+    if (m_iteration % 2 == 0 && m_iteration > 1) {
+        request(RequestType::DOWNLOAD, "GET", "/files", {{"path", path}}, "", [this](bool) {
+            next_step();
+        });
+        return;
+    }
+    request(RequestType::UPLOAD, "POST", "/files", {{"path", path}, {"type", "file"}}, random_body(m_random, m_conf.small_file_size), [this](bool) {
+        next_step();
+    });
+}
+
+void LoadClient::large_edit_step() {
+    const std::string path = "large.bin";
+    if (!m_prepared) {
+        request(RequestType::UPLOAD, "POST", "/files", {{"path", path}, {"type", "file"}}, random_body(m_random, m_conf.large_file_size), [this](bool ok) {
+            m_prepared = ok;
+            next_step();
+        });
+        return;
+    }
+    // same sequence as client's upload_patch: meta, patch within session, empty patch with end flag at the end of file
+    request(RequestType::META, "GET", "/meta", {{"path", path}}, "", [this, path](bool ok) {
+        if (!ok || m_stopped) {
+            next_step();
+            return;
+        }
+        const std::string session = std::to_string(m_random());
+        const uint64_t offset = m_random() % (m_conf.large_file_size - m_conf.edit_size + 1);
+        request(RequestType::PATCH, "PATCH", "/files", {{"path", path}, {"offset", std::to_string(offset)}, {"session", session}},
+                random_body(m_random, m_conf.edit_size), [this, path, session](bool ok) {
+            // session is committed even after stop, so server is not left with open session
+            request(RequestType::COMMIT, "PATCH", "/files", 
+                    {{"path", path}, {"offset", std::to_string(m_conf.large_file_size)}, {"session", session}, {"end", "1"}}, "", [this](bool) {
+                next_step();
+            });
+        });
+    });
+}
+
+void LoadClient::polling_step() {
+    auto remaining = std::make_shared<size_t>(m_conf.poll_burst);
+    for (size_t i = 0; i < m_conf.poll_burst; i++) {
+        request(RequestType::DESCRIPTION, "GET", "/files_description", {}, "", [this, remaining](bool) {
+            if (--*remaining == 0) {
+                schedule(m_conf.poll_interval, [this]() {
+                    next_step();
+                });
+            }
+        });
+    }
+}
+
+void LoadClient::schedule(std::chrono::milliseconds delay, std::function<void()> cb) {
+    m_timer.expires_after(delay);
+    m_timer.async_wait([this, cb](const boost::system::error_code& ec) {
+        if (ec == boost::asio::error::operation_aborted || m_stopped) {
+            return;
+        }
+        cb();
+    });
+}
+
+void LoadClient::close_if_idle() {
+    if (m_stopped && m_in_flight == 0 && !m_closed && m_session) {
+        m_closed = true;
+        m_session->shutdown();
+    }
+}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <boost/asio.hpp>
+#include <nghttp2/asio_http2_client.h>
+#include "LoadConfig.hpp"
+#include "LoadStats.hpp"
+#include "Utils.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Single simulated client with own key and own HTTP/2 connection.<br>
+ * Client runs its workload in closed loop: next step is started once previous one is answered.
+ * All methods should be called from thread of io_service client was created with
+ * 
+ */
+class LoadClient {
+public:
+    LoadClient(const LoadConfig& conf, LoadConfig::Workload workload, size_t index, boost::asio::io_service& io_service, LoadStats& stats);
+
+    /**
+     * @brief connects to server and starts workload once connected
+     * 
+     */
+    void start();
+
+    /**
+     * @brief stops issuing new requests, connection is closed once requests in flight are answered
+     * 
+     */
+    void stop();
+
+private:
+    /**
+     * @brief called once request is finished, ok is false on error status or broken stream
+     * 
+     */
+    using DoneCb = std::function<void(bool ok)>;
+
+    void request(RequestType type, const std::string& method, const std::string& path, const QueryBuilder& query, std::string body, DoneCb cb);
+    void next_step();
+    void small_files_step();
+    void large_edit_step();
+    void polling_step();
+    /**
+     * @brief runs cb after delay unless client is stopped
+     * 
+     */
+    void schedule(std::chrono::milliseconds delay, std::function<void()> cb);
+    void close_if_idle();
+
+    const LoadConfig& m_conf;
+    const LoadConfig::Workload m_workload;
+    const std::string m_key;
+    boost::asio::io_service& m_io_service;
+    LoadStats& m_stats;
+    std::unique_ptr<nghttp2::asio_http2::client::session> m_session;
+    boost::asio::steady_timer m_timer;
+    std::mt19937_64 m_random;
+    size_t m_iteration = 0;
+    size_t m_in_flight = 0;
+    bool m_prepared = false;
+    bool m_stopped = false;
+    bool m_closed = false;
+};
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+
+namespace rusync {
+
+/**
+ * @brief Parameters of load generation run
+ * 
+ */
+struct LoadConfig {
+    /**
+     * @brief SMALL_FILES - upload and download of small files, LARGE_EDITS - meta request, patch and commit of large file,
+     * DESCRIPTION_POLLING - bursts of files description requests, MIXED - clients are evenly split between other workloads
+     * 
+     */
+    enum Workload {SMALL_FILES, LARGE_EDITS, DESCRIPTION_POLLING, MIXED};
+
+    std::string server_host;
+    std::string server_port;
+    Workload workload = MIXED;
+    size_t clients = 100;
+    /**
+     * @brief number of event loops clients are spread over
+     * 
+     */
+    size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::chrono::seconds duration {30};
+    size_t small_file_size = 4096;
+    size_t files_per_client = 100;
+    size_t large_file_size = 8'000'000;
+    size_t edit_size = 64'000;
+    size_t poll_burst = 10;
+    std::chrono::milliseconds poll_interval {1000};
+    /**
+     * @brief pid of local rusync_server, its RSS is sampled during run if set
+     * 
+     */
+    pid_t server_pid = 0;
+    /**
+     * @brief client keys are <key_prefix>_<index>
+     * 
+     */
+    std::string key_prefix = "loadgen";
+
+    static Workload workload_from_str(const std::string& name) {
+        if (name == "small") {
+            return SMALL_FILES;
+        } else if (name == "large") {
+            return LARGE_EDITS;
+        } else if (name == "poll") {
+            return DESCRIPTION_POLLING;
+        } else if (name == "mixed") {
+            return MIXED;
+        }
+        throw std::invalid_argument {"Unknown workload: " + name};
+    }
+
+    /**
+     * @brief converts input args to LoadConfig: <server_ip> <port> followed by --option value pairs
+     * 
+     * @param argc 
+     * @param argv 
+     * @return LoadConfig 
+     */
+    static LoadConfig from_args(int argc, char** argv) {
+        if (argc < 3 || argc % 2 == 0) {
+            throw std::invalid_argument {"Invalid number of arguments"};
+        }
+        LoadConfig conf;
+        conf.server_host = argv[1];
+        conf.server_port = argv[2];
+        for (int i = 3; i < argc; i += 2) {
+            const std::string name = argv[i];
+            const std::string value = argv[i + 1];
+            if (name == "--workload") {
+                conf.workload = workload_from_str(value);
+            } else if (name == "--clients") {
+                conf.clients = std::stoull(value);
+            } else if (name == "--threads") {
+                conf.threads = std::max<size_t>(std::stoull(value), 1);
+            } else if (name == "--duration") {
+                conf.duration = std::chrono::seconds(std::stoull(value));
+            } else if (name == "--small-file-size") {
+                conf.small_file_size = std::stoull(value);
+            } else if (name == "--files-per-client") {
+                conf.files_per_client = std::max<size_t>(std::stoull(value), 1);
+            } else if (name == "--large-file-size") {
+                conf.large_file_size = std::stoull(value);
+            } else if (name == "--edit-size") {
+                conf.edit_size = std::stoull(value);
+            } else if (name == "--poll-burst") {
+                conf.poll_burst = std::max<size_t>(std::stoull(value), 1);
+            } else if (name == "--poll-interval-ms") {
+                conf.poll_interval = std::chrono::milliseconds(std::stoull(value));
+            } else if (name == "--server-pid") {
+                conf.server_pid = std::stoi(value);
+            } else if (name == "--key-prefix") {
+                conf.key_prefix = value;
+            } else {
+                throw std::invalid_argument {"Unknown option: " + name};
+            }
+        }
+        if (conf.edit_size > conf.large_file_size) {
+            throw std::invalid_argument {"Edit size should not exceed large file size"};
+        }
+        return conf;
+    }
+
+    static constexpr const char* USAGE = 
+        "Usage: rusync_loadgen <server_ip> <port> [--workload small|large|poll|mixed] [--clients N] [--threads N] [--duration seconds]\n"
+        "       [--small-file-size bytes] [--files-per-client N] [--large-file-size bytes] [--edit-size bytes]\n"
+        "       [--poll-burst N] [--poll-interval-ms ms] [--server-pid pid] [--key-prefix prefix]";
+};
+}
@@ -0,0 +1,146 @@
+#include "LoadGenerator.hpp"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <syncstream>
+
+namespace rusync {
+
+namespace {
+
+double to_ms(std::chrono::microseconds value) {
+    return value.count() / 1000.0;
+}
+
+}
+
+LoadGenerator::LoadGenerator(const LoadConfig& conf) : m_conf {conf} {
+    for (size_t i = 0; i < std::min(m_conf.threads, std::max<size_t>(m_conf.clients, 1)); i++) {
+        m_loops.push_back(std::make_unique<Loop>());
+    }
+    for (size_t i = 0; i < m_conf.clients; i++) {
+        auto& loop = *m_loops[i % m_loops.size()];
+        const auto workload = m_conf.workload == LoadConfig::MIXED ? static_cast<LoadConfig::Workload>(i % LoadConfig::MIXED) : m_conf.workload;
+        loop.clients.push_back(std::make_unique<LoadClient>(m_conf, workload, i, loop.io_service, loop.stats));
+    }
+}
+
+LoadGenerator::~LoadGenerator() {
+    for (auto& loop: m_loops) {
+        loop->io_service.stop();
+        if (loop->thread.joinable()) {
+            loop->thread.join();
+        }
+    }
+}
+
+int LoadGenerator::run() {
+    m_rss_start = m_rss_peak = server_rss();
+    const auto started = std::chrono::steady_clock::now();
+    for (auto& loop: m_loops) {
+        for (auto& client: loop->clients) {
+            boost::asio::post(loop->io_service, [&client = *client]() {
+                client.start();
+            });
+        }
+        loop->thread = std::thread([&io_service = loop->io_service]() {
+            io_service.run();
+        });
+    }
+    Totals previous;
+    while (std::chrono::steady_clock::now() - started < m_conf.duration) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        const auto current = totals();
+        const auto rss = server_rss();
+        m_rss_peak = std::max(m_rss_peak, rss);
+        std::osyncstream(std::cout) << std::fixed << std::setprecision(1) 
+            << "[" << std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - started).count() << "s] "
+            << current.requests - previous.requests << " req/s, "
+            << (current.bytes_sent + current.bytes_received - previous.bytes_sent - previous.bytes_received) / 1e6 << " MB/s, "
+            << current.errors << " errors total"
+            << (m_conf.server_pid ? ", server RSS " + std::to_string(rss / 1'000'000) + " MB" : "") << std::endl;
+        previous = current;
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - started;
+    for (auto& loop: m_loops) {
+        boost::asio::post(loop->io_service, [&loop = *loop]() {
+            for (auto& client: loop.clients) {
+                client->stop();
+            }
+        });
+    }
+    // loops finish once all connections are closed, loops which are still busy after drain timeout are stopped forcibly
+    const auto drain_deadline = std::chrono::steady_clock::now() + DRAIN_TIMEOUT;
+    for (auto& loop: m_loops) {
+        while (!loop->io_service.stopped() && std::chrono::steady_clock::now() < drain_deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        loop->io_service.stop();
+        loop->thread.join();
+    }
+    m_rss_end = server_rss();
+    m_rss_peak = std::max(m_rss_peak, m_rss_end);
+    report(elapsed);
+    return totals().errors == 0 ? 0 : 1;
+}
+
+LoadGenerator::Totals LoadGenerator::totals() const {
+    Totals result;
+    for (const auto& loop: m_loops) {
+        for (const auto& per_type: loop->stats.per_type) {
+            result.requests += per_type.requests;
+            result.errors += per_type.errors;
+        }
+        result.errors += loop->stats.connection_errors;
+        result.bytes_sent += loop->stats.bytes_sent;
+        result.bytes_received += loop->stats.bytes_received;
+    }
+    return result;
+}
+
+void LoadGenerator::report(std::chrono::duration<double> elapsed) const {
+    const double seconds = elapsed.count();
+    const auto total = totals();
+    std::osyncstream out {std::cout};
+    out << std::fixed << std::setprecision(2) << "\n"
+        << "clients: " << m_conf.clients << ", threads: " << m_loops.size() << ", duration: " << seconds << "s\n"
+        << "requests: " << total.requests << ", errors: " << total.errors << ", " << total.requests / seconds << " req/s\n"
+        << "sent: " << total.bytes_sent / 1e6 / seconds << " MB/s, received: " << total.bytes_received / 1e6 / seconds << " MB/s\n\n"
+        << std::left << std::setw(12) << "type" << std::right << std::setw(10) << "requests" << std::setw(8) << "errors" << std::setw(10) << "req/s"
+        << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms" << std::setw(10) << "p99 ms" << std::setw(10) << "p99.9 ms" << std::setw(10) << "max ms" << "\n";
+    for (size_t i = 0; i < static_cast<size_t>(RequestType::COUNT); i++) {
+        LatencyHistogram latency;
+        uint64_t errors = 0;
+        for (const auto& loop: m_loops) {
+            latency.merge(loop->stats.per_type[i].latency);
+            errors += loop->stats.per_type[i].errors;
+        }
+        if (latency.count() == 0 && errors == 0) {
+            continue;
+        }
+        out << std::left << std::setw(12) << request_type_str(static_cast<RequestType>(i)) << std::right 
+            << std::setw(10) << latency.count() << std::setw(8) << errors << std::setw(10) << latency.count() / seconds
+            << std::setw(10) << to_ms(latency.percentile(0.5)) << std::setw(10) << to_ms(latency.percentile(0.9))
+            << std::setw(10) << to_ms(latency.percentile(0.99)) << std::setw(10) << to_ms(latency.percentile(0.999))
+            << std::setw(10) << to_ms(latency.max()) << "\n";
+    }
+    if (m_conf.server_pid) {
+        out << "\nserver RSS: start " << m_rss_start / 1e6 << " MB, peak " << m_rss_peak / 1e6 << " MB, end " << m_rss_end / 1e6 << " MB\n";
+    }
+    out << std::flush;
+}
+
+uint64_t LoadGenerator::server_rss() const {
+    if (!m_conf.server_pid) {
+        return 0;
+    }
+    std::ifstream status {"/proc/" + std::to_string(m_conf.server_pid) + "/status"};
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.starts_with("VmRSS:")) {
+            return std::stoull(line.substr(6)) * 1024;
+        }
+    }
+    return 0;
+}
+}
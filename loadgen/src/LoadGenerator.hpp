@@ -0,0 +1,69 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include "LoadClient.hpp"
+#include "LoadConfig.hpp"
+#include "LoadStats.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Runs LoadConfig::clients simulated clients spread over LoadConfig::threads event loops for configured duration,
+ * prints progress every second and final report: requests/sec, MB/s, latency percentiles per request type and server RSS
+ * 
+ */
+class LoadGenerator {
+public:
+    LoadGenerator(const LoadConfig& conf);
+    ~LoadGenerator();
+
+    /**
+     * @brief blocks until run is finished
+     * 
+     * @return int 0 if all requests succeeded
+     */
+    int run();
+
+private:
+    /**
+     * @brief event loop with clients assigned to it
+     * 
+     */
+    struct Loop {
+        boost::asio::io_service io_service;
+        LoadStats stats;
+        std::vector<std::unique_ptr<LoadClient>> clients;
+        std::thread thread;
+    };
+
+    struct Totals {
+        uint64_t requests = 0;
+        uint64_t errors = 0;
+        uint64_t bytes_sent = 0;
+        uint64_t bytes_received = 0;
+    };
+
+    Totals totals() const;
+    void report(std::chrono::duration<double> elapsed) const;
+
+    /**
+     * @brief
+     * 
+     * @return uint64_t resident set size of server in bytes, 0 if server pid is not set or can't be read
+     */
+    uint64_t server_rss() const;
+
+    LoadConfig m_conf;
+    std::vector<std::unique_ptr<Loop>> m_loops;
+    uint64_t m_rss_start = 0;
+    uint64_t m_rss_peak = 0;
+    uint64_t m_rss_end = 0;
+    /**
+     * @brief time given to requests in flight after duration has elapsed
+     * 
+     */
+    static constexpr std::chrono::seconds DRAIN_TIMEOUT {10};
+};
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "LatencyHistogram.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Request kinds reported separately
+ * 
+ */
+enum class RequestType {UPLOAD, DOWNLOAD, META, PATCH, COMMIT, DESCRIPTION, COUNT};
+
+inline const char* request_type_str(RequestType type) {
+    static constexpr std::array<const char*, static_cast<size_t>(RequestType::COUNT)> NAMES {
+        "upload", "download", "meta", "patch", "commit", "description"
+    };
+    return NAMES[static_cast<size_t>(type)];
+}
+
+/**
+ * @brief Statistics of clients of single event loop.<br>
+ * Histograms are written only by owning loop and read after it's stopped, counters are atomic so progress can be read during run
+ * 
+ */
+struct LoadStats {
+    struct PerType {
+        LatencyHistogram latency;
+        std::atomic<uint64_t> requests = 0;
+        std::atomic<uint64_t> errors = 0;
+    };
+
+    PerType& operator[](RequestType type) {
+        return per_type[static_cast<size_t>(type)];
+    }
+
+    std::array<PerType, static_cast<size_t>(RequestType::COUNT)> per_type;
+    std::atomic<uint64_t> bytes_sent = 0;
+    std::atomic<uint64_t> bytes_received = 0;
+    std::atomic<uint64_t> connection_errors = 0;
+};
+}
@@ -0,0 +1,24 @@
+#include <iostream>
+#include <syncstream>
+#include "LoadConfig.hpp"
+#include "LoadGenerator.hpp"
+
+namespace rusync {
+
+int start(int argc, char** argv) {
+    LoadConfig conf;
+    try {
+        conf = LoadConfig::from_args(argc, argv);
+    } catch (const std::exception& err) {
+        std::cerr << err.what() << "\n" << LoadConfig::USAGE << std::endl;
+        return -1;
+    }
+    LoadGenerator generator {conf};
+    return generator.run();
+}
+
+}
+
+int main(int argc, char** argv) {
+    return rusync::start(argc, argv);
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace rusync {
+
+/**
+ * @brief Pool of byte buffers owned by thread which created it, so request bodies and replies reuse memory instead of
+ * going to allocator for each request.<br>
+ * Buffer is returned to pool of thread which acquired it once last owner is gone, whatever thread that is (e.g. body of reply
+ * is built on io executor and released on network thread after it was sent). Buffer is cleared but keeps its capacity,
+ * buffers larger than MAX_CAPACITY and buffers beyond MAX_POOLED are freed instead
+ */
+class BufferPool {
+public:
+    using Buffer = std::shared_ptr<std::vector<char>>;
+
+    static constexpr size_t MAX_POOLED = 64;
+    static constexpr size_t MAX_CAPACITY = 4 << 20;
+
+    /**
+     * @brief pool of calling thread, created on first use
+     *
+     * @return BufferPool&
+     */
+    static BufferPool& local() {
+        thread_local BufferPool pool;
+        return pool;
+    }
+
+    BufferPool() : m_state {std::make_shared<State>()} {
+
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * @brief
+     *
+     * @param capacity reserved bytes, pooled buffer is reused as is if it has enough
+     * @return Buffer empty buffer
+     */
+    Buffer acquire(size_t capacity = 0) {
+        std::unique_ptr<std::vector<char>> buffer;
+        {
+            std::lock_guard lock {m_state->mutex};
+            if (!m_state->free.empty()) {
+                buffer = std::move(m_state->free.back());
+                m_state->free.pop_back();
+            }
+        }
+        if (!buffer) {
+            buffer = std::make_unique<std::vector<char>>();
+        }
+        buffer->reserve(capacity);
+        return Buffer(buffer.release(), [state = m_state](std::vector<char>* buffer) {
+            state->release(std::unique_ptr<std::vector<char>>(buffer));
+        });
+    }
+
+    /**
+     * @brief
+     *
+     * @param data
+     * @return Buffer buffer with copy of data
+     */
+    Buffer copy(std::string_view data) {
+        auto buffer = acquire(data.size());
+        buffer->assign(data.begin(), data.end());
+        return buffer;
+    }
+
+    /**
+     * @brief
+     *
+     * @return size_t number of buffers waiting for reuse
+     */
+    size_t pooled() const {
+        std::lock_guard lock {m_state->mutex};
+        return m_state->free.size();
+    }
+
+private:
+    /**
+     * @brief shared with released buffers, so buffer which outlives its thread is simply freed with the last of them
+     *
+     */
+    struct State {
+        void release(std::unique_ptr<std::vector<char>> buffer) {
+            if (buffer->capacity() > MAX_CAPACITY) {
+                return;
+            }
+            buffer->clear();
+            std::lock_guard lock {mutex};
+            if (free.size() < MAX_POOLED) {
+                free.push_back(std::move(buffer));
+            }
+        }
+
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<std::vector<char>>> free;
+    };
+
+    std::shared_ptr<State> m_state;
+};
+
+/**
+ * @brief Accumulates body of http request into pooled buffer and passes it to provided cb. Buffer is reserved from content-length
+ * header if request has it, so body is copied once. Header is sent by client, so reservation is at most BufferPool::MAX_CAPACITY
+ * and longer bodies grow as their data arrives
+ *
+ * @tparam ReqT
+ * @param req
+ * @param cb
+ */
+template <typename ReqT>
+void read_body(const ReqT& req, std::function<void(BufferPool::Buffer)> cb) {
+    size_t content_length = 0;
+    const auto header = req.header().find("content-length");
+    if (header != req.header().end()) {
+        const auto& value = header->second.value;
+        std::from_chars(value.data(), value.data() + value.size(), content_length);
+    }
+    auto buffer = BufferPool::local().acquire(std::min(content_length, BufferPool::MAX_CAPACITY));
+    req.on_data([buffer = std::move(buffer), cb = std::move(cb)](const uint8_t* data, size_t len) mutable {
+        if (len == 0) {
+            cb(std::move(buffer));
+            return;
+        }
+        buffer->insert(buffer->end(), data, data + len);
+    });
+}
+}
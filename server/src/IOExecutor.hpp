@@ -0,0 +1,133 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Logger.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Thread pool for blocking filesystem work, so nghttp2 network threads are never blocked by disk I/O.<br>
+ * Work is split into two lanes: FAST for cheap operations (mkdir, small writes) and BULK for operations proportional to file/tree size (hashing, tree walking, full file reads).
+ * FAST lane is always served first and BULK tasks never occupy all threads, so small requests keep low latency while large hashes are running.
+ */
+class IOExecutor {
+public:
+    enum Lane {FAST, BULK};
+
+    struct Stats {
+        size_t queued_fast;
+        size_t queued_bulk;
+        size_t running;
+        uint64_t completed;
+        /**
+         * @brief maximum observed number of queued tasks (both lanes)
+         *
+         */
+        size_t max_queue_depth;
+    };
+
+    /**
+     * @brief Construct a new IOExecutor object
+     *
+     * @param threads number of threads, at least 2. One thread is always reserved for FAST lane
+     */
+    IOExecutor(size_t threads) : m_max_bulk {std::max<size_t>(threads, 2) - 1} {
+        for (size_t i = 0; i < m_max_bulk + 1; i++) {
+            m_threads.emplace_back([this]() { run(); });
+        }
+    }
+
+    ~IOExecutor() {
+        stop();
+    }
+
+    /**
+     * @brief waits for running tasks and stops all threads. Tasks which are still queued are dropped
+     *
+     */
+    void stop() {
+        {
+            std::lock_guard lock {m_mutex};
+            m_stopped = true;
+        }
+        m_cv.notify_all();
+        for (auto& thread: m_threads) {
+            if (thread.joinable()) {
+                thread.join();
+            }
+        }
+    }
+
+    /**
+     * @brief queue task for execution
+     *
+     * @param lane
+     * @param task
+     */
+    void post(Lane lane, std::function<void()> task) {
+        {
+            std::lock_guard lock {m_mutex};
+            (lane == FAST ? m_fast : m_bulk).push_back(std::move(task));
+            m_max_queue_depth = std::max(m_max_queue_depth, m_fast.size() + m_bulk.size());
+        }
+        m_cv.notify_one();
+    }
+
+    Stats stats() const {
+        std::lock_guard lock {m_mutex};
+        return {m_fast.size(), m_bulk.size(), m_running, m_completed, m_max_queue_depth};
+    }
+
+private:
+    void run() {
+        std::unique_lock lock {m_mutex};
+        while (true) {
+            m_cv.wait(lock, [this]() {
+                return m_stopped || !m_fast.empty() || (!m_bulk.empty() && m_running_bulk < m_max_bulk);
+            });
+            if (m_stopped) {
+                return;
+            }
+            const bool bulk = m_fast.empty();
+            auto& queue = bulk ? m_bulk : m_fast;
+            auto task = std::move(queue.front());
+            queue.pop_front();
+            m_running++;
+            if (bulk) {
+                m_running_bulk++;
+            }
+            lock.unlock();
+            try {
+                task();
+            } catch (const std::exception& err) {
+                RUSYNC_LOG(ERROR) << "Exception occured in io task: " << err.what();
+            }
+            lock.lock();
+            m_running--;
+            m_completed++;
+            if (bulk) {
+                m_running_bulk--;
+                m_cv.notify_one();
+            }
+        }
+    }
+
+    const size_t m_max_bulk;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::function<void()>> m_fast;
+    std::deque<std::function<void()>> m_bulk;
+    size_t m_running = 0;
+    size_t m_running_bulk = 0;
+    uint64_t m_completed = 0;
+    size_t m_max_queue_depth = 0;
+    bool m_stopped = false;
+    std::vector<std::thread> m_threads;
+};
+}
@@ -0,0 +1,517 @@
+#include "PatchSessions.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <cctype>
+#include <system_error>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+namespace rusync {
+
+namespace {
+
+[[noreturn]] void throw_errno(const std::string& what, const fs::path& path) {
+    throw fs::filesystem_error {what, path, std::error_code{errno, std::generic_category()}};
+}
+
+void write_all(int fd, uint64_t offset, const char* data, size_t size, const fs::path& path) {
+    while (size > 0) {
+        const auto written = pwrite(fd, data, size, offset);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("pwrite failed", path);
+        }
+        data += written;
+        offset += written;
+        size -= written;
+    }
+}
+
+bool read_all(int fd, uint64_t offset, char* data, size_t size, const fs::path& path) {
+    while (size > 0) {
+        const auto result = pread(fd, data, size, offset);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("pread failed", path);
+        }
+        if (result == 0) {
+            return false;
+        }
+        data += result;
+        offset += result;
+        size -= result;
+    }
+    return true;
+}
+
+/**
+ * @brief clones src into dst by reflink
+ *
+ * @return false if filesystem doesn't support it
+ */
+bool clone_file(int src, int dst) {
+#ifdef FICLONE
+    return ioctl(dst, FICLONE, src) == 0;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief copies src into dst without passing data through user space
+ *
+ */
+void copy_file(int src, int dst, const fs::path& path) {
+    while (true) {
+        const auto copied = copy_file_range(src, nullptr, dst, nullptr, 1 << 30, 0);
+        if (copied < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("copy_file_range failed", path);
+        }
+        if (copied == 0) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief undo log starts with header and path of file, followed by records of offset and length, each one followed by saved bytes
+ *
+ */
+struct UndoHeader {
+    uint64_t size;
+    uint64_t inode;
+    uint64_t path_length;
+};
+
+constexpr size_t UNDO_BUFFER_SIZE = 1 << 20;
+
+}
+
+PatchSessions::PatchSessions(fs::path staging_dir, uint64_t copy_limit) : m_staging_dir {std::move(staging_dir)}, m_copy_limit {copy_limit} {
+    fs::create_directories(m_staging_dir);
+    for (const auto& entry: fs::directory_iterator(m_staging_dir)) {
+        if (entry.path().extension() == UNDO_EXTENSION) {
+            try {
+                recover(entry.path());
+            } catch (const std::exception& err) {
+                // log is kept, so next start tries again
+                RUSYNC_LOG(ERROR) << "Failed to roll back interrupted patch session by " << entry.path() << ": " << err.what();
+                continue;
+            }
+        }
+        fs::remove_all(entry.path());
+    }
+}
+
+PatchSessions::~PatchSessions() {
+    for (const auto& [path, sessions]: m_sessions) {
+        for (const auto& [id, session]: sessions) {
+            close_session(session);
+        }
+    }
+}
+
+void PatchSessions::apply(const fs::path& path, const std::string& session, uint64_t offset, const char* data, size_t size, bool end) {
+    if (session.empty() || !std::all_of(session.begin(), session.end(), [](unsigned char c) { return std::isalnum(c); })) {
+        throw std::invalid_argument {"Invalid patch session id: " + session};
+    }
+    Session current;
+    bool found = false;
+    {
+        std::lock_guard lock {m_mutex};
+        expire_locked(path);
+        auto path_it = m_sessions.find(path);
+        if (path_it != m_sessions.end() && path_it->second.contains(session)) {
+            auto& existing = path_it->second.at(session);
+            existing.last_used = std::chrono::steady_clock::now();
+            current = existing;
+            found = true;
+        }
+    }
+    if (!found) {
+        {
+            // file of in-place session is half-patched, so it's rolled back before new session copies or logs it
+            std::lock_guard lock {m_mutex};
+            abort_in_place_locked(path, session);
+        }
+        // copying is done without lock, calls for the same path are serialized by caller
+        current = begin(path, session);
+        std::lock_guard lock {m_mutex};
+        m_sessions[path][session] = current;
+    }
+    const bool in_place = !current.undo.empty();
+    try {
+        if (in_place) {
+            save_undo(current, path, offset, size);
+        }
+        write_all(current.fd, offset, data, size, path);
+        if (!end) {
+            return;
+        }
+        if (in_place && offset + size < current.original_size) {
+            save_undo(current, path, offset + size, current.original_size - offset - size);
+        }
+        if (ftruncate(current.fd, offset + size) != 0) {
+            throw_errno("ftruncate failed", path);
+        }
+        if (fsync(current.fd) != 0) {
+            throw_errno("fsync failed", path);
+        }
+        if (!in_place) {
+            fs::rename(current.shadow, path);
+        }
+    } catch (...) {
+        std::lock_guard lock {m_mutex};
+        close_session(current);
+        m_sessions[path].erase(session);
+        if (m_sessions[path].empty()) {
+            m_sessions.erase(path);
+        }
+        throw;
+    }
+    if (in_place) {
+        // file is durable, so log is not needed anymore
+        close(current.undo_fd);
+        std::error_code ec;
+        fs::remove(current.undo, ec);
+    }
+    std::lock_guard lock {m_mutex};
+    close(current.fd);
+    m_sessions[path].erase(session);
+    // undo log of in-place session holds bytes from before this commit, rolling it back later would overwrite committed content
+    abort_in_place_locked(path, session);
+}
+
+void PatchSessions::apply_in_place(const fs::path& path, uint64_t offset, const char* data, size_t size, bool end) {
+    const int fd = open(path.c_str(), O_WRONLY);
+    if (fd < 0) {
+        throw_errno("open failed", path);
+    }
+    try {
+        write_all(fd, offset, data, size, path);
+        if (end && ftruncate(fd, offset + size) != 0) {
+            throw_errno("ftruncate failed", path);
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+std::string PatchSessions::version(const fs::path& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return "";
+    }
+    const uint64_t mtime = static_cast<uint64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+    return std::to_string(st.st_ino) + "-" + std::to_string(st.st_size) + "-" + std::to_string(mtime);
+}
+
+void PatchSessions::abort(const fs::path& path) {
+    std::lock_guard lock {m_mutex};
+    auto it = m_sessions.find(path);
+    if (it == m_sessions.end()) {
+        return;
+    }
+    for (const auto& [id, session]: it->second) {
+        close_session(session);
+    }
+    m_sessions.erase(it);
+}
+
+void PatchSessions::abort(const fs::path& path, const std::string& session) {
+    std::lock_guard lock {m_mutex};
+    auto it = m_sessions.find(path);
+    if (it == m_sessions.end()) {
+        return;
+    }
+    if (auto found = it->second.find(session); found != it->second.end()) {
+        close_session(found->second);
+        it->second.erase(found);
+    }
+    if (it->second.empty()) {
+        m_sessions.erase(it);
+    }
+}
+
+std::string PatchSessions::base_version(const fs::path& path, const std::string& session) const {
+    {
+        std::lock_guard lock {m_mutex};
+        auto it = m_sessions.find(path);
+        if (it != m_sessions.end()) {
+            if (auto found = it->second.find(session); found != it->second.end()) {
+                return found->second.base_version;
+            }
+        }
+    }
+    return version(path);
+}
+
+bool PatchSessions::active(const fs::path& path, const std::string& session) const {
+    std::lock_guard lock {m_mutex};
+    auto it = m_sessions.find(path);
+    return it != m_sessions.end() && it->second.contains(session);
+}
+
+PatchSessions::Session PatchSessions::begin(const fs::path& path, const std::string& session) {
+    const std::string base_version = version(path);
+    const std::string name = std::to_string(m_shadow_counter++) + "_" + session;
+    const fs::path shadow = m_staging_dir / name;
+    const int src = open(path.c_str(), O_RDONLY);
+    if (src < 0) {
+        throw_errno("open failed", path);
+    }
+    struct stat st;
+    if (fstat(src, &st) != 0) {
+        close(src);
+        throw_errno("fstat failed", path);
+    }
+    const int dst = open(shadow.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (dst < 0) {
+        close(src);
+        throw_errno("open failed", shadow);
+    }
+    const bool cloned = clone_file(src, dst);
+    if (cloned || static_cast<uint64_t>(st.st_size) < m_copy_limit) {
+        try {
+            if (!cloned) {
+                copy_file(src, dst, path);
+            }
+        } catch (...) {
+            close(src);
+            close(dst);
+            fs::remove(shadow);
+            throw;
+        }
+        close(src);
+        fs::permissions(shadow, fs::status(path).permissions());
+        RUSYNC_LOG(DEBUG) << "Started patch session " << session << " for " << path;
+        return {.shadow = shadow, .fd = dst, .last_used = std::chrono::steady_clock::now(), .base_version = base_version, .undo = {}, .undo_fd = -1, .original_size = 0};
+    }
+    close(src);
+    close(dst);
+    fs::remove(shadow);
+    const int fd = open(path.c_str(), O_RDWR);
+    if (fd < 0) {
+        throw_errno("open failed", path);
+    }
+    const fs::path undo = m_staging_dir / (name + UNDO_EXTENSION);
+    const int undo_fd = open(undo.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (undo_fd < 0) {
+        close(fd);
+        throw_errno("open failed", undo);
+    }
+    const std::string path_str = path.string();
+    const UndoHeader header {static_cast<uint64_t>(st.st_size), static_cast<uint64_t>(st.st_ino), path_str.size()};
+    try {
+        write_all(undo_fd, 0, reinterpret_cast<const char*>(&header), sizeof(header), undo);
+        write_all(undo_fd, sizeof(header), path_str.data(), path_str.size(), undo);
+    } catch (...) {
+        close(fd);
+        close(undo_fd);
+        fs::remove(undo);
+        throw;
+    }
+    RUSYNC_LOG(DEBUG) << "Started in-place patch session " << session << " for " << path << " of " << st.st_size << " bytes";
+    return {"", fd, std::chrono::steady_clock::now(), base_version, undo, undo_fd, header.size};
+}
+
+void PatchSessions::save_undo(const Session& session, const fs::path& path, uint64_t offset, size_t size) {
+    struct stat st;
+    if (fstat(session.fd, &st) != 0) {
+        throw_errno("fstat failed", path);
+    }
+    // bytes beyond original size are cut by roll back anyway
+    const uint64_t end = std::min<uint64_t>({offset + size, static_cast<uint64_t>(st.st_size), session.original_size});
+    if (end <= offset) {
+        return;
+    }
+    struct stat undo_st;
+    if (fstat(session.undo_fd, &undo_st) != 0) {
+        throw_errno("fstat failed", session.undo);
+    }
+    uint64_t position = undo_st.st_size;
+    const uint64_t record[2] {offset, end - offset};
+    write_all(session.undo_fd, position, reinterpret_cast<const char*>(record), sizeof(record), session.undo);
+    position += sizeof(record);
+    std::vector<char> buffer(std::min<uint64_t>(end - offset, UNDO_BUFFER_SIZE));
+    for (uint64_t copied = offset; copied < end;) {
+        const size_t length = std::min<uint64_t>(buffer.size(), end - copied);
+        if (!read_all(session.fd, copied, buffer.data(), length, path)) {
+            throw_errno("unexpected end of file", path);
+        }
+        write_all(session.undo_fd, position, buffer.data(), length, session.undo);
+        position += length;
+        copied += length;
+    }
+    if (fdatasync(session.undo_fd) != 0) {
+        throw_errno("fdatasync failed", session.undo);
+    }
+}
+
+void PatchSessions::roll_back(int undo_fd, int fd, const fs::path& path) {
+    UndoHeader header;
+    if (!read_all(undo_fd, 0, reinterpret_cast<char*>(&header), sizeof(header), path)) {
+        // file is only written after header is durable
+        return;
+    }
+    struct stat undo_st;
+    if (fstat(undo_fd, &undo_st) != 0) {
+        throw_errno("fstat failed", path);
+    }
+    struct Record {
+        uint64_t position;
+        uint64_t offset;
+        uint64_t length;
+    };
+    std::vector<Record> records;
+    uint64_t position = sizeof(header) + header.path_length;
+    uint64_t record[2];
+    while (read_all(undo_fd, position, reinterpret_cast<char*>(record), sizeof(record), path)) {
+        position += sizeof(record);
+        if (position + record[1] > static_cast<uint64_t>(undo_st.st_size)) {
+            // record which is not complete was not durable, so its patch was not written
+            break;
+        }
+        records.push_back({position, record[0], record[1]});
+        position += record[1];
+    }
+    std::vector<char> buffer(UNDO_BUFFER_SIZE);
+    for (auto it = records.rbegin(); it != records.rend(); it++) {
+        for (uint64_t done = 0; done < it->length;) {
+            const size_t length = std::min<uint64_t>(buffer.size(), it->length - done);
+            if (!read_all(undo_fd, it->position + done, buffer.data(), length, path)) {
+                throw_errno("unexpected end of undo log", path);
+            }
+            write_all(fd, it->offset + done, buffer.data(), length, path);
+            done += length;
+        }
+    }
+    if (ftruncate(fd, header.size) != 0) {
+        throw_errno("ftruncate failed", path);
+    }
+    if (fsync(fd) != 0) {
+        throw_errno("fsync failed", path);
+    }
+}
+
+void PatchSessions::recover(const fs::path& undo) {
+    const int undo_fd = open(undo.c_str(), O_RDONLY);
+    if (undo_fd < 0) {
+        throw_errno("open failed", undo);
+    }
+    UndoHeader header;
+    std::string path;
+    if (read_all(undo_fd, 0, reinterpret_cast<char*>(&header), sizeof(header), undo)) {
+        path.resize(header.path_length);
+        if (!read_all(undo_fd, sizeof(header), path.data(), path.size(), undo)) {
+            path.clear();
+        }
+    }
+    const int fd = path.empty() ? -1 : open(path.c_str(), O_RDWR);
+    struct stat st;
+    // file which was removed or replaced meanwhile is left as is
+    if (fd >= 0 && fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_ino) == header.inode) {
+        try {
+            roll_back(undo_fd, fd, path);
+        } catch (...) {
+            close(fd);
+            close(undo_fd);
+            throw;
+        }
+        RUSYNC_LOG(INFO) << "Rolled back interrupted patch session of " << path;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    close(undo_fd);
+}
+
+std::vector<fs::path> PatchSessions::expired() const {
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<fs::path> result;
+    std::lock_guard lock {m_mutex};
+    for (const auto& [path, sessions]: m_sessions) {
+        if (std::any_of(sessions.begin(), sessions.end(), [&](const auto& session) { return now - session.second.last_used > SESSION_TIMEOUT; })) {
+            result.push_back(path);
+        }
+    }
+    return result;
+}
+
+void PatchSessions::expire(const fs::path& path) {
+    std::lock_guard lock {m_mutex};
+    expire_locked(path);
+}
+
+void PatchSessions::expire_locked(const fs::path& path) {
+    auto path_it = m_sessions.find(path);
+    if (path_it == m_sessions.end()) {
+        return;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    auto& sessions = path_it->second;
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        if (now - it->second.last_used > SESSION_TIMEOUT) {
+            RUSYNC_LOG(INFO) << "Patch session " << it->first << " for " << path << " expired";
+            close_session(it->second);
+            it = sessions.erase(it);
+        } else {
+            it++;
+        }
+    }
+    if (sessions.empty()) {
+        m_sessions.erase(path_it);
+    }
+}
+
+void PatchSessions::abort_in_place_locked(const fs::path& path, const std::string& except) {
+    auto path_it = m_sessions.find(path);
+    if (path_it == m_sessions.end()) {
+        return;
+    }
+    auto& sessions = path_it->second;
+    for (auto it = sessions.begin(); it != sessions.end();) {
+        if (it->first != except && !it->second.undo.empty()) {
+            RUSYNC_LOG(INFO) << "Patch session " << it->first << " for " << path << " is aborted by session " << except;
+            close_session(it->second);
+            it = sessions.erase(it);
+        } else {
+            it++;
+        }
+    }
+    if (sessions.empty()) {
+        m_sessions.erase(path_it);
+    }
+}
+
+void PatchSessions::close_session(const Session& session) {
+    std::error_code ec;
+    if (session.undo.empty()) {
+        close(session.fd);
+        fs::remove(session.shadow, ec);
+        return;
+    }
+    try {
+        roll_back(session.undo_fd, session.fd, session.undo);
+        fs::remove(session.undo, ec);
+    } catch (const std::exception& err) {
+        // log is kept, so file is rolled back on next start
+        RUSYNC_LOG(ERROR) << "Failed to roll back patch session by " << session.undo << ": " << err.what();
+    }
+    close(session.undo_fd);
+    close(session.fd);
+}
+}
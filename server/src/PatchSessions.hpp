@@ -0,0 +1,200 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace rusync {
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Transactional application of file patches.<br>
+ * All patches of one session are applied to shadow copy of file within staging dir (reflink clone where filesystem supports it, kernel-side copy otherwise).
+ * Patch with end flag truncates shadow with ftruncate, fsyncs it once and atomically renames it over original file, so readers never observe half-patched file.<br>
+ * Copy costs I/O of whole file, so files of copy_limit and more which can't be cloned are patched in place instead: bytes overwritten by each patch
+ * are saved to undo log first, abort (or restart after crash) writes them back. Such file is visible half-patched while session is open,
+ * so in-place session is rolled back once another session of its path begins, and dropped once another one is committed.<br>
+ * Caller is responsible for serializing calls for the same path (see PathSerializer).
+ */
+class PatchSessions {
+public:
+    /**
+     * @brief files of this size and more are patched in place if they can't be cloned
+     *
+     */
+    static constexpr uint64_t COPY_LIMIT = 64 << 20;
+
+    /**
+     * @brief Construct a new Patch Sessions object. Files of in-place sessions interrupted by previous run are rolled back by their undo logs,
+     * other leftovers within staging_dir are removed
+     *
+     * @param staging_dir dir for shadow files and undo logs, should be on the same filesystem as patched files
+     * @param copy_limit
+     */
+    PatchSessions(fs::path staging_dir, uint64_t copy_limit = COPY_LIMIT);
+    ~PatchSessions();
+
+    /**
+     * @brief applies patch within session. Shadow copy is created on first patch of session and swapped in on patch with end == true
+     *
+     * @param path path to patched file
+     * @param session session id, only alphanumeric characters are allowed
+     * @param offset
+     * @param data
+     * @param size
+     * @param end if true - file is truncated right after this patch and session is committed
+     */
+    void apply(const fs::path& path, const std::string& session, uint64_t offset, const char* data, size_t size, bool end);
+
+    /**
+     * @brief applies patch directly to file. Used by clients which don't send session id
+     *
+     * @param path
+     * @param offset
+     * @param data
+     * @param size
+     * @param end if true - file is truncated right after this patch
+     */
+    static void apply_in_place(const fs::path& path, uint64_t offset, const char* data, size_t size, bool end);
+
+    /**
+     * @brief opaque version of file which changes whenever file is written or replaced (inode, size and modification time)
+     *
+     * @param path
+     * @return std::string empty if file doesn't exist
+     */
+    static std::string version(const fs::path& path);
+
+    /**
+     * @brief version which patches of session are based on. File patched in place changes with every patch, so its version is taken when session starts
+     *
+     * @param path
+     * @param session
+     * @return std::string version of file when session started, current version if session is not active
+     */
+    std::string base_version(const fs::path& path, const std::string& session) const;
+
+    /**
+     * @brief drops all open sessions of path (e.g. file was overwritten or removed)
+     *
+     * @param path
+     */
+    void abort(const fs::path& path);
+
+    /**
+     * @brief drops one session of path (e.g. its patches were based on another version), other sessions are kept
+     *
+     * @param path
+     * @param session
+     */
+    void abort(const fs::path& path, const std::string& session);
+
+    /**
+     * @brief
+     *
+     * @param path
+     * @param session
+     * @return true if session was started and not committed yet
+     */
+    bool active(const fs::path& path, const std::string& session) const;
+
+    /**
+     * @brief paths which have sessions not used for SESSION_TIMEOUT (e.g. client disconnected in the middle of patching).
+     * Checked periodically, so in-place sessions of gone clients are rolled back without waiting for next patch
+     *
+     * @return std::vector<fs::path>
+     */
+    std::vector<fs::path> expired() const;
+
+    /**
+     * @brief drops sessions of path which were not used for SESSION_TIMEOUT. Rolling back in-place session writes file,
+     * so it's serialized with other calls for path like apply
+     *
+     * @param path
+     */
+    void expire(const fs::path& path);
+
+private:
+    struct Session {
+        /**
+         * @brief shadow copy, empty for in-place session
+         *
+         */
+        fs::path shadow;
+        /**
+         * @brief shadow copy or, for in-place session, the file itself
+         *
+         */
+        int fd;
+        std::chrono::steady_clock::time_point last_used;
+        std::string base_version;
+        /**
+         * @brief undo log of in-place session, empty otherwise
+         *
+         */
+        fs::path undo;
+        int undo_fd = -1;
+        uint64_t original_size = 0;
+    };
+
+    /**
+     * @brief creates shadow copy of path, or undo log if path is patched in place
+     *
+     * @param path
+     * @param session
+     * @return Session
+     */
+    Session begin(const fs::path& path, const std::string& session);
+
+    /**
+     * @brief saves bytes of file which are going to be overwritten to undo log, they are durable once it returns
+     *
+     * @param session in-place session
+     * @param path
+     * @param offset
+     * @param size
+     */
+    static void save_undo(const Session& session, const fs::path& path, uint64_t offset, size_t size);
+
+    /**
+     * @brief writes bytes saved in undo log back in reverse order, restores original size of file and syncs it
+     *
+     * @param undo_fd
+     * @param fd patched file
+     * @param path for errors
+     */
+    static void roll_back(int undo_fd, int fd, const fs::path& path);
+
+    /**
+     * @brief rolls back file of undo log left by previous run, if it's still the same file
+     *
+     * @param undo
+     */
+    static void recover(const fs::path& undo);
+
+    void expire_locked(const fs::path& path);
+
+    /**
+     * @brief rolls back and drops in-place sessions of path other than except
+     *
+     * @param path
+     * @param except
+     */
+    void abort_in_place_locked(const fs::path& path, const std::string& except);
+
+    static void close_session(const Session& session);
+
+    fs::path m_staging_dir;
+    const uint64_t m_copy_limit;
+    mutable std::mutex m_mutex;
+    std::map<fs::path, std::map<std::string, Session>> m_sessions;
+    std::atomic<uint64_t> m_shadow_counter = 0;
+    const std::chrono::minutes SESSION_TIMEOUT {10};
+    static constexpr const char* UNDO_EXTENSION = ".undo";
+};
+}
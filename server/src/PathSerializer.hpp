@@ -0,0 +1,382 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Logger.hpp"
+#include "IOExecutor.hpp"
+
+namespace rusync {
+
+/**
+ * @brief Sharded table of per-path serial queues on top of IOExecutor.<br>
+ * Tasks posted for the same path are executed one by one in order of posting, tasks for different paths run in parallel.
+ * Table is split into SHARDS independent parts (each with own mutex) by hash of path, so posting for different files doesn't contend on single lock.
+ * Waiting tasks don't occupy executor threads: only the head of each queue is posted to executor.<br>
+ * Shared tasks (e.g. reads and writes of separate ranges) which are adjacent in queue of path run in parallel with each other, but never with other tasks of path.<br>
+ * Tree task (e.g. removal of dir) is ordered with tasks of its path and of all paths under it: it waits for tasks posted before it and
+ * tasks posted after it wait for it. It joins queue of each such path, so it takes all shard locks, but only once it's posted and once it's done
+ */
+class PathSerializer {
+public:
+    static constexpr size_t SHARDS = 64;
+
+    PathSerializer(IOExecutor& executor) : m_executor {executor} {
+
+    }
+
+    /**
+     * @brief queue task for path
+     *
+     * @param path normalized path
+     * @param lane executor lane for this task
+     * @param task
+     */
+    void post(const std::string& path, IOExecutor::Lane lane, std::function<void()> task) {
+        enqueue(path, {lane, std::move(task), nullptr, false});
+    }
+
+    /**
+     * @brief queue task for path, which may run together with adjacent shared tasks of path
+     *
+     * @param path normalized path
+     * @param lane executor lane for this task
+     * @param task
+     */
+    void post_shared(const std::string& path, IOExecutor::Lane lane, std::function<void()> task) {
+        enqueue(path, {lane, std::move(task), nullptr, true});
+    }
+
+    /**
+     * @brief queue task for path and everything under it
+     *
+     * @param path normalized path
+     * @param lane executor lane for this task
+     * @param task
+     */
+    void post_tree(const std::string& path, IOExecutor::Lane lane, std::function<void()> task) {
+        auto tree = std::make_shared<Tree>(path, lane, std::move(task));
+        size_t waiting = 0;
+        {
+            const auto locks = lock_all();
+            for (auto& shard: m_shards) {
+                for (auto& [queued_path, queue]: shard.queues) {
+                    if (covers(path, queued_path)) {
+                        // queue which exists is busy, so tree is not at its head yet
+                        tree->participants.push_back(queued_path);
+                        queue.tasks.push_back({lane, nullptr, tree, false});
+                        waiting++;
+                    }
+                }
+            }
+            if (auto [it, inserted] = shard_for(path).queues.try_emplace(path); inserted) {
+                auto& queue = it->second;
+                join_trees(path, queue);
+                if (!queue.tasks.empty()) {
+                    waiting++;
+                }
+                tree->participants.push_back(path);
+                queue.tasks.push_back({lane, nullptr, tree, false});
+            }
+            tree->waiting = waiting;
+            m_trees.push_back(tree);
+        }
+        if (waiting == 0) {
+            schedule_tree(tree);
+        }
+    }
+
+    /**
+     * @brief number of paths which have queued or running tasks
+     *
+     * @return size_t
+     */
+    size_t active() const {
+        size_t result = 0;
+        for (const auto& shard: m_shards) {
+            std::lock_guard lock {shard.mutex};
+            result += shard.queues.size();
+        }
+        return result;
+    }
+
+private:
+    /**
+     * @brief tree task, it stays at the head of queues of all participant paths till it's done
+     *
+     */
+    struct Tree {
+        Tree(std::string path, IOExecutor::Lane lane, std::function<void()> fn) : path {std::move(path)}, lane {lane}, fn {std::move(fn)} {
+
+        }
+
+        /**
+         * @brief adds path which got its first task after tree was posted
+         *
+         * @param path
+         */
+        void join(const std::string& path) {
+            std::lock_guard lock {mutex};
+            participants.push_back(path);
+        }
+
+        const std::string path;
+        const IOExecutor::Lane lane;
+        std::function<void()> fn;
+        std::mutex mutex;
+        std::vector<std::string> participants;
+        /**
+         * @brief number of participant queues where tree is not at the head yet
+         *
+         */
+        std::atomic<size_t> waiting = 0;
+    };
+
+    struct Task {
+        IOExecutor::Lane lane;
+        std::function<void()> fn;
+        /**
+         * @brief set for entry of tree task, fn is empty then
+         *
+         */
+        std::shared_ptr<Tree> tree;
+        bool shared;
+    };
+
+    /**
+     * @brief Queue of the path. Head of tasks stays in queue while it's running, shared tasks leave it once they are started.
+     * Non-empty queue means path is busy
+     *
+     */
+    struct Queue {
+        bool empty() const {
+            return tasks.empty() && shared_running == 0;
+        }
+
+        std::deque<Task> tasks;
+        size_t shared_running = 0;
+    };
+
+    using Queues = std::unordered_map<std::string, Queue>;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        Queues queues;
+    };
+
+    /**
+     * @brief work of path which can be started after its queue changed
+     *
+     */
+    struct Runnable {
+        std::vector<Task> shared;
+        /**
+         * @brief lane of head of queue which should be started
+         *
+         */
+        std::optional<IOExecutor::Lane> head;
+        /**
+         * @brief tree task which reached heads of all its queues
+         *
+         */
+        std::shared_ptr<Tree> tree;
+    };
+
+    static bool covers(const std::string& tree, const std::string& path) {
+        return path.starts_with(tree) && (path.size() == tree.size() || path[tree.size()] == '/');
+    }
+
+    Shard& shard_for(const std::string& path) {
+        return m_shards[std::hash<std::string>{}(path) % SHARDS];
+    }
+
+    /**
+     * @brief locks shards in fixed order, so it never deadlocks with other thread doing the same
+     *
+     */
+    std::vector<std::unique_lock<std::mutex>> lock_all() {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        locks.reserve(SHARDS);
+        for (auto& shard: m_shards) {
+            locks.emplace_back(shard.mutex);
+        }
+        return locks;
+    }
+
+    /**
+     * @brief puts entries of unfinished tree tasks which cover path into its new queue, in order of posting. Only the first of them is at the head.
+     * Should be called under lock of shard of path
+     *
+     * @param path
+     * @param queue empty queue of path
+     */
+    void join_trees(const std::string& path, Queue& queue) {
+        for (const auto& tree: m_trees) {
+            if (covers(tree->path, path)) {
+                tree->join(path);
+                if (!queue.tasks.empty()) {
+                    tree->waiting++;
+                }
+                queue.tasks.push_back({tree->lane, nullptr, tree, false});
+            }
+        }
+    }
+
+    void enqueue(const std::string& path, Task task) {
+        auto& shard = shard_for(path);
+        Runnable runnable;
+        {
+            std::lock_guard lock {shard.mutex};
+            auto it = shard.queues.try_emplace(path).first;
+            auto& queue = it->second;
+            if (queue.empty()) {
+                // path which had no tasks when tree task was posted still has to wait for it
+                join_trees(path, queue);
+            }
+            queue.tasks.push_back(std::move(task));
+            if (queue.tasks.size() == 1) {
+                runnable = advance(shard.queues, it);
+            }
+        }
+        start(path, std::move(runnable));
+    }
+
+    /**
+     * @brief starts tasks at the head of queue which became runnable: adjacent shared tasks, or head once no shared task is running.
+     * Should be called under lock of shard of queue, once its head is new
+     *
+     * @param queues
+     * @param it
+     * @return Runnable
+     */
+    static Runnable advance(Queues& queues, Queues::iterator it) {
+        auto& queue = it->second;
+        Runnable runnable;
+        while (!queue.tasks.empty() && queue.tasks.front().shared) {
+            runnable.shared.push_back(std::move(queue.tasks.front()));
+            queue.tasks.pop_front();
+            queue.shared_running++;
+        }
+        if (queue.empty()) {
+            queues.erase(it);
+            return runnable;
+        }
+        if (queue.tasks.empty() || queue.shared_running > 0) {
+            return runnable;
+        }
+        const auto& head = queue.tasks.front();
+        if (!head.tree) {
+            runnable.head = head.lane;
+        } else if (--head.tree->waiting == 0) {
+            runnable.tree = head.tree;
+        }
+        return runnable;
+    }
+
+    void start(const std::string& path, Runnable runnable) {
+        for (auto& task: runnable.shared) {
+            m_executor.post(task.lane, [this, path, fn = std::move(task.fn)]() {
+                run_shared(path, fn);
+            });
+        }
+        if (runnable.head) {
+            m_executor.post(*runnable.head, [this, path]() {
+                run(path);
+            });
+        }
+        if (runnable.tree) {
+            schedule_tree(std::move(runnable.tree));
+        }
+    }
+
+    void schedule_tree(std::shared_ptr<Tree> tree) {
+        const auto lane = tree->lane;
+        m_executor.post(lane, [this, tree = std::move(tree)]() {
+            run_tree(tree);
+        });
+    }
+
+    static void execute(const std::string& path, const std::function<void()>& fn) {
+        try {
+            fn();
+        } catch (const std::exception& err) {
+            RUSYNC_LOG(ERROR) << "Exception occured in task for " << path << ": " << err.what();
+        }
+    }
+
+    void run(const std::string& path) {
+        auto& shard = shard_for(path);
+        std::function<void()> fn;
+        {
+            std::lock_guard lock {shard.mutex};
+            fn = std::move(shard.queues.at(path).tasks.front().fn);
+        }
+        execute(path, fn);
+        Runnable runnable;
+        {
+            std::lock_guard lock {shard.mutex};
+            auto it = shard.queues.find(path);
+            it->second.tasks.pop_front();
+            runnable = advance(shard.queues, it);
+        }
+        start(path, std::move(runnable));
+    }
+
+    void run_shared(const std::string& path, const std::function<void()>& fn) {
+        execute(path, fn);
+        auto& shard = shard_for(path);
+        Runnable runnable;
+        {
+            std::lock_guard lock {shard.mutex};
+            auto it = shard.queues.find(path);
+            if (--it->second.shared_running == 0) {
+                runnable = advance(shard.queues, it);
+            }
+        }
+        start(path, std::move(runnable));
+    }
+
+    void run_tree(const std::shared_ptr<Tree>& tree) {
+        execute(tree->path, tree->fn);
+        std::vector<std::pair<std::string, Runnable>> next;
+        {
+            const auto locks = lock_all();
+            std::erase(m_trees, tree);
+            for (const auto& path: tree->participants) {
+                auto& queues = shard_for(path).queues;
+                auto it = queues.find(path);
+                auto& tasks = it->second.tasks;
+                const auto entry = std::find_if(tasks.begin(), tasks.end(), [&tree](const Task& task) {
+                    return task.tree == tree;
+                });
+                // tree runs only at the head of its queues, head is new only if it was there
+                const bool head = entry == tasks.begin();
+                tasks.erase(entry);
+                if (head) {
+                    next.emplace_back(path, advance(queues, it));
+                }
+            }
+        }
+        for (auto& [path, runnable]: next) {
+            start(path, std::move(runnable));
+        }
+    }
+
+    IOExecutor& m_executor;
+    std::array<Shard, SHARDS> m_shards;
+    /**
+     * @brief tree tasks which are not done yet, in order of posting. Changed under all shard locks, so it's read under any of them
+     *
+     */
+    std::vector<std::shared_ptr<Tree>> m_trees;
+};
+}
@@ -0,0 +1,190 @@
+#include "RangedUploads.hpp"
+#include "Logger.hpp"
+#include <algorithm>
+#include <cctype>
+#include <set>
+#include <system_error>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace rusync {
+
+namespace {
+
+[[noreturn]] void throw_errno(const std::string& what, const fs::path& path) {
+    throw fs::filesystem_error {what, path, std::error_code{errno, std::generic_category()}};
+}
+
+bool valid_transfer(const std::string& transfer) {
+    return !transfer.empty() && std::all_of(transfer.begin(), transfer.end(), [](unsigned char c) { return std::isalnum(c); });
+}
+
+}
+
+RangedUploads::Upload::Upload(fs::path staging, TransferJournal journal, int fd) :
+    staging {std::move(staging)}, journal {std::move(journal)}, fd {fd}, last_used {std::chrono::steady_clock::now()} {
+
+}
+
+RangedUploads::Upload::~Upload() {
+    close(fd);
+    if (discarded) {
+        std::error_code ec;
+        fs::remove(staging, ec);
+        journal.remove();
+    }
+}
+
+RangedUploads::RangedUploads(fs::path staging_dir) : m_staging_dir {std::move(staging_dir)} {
+    fs::create_directories(m_staging_dir);
+    std::set<fs::path> restored;
+    for (const auto& entry: fs::directory_iterator(m_staging_dir)) {
+        if (entry.path().extension() != JOURNAL_EXTENSION) {
+            continue;
+        }
+        if (auto key = restore(entry.path())) {
+            restored.insert(entry.path());
+            restored.insert(m_uploads.at(*key)->staging);
+        }
+    }
+    for (const auto& entry: fs::directory_iterator(m_staging_dir)) {
+        if (!restored.contains(entry.path())) {
+            fs::remove_all(entry.path());
+        }
+    }
+}
+
+bool RangedUploads::write(const fs::path& path, const std::string& transfer, uint64_t size, uint64_t offset, const char* data, size_t length) {
+    if (!valid_transfer(transfer)) {
+        throw std::invalid_argument {"Invalid transfer id: " + transfer};
+    }
+    if (offset + length > size) {
+        throw std::out_of_range {"Range is out of file size"};
+    }
+    std::shared_ptr<Upload> upload;
+    {
+        std::lock_guard lock {m_mutex};
+        expire_locked();
+        auto it = m_uploads.find({path, transfer});
+        if (it != m_uploads.end() && it->second->journal.size() != size) {
+            discard(it);
+            it = m_uploads.end();
+        }
+        if (it == m_uploads.end()) {
+            it = m_uploads.emplace(Key{path, transfer}, begin(path, transfer, size)).first;
+        }
+        upload = it->second;
+        upload->last_used = std::chrono::steady_clock::now();
+    }
+    // ranges don't overlap, so they are written without lock
+    for (size_t written = 0; written < length;) {
+        const auto result = pwrite(upload->fd, data + written, length - written, offset + written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw_errno("pwrite failed", upload->staging);
+        }
+        written += result;
+    }
+    // range is recorded in journal only once its data is durable
+    if (fdatasync(upload->fd) != 0) {
+        throw_errno("fdatasync failed", upload->staging);
+    }
+    {
+        std::lock_guard lock {m_mutex};
+        auto it = m_uploads.find({path, transfer});
+        // upload could be aborted while range was being written
+        if (it == m_uploads.end() || it->second != upload) {
+            return false;
+        }
+        upload->journal.record(offset, offset + length);
+        if (!upload->journal.complete()) {
+            return false;
+        }
+        m_uploads.erase(it);
+    }
+    fs::create_directories(path.parent_path());
+    fs::rename(upload->staging, path);
+    upload->journal.remove();
+    return true;
+}
+
+std::vector<RangeSet::Range> RangedUploads::received(const fs::path& path, const std::string& transfer, uint64_t size) {
+    std::lock_guard lock {m_mutex};
+    auto it = m_uploads.find({path, transfer});
+    if (it == m_uploads.end() || it->second->journal.size() != size) {
+        return {};
+    }
+    it->second->last_used = std::chrono::steady_clock::now();
+    return it->second->journal.received().ranges();
+}
+
+void RangedUploads::abort(const fs::path& path) {
+    std::lock_guard lock {m_mutex};
+    for (auto it = m_uploads.lower_bound({path, ""}); it != m_uploads.end() && it->first.first == path;) {
+        discard(it++);
+    }
+}
+
+std::shared_ptr<RangedUploads::Upload> RangedUploads::begin(const fs::path& path, const std::string& transfer, uint64_t size) {
+    const fs::path staging = staging_path(path, transfer);
+    const int fd = open(staging.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw_errno("open failed", staging);
+    }
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        throw_errno("ftruncate failed", staging);
+    }
+    auto upload = std::make_shared<Upload>(staging, TransferJournal::create(fs::path(staging) += JOURNAL_EXTENSION, size, path.string()), fd);
+    RUSYNC_LOG(INFO) << "Started ranged upload " << transfer << " of " << size << " bytes for " << path;
+    return upload;
+}
+
+std::optional<RangedUploads::Key> RangedUploads::restore(const fs::path& journal_path) {
+    auto journal = TransferJournal::load(journal_path);
+    const fs::path staging = fs::path(journal_path).replace_extension();
+    const std::string name = staging.filename().string();
+    const std::string transfer = name.substr(name.find('_') + 1);
+    std::error_code ec;
+    if (!journal || !valid_transfer(transfer) || staging != staging_path(journal->key(), transfer) || fs::file_size(staging, ec) != journal->size()) {
+        return std::nullopt;
+    }
+    const int fd = open(staging.c_str(), O_RDWR);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    Key key {journal->key(), transfer};
+    RUSYNC_LOG(INFO) << "Restored ranged upload " << transfer << " for " << key.first << ", received " 
+        << journal->received().bytes() << " of " << journal->size() << " bytes";
+    m_uploads[key] = std::make_shared<Upload>(staging, std::move(*journal), fd);
+    return key;
+}
+
+void RangedUploads::expire() {
+    std::lock_guard lock {m_mutex};
+    expire_locked();
+}
+
+void RangedUploads::expire_locked() {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = m_uploads.begin(); it != m_uploads.end();) {
+        if (now - it->second->last_used > UPLOAD_TIMEOUT) {
+            RUSYNC_LOG(INFO) << "Ranged upload " << it->first.second << " for " << it->first.first << " expired";
+            discard(it++);
+        } else {
+            it++;
+        }
+    }
+}
+
+void RangedUploads::discard(std::map<Key, std::shared_ptr<Upload>>::iterator it) {
+    it->second->discarded = true;
+    m_uploads.erase(it);
+}
+
+fs::path RangedUploads::staging_path(const fs::path& path, const std::string& transfer) const {
+    return m_staging_dir / (std::to_string(std::hash<std::string>{}(path.string())) + "_" + transfer);
+}
+}
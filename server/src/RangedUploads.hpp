@@ -0,0 +1,111 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include "TransferJournal.hpp"
+
+namespace rusync {
+
+namespace fs = std::filesystem;
+
+/**
+ * @brief Assembles files uploaded by concurrent byte ranges.<br>
+ * First range of transfer creates staging file of full size, every range is written to it with positional write, so ranges of the same file are written in parallel.
+ * Once ranges cover whole file - staging file is fsynced and atomically renamed over destination.
+ * Received ranges are recorded in TransferJournal next to staging file, so interrupted upload (client disconnect or server restart) can be resumed by the same transfer id.
+ */
+class RangedUploads {
+public:
+    /**
+     * @brief Construct a new Ranged Uploads object. Unfinished uploads of previous run within staging_dir are restored from their journals, other leftovers are removed
+     *
+     * @param staging_dir dir for files being assembled, should be on the same filesystem as destination files
+     */
+    RangedUploads(fs::path staging_dir);
+
+    /**
+     * @brief writes range of file
+     *
+     * @param path destination path
+     * @param transfer transfer id, same for all ranges of file. Only alphanumeric characters are allowed
+     * @param size size of whole file
+     * @param offset offset of range
+     * @param data
+     * @param length
+     * @return true if this range completed the file and it was moved to path
+     */
+    bool write(const fs::path& path, const std::string& transfer, uint64_t size, uint64_t offset, const char* data, size_t length);
+
+    /**
+     * @brief ranges already received for transfer
+     *
+     * @param path
+     * @param transfer
+     * @param size
+     * @return std::vector<RangeSet::Range> empty if transfer is unknown or was started with different size
+     */
+    std::vector<RangeSet::Range> received(const fs::path& path, const std::string& transfer, uint64_t size);
+
+    /**
+     * @brief drops all unfinished uploads of path (e.g. file was overwritten or removed)
+     *
+     * @param path
+     */
+    void abort(const fs::path& path);
+
+    /**
+     * @brief drops uploads which were not used for UPLOAD_TIMEOUT. Called periodically, so uploads abandoned by clients don't wait for next write
+     *
+     */
+    void expire();
+
+private:
+    /**
+     * @brief Unfinished upload. File is closed on destruction, staging file and journal are removed only if upload was discarded
+     *
+     */
+    struct Upload {
+        Upload(fs::path staging, TransferJournal journal, int fd);
+        ~Upload();
+        fs::path staging;
+        TransferJournal journal;
+        int fd;
+        std::chrono::steady_clock::time_point last_used;
+        bool discarded = false;
+    };
+
+    using Key = std::pair<fs::path, std::string>;
+
+    std::shared_ptr<Upload> begin(const fs::path& path, const std::string& transfer, uint64_t size);
+
+    /**
+     * @brief restores upload from journal of previous run
+     *
+     * @param journal_path
+     * @return std::optional<Key> key of restored upload, nullopt if journal or staging file are broken
+     */
+    std::optional<Key> restore(const fs::path& journal_path);
+
+    void expire_locked();
+
+    void discard(std::map<Key, std::shared_ptr<Upload>>::iterator it);
+
+    fs::path staging_path(const fs::path& path, const std::string& transfer) const;
+
+    fs::path m_staging_dir;
+    std::mutex m_mutex;
+    std::map<Key, std::shared_ptr<Upload>> m_uploads;
+    /**
+     * @brief unfinished upload is kept long enough for client to reconnect and resume it
+     *
+     */
+    const std::chrono::hours UPLOAD_TIMEOUT {24};
+    static constexpr const char* JOURNAL_EXTENSION = ".journal";
+};
+}
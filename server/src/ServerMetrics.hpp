@@ -0,0 +1,175 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "IOExecutor.hpp"
+#include "Metrics.hpp"
+
+namespace rusync {
+
+/**
+ * @brief All metrics of ServerSync, rendered by /metrics handler in Prometheus text format
+ * 
+ */
+class ServerMetrics {
+public:
+    enum Endpoint {FILES, DESCRIPTION, META, METRICS, ENDPOINTS};
+    enum Method {GET, POST, PATCH, DELETE, OTHER_METHOD, METHODS};
+    enum CodeClass {SUCCESS, CLIENT_ERROR, SERVER_ERROR, CODE_CLASSES};
+
+    static Endpoint endpoint_from(std::string_view path) {
+        if (path == "/files_description") {
+            return DESCRIPTION;
+        } else if (path == "/meta") {
+            return META;
+        } else if (path == "/metrics") {
+            return METRICS;
+        }
+        return FILES;
+    }
+
+    static Method method_from(std::string_view method) {
+        if (method == "GET") {
+            return GET;
+        } else if (method == "POST") {
+            return POST;
+        } else if (method == "PATCH") {
+            return PATCH;
+        } else if (method == "DELETE") {
+            return DELETE;
+        }
+        return OTHER_METHOD;
+    }
+
+    /**
+     * @brief records answered request
+     * 
+     * @param endpoint 
+     * @param method 
+     * @param status 
+     * @param duration time from request being ready for handling (body received) till response was submitted,
+     * nullopt for requests rejected right away, which are counted but kept out of duration histogram
+     * @param bytes_out size of response body
+     */
+    void record_request(Endpoint endpoint, Method method, unsigned status, std::optional<std::chrono::nanoseconds> duration, size_t bytes_out) {
+        const auto code = status >= 500 ? SERVER_ERROR : (status >= 400 ? CLIENT_ERROR : SUCCESS);
+        m_requests[index(endpoint, method) * CODE_CLASSES + code].add();
+        if (duration) {
+            m_durations[index(endpoint, method)].record(*duration);
+        }
+        m_bytes_out[endpoint].add(bytes_out);
+    }
+
+    void record_bytes_in(size_t bytes) {
+        m_bytes_in.add(bytes);
+    }
+
+    /**
+     * @brief records hashing of files (chunks for meta, whole files for description)
+     * 
+     * @param duration 
+     * @param bytes 
+     */
+    void record_hashing(std::chrono::nanoseconds duration, uint64_t bytes) {
+        m_hashing.record(duration);
+        m_hashed_bytes.add(bytes);
+    }
+
+    /**
+     * @brief records lookup of already received ranges of upload, hit means upload is resumed
+     * 
+     * @param hit 
+     */
+    void record_resume_lookup(bool hit) {
+        (hit ? m_resume_hits : m_resume_misses).add();
+    }
+
+    /**
+     * @brief requests which were accepted and not answered yet (queued or being handled)
+     * 
+     */
+    Gauge pending_requests;
+
+    /**
+     * @brief 
+     * 
+     * @param executor_stats 
+     * @param active_paths number of paths with queued or running work in PathSerializer
+     * @return std::string metrics in Prometheus text format
+     */
+    std::string render(const IOExecutor::Stats& executor_stats, size_t active_paths) const {
+        MetricsWriter writer;
+        writer.header("rusync_requests_total", "counter", "Number of answered requests");
+        for (size_t endpoint = 0; endpoint < ENDPOINTS; endpoint++) {
+            for (size_t method = 0; method < METHODS; method++) {
+                for (size_t code = 0; code < CODE_CLASSES; code++) {
+                    const auto value = m_requests[index(endpoint, method) * CODE_CLASSES + code].value();
+                    if (value != 0) {
+                        writer.sample("rusync_requests_total", labels(endpoint, method) + ",code=\"" + CODE_NAMES[code] + "\"", value);
+                    }
+                }
+            }
+        }
+        writer.header("rusync_request_duration_seconds", "histogram", "Time from request being ready for handling till response");
+        for (size_t endpoint = 0; endpoint < ENDPOINTS; endpoint++) {
+            for (size_t method = 0; method < METHODS; method++) {
+                const auto& histogram = m_durations[index(endpoint, method)];
+                if (histogram.snapshot().count() != 0) {
+                    writer.histogram("rusync_request_duration_seconds", labels(endpoint, method), histogram);
+                }
+            }
+        }
+        writer.header("rusync_received_bytes_total", "counter", "Bytes of request bodies");
+        writer.sample("rusync_received_bytes_total", "", m_bytes_in.value());
+        writer.header("rusync_sent_bytes_total", "counter", "Bytes of response bodies");
+        for (size_t endpoint = 0; endpoint < ENDPOINTS; endpoint++) {
+            writer.sample("rusync_sent_bytes_total", std::string("endpoint=\"") + ENDPOINT_NAMES[endpoint] + "\"", m_bytes_out[endpoint].value());
+        }
+        writer.header("rusync_hashing_duration_seconds", "histogram", "Time spent hashing files for meta and description requests");
+        writer.histogram("rusync_hashing_duration_seconds", "", m_hashing);
+        writer.header("rusync_hashed_bytes_total", "counter", "Bytes hashed for meta and description requests");
+        writer.sample("rusync_hashed_bytes_total", "", m_hashed_bytes.value());
+        writer.header("rusync_upload_resume_lookups_total", "counter", "Lookups of received ranges of uploads, hit means upload was resumed");
+        writer.sample("rusync_upload_resume_lookups_total", "result=\"hit\"", m_resume_hits.value());
+        writer.sample("rusync_upload_resume_lookups_total", "result=\"miss\"", m_resume_misses.value());
+        writer.header("rusync_pending_requests", "gauge", "Requests accepted and not answered yet");
+        writer.sample("rusync_pending_requests", "", pending_requests.value());
+        writer.header("rusync_io_queued_tasks", "gauge", "Tasks waiting in io executor");
+        writer.sample("rusync_io_queued_tasks", "lane=\"fast\"", executor_stats.queued_fast);
+        writer.sample("rusync_io_queued_tasks", "lane=\"bulk\"", executor_stats.queued_bulk);
+        writer.header("rusync_io_running_tasks", "gauge", "Tasks being executed by io executor");
+        writer.sample("rusync_io_running_tasks", "", executor_stats.running);
+        writer.header("rusync_io_completed_tasks_total", "counter", "Tasks completed by io executor");
+        writer.sample("rusync_io_completed_tasks_total", "", executor_stats.completed);
+        writer.header("rusync_io_max_queue_depth", "gauge", "Maximum observed number of queued io tasks");
+        writer.sample("rusync_io_max_queue_depth", "", executor_stats.max_queue_depth);
+        writer.header("rusync_active_paths", "gauge", "Paths with queued or running operations");
+        writer.sample("rusync_active_paths", "", active_paths);
+        return writer.str();
+    }
+
+private:
+    static size_t index(size_t endpoint, size_t method) {
+        return endpoint * METHODS + method;
+    }
+
+    static std::string labels(size_t endpoint, size_t method) {
+        return std::string("endpoint=\"") + ENDPOINT_NAMES[endpoint] + "\",method=\"" + METHOD_NAMES[method] + "\"";
+    }
+
+    static constexpr std::array<const char*, ENDPOINTS> ENDPOINT_NAMES {"/files", "/files_description", "/meta", "/metrics"};
+    static constexpr std::array<const char*, METHODS> METHOD_NAMES {"GET", "POST", "PATCH", "DELETE", "OTHER"};
+    static constexpr std::array<const char*, CODE_CLASSES> CODE_NAMES {"2xx", "4xx", "5xx"};
+
+    std::array<Counter, size_t{ENDPOINTS} * METHODS * CODE_CLASSES> m_requests;
+    std::array<Histogram, size_t{ENDPOINTS} * METHODS> m_durations;
+    std::array<Counter, ENDPOINTS> m_bytes_out;
+    Counter m_bytes_in;
+    Histogram m_hashing;
+    Counter m_hashed_bytes;
+    Counter m_resume_hits;
+    Counter m_resume_misses;
+};
+}
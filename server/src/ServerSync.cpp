@@ -1,15 +1,26 @@
+#include <algorithm>
 #include <filesystem>
-#include <boost/algorithm/string.hpp>
-#include <syncstream>
-#include <rapidjson/document.h>
-#include <rapidjson/writer.h>
-#include <rapidjson/stringbuffer.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include "BinaryWriter.hpp"
+#include "DescriptionJson.hpp"
+#include "EntryTable.hpp"
+#include "Logger.hpp"
 #include "ServerSync.hpp"
+#include "Tracing.hpp"
 
 namespace rusync {
-ServerSync::ServerSync(const Config& config) : m_conf {config} {
+ServerSync::ServerSync(const Config& config) : 
+    m_conf {config},
+    m_patch_sessions {m_conf.path / STAGING_DIR / "patches"},
+    m_ranged_uploads {m_conf.path / STAGING_DIR / "uploads"},
+    m_path_serializer {m_io_executor},
+    m_io_executor {std::thread::hardware_concurrency()} {
+    // trees of previous run which were removed but not deleted yet
+    fs::remove_all(m_conf.path / STAGING_DIR / TRASH_DIR);
     m_server.num_threads(std::thread::hardware_concurrency());
     m_server.handle(FILES_PATH, [this](const auto&... args) {
         handle_files_request(args...);
@@ -20,14 +31,145 @@ ServerSync::ServerSync(const Config& config) : m_conf {config} {
     m_server.handle(META_PATH, [this](const auto&... args) {
         handle_meta_request(args...);
     });
+    m_server.handle(METRICS_PATH, [this](const auto&... args) {
+        handle_metrics_request(args...);
+    });
 }
 
 void ServerSync::listen() {
     boost::system::error_code ec;
-    std::osyncstream(std::cout) << "Server is listening" << std::endl;
-    if (m_server.listen_and_serve(ec, m_conf.ip, m_conf.port)) {
-        std::cerr << "error: " << ec.message() << std::endl;
+    RUSYNC_LOG(INFO) << "Server is listening";
+    if (m_server.listen_and_serve(ec, m_conf.ip, m_conf.port, true)) {
+        RUSYNC_LOG(ERROR) << "error: " << ec.message();
+        return;
     }
+    m_expiry_timer.emplace(*m_server.io_services().front());
+    schedule_expiry();
+    m_server.join();
+}
+
+void ServerSync::schedule_expiry() {
+    m_expiry_timer->expires_from_now(EXPIRY_INTERVAL);
+    m_expiry_timer->async_wait([this](const boost::system::error_code& err) {
+        if (err == boost::asio::error::operation_aborted) {
+            return;
+        }
+        // expired staging files are removed, which shouldn't block network thread
+        m_io_executor.post(IOExecutor::BULK, [this]() {
+            m_ranged_uploads.expire();
+            // roll back of in-place session writes file, so it's ordered with patches of path
+            for (const auto& path: m_patch_sessions.expired()) {
+                m_path_serializer.post(path.string(), IOExecutor::BULK, [this, path]() {
+                    m_patch_sessions.expire(path);
+                });
+            }
+        });
+        schedule_expiry();
+    });
+}
+
+std::function<void()> ServerSync::make_reply_job(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, std::function<Reply()> work) {
+    // response object is destroyed together with stream, so completion should not touch it after stream was closed
+    auto closed = std::make_shared<bool>(false);
+    res.on_close([closed](uint32_t /*error_code*/) {
+        *closed = true;
+    });
+    const auto endpoint = ServerMetrics::endpoint_from(req.uri().path);
+    const auto method = ServerMetrics::method_from(req.method());
+    const auto started = std::chrono::steady_clock::now();
+    m_metrics.pending_requests.add(1);
+    auto trace = trace_context(req);
+    return [this, &res, &io_service = res.io_service(), closed, endpoint, method, started, trace = std::move(trace), work = std::move(work)]() {
+        TraceScope scope {trace ? trace->trace : 0};
+        std::optional<TraceSpan> span;
+        if (trace && Tracer::enabled()) {
+            const auto now = Tracer::now();
+            Tracer::instance().complete("queued", "server", trace->accepted, now);
+            Tracer::instance().flow(false, trace->span, now);
+            span.emplace(trace->name, "server");
+        }
+        Reply reply;
+        try {
+            reply = work();
+        } catch (const std::exception& err) {
+            RUSYNC_LOG(ERROR) << "Error occured while handling request: " << err.what();
+            reply = {500};
+        }
+        if (span) {
+            span->arg("status", std::to_string(reply.status));
+            span->end();
+        }
+        boost::asio::post(io_service, [this, &res, closed, endpoint, method, started, reply = std::move(reply)]() mutable {
+            m_metrics.pending_requests.add(-1);
+            if (*closed) {
+                return;
+            }
+            m_metrics.record_request(endpoint, method, reply.status, std::chrono::steady_clock::now() - started, reply.body_size());
+            res.write_head(reply.status);
+            if (reply.body_size() == 0) {
+                res.end();
+                return;
+            }
+            // generator keeps pooled body alive until it's sent, then buffer returns to pool of thread which built it
+            res.end([body = std::move(reply.body), sent = size_t{0}](uint8_t* buf, size_t len, uint32_t* data_flags) mutable -> ssize_t {
+                const size_t size = std::min(len, body->size() - sent);
+                memcpy(buf, body->data() + sent, size);
+                sent += size;
+                if (sent == body->size()) {
+                    *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                }
+                return size;
+            });
+        });
+    };
+}
+
+std::optional<ServerSync::TraceContext> ServerSync::trace_context(const nghttp2::asio_http2::server::request &req) {
+    if (!Tracer::enabled()) {
+        return std::nullopt;
+    }
+    const auto header = req.header().find(TRACE_HEADER);
+    if (header == req.header().end()) {
+        return std::nullopt;
+    }
+    const auto ids = Tracer::parse_header(header->second.value);
+    if (!ids) {
+        return std::nullopt;
+    }
+    return TraceContext{ids->first, ids->second, Tracer::now(), req.method() + " " + req.uri().path};
+}
+
+void ServerSync::reply_now(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, unsigned int status) {
+    m_metrics.record_request(ServerMetrics::endpoint_from(req.uri().path), ServerMetrics::method_from(req.method()), status, std::nullopt, 0);
+    res.write_head(status);
+    res.end();
+}
+
+void ServerSync::reply_async(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, IOExecutor::Lane lane, std::function<Reply()> work) {
+    m_io_executor.post(lane, make_reply_job(req, res, std::move(work)));
+}
+
+void ServerSync::reply_serialized(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, const fs::path& path, IOExecutor::Lane lane, std::function<Reply()> work) {
+    m_path_serializer.post(path.string(), lane, make_reply_job(req, res, std::move(work)));
+}
+
+void ServerSync::reply_shared(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, const fs::path& path, IOExecutor::Lane lane, std::function<Reply()> work) {
+    m_path_serializer.post_shared(path.string(), lane, make_reply_job(req, res, std::move(work)));
+}
+
+void ServerSync::reply_serialized_tree(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, const fs::path& path, IOExecutor::Lane lane, std::function<Reply()> work) {
+    m_path_serializer.post_tree(path.string(), lane, make_reply_job(req, res, std::move(work)));
+}
+
+bool ServerSync::reserved_key(std::string_view key) {
+    const fs::path normalized = fs::path(key).lexically_normal();
+    return !normalized.empty() && *normalized.begin() == STAGING_DIR;
+}
+
+fs::path ServerSync::file_path(const QueryParams& query_params) const {
+    fs::path path = (m_conf.path / fs::path(query_params.at("key")) / query_params.at("path")).lexically_normal();
+    // "dir/" and "dir" are the same entry
+    return path.has_filename() ? path : path.parent_path();
 }
 
 void ServerSync::handle_file_upload(const nghttp2::asio_http2::server::request &req, 
@@ -35,90 +177,205 @@ void ServerSync::handle_file_upload(const nghttp2::asio_http2::server::request &
                         const ServerSync::QueryParams& query_params,
                         const fs::path& full_path) {
     if (query_params.at("type") == "dir") {
-        std::filesystem::create_directories(full_path.parent_path());
-        fs::create_directory(full_path);
-        std::osyncstream(std::cout) << "Created dir at path: " << full_path << std::endl;
+        reply_serialized(req, res, full_path, IOExecutor::FAST, [full_path]() {
+            std::filesystem::create_directories(full_path.parent_path());
+            fs::create_directory(full_path);
+            RUSYNC_LOG(DEBUG) << "Created dir at path: " << full_path;
+            return Reply{200};
+        });
         return;
     }
-    on_full_data([full_path, &res](std::vector<char> buffer) {
-        std::filesystem::create_directories(full_path.parent_path());
-        std::fstream stream {full_path, std::ios::binary | std::ios::out };
-        stream.write(buffer.data(), buffer.size());
-        std::osyncstream(std::cout) << "Created file " << full_path << " size: " << buffer.size() << " bytes" << std::endl;
-        res.write_head(200);
-        res.end();
-    }, req);
+    if (query_params.contains("transfer")) {
+        handle_file_range_upload(req, res, query_params, full_path);
+        return;
+    }
+    read_body(req, [this, full_path, &req, &res](BufferPool::Buffer buffer) {
+        m_metrics.record_bytes_in(buffer->size());
+        const auto lane = buffer->size() < BULK_IO_THRESHOLD ? IOExecutor::FAST : IOExecutor::BULK;
+        reply_serialized(req, res, full_path, lane, [this, full_path, buffer = std::move(buffer)]() {
+            m_patch_sessions.abort(full_path);
+            m_ranged_uploads.abort(full_path);
+            std::filesystem::create_directories(full_path.parent_path());
+            std::fstream stream {full_path, std::ios::binary | std::ios::out };
+            stream.write(buffer->data(), buffer->size());
+            RUSYNC_LOG(DEBUG) << "Created file " << full_path << " size: " << buffer->size() << " bytes";
+            return Reply{200};
+        });
+    });
+}
+
+void ServerSync::handle_file_range_upload(const nghttp2::asio_http2::server::request &req, 
+                        const nghttp2::asio_http2::server::response &res,
+                        const ServerSync::QueryParams& query_params,
+                        const fs::path& full_path) {
+    read_body(req, [this, full_path, query_params, &req, &res](BufferPool::Buffer buffer) {
+        m_metrics.record_bytes_in(buffer->size());
+        const auto lane = buffer->size() < BULK_IO_THRESHOLD ? IOExecutor::FAST : IOExecutor::BULK;
+        // last range renames file into place, so it's not reordered with patches or removal of path
+        reply_shared(req, res, full_path, lane, [this, full_path, query_params, buffer = std::move(buffer)]() {
+            const uint64_t offset = query_params.number("offset");
+            const uint64_t size = query_params.number("size");
+            const std::string transfer {query_params.at("transfer")};
+            if (m_ranged_uploads.write(full_path, transfer, size, offset, buffer->data(), buffer->size())) {
+                m_patch_sessions.abort(full_path);
+                RUSYNC_LOG(DEBUG) << "Created file " << full_path << " size: " << size << " bytes from ranges of transfer " << transfer;
+            }
+            return Reply{200};
+        });
+    });
 }
 
 void ServerSync::handle_file_patch(const nghttp2::asio_http2::server::request &req, 
                         const nghttp2::asio_http2::server::response &res,
                         const ServerSync::QueryParams& query_params,
                         const fs::path& full_path) {
-    on_full_data([&res, query_params, this, full_path](std::vector<char> buffer) {
-        if (fs::is_directory(full_path)) {
-            res.write_head(200);
-            res.end();
-            return;
-        }
-        const uint64_t offset = std::stoull(query_params.at("offset"));
-        std::fstream stream {full_path, std::ios::binary | std::ios::out | std::ios::in};
-        stream.seekp(offset);
-        stream.write(buffer.data(), buffer.size());
-        std::osyncstream(std::cout) << "Patching file " << full_path << " with " << buffer.size() << " bytes at offset: " << offset << std::endl; 
-        if (query_params.contains("end") && query_params.at("end") == "1" 
-            && stream.tellp() != fs::file_size(full_path) // here we cutting the end of file
-            ) {
-            const auto old_size = fs::file_size(full_path);
-            std::vector<char> temp_file_buffer;
-            temp_file_buffer.resize(stream.tellp());
-            stream.seekg(0);
-            stream.read(temp_file_buffer.data(), temp_file_buffer.size());
-            stream.close();
-            stream.open(full_path, std::ios::binary | std::ios::out);
-            stream.write(temp_file_buffer.data(), temp_file_buffer.size());
-            std::osyncstream(std::cout) << "Resizing " << full_path << " from " << old_size << " to " << temp_file_buffer.size() << std::endl;
-        }
-        res.write_head(200);
-        res.end();
-    }, req);
+    read_body(req, [&req, &res, query_params, this, full_path](BufferPool::Buffer buffer) {
+        m_metrics.record_bytes_in(buffer->size());
+        const bool end = query_params.contains("end") && query_params.at("end") == "1";
+        const std::string session {query_params.get("session").value_or("")};
+        // first patch of session creates shadow copy of file
+        const bool heavy = buffer->size() >= BULK_IO_THRESHOLD || (!session.empty() && !m_patch_sessions.active(full_path, session));
+        reply_serialized(req, res, full_path, heavy ? IOExecutor::BULK : IOExecutor::FAST, [this, query_params, full_path, end, session, buffer = std::move(buffer)]() {
+            if (fs::is_directory(full_path)) {
+                return Reply{200};
+            }
+            const uint64_t offset = query_params.number("offset");
+            if (query_params.contains("append") && (!fs::is_regular_file(full_path) || fs::file_size(full_path) != offset)) {
+                // client appends to content it synced before, which is not what server has. Client falls back to regular patch
+                return Reply{409};
+            }
+            if (query_params.contains("version") && m_patch_sessions.base_version(full_path, session) != query_params.at("version")) {
+                // client diffed against chunks it synced before, but file was changed since then. Client falls back to /meta
+                // and starts new session, so patches already staged by this one are dropped now instead of waiting for expiry
+                m_patch_sessions.abort(full_path, session);
+                return Reply{409};
+            }
+            if (session.empty()) {
+                PatchSessions::apply_in_place(full_path, offset, buffer->data(), buffer->size(), end);
+            } else {
+                m_patch_sessions.apply(full_path, session, offset, buffer->data(), buffer->size(), end);
+            }
+            RUSYNC_LOG(DEBUG) << "Patching file " << full_path << " with " << buffer->size() << " bytes at offset: " << offset 
+                << (end ? ", truncated to " + std::to_string(offset + buffer->size()) : "");
+            // version of committed file lets client send next patches without requesting meta
+            return Reply{200, end ? PatchSessions::version(full_path) : ""};
+        });
+    });
 }
 
 void ServerSync::handle_file_download(const nghttp2::asio_http2::server::request &req, 
                         const nghttp2::asio_http2::server::response &res,
                         const ServerSync::QueryParams& query_params,
                         const fs::path& full_path) {
-    if (!fs::exists(full_path)) {
-        res.write_head(404);
-        res.end();
+    if (query_params.contains("transfer")) {
+        reply_async(req, res, IOExecutor::FAST, [this, full_path, query_params]() {
+            const auto ranges = m_ranged_uploads.received(full_path, std::string(query_params.at("transfer")), query_params.number("size"));
+            m_metrics.record_resume_lookup(!ranges.empty());
+            auto buffer = BufferPool::local().acquire();
+            buffer->resize(ranges.size() * 2 * sizeof(uint64_t));
+            BinaryWriter writer {reinterpret_cast<unsigned char*>(buffer->data()), buffer->size()};
+            for (const auto& [offset, end]: ranges) {
+                writer.write(offset);
+                writer.write(end);
+            }
+            return Reply{200, std::move(buffer)};
+        });
+        return;
+    }
+    if (query_params.contains("offset") && query_params.contains("length")) {
+        const uint64_t offset = query_params.number("offset");
+        // ranges are read in parallel with each other, but never during write of file. Client checks hash of assembled file
+        reply_shared(req, res, full_path, IOExecutor::BULK, [full_path, offset, requested = query_params.number("length")]() {
+            const int fd = open(full_path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return Reply{404};
+            }
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                return Reply{404};
+            }
+            const uint64_t size = st.st_size;
+            if (offset > size || (offset == size && requested > 0)) {
+                close(fd);
+                return Reply{416};
+            }
+            // length comes from client, so body is never bigger than the rest of file or than one part of ranged transfer
+            const uint64_t length = std::min({requested, size - offset, MAX_RANGE_LENGTH});
+            auto buffer = BufferPool::local().acquire();
+            buffer->resize(length);
+            size_t bytes_read = 0;
+            while (bytes_read < length) {
+                const auto result = pread(fd, buffer->data() + bytes_read, length - bytes_read, offset + bytes_read);
+                if (result < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (result <= 0) {
+                    break;
+                }
+                bytes_read += result;
+            }
+            close(fd);
+            buffer->resize(bytes_read);
+            return Reply{200, std::move(buffer)};
+        });
         return;
     }
-    std::ifstream stream {full_path, std::ios::binary};
-    std::string buffer;
-    buffer.resize(fs::file_size(full_path));
-    stream.read(buffer.data(), buffer.size());
-    res.write_head(200);
-    res.end(std::move(buffer));
+    reply_serialized(req, res, full_path, IOExecutor::BULK, [full_path]() {
+        if (!fs::exists(full_path)) {
+            return Reply{404};
+        }
+        std::ifstream stream {full_path, std::ios::binary};
+        auto buffer = BufferPool::local().acquire();
+        buffer->resize(fs::file_size(full_path));
+        stream.read(buffer->data(), buffer->size());
+        return Reply{200, std::move(buffer)};
+    });
 }
 
 void ServerSync::handle_file_removal(const nghttp2::asio_http2::server::request &req, 
                         const nghttp2::asio_http2::server::response &res,
                         const ServerSync::QueryParams& query_params,
                         const fs::path& full_path) {
-    if (!fs::exists(full_path)) {
-        res.write_head(404);
-        res.end();
-        return;
-    }
-    std::osyncstream(std::cout) << "Removing " << (fs::is_regular_file(full_path) ? " file " : " dir ") << full_path << std::endl;
-    fs::remove_all(full_path);
-    res.write_head(200);
-    res.end();        
+    // type of path is only known on executor, so removal is queued as cheap one and dir tree is moved aside to be removed by BULK lane.
+    // Writes to files within removed dir which were posted before are done before it's removed, ones posted after it are done after
+    reply_serialized_tree(req, res, full_path, IOExecutor::FAST, [this, full_path]() {
+        m_patch_sessions.abort(full_path);
+        m_ranged_uploads.abort(full_path);
+        std::error_code ec;
+        const auto status = fs::symlink_status(full_path, ec);
+        if (!fs::exists(status)) {
+            return Reply{404};
+        }
+        if (!fs::is_directory(status)) {
+            RUSYNC_LOG(DEBUG) << "Removing file " << full_path;
+            fs::remove(full_path);
+            return Reply{200};
+        }
+        RUSYNC_LOG(DEBUG) << "Removing dir " << full_path;
+        const fs::path trash = m_conf.path / STAGING_DIR / TRASH_DIR / std::to_string(m_trash_counter++);
+        fs::create_directories(trash.parent_path(), ec);
+        fs::rename(full_path, trash, ec);
+        if (ec) {
+            fs::remove_all(full_path);
+            return Reply{200};
+        }
+        m_io_executor.post(IOExecutor::BULK, [trash]() {
+            std::error_code ec;
+            fs::remove_all(trash, ec);
+        });
+        return Reply{200};
+    });
 } 
 
 void ServerSync::handle_files_request(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res) {
-    std::osyncstream(std::cout) << "Request to " << req.method() << " files api, uri: " << uri_obj_to_str(req.uri()) << std::endl;
-    auto query_params = parse_params(nghttp2::asio_http2::percent_decode(req.uri().raw_query));
-    fs::path full_path = m_conf.path / fs::path(query_params.at("key")) / query_params.at("path");
+    const auto query_params = QueryParams::decode(req.uri().raw_query);
+    RUSYNC_LOG(DEBUG) << "Request to " << req.method() << " files api, uri: " << req.uri().path << "?" << query_params.str();
+    if (reserved_key(query_params.at("key"))) {
+        reply_now(req, res, 400);
+        return;
+    }
+    const fs::path full_path = file_path(query_params);
     if (req.method() == "POST") {
         handle_file_upload(req, res, query_params, full_path);
     } else if (req.method() == "PATCH") {
@@ -128,117 +385,117 @@ void ServerSync::handle_files_request(const nghttp2::asio_http2::server::request
     } else if (req.method() == "DELETE") {
         handle_file_removal(req, res, query_params, full_path);
     } else {
-        res.write_head(405);
-        res.end();
+        reply_now(req, res, 405);
     }
 }
 void ServerSync::handle_files_description_request(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res) {
-    std::osyncstream(std::cout) << "Request to " << req.method() << " files description, uri: " << uri_obj_to_str(req.uri()) << std::endl;
-    auto query_params = parse_params(nghttp2::asio_http2::percent_decode(req.uri().raw_query));
+    const auto query_params = QueryParams::decode(req.uri().raw_query);
+    RUSYNC_LOG(DEBUG) << "Request to " << req.method() << " files description, uri: " << req.uri().path << "?" << query_params.str();
     if (req.method() != "GET") {
-        res.write_head(405);
-        res.end();
+        reply_now(req, res, 405);
         return;
     }
-    rapidjson::Document doc(rapidjson::kArrayType);
-    rapidjson::Document::AllocatorType& alloc = doc.GetAllocator();
-    if (fs::exists(m_conf.path / query_params["key"])) {
-        auto local_entries = extract_entries_from_path<std::vector<DirEntry>>(m_conf.path / query_params["key"]);
-        for (const auto& entry: local_entries) {
-            rapidjson::Value obj;
-            obj.SetObject();
-            obj.GetObject().AddMember("path", rapidjson::Value().SetString(entry.path.c_str(), alloc), alloc);
-            obj.GetObject().AddMember("type", rapidjson::Value().SetString(entry.type_str().c_str(), alloc), alloc);
-            obj.GetObject().AddMember("hash", rapidjson::Value().SetUint64(entry.hash), alloc);
-            doc.PushBack(obj, alloc);
-        }
+    if (reserved_key(query_params.get("key").value_or(""))) {
+        reply_now(req, res, 400);
+        return;
     }
-
-    rapidjson::StringBuffer buffer;
-    rapidjson::Writer<rapidjson::StringBuffer> writer {buffer};
-    doc.Accept(writer);
-    std::string res_buffer(buffer.GetString(), buffer.GetSize());
-    res.write_head(200);
-    res.end(std::move(res_buffer));
+    DescriptionOptions options;
+    options.algorithm = requested_hash(query_params);
+    options.dir_hashes = query_params.contains("tree");
+    // body of request holds subtree digests of client's dirs, subtrees which client already has are left out
+    read_body(req, [this, &req, &res, root = m_conf.path / query_params.get("key").value_or(""), options = std::move(options)](BufferPool::Buffer buffer) mutable {
+        m_metrics.record_bytes_in(buffer->size());
+        reply_async(req, res, IOExecutor::BULK, [this, root, options, buffer = std::move(buffer)]() mutable {
+            if (options.dir_hashes) {
+                const size_t count = std::min(buffer->size() / sizeof(uint64_t), MAX_KNOWN_DIRS);
+                options.known_dirs.resize(count);
+                memcpy(options.known_dirs.data(), buffer->data(), count * sizeof(uint64_t));
+                std::sort(options.known_dirs.begin(), options.known_dirs.end());
+            }
+            EntryTable local_entries;
+            if (fs::exists(root)) {
+                const auto started = std::chrono::steady_clock::now();
+                // client ignores the same paths, so they don't show up as missing on either side
+                local_entries = extract_entries_from_path<EntryTable>(root, options.algorithm.value_or(HashAlgorithm::XXHASH64), IgnoreRules::load(root));
+                uint64_t bytes = 0;
+                for (const auto& entry: local_entries) {
+                    bytes += entry.size;
+                }
+                m_metrics.record_hashing(std::chrono::steady_clock::now() - started, bytes);
+            }
+            // json is written straight into reserved body of reply
+            auto body = BufferPool::local().acquire(std::min(local_entries.size() * DESCRIPTION_BODY_PER_ENTRY, BufferPool::MAX_CAPACITY));
+            serialize_description(local_entries, options, *body);
+            return Reply{200, std::move(body)};
+        });
+    });
 }
 
 void ServerSync::handle_meta_request(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res) {
-    std::osyncstream(std::cout) << "Request to meta api, uri: " << uri_obj_to_str(req.uri()) << std::endl;
-    auto query_params = parse_params(nghttp2::asio_http2::percent_decode(req.uri().raw_query));
-    fs::path full_path = m_conf.path / fs::path(query_params.at("key")) / query_params.at("path");
-    if (req.method() != "GET") {
-        res.write_head(405);
-        res.end();
-        return;
-    }
-    if (!fs::exists(full_path)) {
-        res.write_head(404);
-        res.end();
+    const auto query_params = QueryParams::decode(req.uri().raw_query);
+    RUSYNC_LOG(DEBUG) << "Request to meta api, uri: " << req.uri().path << "?" << query_params.str();
+    if (reserved_key(query_params.at("key"))) {
+        reply_now(req, res, 400);
         return;
     }
-    if (!fs::is_regular_file(full_path)) {
-        std::string buffer;
-        buffer.resize(1);
-        BinaryWriter writer {reinterpret_cast<unsigned char*>(buffer.data()), buffer.size()};
-        writer.write(uint8_t{0});
-        res.write_head(200);
-        res.end(std::move(buffer));
+    const fs::path full_path = file_path(query_params);
+    if (req.method() != "GET") {
+        reply_now(req, res, 405);
         return;
     }
-    std::vector<FileChunk> chunks = compute_chunks_for_file(full_path);
-    std::osyncstream(std::cout) << "Computed " << chunks.size() << " chunks for " << full_path << std::endl;
-    std::string result_buffer;
-    result_buffer.resize(chunks.size() * (sizeof(chunks[0].size) + sizeof(chunks[0].hash)) + 1);
-    BinaryWriter writer {reinterpret_cast<unsigned char*>(result_buffer.data()), result_buffer.size()};
-    writer.write(uint8_t{1});
-    for (const auto& chunk: chunks) {
-        writer.write(chunk.size);
-        writer.write(chunk.hash);
-    }
-    res.write_head(200);
-    res.end(std::move(result_buffer));
-}
-
-size_t ServerSync::calculate_chunk_size(size_t file_size) {
-    if (file_size < 1'000'000) {
-        return 1000;
-    } else if (file_size < 1'000'000'000) {
-        return 31622;
-    }
-    return 100000; 
-}
-
-std::vector<FileChunk> ServerSync::compute_chunks_for_file(const fs::path& path) {
-    const int chunk_size = calculate_chunk_size(fs::file_size(path));
-    std::vector<FileChunk> chunks;
-    FILE* stream = fopen(path.c_str(), "rb");
-    std::vector<char> buffer;
-    buffer.resize(chunk_size);
-    while(!feof(stream)) {
-        const auto bytes_read = fread(buffer.data(), 1, buffer.size(), stream);
-        if (bytes_read > 0) {
-            const auto hash = XXH64(buffer.data(), bytes_read, 0);
-            chunks.push_back({static_cast<uint32_t>(bytes_read), hash});
+    const auto algorithm = requested_hash(query_params).value_or(HashAlgorithm::XXHASH64);
+    reply_serialized(req, res, full_path, IOExecutor::BULK, [this, full_path, algorithm]() {
+        if (!fs::exists(full_path)) {
+            return Reply{404};
         }
-    }
-    fclose(stream);
-    return chunks;
+        // lowest bit is is_file, the rest is id of algorithm (0 for XXH64, so clients which don't ask for algorithm see 0 or 1)
+        const uint8_t flags = static_cast<uint8_t>(algorithm) << 1;
+        if (!fs::is_regular_file(full_path)) {
+            auto buffer = BufferPool::local().acquire();
+            buffer->resize(1);
+            BinaryWriter writer {reinterpret_cast<unsigned char*>(buffer->data()), buffer->size()};
+            writer.write(flags);
+            return Reply{200, std::move(buffer)};
+        }
+        const auto started = std::chrono::steady_clock::now();
+        TraceSpan span {"hash", "server", {{"algorithm", hash_algorithm_name(algorithm)}}};
+        // served files can be truncated by anything on server, mapped file would crash server with SIGBUS then
+        std::vector<FileChunk> chunks = compute_chunks_for_file(full_path, algorithm, false);
+        span.end();
+        m_metrics.record_hashing(std::chrono::steady_clock::now() - started, fs::file_size(full_path));
+        RUSYNC_LOG(DEBUG) << "Computed " << chunks.size() << " chunks for " << full_path;
+        auto result_buffer = BufferPool::local().acquire();
+        result_buffer->resize(chunks.size() * (sizeof(chunks[0].size) + sizeof(chunks[0].hash)) + 1);
+        BinaryWriter writer {reinterpret_cast<unsigned char*>(result_buffer->data()), result_buffer->size()};
+        writer.write(static_cast<uint8_t>(flags | 1));
+        for (const auto& chunk: chunks) {
+            writer.write(chunk.size);
+            writer.write(chunk.hash);
+        }
+        return Reply{200, std::move(result_buffer)};
+    });
 }
 
-
-std::string ServerSync::uri_obj_to_str(const nghttp2::asio_http2::uri_ref& uri) {
-    return uri.scheme + "://" + uri.host + uri.path + "?" + nghttp2::asio_http2::percent_decode(uri.raw_query);
+std::optional<HashAlgorithm> ServerSync::requested_hash(const QueryParams& query_params) {
+    const auto hash = query_params.get("hash");
+    if (!hash) {
+        return std::nullopt;
+    }
+    return hash_algorithm_from(*hash).value_or(HashAlgorithm::XXHASH64);
 }
 
-ServerSync::QueryParams ServerSync::parse_params(std::string_view query) {
-    QueryParams result;
-    std::vector<std::string> params;
-    boost::algorithm::split(params, query, boost::is_any_of("&"));
-    for (const auto& param: params) {
-        std::vector<std::string> key_value;
-        boost::algorithm::split(key_value, param, boost::is_any_of("="));
-        result[key_value[0]] = key_value[1];
+void ServerSync::handle_metrics_request(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res) {
+    if (req.method() != "GET") {
+        reply_now(req, res, 405);
+        return;
     }
-    return result;
+    // only reads counters, so it's answered right on network thread
+    const auto started = std::chrono::steady_clock::now();
+    auto body = m_metrics.render(m_io_executor.stats(), m_path_serializer.active());
+    m_metrics.record_request(ServerMetrics::METRICS, ServerMetrics::GET, 200, std::chrono::steady_clock::now() - started, body.size());
+    auto headers = nghttp2::asio_http2::header_map();
+    headers.emplace("content-type", nghttp2::asio_http2::header_value{"text/plain; version=0.0.4", false});
+    res.write_head(200, std::move(headers));
+    res.end(std::move(body));
+}
 }
-}
\ No newline at end of file
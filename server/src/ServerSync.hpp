@@ -1,14 +1,22 @@
 #pragma once 
 #include <nghttp2/asio_http2_server.h>
+#include <atomic>
 #include <cstddef>
 #include <filesystem>
+#include <optional>
 #include "Config.hpp"
 #include "boost/date_time/posix_time/posix_time_duration.hpp"
 #include <iostream>
 #include "DirEntry.hpp"
 
 #include "Utils.hpp"
+#include "BufferPool.hpp"
 #include "FileChunk.hpp"
+#include "IOExecutor.hpp"
+#include "PathSerializer.hpp"
+#include "PatchSessions.hpp"
+#include "RangedUploads.hpp"
+#include "ServerMetrics.hpp"
 
 namespace rusync {
 
@@ -21,13 +29,142 @@ class ServerSync {
 public:
     ServerSync(const Config& config);
 
-    using QueryParams = std::map<std::string, std::string>;
+    using QueryParams = rusync::QueryParams;
     /**
      * @brief will block and listen on specified ip and port
      * 
      */
     void listen();
 private:
+    /**
+     * @brief expires abandoned ranged uploads and patch sessions on BULK lane every EXPIRY_INTERVAL, so they don't wait for next write
+     * 
+     */
+    void schedule_expiry();
+
+    /**
+     * @brief Response produced by filesystem work, body is pooled buffer of thread which did the work
+     * 
+     */
+    struct Reply {
+        Reply(unsigned int status = 200) : status {status} {
+
+        }
+
+        Reply(unsigned int status, BufferPool::Buffer body) : status {status}, body {std::move(body)} {
+
+        }
+
+        Reply(unsigned int status, std::string_view body) : status {status}, body {BufferPool::local().copy(body)} {
+
+        }
+
+        size_t body_size() const {
+            return body ? body->size() : 0;
+        }
+
+        unsigned int status;
+        BufferPool::Buffer body;
+    };
+
+    /**
+     * @brief trace context passed by client in TRACE_HEADER
+     * 
+     */
+    struct TraceContext {
+        uint64_t trace;
+        uint64_t span;
+        uint64_t accepted;
+        std::string name;
+    };
+
+    /**
+     * @brief reads TRACE_HEADER of request, must be called on network thread
+     * 
+     * @param req 
+     * @return std::optional<TraceContext> nullopt if tracing is disabled or request is not traced
+     */
+    static std::optional<TraceContext> trace_context(const nghttp2::asio_http2::server::request &req);
+
+    /**
+     * @brief wraps work into job which sends its result back as response from network thread which owns res.<br>
+     * If stream is closed before work is done - result is dropped
+     * 
+     * @param req used for metrics labels and trace context only, not accessed by job
+     * @param res 
+     * @param work 
+     * @return std::function<void()> job to run on io executor
+     */
+    std::function<void()> make_reply_job(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, std::function<Reply()> work);
+
+    /**
+     * @brief replies with empty body right away, used for errors detected on network thread
+     * 
+     * @param req 
+     * @param res 
+     * @param status 
+     */
+    void reply_now(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, unsigned int status);
+
+    /**
+     * @brief runs work on io executor and replies with its result
+     * 
+     * @param req 
+     * @param res 
+     * @param lane 
+     * @param work 
+     */
+    void reply_async(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, IOExecutor::Lane lane, std::function<Reply()> work);
+
+    /**
+     * @brief same as reply_async, but work is executed only after all previously posted work for the same path is done
+     * 
+     * @param req 
+     * @param res 
+     * @param path 
+     * @param lane 
+     * @param work 
+     */
+    void reply_serialized(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, const fs::path& path, IOExecutor::Lane lane, std::function<Reply()> work);
+
+    /**
+     * @brief same as reply_serialized, but work may run in parallel with adjacent shared work for the same path
+     * 
+     * @param req 
+     * @param res 
+     * @param path 
+     * @param lane 
+     * @param work 
+     */
+    void reply_shared(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, const fs::path& path, IOExecutor::Lane lane, std::function<Reply()> work);
+
+    /**
+     * @brief same as reply_serialized, but work is also ordered with work for all paths under path
+     * 
+     * @param req 
+     * @param res 
+     * @param path 
+     * @param lane 
+     * @param work 
+     */
+    void reply_serialized_tree(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res, const fs::path& path, IOExecutor::Lane lane, std::function<Reply()> work);
+
+    /**
+     * @brief 
+     * 
+     * @param key 
+     * @return true if key is STAGING_DIR or within it, such key is rejected, so clients can't touch staging files
+     */
+    static bool reserved_key(std::string_view key);
+
+    /**
+     * @brief 
+     * 
+     * @param query_params 
+     * @return fs::path normalized path of file within dir of client, so the same file always gets the same serializer key
+     */
+    fs::path file_path(const QueryParams& query_params) const;
+
     /**
      * @brief Handles POST to FILES_PATH
      * 
@@ -55,7 +192,22 @@ private:
                             const fs::path& full_path);
 
     /**
-     * @brief handles GET to FILES_PATH
+     * @brief handles POST to FILES_PATH with transfer param: writes single range of file uploaded by ranges.<br>
+     * Ranges are shared work of path, so ranges of the same file are written in parallel, but not together with other writes of file
+     * 
+     * @param req 
+     * @param res 
+     * @param query_params 
+     * @param full_path 
+     */
+    void handle_file_range_upload(const nghttp2::asio_http2::server::request &req, 
+                            const nghttp2::asio_http2::server::response &res,
+                            const QueryParams& query_params,
+                            const fs::path& full_path);
+
+    /**
+     * @brief handles GET to FILES_PATH. If offset and length params are present - only this range of file is sent.<br>
+     * If transfer param is present - ranges already received for this ranged upload are sent as (offset, end) pairs, so client can resume it
      * 
      * @param req 
      * @param res 
@@ -88,7 +240,8 @@ private:
     void handle_files_request(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res);
 
     /**
-     * @brief Handles request to DESCRIPTION_PATH
+     * @brief Handles request to DESCRIPTION_PATH. Entries ignored by IGNORE_FILE within dir of client are left out.
+     * Dirs get Merkle hashes only if client asked for them by tree param, then subtrees whose digests client sent in body are pruned
      * 
      * @param req 
      * @param res 
@@ -96,36 +249,75 @@ private:
     void handle_files_description_request(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res);
 
     /**
-     * @brief handles request to META_PATH
+     * @brief handles request to METRICS_PATH: metrics in Prometheus text format
      * 
      * @param req 
      * @param res 
      */
-    void handle_meta_request(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res);
+    void handle_metrics_request(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res);
 
     /**
-     * @brief computes patch chunk size based of file size
+     * @brief handles request to META_PATH
      * 
-     * @param file_size 
-     * @return size_t 
+     * @param req 
+     * @param res 
      */
-    static size_t calculate_chunk_size(size_t file_size);
-    std::vector<FileChunk> compute_chunks_for_file(const fs::path& path);
-
-    static std::string uri_obj_to_str(const nghttp2::asio_http2::uri_ref& uri);
+    void handle_meta_request(const nghttp2::asio_http2::server::request &req, const nghttp2::asio_http2::server::response &res);
 
     /**
-     * @brief parsing parameters from string to map of <key, value>
+     * @brief reads hash query param, by which client asks for algorithm of hashes
      * 
-     * @param query 
-     * @return QueryParams 
+     * @param query_params 
+     * @return std::optional<HashAlgorithm> nullopt if client didn't ask (response has old format then), XXH64 if algorithm is unknown
      */
-    static QueryParams parse_params(std::string_view query);
+    static std::optional<HashAlgorithm> requested_hash(const QueryParams& query_params);
 
     nghttp2::asio_http2::server::http2 m_server;
     Config m_conf;
+    ServerMetrics m_metrics;
+    PatchSessions m_patch_sessions;
+    RangedUploads m_ranged_uploads;
+    PathSerializer m_path_serializer;
+    /**
+     * @brief its tasks use members above, so it's declared after them and its threads are joined first
+     * 
+     */
+    IOExecutor m_io_executor;
+    /**
+     * @brief writes with body size starting from this value go to BULK lane of io executor
+     * 
+     */
+    static constexpr size_t BULK_IO_THRESHOLD = 1'000'000;
+    /**
+     * @brief files description is reserved by this estimate per entry (path of average length), so it's rarely reallocated
+     * 
+     */
+    static constexpr size_t DESCRIPTION_BODY_PER_ENTRY = 128;
+    /**
+     * @brief longest range served by one request, the largest part client downloads ranged transfer by
+     * 
+     */
+    static constexpr uint64_t MAX_RANGE_LENGTH = 64'000'000;
     const char* FILES_PATH = "/files";
     const char* DESCRIPTION_PATH = "/files_description";
     const char* META_PATH = "/meta";
+    const char* METRICS_PATH = "/metrics";
+    /**
+     * @brief dir for shadow copies of patched files and files uploaded by ranges, relative to server dir. Name is reserved, it's not accepted as key
+     * 
+     */
+    static constexpr const char* STAGING_DIR = ".rusync_staging";
+    /**
+     * @brief dir within STAGING_DIR where removed dirs are moved to, so DELETE doesn't wait for removal of whole tree
+     * 
+     */
+    static constexpr const char* TRASH_DIR = "trash";
+    std::atomic<uint64_t> m_trash_counter = 0;
+    /**
+     * @brief created by listen on first io service of server
+     * 
+     */
+    std::optional<boost::asio::deadline_timer> m_expiry_timer;
+    const boost::posix_time::minutes EXPIRY_INTERVAL = boost::posix_time::minutes{1};
 };
 }
\ No newline at end of file
@@ -2,7 +2,9 @@
 #include <syncstream>
 #include <iostream>
 #include "Config.hpp"
+#include "Logger.hpp"
 #include "ServerSync.hpp"
+#include "Tracing.hpp"
 
 namespace rusync {
 
@@ -21,10 +23,14 @@ int start(int argc, char** argv) {
         return -1;
     }
 
+    if (const char* trace_file = std::getenv("RUSYNC_TRACE_FILE"); trace_file && !Tracer::instance().start(trace_file, "rusync_server")) {
+        RUSYNC_LOG(ERROR) << "Failed to open trace file " << trace_file;
+    }
+
     ServerSync server {conf};
     server.listen();
     
-    std::osyncstream(std::cout) << "Server Exiting..." << std::endl;
+    RUSYNC_LOG(INFO) << "Server Exiting...";
 
     return 0;
 
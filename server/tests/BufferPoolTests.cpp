@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include "BufferPool.hpp"
+
+namespace {
+
+struct HeaderValue {
+    std::string value;
+};
+
+/**
+ * @brief request which delivers body by frames like nghttp2 does
+ *
+ */
+struct FakeRequest {
+    const std::multimap<std::string, HeaderValue>& header() const {
+        return headers;
+    }
+
+    void on_data(std::function<void(const uint8_t*, size_t)> cb) const {
+        data_cb = std::move(cb);
+    }
+
+    void send(const std::string& frame) const {
+        data_cb(reinterpret_cast<const uint8_t*>(frame.data()), frame.size());
+    }
+
+    std::multimap<std::string, HeaderValue> headers;
+    mutable std::function<void(const uint8_t*, size_t)> data_cb;
+};
+
+}
+
+TEST(BufferPoolTest, released_buffer_is_reused) {
+    rusync::BufferPool pool;
+    const char* data = nullptr;
+    {
+        auto buffer = pool.acquire(1000);
+        buffer->assign(10, 'a');
+        data = buffer->data();
+        EXPECT_EQ(pool.pooled(), 0);
+    }
+    EXPECT_EQ(pool.pooled(), 1);
+    auto buffer = pool.acquire(100);
+    EXPECT_TRUE(buffer->empty());
+    EXPECT_GE(buffer->capacity(), 1000);
+    EXPECT_EQ(buffer->data(), data);
+    EXPECT_EQ(pool.pooled(), 0);
+}
+
+TEST(BufferPoolTest, buffer_released_by_other_thread_returns_to_its_pool) {
+    rusync::BufferPool pool;
+    auto buffer = pool.acquire(64);
+    std::thread other {[buffer = std::move(buffer)]() mutable {
+        buffer.reset();
+    }};
+    other.join();
+    EXPECT_EQ(pool.pooled(), 1);
+    EXPECT_EQ(rusync::BufferPool::local().pooled(), 0);
+}
+
+TEST(BufferPoolTest, large_and_excess_buffers_are_freed) {
+    rusync::BufferPool pool;
+    pool.acquire(rusync::BufferPool::MAX_CAPACITY + 1);
+    EXPECT_EQ(pool.pooled(), 0);
+    {
+        std::vector<rusync::BufferPool::Buffer> buffers;
+        for (size_t i = 0; i < rusync::BufferPool::MAX_POOLED + 10; i++) {
+            buffers.push_back(pool.acquire());
+        }
+    }
+    EXPECT_EQ(pool.pooled(), rusync::BufferPool::MAX_POOLED);
+}
+
+TEST(BufferPoolTest, buffer_outlives_pool) {
+    rusync::BufferPool::Buffer buffer;
+    {
+        rusync::BufferPool pool;
+        buffer = pool.acquire(16);
+    }
+    buffer->assign(16, 'b');
+    buffer.reset();
+}
+
+TEST(BufferPoolTest, copy) {
+    rusync::BufferPool pool;
+    const auto buffer = pool.copy("abc");
+    EXPECT_EQ(std::string(buffer->data(), buffer->size()), "abc");
+}
+
+TEST(BufferPoolTest, read_body_reserves_content_length) {
+    FakeRequest req;
+    req.headers.emplace("content-length", HeaderValue{"10000"});
+    rusync::BufferPool::Buffer body;
+    rusync::read_body(req, [&body](rusync::BufferPool::Buffer buffer) {
+        body = std::move(buffer);
+    });
+    req.send("abc");
+    req.send("def");
+    EXPECT_FALSE(body);
+    req.send("");
+    ASSERT_TRUE(body);
+    EXPECT_EQ(std::string(body->data(), body->size()), "abcdef");
+    EXPECT_GE(body->capacity(), 10000);
+}
+
+TEST(BufferPoolTest, read_body_without_content_length) {
+    FakeRequest req;
+    std::string received;
+    rusync::read_body(req, [&received](rusync::BufferPool::Buffer buffer) {
+        received.assign(buffer->data(), buffer->size());
+    });
+    const std::string frame(20000, 'x');
+    req.send(frame);
+    req.send(frame);
+    req.send("");
+    EXPECT_EQ(received, frame + frame);
+}
@@ -0,0 +1,64 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include "IOExecutor.hpp"
+
+TEST(IOExecutor, executes_posted_tasks) {
+    std::atomic<int> executed = 0;
+    {
+        rusync::IOExecutor executor {2};
+        std::promise<void> done;
+        for (int i = 0; i < 10; i++) {
+            executor.post(i % 2 ? rusync::IOExecutor::FAST : rusync::IOExecutor::BULK, [&]() {
+                if (++executed == 10) {
+                    done.set_value();
+                }
+            });
+        }
+        done.get_future().wait();
+        // counter is updated right after last task returns
+        for (int i = 0; i < 1000 && executor.stats().completed != 10; i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        EXPECT_EQ(executor.stats().completed, 10);
+    }
+    EXPECT_EQ(executed, 10);
+}
+
+TEST(IOExecutor, fast_lane_not_blocked_by_bulk) {
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<void> bulk_started;
+    std::promise<void> fast_done;
+    rusync::IOExecutor executor {2};
+    // one bulk task occupies the only bulk-capable thread, others are waiting in queue
+    executor.post(rusync::IOExecutor::BULK, [&]() {
+        bulk_started.set_value();
+        released.wait();
+    });
+    bulk_started.get_future().wait();
+    executor.post(rusync::IOExecutor::BULK, [&]() {});
+    executor.post(rusync::IOExecutor::BULK, [&]() {});
+    executor.post(rusync::IOExecutor::FAST, [&]() {
+        fast_done.set_value();
+    });
+    EXPECT_EQ(fast_done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    const auto stats = executor.stats();
+    EXPECT_EQ(stats.queued_bulk, 2);
+    EXPECT_EQ(stats.queued_fast, 0);
+    EXPECT_GE(stats.max_queue_depth, 2);
+    release.set_value();
+}
+
+TEST(IOExecutor, survives_throwing_task) {
+    std::promise<void> done;
+    rusync::IOExecutor executor {2};
+    executor.post(rusync::IOExecutor::FAST, []() {
+        throw std::runtime_error{"test"};
+    });
+    executor.post(rusync::IOExecutor::FAST, [&]() {
+        done.set_value();
+    });
+    EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+}
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <vector>
+#include "ServerMetrics.hpp"
+
+TEST(Metrics, counter_sums_over_threads) {
+    constexpr int THREADS = 8;
+    constexpr int ADDS = 10000;
+    rusync::Counter counter;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < THREADS; t++) {
+        threads.emplace_back([&counter]() {
+            for (int i = 0; i < ADDS; i++) {
+                counter.add();
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(counter.value(), THREADS * ADDS);
+}
+
+TEST(Metrics, gauge_add_and_remove_on_different_threads) {
+    rusync::Gauge gauge;
+    std::thread([&gauge]() { gauge.add(5); }).join();
+    gauge.add(-3);
+    EXPECT_EQ(gauge.value(), 2);
+}
+
+TEST(Metrics, histogram_cumulative_buckets) {
+    using namespace std::chrono_literals;
+    rusync::Histogram histogram {0.001, 0.01};
+    histogram.record(500us);
+    histogram.record(1ms);
+    histogram.record(5ms);
+    histogram.record(1s);
+    const auto snapshot = histogram.snapshot();
+    ASSERT_EQ(snapshot.cumulative.size(), 3);
+    EXPECT_EQ(snapshot.cumulative[0], 2);
+    EXPECT_EQ(snapshot.cumulative[1], 3);
+    EXPECT_EQ(snapshot.count(), 4);
+    EXPECT_NEAR(snapshot.sum_seconds, 1.0065, 1e-9);
+}
+
+TEST(Metrics, render_prometheus_text) {
+    using namespace std::chrono_literals;
+    rusync::ServerMetrics metrics;
+    metrics.record_request(rusync::ServerMetrics::META, rusync::ServerMetrics::GET, 200, 2ms, 100);
+    metrics.record_request(rusync::ServerMetrics::FILES, rusync::ServerMetrics::POST, 500, 1ms, 0);
+    // rejected right away, so it's counted without duration
+    metrics.record_request(rusync::ServerMetrics::META, rusync::ServerMetrics::GET, 400, std::nullopt, 0);
+    metrics.record_bytes_in(42);
+    metrics.record_resume_lookup(true);
+    const auto text = metrics.render(rusync::IOExecutor::Stats{1, 2, 3, 4, 5}, 6);
+    EXPECT_NE(text.find("rusync_requests_total{endpoint=\"/meta\",method=\"GET\",code=\"2xx\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("rusync_requests_total{endpoint=\"/files\",method=\"POST\",code=\"5xx\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("rusync_requests_total{endpoint=\"/meta\",method=\"GET\",code=\"4xx\"} 1\n"), std::string::npos);
+    EXPECT_EQ(text.find("method=\"DELETE\""), std::string::npos);
+    EXPECT_NE(text.find("rusync_request_duration_seconds_bucket{endpoint=\"/meta\",method=\"GET\",le=\"+Inf\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("rusync_request_duration_seconds_bucket{endpoint=\"/meta\",method=\"GET\",le=\"0.0025\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("rusync_request_duration_seconds_bucket{endpoint=\"/meta\",method=\"GET\",le=\"0.001\"} 0\n"), std::string::npos);
+    EXPECT_NE(text.find("rusync_received_bytes_total 42\n"), std::string::npos);
+    EXPECT_NE(text.find("rusync_sent_bytes_total{endpoint=\"/meta\"} 100\n"), std::string::npos);
+    EXPECT_NE(text.find("rusync_upload_resume_lookups_total{result=\"hit\"} 1\n"), std::string::npos);
+    EXPECT_NE(text.find("rusync_io_queued_tasks{lane=\"bulk\"} 2\n"), std::string::npos);
+    EXPECT_NE(text.find("rusync_active_paths 6\n"), std::string::npos);
+    EXPECT_NE(text.find("# TYPE rusync_request_duration_seconds histogram\n"), std::string::npos);
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include "PatchSessions.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+class PatchSessionsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir = fs::temp_directory_path() / ("rusync_patch_sessions_" + std::to_string(getpid()));
+        fs::create_directories(dir);
+        file = dir / "file.txt";
+        write(file, "0123456789");
+    }
+    void TearDown() override {
+        fs::remove_all(dir);
+    }
+    static void write(const fs::path& path, const std::string& content) {
+        std::ofstream stream {path, std::ios::binary};
+        stream << content;
+    }
+    static std::string read(const fs::path& path) {
+        std::ifstream stream {path, std::ios::binary};
+        std::stringstream content;
+        content << stream.rdbuf();
+        return content.str();
+    }
+    fs::path dir;
+    fs::path file;
+};
+
+}
+
+TEST_F(PatchSessionsTest, in_place_patch) {
+    rusync::PatchSessions::apply_in_place(file, 2, "ab", 2, false);
+    EXPECT_EQ(read(file), "01ab456789");
+}
+
+TEST_F(PatchSessionsTest, in_place_truncate) {
+    rusync::PatchSessions::apply_in_place(file, 4, "x", 1, true);
+    EXPECT_EQ(read(file), "0123x");
+}
+
+TEST_F(PatchSessionsTest, session_is_invisible_till_end) {
+    rusync::PatchSessions sessions {dir / "staging"};
+    sessions.apply(file, "s1", 0, "ab", 2, false);
+    EXPECT_TRUE(sessions.active(file, "s1"));
+    EXPECT_EQ(read(file), "0123456789");
+    sessions.apply(file, "s1", 8, "cd", 2, false);
+    EXPECT_EQ(read(file), "0123456789");
+    sessions.apply(file, "s1", 10, "", 0, true);
+    EXPECT_FALSE(sessions.active(file, "s1"));
+    EXPECT_EQ(read(file), "ab234567cd");
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+}
+
+TEST_F(PatchSessionsTest, session_end_truncates_and_extends) {
+    rusync::PatchSessions sessions {dir / "staging"};
+    sessions.apply(file, "s1", 3, "x", 1, true);
+    EXPECT_EQ(read(file), "012x");
+    sessions.apply(file, "s2", 4, "yz", 2, true);
+    EXPECT_EQ(read(file), "012xyz");
+}
+
+TEST_F(PatchSessionsTest, abort_discards_patches) {
+    rusync::PatchSessions sessions {dir / "staging"};
+    sessions.apply(file, "s1", 0, "ab", 2, false);
+    sessions.abort(file);
+    EXPECT_FALSE(sessions.active(file, "s1"));
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+    EXPECT_EQ(read(file), "0123456789");
+}
+
+TEST_F(PatchSessionsTest, abort_of_one_session_keeps_others) {
+    rusync::PatchSessions sessions {dir / "staging"};
+    sessions.apply(file, "s1", 0, "ab", 2, false);
+    sessions.apply(file, "s2", 2, "cd", 2, false);
+    sessions.abort(file, "s1");
+    EXPECT_FALSE(sessions.active(file, "s1"));
+    EXPECT_TRUE(sessions.active(file, "s2"));
+    sessions.abort(file, "missing");
+    sessions.apply(file, "s2", 10, "", 0, true);
+    EXPECT_EQ(read(file), "01cd456789");
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+}
+
+TEST_F(PatchSessionsTest, invalid_session_id) {
+    rusync::PatchSessions sessions {dir / "staging"};
+    EXPECT_THROW({
+        sessions.apply(file, "../../etc", 0, "ab", 2, false);
+    }, std::invalid_argument);
+}
+
+TEST_F(PatchSessionsTest, missing_file) {
+    rusync::PatchSessions sessions {dir / "staging"};
+    EXPECT_THROW({
+        sessions.apply(dir / "missing", "s1", 0, "ab", 2, false);
+    }, fs::filesystem_error);
+}
+
+TEST_F(PatchSessionsTest, version_changes_on_commit_only) {
+    rusync::PatchSessions sessions {dir / "staging"};
+    const auto initial = rusync::PatchSessions::version(file);
+    EXPECT_FALSE(initial.empty());
+    sessions.apply(file, "s1", 0, "ab", 2, false);
+    EXPECT_EQ(rusync::PatchSessions::version(file), initial);
+    sessions.apply(file, "s1", 10, "", 0, true);
+    const auto committed = rusync::PatchSessions::version(file);
+    EXPECT_NE(committed, initial);
+    rusync::PatchSessions::apply_in_place(file, 10, "x", 1, true);
+    EXPECT_NE(rusync::PatchSessions::version(file), committed);
+    EXPECT_EQ(rusync::PatchSessions::version(dir / "missing"), "");
+}
+
+TEST_F(PatchSessionsTest, in_place_session_commits_or_rolls_back) {
+    // files which can't be cloned are patched in place whatever their size
+    rusync::PatchSessions sessions {dir / "staging", 0};
+    const auto initial = rusync::PatchSessions::version(file);
+    sessions.apply(file, "s1", 0, "ab", 2, false);
+    sessions.apply(file, "s1", 1, "cd", 2, false);
+    sessions.apply(file, "s1", 12, "xy", 2, false);
+    EXPECT_EQ(sessions.base_version(file, "s1"), initial);
+    sessions.abort(file);
+    EXPECT_EQ(read(file), "0123456789");
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+    sessions.apply(file, "s2", 8, "zz", 2, false);
+    sessions.apply(file, "s2", 3, "x", 1, true);
+    EXPECT_EQ(read(file), "012x");
+    EXPECT_EQ(sessions.base_version(file, "s2"), rusync::PatchSessions::version(file));
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+}
+
+TEST_F(PatchSessionsTest, new_session_rolls_back_in_place_one) {
+    rusync::PatchSessions sessions {dir / "staging", 0};
+    sessions.apply(file, "s1", 4, "abcd", 4, false);
+    sessions.apply(file, "s2", 0, "hello world, longer", 19, true);
+    EXPECT_FALSE(sessions.active(file, "s1"));
+    EXPECT_EQ(read(file), "hello world, longer");
+    // old bytes of s1 are not written over committed content
+    sessions.abort(file);
+    EXPECT_EQ(read(file), "hello world, longer");
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+}
+
+TEST_F(PatchSessionsTest, commit_drops_in_place_session) {
+    // files of 11 bytes and more are patched in place
+    rusync::PatchSessions sessions {dir / "staging", 11};
+    sessions.apply(file, "s1", 0, "ab", 2, false);
+    rusync::PatchSessions::apply_in_place(file, 10, "!!", 2, true);
+    sessions.apply(file, "s2", 0, "xy", 2, false);
+    EXPECT_EQ(read(file), "xy23456789!!");
+    sessions.apply(file, "s1", 10, "", 0, true);
+    EXPECT_FALSE(sessions.active(file, "s2"));
+    EXPECT_EQ(read(file), "ab23456789");
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+}
+
+TEST_F(PatchSessionsTest, nothing_is_expired_right_away) {
+    rusync::PatchSessions sessions {dir / "staging", 0};
+    sessions.apply(file, "s1", 4, "abcd", 4, false);
+    EXPECT_TRUE(sessions.expired().empty());
+    sessions.expire(file);
+    EXPECT_TRUE(sessions.active(file, "s1"));
+}
+
+TEST_F(PatchSessionsTest, in_place_session_is_rolled_back_after_crash) {
+    auto crashed = std::make_unique<rusync::PatchSessions>(dir / "staging", 0);
+    crashed->apply(file, "s1", 2, "abcdefghijkl", 12, false);
+    {
+        rusync::PatchSessions restarted {dir / "staging", 0};
+        EXPECT_EQ(read(file), "0123456789");
+        EXPECT_TRUE(fs::is_empty(dir / "staging"));
+    }
+    crashed.reset();
+    EXPECT_EQ(read(file), "0123456789");
+}
@@ -0,0 +1,327 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "PathSerializer.hpp"
+
+TEST(PathSerializer, stress_same_path_in_order) {
+    constexpr int PATHS = 16;
+    constexpr int WRITES = 500;
+    std::mutex mutex;
+    std::map<std::string, std::vector<int>> applied;
+    std::atomic<int> remaining = PATHS * WRITES;
+    std::atomic<bool> overlapped = false;
+    std::map<std::string, std::atomic<int>> in_flight;
+    for (int p = 0; p < PATHS; p++) {
+        in_flight["file" + std::to_string(p)] = 0;
+    }
+    std::promise<void> done;
+    rusync::IOExecutor executor {8};
+    rusync::PathSerializer serializer {executor};
+    for (int i = 0; i < WRITES; i++) {
+        for (int p = 0; p < PATHS; p++) {
+            const std::string path = "file" + std::to_string(p);
+            const auto lane = i % 3 ? rusync::IOExecutor::FAST : rusync::IOExecutor::BULK;
+            serializer.post(path, lane, [&, path, i]() {
+                if (++in_flight.at(path) > 1) {
+                    overlapped = true;
+                }
+                {
+                    std::lock_guard lock {mutex};
+                    applied[path].push_back(i);
+                }
+                in_flight.at(path)--;
+                if (--remaining == 0) {
+                    done.set_value();
+                }
+            });
+        }
+    }
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(30)), std::future_status::ready);
+    executor.stop();
+    EXPECT_FALSE(overlapped);
+    for (const auto& [path, order]: applied) {
+        ASSERT_EQ(order.size(), WRITES);
+        EXPECT_TRUE(std::is_sorted(order.begin(), order.end())) << path;
+    }
+}
+
+TEST(PathSerializer, different_paths_run_in_parallel) {
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<void> other_done;
+    rusync::IOExecutor executor {4};
+    rusync::PathSerializer serializer {executor};
+    serializer.post("a", rusync::IOExecutor::FAST, [&]() {
+        released.wait();
+    });
+    serializer.post("b", rusync::IOExecutor::FAST, [&]() {
+        other_done.set_value();
+    });
+    EXPECT_EQ(other_done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_GE(serializer.active(), 1);
+    release.set_value();
+    executor.stop();
+}
+
+TEST(PathSerializer, queued_tasks_dont_occupy_threads) {
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<void> other_done;
+    rusync::IOExecutor executor {2};
+    rusync::PathSerializer serializer {executor};
+    // many writes to blocked path shouldn't starve the only remaining thread
+    for (int i = 0; i < 10; i++) {
+        serializer.post("blocked", rusync::IOExecutor::FAST, [&]() {
+            released.wait();
+        });
+    }
+    serializer.post("other", rusync::IOExecutor::FAST, [&]() {
+        other_done.set_value();
+    });
+    EXPECT_EQ(other_done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    release.set_value();
+    executor.stop();
+}
+
+namespace {
+
+/**
+ * @brief records names of finished tasks, done is set once expected number of them finished
+ *
+ */
+struct Recorder {
+    explicit Recorder(int expected) : remaining {expected} {
+
+    }
+    std::function<void()> task(const std::string& name) {
+        return [this, name]() {
+            {
+                std::lock_guard lock {mutex};
+                executed.push_back(name);
+            }
+            if (--remaining == 0) {
+                done.set_value();
+            }
+        };
+    }
+    size_t position(const std::string& name) {
+        std::lock_guard lock {mutex};
+        return std::find(executed.begin(), executed.end(), name) - executed.begin();
+    }
+    bool finished(const std::string& name) {
+        std::lock_guard lock {mutex};
+        return std::find(executed.begin(), executed.end(), name) != executed.end();
+    }
+    std::mutex mutex;
+    std::vector<std::string> executed;
+    std::atomic<int> remaining;
+    std::promise<void> done;
+};
+
+}
+
+TEST(PathSerializer, tree_is_ordered_with_paths_under_it) {
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    rusync::IOExecutor executor {4};
+    rusync::PathSerializer serializer {executor};
+    Recorder recorder {5};
+    serializer.post("dir/a", rusync::IOExecutor::FAST, [&]() {
+        released.wait();
+    });
+    serializer.post_tree("dir", rusync::IOExecutor::FAST, recorder.task("remove dir"));
+    serializer.post("dir/a", rusync::IOExecutor::FAST, recorder.task("write a"));
+    serializer.post("dir/sub/new", rusync::IOExecutor::FAST, recorder.task("write new"));
+    serializer.post("dir", rusync::IOExecutor::FAST, recorder.task("create dir"));
+    // path which only shares prefix with tree is not held by it
+    serializer.post("dir2/b", rusync::IOExecutor::FAST, recorder.task("write dir2"));
+    while (!recorder.finished("write dir2")) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    EXPECT_FALSE(recorder.finished("remove dir"));
+    release.set_value();
+    ASSERT_EQ(recorder.done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    executor.stop();
+    EXPECT_LT(recorder.position("remove dir"), recorder.position("write a"));
+    EXPECT_LT(recorder.position("remove dir"), recorder.position("write new"));
+    EXPECT_LT(recorder.position("remove dir"), recorder.position("create dir"));
+    EXPECT_EQ(serializer.active(), 0);
+}
+
+TEST(PathSerializer, nested_trees_keep_order_of_posting) {
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    rusync::IOExecutor executor {4};
+    rusync::PathSerializer serializer {executor};
+    Recorder recorder {4};
+    serializer.post("a/b/x", rusync::IOExecutor::FAST, [&]() {
+        released.wait();
+    });
+    serializer.post_tree("a/b", rusync::IOExecutor::FAST, recorder.task("remove a/b"));
+    serializer.post("a/b/y", rusync::IOExecutor::FAST, recorder.task("write a/b/y"));
+    serializer.post_tree("a", rusync::IOExecutor::BULK, recorder.task("remove a"));
+    serializer.post("a/c", rusync::IOExecutor::FAST, recorder.task("write a/c"));
+    release.set_value();
+    ASSERT_EQ(recorder.done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    executor.stop();
+    EXPECT_EQ(recorder.executed, (std::vector<std::string>{"remove a/b", "write a/b/y", "remove a", "write a/c"}));
+    EXPECT_EQ(serializer.active(), 0);
+}
+
+TEST(PathSerializer, nested_tree_waits_for_tree_over_it) {
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    rusync::IOExecutor executor {4};
+    rusync::PathSerializer serializer {executor};
+    std::atomic<bool> writing = false;
+    std::atomic<bool> overlapped = false;
+    Recorder recorder {4};
+    serializer.post_tree("a", rusync::IOExecutor::FAST, [&]() {
+        released.wait();
+        recorder.task("remove a")();
+    });
+    serializer.post("a/b/r", rusync::IOExecutor::FAST, [&]() {
+        writing = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        writing = false;
+        recorder.task("write a/b/r")();
+    });
+    serializer.post_tree("a/b", rusync::IOExecutor::FAST, [&]() {
+        overlapped = writing.load();
+        recorder.task("remove a/b")();
+    });
+    serializer.post("a/b/x", rusync::IOExecutor::FAST, recorder.task("write a/b/x"));
+    release.set_value();
+    ASSERT_EQ(recorder.done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    executor.stop();
+    EXPECT_FALSE(overlapped);
+    EXPECT_EQ(recorder.executed, (std::vector<std::string>{"remove a", "write a/b/r", "remove a/b", "write a/b/x"}));
+    EXPECT_EQ(serializer.active(), 0);
+}
+
+TEST(PathSerializer, shared_tasks_run_together_but_not_with_others) {
+    rusync::IOExecutor executor {4};
+    rusync::PathSerializer serializer {executor};
+    std::promise<void> both_started;
+    auto started_together = both_started.get_future().share();
+    std::atomic<int> started = 0;
+    std::atomic<int> running_shared = 0;
+    std::atomic<bool> overlapped = false;
+    Recorder recorder {5};
+    serializer.post("file", rusync::IOExecutor::FAST, recorder.task("write"));
+    for (const std::string name: {"range1", "range2"}) {
+        serializer.post_shared("file", rusync::IOExecutor::BULK, [&, name]() {
+            running_shared++;
+            if (++started == 2) {
+                both_started.set_value();
+            }
+            // each range waits for the other one, so they are done only if they run at once
+            EXPECT_EQ(started_together.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+            running_shared--;
+            recorder.task(name)();
+        });
+    }
+    serializer.post("file", rusync::IOExecutor::FAST, [&]() {
+        overlapped = running_shared > 0;
+        recorder.task("patch")();
+    });
+    serializer.post_shared("file", rusync::IOExecutor::BULK, recorder.task("range3"));
+    ASSERT_EQ(recorder.done.get_future().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    executor.stop();
+    EXPECT_FALSE(overlapped);
+    EXPECT_EQ(recorder.executed.front(), "write");
+    EXPECT_EQ(recorder.position("patch"), 3);
+    EXPECT_EQ(recorder.executed.back(), "range3");
+    EXPECT_EQ(serializer.active(), 0);
+}
+
+TEST(PathSerializer, stress_nested_trees_keep_order_of_posting) {
+    struct Posted {
+        std::string path;
+        bool tree;
+    };
+    const auto conflict = [](const Posted& a, const Posted& b) {
+        const auto covers = [](const std::string& tree, const std::string& path) {
+            return path.starts_with(tree) && (path.size() == tree.size() || path[tree.size()] == '/');
+        };
+        return a.path == b.path || (a.tree && covers(a.path, b.path)) || (b.tree && covers(b.path, a.path));
+    };
+    const std::vector<std::string> paths {"a", "a/b", "a/b/r", "a/b/s", "a/c", "a/c/t", "d"};
+    constexpr int TASKS = 3000;
+    constexpr int ROUND = 10;
+    std::vector<Posted> posted;
+    std::mt19937 random {42};
+    for (int i = 0; i < TASKS; i++) {
+        posted.push_back({paths[random() % paths.size()], random() % 3 == 0});
+    }
+    std::mutex mutex;
+    std::vector<int> started;
+    std::vector<int> running;
+    std::atomic<bool> overlapped = false;
+    std::atomic<int> remaining = TASKS;
+    std::promise<void> done;
+    rusync::IOExecutor executor {8};
+    rusync::PathSerializer serializer {executor};
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    // rounds start with no queues, so trees are posted both over busy and over new paths
+    for (int round = 0; round < TASKS; round += ROUND) {
+        for (int i = round; i < round + ROUND; i++) {
+            auto task = [&, i]() {
+                {
+                    std::lock_guard lock {mutex};
+                    for (int other: running) {
+                        if (conflict(posted[i], posted[other])) {
+                            overlapped = true;
+                        }
+                    }
+                    running.push_back(i);
+                    started.push_back(i);
+                }
+                // slow tree tasks let queues under them grow
+                if (posted[i].tree) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                } else {
+                    std::this_thread::yield();
+                }
+                {
+                    std::lock_guard lock {mutex};
+                    std::erase(running, i);
+                }
+                if (--remaining == 0) {
+                    done.set_value();
+                }
+            };
+            const auto lane = i % 2 ? rusync::IOExecutor::FAST : rusync::IOExecutor::BULK;
+            if (posted[i].tree) {
+                serializer.post_tree(posted[i].path, lane, task);
+            } else {
+                serializer.post(posted[i].path, lane, task);
+            }
+        }
+        while (remaining > TASKS - round - ROUND && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+    ASSERT_EQ(done.get_future().wait_until(deadline), std::future_status::ready);
+    executor.stop();
+    EXPECT_FALSE(overlapped);
+    ASSERT_EQ(started.size(), TASKS);
+    std::vector<size_t> position(TASKS);
+    for (size_t p = 0; p < started.size(); p++) {
+        position[started[p]] = p;
+    }
+    for (int i = 0; i < TASKS; i++) {
+        for (int j = i + 1; j < TASKS; j++) {
+            if (conflict(posted[i], posted[j])) {
+                ASSERT_LT(position[i], position[j]) << i << " " << posted[i].path << " and " << j << " " << posted[j].path;
+            }
+        }
+    }
+    EXPECT_EQ(serializer.active(), 0);
+}
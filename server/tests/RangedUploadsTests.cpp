@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "RangedUploads.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+class RangedUploadsTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        dir = fs::temp_directory_path() / ("rusync_ranged_uploads_" + std::to_string(getpid()));
+        fs::create_directories(dir);
+        file = dir / "sub" / "file.txt";
+    }
+    void TearDown() override {
+        fs::remove_all(dir);
+    }
+    static std::string read(const fs::path& path) {
+        std::ifstream stream {path, std::ios::binary};
+        std::stringstream content;
+        content << stream.rdbuf();
+        return content.str();
+    }
+    fs::path dir;
+    fs::path file;
+};
+
+}
+
+TEST_F(RangedUploadsTest, file_appears_after_last_range) {
+    rusync::RangedUploads uploads {dir / "staging"};
+    EXPECT_FALSE(uploads.write(file, "t1", 10, 6, "6789", 4));
+    EXPECT_FALSE(fs::exists(file));
+    EXPECT_FALSE(uploads.write(file, "t1", 10, 0, "012", 3));
+    EXPECT_FALSE(fs::exists(file));
+    EXPECT_TRUE(uploads.write(file, "t1", 10, 3, "345", 3));
+    EXPECT_EQ(read(file), "0123456789");
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+}
+
+TEST_F(RangedUploadsTest, repeated_range_is_not_counted_twice) {
+    rusync::RangedUploads uploads {dir / "staging"};
+    EXPECT_FALSE(uploads.write(file, "t1", 6, 0, "012", 3));
+    EXPECT_FALSE(uploads.write(file, "t1", 6, 0, "012", 3));
+    EXPECT_FALSE(fs::exists(file));
+    EXPECT_TRUE(uploads.write(file, "t1", 6, 3, "345", 3));
+    EXPECT_EQ(read(file), "012345");
+}
+
+TEST_F(RangedUploadsTest, abort_drops_staging_file) {
+    rusync::RangedUploads uploads {dir / "staging"};
+    EXPECT_FALSE(uploads.write(file, "t1", 6, 0, "012", 3));
+    uploads.abort(file);
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+    // new range starts new upload
+    EXPECT_FALSE(uploads.write(file, "t1", 6, 3, "345", 3));
+    EXPECT_FALSE(fs::exists(file));
+}
+
+TEST_F(RangedUploadsTest, invalid_ranges) {
+    rusync::RangedUploads uploads {dir / "staging"};
+    EXPECT_THROW(uploads.write(file, "../t", 6, 0, "012", 3), std::invalid_argument);
+    EXPECT_THROW(uploads.write(file, "t1", 6, 4, "012", 3), std::out_of_range);
+}
+
+TEST_F(RangedUploadsTest, parallel_ranges) {
+    rusync::RangedUploads uploads {dir / "staging"};
+    constexpr size_t PARTS = 16;
+    constexpr size_t PART_SIZE = 4096;
+    std::vector<std::thread> threads;
+    std::atomic<int> completed = 0;
+    for (size_t i = 0; i < PARTS; i++) {
+        threads.emplace_back([&, i]() {
+            const std::string data(PART_SIZE, static_cast<char>('a' + i));
+            if (uploads.write(file, "t1", PARTS * PART_SIZE, i * PART_SIZE, data.data(), data.size())) {
+                completed++;
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    EXPECT_EQ(completed, 1);
+    const auto content = read(file);
+    ASSERT_EQ(content.size(), PARTS * PART_SIZE);
+    for (size_t i = 0; i < PARTS; i++) {
+        EXPECT_EQ(content[i * PART_SIZE], static_cast<char>('a' + i));
+        EXPECT_EQ(content[(i + 1) * PART_SIZE - 1], static_cast<char>('a' + i));
+    }
+}
+
+TEST_F(RangedUploadsTest, resumes_after_restart) {
+    {
+        rusync::RangedUploads uploads {dir / "staging"};
+        EXPECT_FALSE(uploads.write(file, "t1", 6, 0, "012", 3));
+        EXPECT_TRUE(uploads.received(file, "t1", 7).empty());
+    }
+    rusync::RangedUploads uploads {dir / "staging"};
+    EXPECT_EQ(uploads.received(file, "t1", 6), (std::vector<rusync::RangeSet::Range>{{0, 3}}));
+    EXPECT_TRUE(uploads.received(file, "t2", 6).empty());
+    EXPECT_TRUE(uploads.write(file, "t1", 6, 3, "345", 3));
+    EXPECT_EQ(read(file), "012345");
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+}
+
+TEST_F(RangedUploadsTest, leftovers_are_removed) {
+    fs::create_directories(dir / "staging");
+    std::ofstream {dir / "staging" / "garbage"} << "x";
+    std::ofstream {dir / "staging" / "1_t1.journal"} << "broken";
+    rusync::RangedUploads uploads {dir / "staging"};
+    EXPECT_TRUE(fs::is_empty(dir / "staging"));
+}